@@ -0,0 +1,195 @@
+// In-process API vs rotctld over loopback.
+//
+// One bridge with a simulated CamPTZ head and a rotctld source. The same
+// position polls (`p`) and position sets (`P`) are made through the C API of
+// librbridge and by a rotctld client over TCP loopback, one at a time, and
+// the latency and CPU per request (the whole process: caller and bridge) are
+// reported for each.
+//
+//   embed_bench --requests=20000 --port=45900
+
+#include "popl.hpp"
+#include "api/rbridge.h"
+#include "RotatorCommon.hpp"
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+
+struct Sample {
+  double p50 = 0, p99 = 0, cpu = 0;  // (us)
+};
+
+static double processCpu()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// f() makes one request; false stops the run
+template<typename F>
+static Sample measure(int requests, F f)
+{
+  std::vector<double> latencies;
+  latencies.reserve(requests);
+  double cpuStart = processCpu();
+  for (int i = 0; i < requests; i++) {
+    auto start = std::chrono::steady_clock::now();
+    if (!f(i)) {
+      fprintf(stderr, "embed_bench: request %d failed\n", i);
+      break;
+    }
+    latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+  }
+  Sample sample;
+  if (latencies.empty()) {
+    return sample;
+  }
+  sample.cpu = (processCpu() - cpuStart) * 1e6 / latencies.size();
+  std::sort(latencies.begin(), latencies.end());
+  sample.p50 = latencies[latencies.size() / 2];
+  sample.p99 = latencies[(size_t)(latencies.size() * 0.99)];
+  return sample;
+}
+
+class RotctldClient {
+  int sock = -1;
+  std::string buffered;
+
+public:
+  bool Connect(int port) {
+    sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int attempt = 0; attempt < 50; attempt++) {
+      if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return false;
+  }
+
+  ~RotctldClient() {
+    if (sock >= 0) {
+      CLOSE_SOCKET(sock);
+    }
+  }
+
+  // sends command and reads lines reply lines; false on an RPRT error
+  bool Exchange(const std::string &command, int lines) {
+    if (send_fixed(sock, command.data(), command.size(), 0) < 0) {
+      return false;
+    }
+    std::string last;
+    for (int i = 0; i < lines; i++) {
+      size_t end;
+      while ((end = buffered.find('\n')) == std::string::npos) {
+        char buf[256];
+        int ret = recv(sock, buf, sizeof(buf), 0);
+        if (ret <= 0) {
+          return false;
+        }
+        buffered.append(buf, ret);
+      }
+      last = buffered.substr(0, end);
+      buffered.erase(0, end + 1);
+    }
+    return last.compare(0, 5, "RPRT ") != 0 || last == "RPRT 0";
+  }
+};
+
+int main(int argc, char *argv[])
+{
+  popl::OptionParser op("Allowed options");
+  auto helpOption = op.add<popl::Switch>("h", "help", "produce help message");
+  auto requests = op.add<popl::Implicit<int>>("", "requests", "Requests per measurement", 20000);
+  auto port = op.add<popl::Implicit<int>>("", "port", "Loopback port of the rotctld source", 45900);
+  op.parse(argc, argv);
+
+  if (helpOption->is_set()) {
+    std::cout << op << "\n";
+    return 0;
+  }
+
+  if (rbridge_api_version() != RBRIDGE_API_VERSION) {
+    fprintf(stderr, "embed_bench: built against API %d, linked %d\n", RBRIDGE_API_VERSION, rbridge_api_version());
+    return 1;
+  }
+
+  // the bridge logs every request to stdout
+  fflush(stdout);
+  int savedStdout = dup(STDOUT_FILENO);
+  int devNull = open("/dev/null", O_WRONLY);
+  dup2(devNull, STDOUT_FILENO);
+
+  rbridge *bridge = rbridge_create();
+  std::string source = "source rotctld host=127.0.0.1 port=" + std::to_string(port->value());
+  if (rbridge_config_line(bridge, "sink camptz transport=sim smart-sink=0 keepalive=0 presets=0") != RBRIDGE_OK ||
+      rbridge_config_line(bridge, source.c_str()) != RBRIDGE_OK || rbridge_start(bridge) != RBRIDGE_OK) {
+    dup2(savedStdout, STDOUT_FILENO);
+    fprintf(stderr, "embed_bench: bridge did not start\n");
+    return 1;
+  }
+
+  int count = requests->value();
+  // a small circle, so the head is always near its target
+  auto target = [](int i, double &azi, double &ele) {
+    azi = 180 + (i % 20) * 0.1;
+    ele = 45 + (i % 10) * 0.1;
+  };
+
+  Sample apiPoll = measure(count, [bridge](int) {
+    double azi, ele;
+    return rbridge_get_position(bridge, &azi, &ele) == RBRIDGE_OK;
+  });
+  Sample apiSet = measure(count, [bridge, &target](int i) {
+    double azi, ele;
+    target(i, azi, ele);
+    return rbridge_set_position(bridge, azi, ele) == RBRIDGE_OK;
+  });
+
+  Sample tcpPoll, tcpSet;
+  RotctldClient client;
+  bool connected = client.Connect(port->value());
+  if (connected) {
+    tcpPoll = measure(count, [&client](int) { return client.Exchange("p\n", 2); });
+    tcpSet = measure(count, [&client, &target](int i) {
+      double azi, ele;
+      target(i, azi, ele);
+      char command[64];
+      snprintf(command, sizeof(command), "P %.2f %.2f\n", azi, ele);
+      return client.Exchange(command, 1);
+    });
+  }
+
+  rbridge_stop(bridge);
+  rbridge_destroy(bridge);
+  fflush(stdout);
+  dup2(savedStdout, STDOUT_FILENO);
+  close(devNull);
+  close(savedStdout);
+
+  if (!connected) {
+    fprintf(stderr, "embed_bench: cannot connect to the rotctld source\n");
+    return 1;
+  }
+
+  printf("\n%d requests each, simulated head\n", count);
+  printf("%-18s %9s %9s %12s\n", "path", "p50(us)", "p99(us)", "cpu/req(us)");
+  struct Row {
+    const char *name;
+    Sample sample;
+  };
+  for (auto &row : {Row{"api poll", apiPoll}, Row{"rotctld tcp poll", tcpPoll}, Row{"api set", apiSet},
+                    Row{"rotctld tcp set", tcpSet}}) {
+    printf("%-18s %9.1f %9.1f %12.1f\n", row.name, row.sample.p50, row.sample.p99, row.sample.cpu);
+  }
+  return 0;
+}
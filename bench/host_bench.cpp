@@ -0,0 +1,373 @@
+// Multi-pipeline host benchmark.
+//
+// Runs N rotators (rotctld source -> CamPTZ sink on the simulated head) as
+// - processes: one RBridge process per rotator (--pipeline), as deployed
+//   so far
+// - host: one RBridge process hosting all of them (--pipelines), sharded
+//   across the cores
+// with one client per rotator polling the position at --rate and moving the
+// head every fifth request, and reports memory (RSS, and PSS, which splits
+// the pages shared between processes), threads and CPU of the bridge
+// process(es), per rotator, with the client round trip latency.
+//
+// --stalled points the first rotator at a device that accepts the link and
+// never answers; its requests time out and its client is left out of the
+// latencies, which show whether the others are held up by it.
+//
+//   host_bench --bridge=./RBridge --pipelines=20 --seconds=10 --rate=10
+
+#include "popl.hpp"
+#include "RotatorCommon.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <signal.h>
+#include <spawn.h>
+#include <sstream>
+#include <sys/wait.h>
+
+extern char **environ;
+
+struct Usage {
+  int processes = 0;
+  int threads = 0;
+  double rss = 0;  // (MB)
+  double pss = 0;  // (MB)
+  double cpu = 0;  // (s)
+};
+
+struct RunResult {
+  bool ok = false;
+  Usage usage;
+  double seconds = 0;
+  uint64_t requests = 0;
+  double p50 = 0, p99 = 0;  // (us)
+};
+
+static double statusField(pid_t pid, const char *file, const std::string &key)
+{
+  std::ifstream in("/proc/" + std::to_string(pid) + "/" + file);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, key.size(), key) == 0) {
+      return strtod(line.c_str() + key.size(), nullptr);
+    }
+  }
+  return 0;
+}
+
+static double cpuOf(pid_t pid)
+{
+  std::ifstream in("/proc/" + std::to_string(pid) + "/stat");
+  std::string stat;
+  std::getline(in, stat);
+  auto close = stat.rfind(')');
+  if (close == std::string::npos) {
+    return 0;
+  }
+  std::istringstream fields(stat.substr(close + 2));
+  std::string field;
+  double ticks = 0;
+  for (int i = 0; i < 13 && fields >> field; i++) {
+    if (i == 11 || i == 12) {
+      ticks += strtod(field.c_str(), nullptr);
+    }
+  }
+  return ticks / sysconf(_SC_CLK_TCK);
+}
+
+static Usage usageOf(const std::vector<pid_t> &pids)
+{
+  Usage usage;
+  for (pid_t pid : pids) {
+    usage.processes++;
+    usage.threads += (int)statusField(pid, "status", "Threads:");
+    usage.rss += statusField(pid, "status", "VmRSS:") / 1024;
+    usage.pss += statusField(pid, "smaps_rollup", "Pss:") / 1024;
+    usage.cpu += cpuOf(pid);
+  }
+  return usage;
+}
+
+static pid_t spawnBridge(const std::string &bridge, const std::vector<std::string> &args)
+{
+  std::vector<char *> argv;
+  argv.push_back(const_cast<char *>(bridge.c_str()));
+  for (auto &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+  pid_t pid = -1;
+  if (posix_spawn(&pid, bridge.c_str(), &actions, nullptr, argv.data(), environ) != 0) {
+    pid = -1;
+  }
+  posix_spawn_file_actions_destroy(&actions);
+  return pid;
+}
+
+static int connectTo(int port)
+{
+  for (int attempt = 0; attempt < 200; attempt++) {
+    int sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      return sock;
+    }
+    CLOSE_SOCKET(sock);
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  }
+  return -1;
+}
+
+// a head that takes the link and never answers
+static void stalledDevice(int listenSock, std::atomic<bool> *closing)
+{
+  std::vector<int> links;
+  while (!*closing) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(listenSock, &fds);
+    struct timeval tv = {0, 100000};
+    if (select(listenSock + 1, &fds, nullptr, nullptr, &tv) > 0) {
+      links.push_back(accept(listenSock, nullptr, nullptr));
+    }
+  }
+  for (int fd : links) {
+    CLOSE_SOCKET(fd);
+  }
+}
+
+// one line per reply of P, one or two (position, or RPRT on failure) of p
+static bool readReply(int sock, std::string &buffered, bool position)
+{
+  int lines = 0;
+  while (true) {
+    auto eol = buffered.find('\n');
+    if (eol != std::string::npos) {
+      bool failed = buffered.compare(0, 4, "RPRT") == 0;
+      buffered.erase(0, eol + 1);
+      lines++;
+      if (!position || failed || lines == 2) {
+        return true;
+      }
+      continue;
+    }
+    char buf[256];
+    int ret = recv(sock, buf, sizeof(buf), 0);
+    if (ret <= 0) {
+      return false;
+    }
+    buffered.append(buf, ret);
+  }
+}
+
+static void client(int port, double rate, std::atomic<bool> *closing, std::vector<double> *latencies, int *ok)
+{
+  int sock = connectTo(port);
+  if (sock < 0) {
+    *ok = 0;
+    return;
+  }
+  std::string buffered;
+  auto interval = std::chrono::duration<double>(1.0 / rate);
+  auto next = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; !*closing; i++) {
+    bool position = i % 5 != 0;
+    char line[64];
+    if (position) {
+      snprintf(line, sizeof(line), "p\n");
+    } else {
+      snprintf(line, sizeof(line), "P %d %d\n", (int)(i / 5 % 2) * 20 + 100, 30);
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (send_fixed(sock, line, strlen(line), 0) < 0 || !readReply(sock, buffered, position)) {
+      *ok = 0;
+      break;
+    }
+    latencies->push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e6);
+    next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
+    std::this_thread::sleep_until(next);
+  }
+  CLOSE_SOCKET(sock);
+}
+
+static std::string pipelineLines(int port, int devicePort)
+{
+  std::string lines = "source rotctld port=" + std::to_string(port) + "\n";
+  if (devicePort > 0) {
+    lines += "sink camptz host=127.0.0.1 port=" + std::to_string(devicePort) + " keepalive=0\n";
+  } else {
+    lines += "sink camptz transport=sim keepalive=0\n";
+  }
+  return lines;
+}
+
+static bool writeFile(const std::string &path, const std::string &text)
+{
+  std::ofstream out(path);
+  out << text;
+  return out.good();
+}
+
+static RunResult run(bool hosted, const std::string &bridge, const std::string &dir, const std::string &backend,
+                     int pipelines, int port, int devicePort, int seconds, double rate)
+{
+  RunResult result;
+  std::vector<pid_t> pids;
+  if (hosted) {
+    std::string config;
+    for (int i = 0; i < pipelines; i++) {
+      config += "pipeline r" + std::to_string(i) + "\n" + pipelineLines(port + i, i == 0 ? devicePort : 0);
+    }
+    std::string path = dir + "/host.conf";
+    if (!writeFile(path, config)) {
+      return result;
+    }
+    pids.push_back(spawnBridge(bridge, {"--pipelines=" + path, "--io-backend=" + backend}));
+  } else {
+    for (int i = 0; i < pipelines; i++) {
+      std::string path = dir + "/r" + std::to_string(i) + ".conf";
+      if (!writeFile(path, pipelineLines(port + i, i == 0 ? devicePort : 0))) {
+        return result;
+      }
+      pids.push_back(spawnBridge(bridge, {"--pipeline=" + path, "--io-backend=" + backend}));
+    }
+  }
+  if (std::find(pids.begin(), pids.end(), -1) != pids.end()) {
+    fprintf(stderr, "host_bench: cannot start %s\n", bridge.c_str());
+    return result;
+  }
+
+  // connected and warmed up before counting
+  std::atomic<bool> closing{false};
+  std::vector<std::vector<double>> latencies(pipelines);
+  std::vector<int> ok(pipelines, 1);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < pipelines; i++) {
+    clients.push_back(std::thread(client, port + i, rate, &closing, &latencies[i], &ok[i]));
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  Usage before = usageOf(pids);
+  std::vector<size_t> warm(pipelines);
+  for (int i = 0; i < pipelines; i++) {
+    warm[i] = latencies[i].size();
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  Usage after = usageOf(pids);
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  closing = true;
+
+  for (auto &thread : clients) {
+    thread.join();
+  }
+  for (pid_t pid : pids) {
+    kill(pid, SIGTERM);
+  }
+  for (pid_t pid : pids) {
+    waitpid(pid, nullptr, 0);
+  }
+
+  std::vector<double> all;
+  result.ok = true;
+  for (int i = 0; i < pipelines; i++) {
+    // the stalled one is only there to stall
+    if (i == 0 && devicePort > 0) {
+      continue;
+    }
+    result.ok &= ok[i] != 0;
+    all.insert(all.end(), latencies[i].begin() + (std::min)(warm[i], latencies[i].size()), latencies[i].end());
+  }
+  std::sort(all.begin(), all.end());
+  result.usage = after;
+  result.usage.cpu = after.cpu - before.cpu;
+  result.requests = all.size();
+  if (!all.empty()) {
+    result.p50 = all[all.size() / 2];
+    result.p99 = all[(size_t)(all.size() * 0.99)];
+  }
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  popl::OptionParser op("Allowed options");
+  auto helpOption = op.add<popl::Switch>("h", "help", "produce help message");
+  auto bridge = op.add<popl::Implicit<std::string>>("", "bridge", "RBridge binary to run", "./RBridge");
+  auto pipelines = op.add<popl::Implicit<int>>("", "pipelines", "Rotators", 20);
+  auto seconds = op.add<popl::Implicit<int>>("", "seconds", "Measured time per run (s)", 10);
+  auto rate = op.add<popl::Implicit<double>>("", "rate", "Requests per second per rotator", 10.0);
+  auto port = op.add<popl::Implicit<int>>("", "port", "First loopback port to use", 46000);
+  auto backend = op.add<popl::Implicit<std::string>>("", "io-backend", "I/O backend of the bridges", "epoll");
+  auto stalled = op.add<popl::Switch>("", "stalled", "First rotator's device never answers");
+  op.parse(argc, argv);
+
+  if (helpOption->is_set()) {
+    std::cout << op << "\n";
+    return 0;
+  }
+
+  char dirTemplate[] = "/tmp/host_bench.XXXXXX";
+  if (mkdtemp(dirTemplate) == nullptr) {
+    perror("host_bench: mkdtemp");
+    return 1;
+  }
+  std::string dir = dirTemplate;
+
+  int devicePort = 0, deviceSock = -1;
+  std::atomic<bool> deviceClosing{false};
+  std::thread device;
+  if (stalled->is_set()) {
+    devicePort = port->value() + 2 * pipelines->value();
+    deviceSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int reuse = 1;
+    setsockopt(deviceSock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(devicePort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(deviceSock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(deviceSock, 8) < 0) {
+      fprintf(stderr, "host_bench: cannot listen on %d\n", devicePort);
+      return 1;
+    }
+    device = std::thread(stalledDevice, deviceSock, &deviceClosing);
+  }
+
+  int n = pipelines->value();
+  RunResult processes = run(false, bridge->value(), dir, backend->value(), n, port->value(), devicePort,
+                            seconds->value(), rate->value());
+  RunResult hosted = run(true, bridge->value(), dir, backend->value(), n, port->value() + n, devicePort,
+                         seconds->value(), rate->value());
+
+  if (device.joinable()) {
+    deviceClosing = true;
+    device.join();
+    CLOSE_SOCKET(deviceSock);
+  }
+
+  printf("\n%d rotators, %.0f req/s each%s\n", n, rate->value(), stalled->is_set() ? ", first one stalled" : "");
+  printf("%-10s %6s %8s %9s %9s %10s %10s %14s %9s %9s\n", "model", "procs", "threads", "rss(MB)", "pss(MB)",
+         "rss/rot", "pss/rot", "cpu/rot(ms/s)", "p50(us)", "p99(us)");
+  for (auto row : {std::make_pair("processes", &processes), std::make_pair("host", &hosted)}) {
+    const RunResult &r = *row.second;
+    if (!r.ok) {
+      printf("%-10s %6s\n", row.first, "failed");
+      continue;
+    }
+    printf("%-10s %6d %8d %9.1f %9.1f %10.2f %10.2f %14.2f %9.0f %9.0f\n", row.first, r.usage.processes,
+           r.usage.threads, r.usage.rss, r.usage.pss, r.usage.rss / n, r.usage.pss / n,
+           r.usage.cpu * 1e3 / r.seconds / n, r.p50, r.p99);
+  }
+  return 0;
+}
@@ -0,0 +1,319 @@
+// Socket I/O backend benchmark.
+//
+// Two request paths, each under every available backend:
+// - device: CamPTZ-style query-reply pairs (7-byte Pelco-D frames) through
+//   TcpTransport::Transact against an in-process device; blocking
+//   send_fixed / recv_fixed vs the linked io_uring send -> recv
+// - source: `p` polls from one rotctld client, answered by a stub pipeline;
+//   thread per client (select / recv / send) vs the epoll and io_uring
+//   reactors
+// and reports system calls per request and CPU per 1k requests of the
+// bridge side (the client and the fake device are not counted).
+//
+// System calls are counted by interposing the libc socket / ring entry
+// points, so only calls made by the bridge's own code are seen; the futex
+// wakeups of thread hand-offs are not, which is why voluntary context
+// switches per request are listed too.
+//
+//   io_bench --requests=20000 --port=45500
+
+#include "popl.hpp"
+#include "rotators/rotctld.hpp"
+#include "transport/IoBackend.hpp"
+#include "transport/TcpTransport.hpp"
+#include <cstdarg>
+#include <dlfcn.h>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+
+static std::atomic<uint64_t> syscallCount{0};
+// the client and the fake device do not count
+static thread_local bool uncounted = false;
+
+static void countSyscall()
+{
+  if (!uncounted) {
+    syscallCount++;
+  }
+}
+
+template<typename F>
+static F realFunction(const char *name)
+{
+  return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+extern "C" {
+
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+  static auto real = realFunction<ssize_t (*)(int, const void *, size_t, int)>("send");
+  countSyscall();
+  return real(fd, buf, len, flags);
+}
+
+ssize_t recv(int fd, void *buf, size_t len, int flags)
+{
+  static auto real = realFunction<ssize_t (*)(int, void *, size_t, int)>("recv");
+  countSyscall();
+  return real(fd, buf, len, flags);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+  static auto real = realFunction<int (*)(int, fd_set *, fd_set *, fd_set *, struct timeval *)>("select");
+  countSyscall();
+  return real(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+  static auto real = realFunction<int (*)(int, struct epoll_event *, int, int)>("epoll_wait");
+  countSyscall();
+  return real(epfd, events, maxevents, timeout);
+}
+
+long syscall(long number, ...)
+{
+  static auto real = realFunction<long (*)(long, ...)>("syscall");
+  va_list args;
+  va_start(args, number);
+  long a[6];
+  for (int i = 0; i < 6; i++) {
+    a[i] = va_arg(args, long);
+  }
+  va_end(args);
+  countSyscall();
+  return real(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+}
+
+struct RunResult {
+  bool ok = false;
+  double syscallsPerRequest = 0;
+  double cpuPer1k = 0;       // (ms)
+  double switchesPerRequest = 0;
+  double wallPerRequest = 0; // (us)
+};
+
+struct Usage {
+  double cpu;  // (s)
+  long switches;
+};
+
+static Usage usageOf(int who)
+{
+  struct rusage usage;
+  getrusage(who, &usage);
+  return Usage{
+    usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6,
+    usage.ru_nvcsw
+  };
+}
+
+static int listenOn(int port)
+{
+  int sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  int reuse = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 1) < 0) {
+    CLOSE_SOCKET(sock);
+    return -1;
+  }
+  return sock;
+}
+
+static int connectTo(int port)
+{
+  int sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; attempt++) {
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      return sock;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  CLOSE_SOCKET(sock);
+  return -1;
+}
+
+// a head answering every 7-byte frame with a 7-byte reply
+static void fakeDevice(int listenSock)
+{
+  uncounted = true;
+  int sock = accept(listenSock, nullptr, nullptr);
+  char frame[7];
+  while (true) {
+    if (recv_fixed(sock, frame, sizeof(frame), 0) < 0) {
+      break;
+    }
+    char reply[7] = {'\xFF', '\x01', '\x00', '\x59', '\x30', '\x39', '\x00'};
+    if (send_fixed(sock, reply, sizeof(reply), 0) < 0) {
+      break;
+    }
+  }
+  CLOSE_SOCKET(sock);
+}
+
+static RunResult runDevice(IoBackend backend, int port, int requests)
+{
+  RunResult result;
+  int listenSock = listenOn(port);
+  if (listenSock < 0) {
+    fprintf(stderr, "io_bench: cannot listen on %d\n", port);
+    return result;
+  }
+  std::thread device(fakeDevice, listenSock);
+
+  SetIoBackend(backend);
+  TcpTransport transport("127.0.0.1", port);
+  if (transport.Open()) {
+    const char query[7] = {'\xFF', '\x01', '\x00', '\x51', '\x00', '\x00', '\x52'};
+    char reply[7];
+    syscallCount = 0;
+    Usage before = usageOf(RUSAGE_THREAD);
+    auto start = std::chrono::steady_clock::now();
+    result.ok = true;
+    for (int i = 0; i < requests && result.ok; i++) {
+      result.ok = transport.Transact(query, sizeof(query), reply, sizeof(reply)) == sizeof(reply);
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Usage after = usageOf(RUSAGE_THREAD);
+
+    result.syscallsPerRequest = (double)syscallCount / requests;
+    result.cpuPer1k = (after.cpu - before.cpu) * 1e3 * 1000 / requests;
+    result.switchesPerRequest = (double)(after.switches - before.switches) / requests;
+    result.wallPerRequest = wall * 1e6 / requests;
+    transport.Close();
+  }
+
+  device.join();
+  CLOSE_SOCKET(listenSock);
+  return result;
+}
+
+static RunResult runSource(IoBackend backend, int port, int requests)
+{
+  RunResult result;
+  SetIoBackend(backend);
+
+  rotctld source;
+  source.Initialize("127.0.0.1", port, false);
+  source.SetRequestHandler([](RotatorRequest, RotatorCallback callback) {
+    RotatorResponse resp;
+    resp.success = true;
+    resp.payload.aziResp.azi = 123.45;
+    callback(resp);
+    return true;
+  });
+  source.Start();
+
+  uncounted = true;
+  int sock = connectTo(port);
+  if (sock >= 0) {
+    std::string buffered;
+    char buf[256];
+    syscallCount = 0;
+    Usage processBefore = usageOf(RUSAGE_SELF);
+    Usage clientBefore = usageOf(RUSAGE_THREAD);
+    auto start = std::chrono::steady_clock::now();
+    result.ok = true;
+    for (int i = 0; i < requests && result.ok; i++) {
+      result.ok = send_fixed(sock, "p\n", 2, 0) == 2;
+      // two lines per reply
+      int lines = 0;
+      while (result.ok && lines < 2) {
+        int ret = recv(sock, buf, sizeof(buf), 0);
+        if (ret <= 0) {
+          result.ok = false;
+          break;
+        }
+        for (int j = 0; j < ret; j++) {
+          lines += buf[j] == '\n';
+        }
+      }
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Usage clientAfter = usageOf(RUSAGE_THREAD);
+    Usage processAfter = usageOf(RUSAGE_SELF);
+
+    double cpu = (processAfter.cpu - processBefore.cpu) - (clientAfter.cpu - clientBefore.cpu);
+    long switches = (processAfter.switches - processBefore.switches) - (clientAfter.switches - clientBefore.switches);
+    result.syscallsPerRequest = (double)syscallCount / requests;
+    result.cpuPer1k = cpu * 1e3 * 1000 / requests;
+    result.switchesPerRequest = (double)switches / requests;
+    result.wallPerRequest = wall * 1e6 / requests;
+    CLOSE_SOCKET(sock);
+  }
+  uncounted = false;
+
+  source.Terminate();
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  popl::OptionParser op("Allowed options");
+  auto helpOption = op.add<popl::Switch>("h", "help", "produce help message");
+  auto requests = op.add<popl::Implicit<int>>("", "requests", "Requests per run", 20000);
+  auto port = op.add<popl::Implicit<int>>("", "port", "First loopback port to use", 45500);
+  op.parse(argc, argv);
+
+  if (helpOption->is_set()) {
+    std::cout << op << "\n";
+    return 0;
+  }
+
+  struct Case {
+    const char *path;
+    IoBackend backend;
+    RunResult (*run)(IoBackend, int, int);
+  };
+  const Case cases[] = {
+    {"device", IO_BLOCKING, runDevice},
+    {"device", IO_URING, runDevice},
+    {"source", IO_BLOCKING, runSource},
+    {"source", IO_EPOLL, runSource},
+    {"source", IO_URING, runSource},
+  };
+
+  struct Row {
+    const Case *test;
+    IoBackend backend;
+    RunResult result;
+  };
+  std::vector<Row> rows;
+  int nextPort = port->value();
+  for (const auto &test : cases) {
+    IoBackend effective = SetIoBackend(test.backend);
+    if (effective != test.backend) {
+      continue;
+    }
+    rows.push_back(Row{&test, effective, test.run(test.backend, nextPort++, requests->value())});
+  }
+
+  printf("\n%-8s %-9s %14s %12s %12s %12s\n", "path", "backend", "syscalls/req", "cpu/1k(ms)", "ctxsw/req",
+         "latency(us)");
+  for (auto &row : rows) {
+    if (!row.result.ok) {
+      printf("%-8s %-9s %14s\n", row.test->path, IoBackendName(row.backend), "failed");
+      continue;
+    }
+    printf("%-8s %-9s %14.2f %12.1f %12.2f %12.1f\n", row.test->path, IoBackendName(row.backend),
+           row.result.syscallsPerRequest, row.result.cpuPer1k, row.result.switchesPerRequest,
+           row.result.wallPerRequest);
+  }
+  return 0;
+}
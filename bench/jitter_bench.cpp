@@ -0,0 +1,308 @@
+// Command timing jitter benchmark.
+//
+// A driver thread submits azimuth changes at scheduled times (--rate) into a
+// pipeline whose CamPTZ sink talks to an in-process device over loopback.
+// The moment each command's Pelco-D frame is handed to send() on the device
+// socket is taken by interposing send(). Reported, per mode, is the lateness
+// of the send against the scheduled time:
+// - wake: the driver waking up for it
+// - path: the submitted request through the dispatcher and the CamPTZ
+//   worker to send()
+// - total: both, which is what the head sees
+// under synthetic load: --cpu-load threads spinning and --io-load threads
+// writing and fsyncing a temporary file, all at normal priority.
+//
+// The real-time run puts the dispatcher and the CamPTZ worker in real-time
+// mode (SCHED_FIFO --priority, --cpu, memory locked). The driver stands in
+// for an upstream that is on time, so it runs with the same settings.
+// Memory stays locked after that run, so it goes last.
+//
+//   jitter_bench --seconds=10 --rate=50 --cpu-load=2 --io-load=1 --priority=80
+
+#include "popl.hpp"
+#include "pipeline/Pipeline.hpp"
+#include "rotators/CamPTZ.hpp"
+#include "transport/IoBackend.hpp"
+#include <algorithm>
+#include <cmath>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <iostream>
+
+static std::atomic<bool> recording{false};
+static std::vector<int64_t> sendTimes;  // (ns) of the k-th pan position frame
+static std::atomic<size_t> sendCount{0};
+
+static int64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+extern "C" {
+
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+  static auto real = reinterpret_cast<ssize_t (*)(int, const void *, size_t, int)>(dlsym(RTLD_NEXT, "send"));
+  if (recording) {
+    // coalesced writes carry several 7-byte frames
+    int64_t now = nowNs();
+    const unsigned char *frames = (const unsigned char *)buf;
+    for (size_t off = 0; off + 7 <= len; off += 7) {
+      if (frames[off] == 0xFF && frames[off + 3] == 0x4B) {
+        size_t k = sendCount++;
+        if (k < sendTimes.size()) {
+          sendTimes[k] = now;
+        }
+      }
+    }
+  }
+  return real(fd, buf, len, flags);
+}
+
+}
+
+struct Lateness {
+  double p50 = 0, p99 = 0, p999 = 0, max = 0, stddev = 0;  // (us)
+};
+
+struct RunResult {
+  bool ok = false;
+  size_t commands = 0;
+  Lateness wake, path, total;
+};
+
+static Lateness summarize(std::vector<double> values)
+{
+  Lateness result;
+  if (values.empty()) {
+    return result;
+  }
+  std::sort(values.begin(), values.end());
+  double mean = 0;
+  for (double v : values) {
+    mean += v;
+  }
+  mean /= values.size();
+  double var = 0;
+  for (double v : values) {
+    var += (v - mean) * (v - mean);
+  }
+  result.p50 = values[values.size() / 2];
+  result.p99 = values[(size_t)(values.size() * 0.99)];
+  result.p999 = values[(size_t)(values.size() * 0.999)];
+  result.max = values.back();
+  result.stddev = std::sqrt(var / values.size());
+  return result;
+}
+
+// a head that answers position queries and takes everything else silently
+static void device(int listenSock)
+{
+  int sock = accept(listenSock, nullptr, nullptr);
+  unsigned char frame[7];
+  while (recv_fixed(sock, (char *)frame, sizeof(frame), 0) >= 0) {
+    if (frame[3] == 0x51 || frame[3] == 0x53) {
+      char reply[7] = {'\xFF', '\x01', '\x00', (char)(frame[3] + 8), '\x00', '\x00', '\x00'};
+      if (send_fixed(sock, reply, sizeof(reply), 0) < 0) {
+        break;
+      }
+    }
+  }
+  CLOSE_SOCKET(sock);
+}
+
+static int listenOn(int port)
+{
+  int sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  int reuse = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 1) < 0) {
+    CLOSE_SOCKET(sock);
+    return -1;
+  }
+  return sock;
+}
+
+static void cpuLoad(std::atomic<bool> *closing)
+{
+  volatile uint64_t spin = 0;
+  while (!*closing) {
+    spin = spin + 1;
+  }
+}
+
+static void ioLoad(std::atomic<bool> *closing, std::string path)
+{
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    return;
+  }
+  std::vector<char> block(256 * 1024, 'x');
+  for (int i = 0; !*closing; i++) {
+    if (i % 16 == 0) {
+      lseek(fd, 0, SEEK_SET);
+    }
+    if (write(fd, block.data(), block.size()) < 0) {
+      break;
+    }
+    fsync(fd);
+  }
+  close(fd);
+  unlink(path.c_str());
+}
+
+static RunResult run(const RealTimeParams *realTime, int port, int seconds, double rate, int cpuThreads,
+                     int ioThreads)
+{
+  RunResult result;
+  int listenSock = listenOn(port);
+  if (listenSock < 0) {
+    fprintf(stderr, "jitter_bench: cannot listen on %d\n", port);
+    return result;
+  }
+  std::thread head(device, listenSock);
+
+  Pipeline pipeline;
+  auto sink = std::make_unique<CamPTZ>();
+  sink->Initialize("127.0.0.1", port, 0, 0, false, false);
+  pipeline.SetSink(std::move(sink));
+  if (realTime != nullptr) {
+    pipeline.SetRealTime(*realTime);
+  }
+  pipeline.Start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::atomic<bool> closing{false};
+  std::vector<std::thread> load;
+  for (int i = 0; i < cpuThreads; i++) {
+    load.push_back(std::thread(cpuLoad, &closing));
+  }
+  for (int i = 0; i < ioThreads; i++) {
+    load.push_back(std::thread(ioLoad, &closing, "/tmp/jitter_bench." + std::to_string(getpid()) + "." +
+                                                   std::to_string(i)));
+  }
+
+  size_t count = (size_t)(seconds * rate);
+  std::vector<int64_t> scheduled(count), submitted(count);
+  sendTimes.assign(count, 0);
+  sendCount = 0;
+
+  std::thread driver([&]() {
+    if (realTime != nullptr) {
+      EnterRealTime("driver", *realTime);
+    }
+    auto interval = std::chrono::nanoseconds((int64_t)(1e9 / rate));
+    auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    recording = true;
+    for (size_t k = 0; k < count; k++) {
+      next += interval;
+      std::this_thread::sleep_until(next);
+      submitted[k] = nowNs();
+      scheduled[k] = std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count();
+
+      RotatorRequest req;
+      req.cmd = CHANGE_AZI;
+      req.payload.ChangeAzi.aziRequested = 10 + k % 300;
+      pipeline.Request(req, [](RotatorResponse) {});
+    }
+  });
+  driver.join();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  recording = false;
+
+  closing = true;
+  for (auto &thread : load) {
+    thread.join();
+  }
+  pipeline.Terminate();
+  head.join();
+  CLOSE_SOCKET(listenSock);
+
+  size_t sent = (std::min)(sendCount.load(), count);
+  std::vector<double> wake, path, total;
+  for (size_t k = 0; k < sent; k++) {
+    wake.push_back((submitted[k] - scheduled[k]) / 1e3);
+    path.push_back((sendTimes[k] - submitted[k]) / 1e3);
+    total.push_back((sendTimes[k] - scheduled[k]) / 1e3);
+  }
+  result.ok = sent == count;
+  result.commands = sent;
+  result.wake = summarize(wake);
+  result.path = summarize(path);
+  result.total = summarize(total);
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  popl::OptionParser op("Allowed options");
+  auto helpOption = op.add<popl::Switch>("h", "help", "produce help message");
+  auto seconds = op.add<popl::Implicit<int>>("", "seconds", "Duration of each run (s)", 10);
+  auto rate = op.add<popl::Implicit<double>>("", "rate", "Commands per second", 50.0);
+  auto cpuLoadThreads = op.add<popl::Implicit<int>>("", "cpu-load", "Spinning threads (default: two per CPU)", 0);
+  auto ioLoadThreads = op.add<popl::Implicit<int>>("", "io-load", "Threads writing and fsyncing a file", 1);
+  auto priority = op.add<popl::Implicit<int>>("", "priority", "SCHED_FIFO priority of the real-time run", 80);
+  auto cpu = op.add<popl::Implicit<int>>("", "cpu", "CPU of the real-time threads (-1: any)", -1);
+  auto port = op.add<popl::Implicit<int>>("", "port", "First loopback port to use", 45600);
+  op.parse(argc, argv);
+
+  if (helpOption->is_set()) {
+    std::cout << op << "\n";
+    return 0;
+  }
+
+  int cpuThreads = cpuLoadThreads->is_set() ? cpuLoadThreads->value()
+                                            : 2 * (std::max)(1u, std::thread::hardware_concurrency());
+  SetIoBackend(IO_BLOCKING);
+
+  RealTimeParams realTime;
+  realTime.priority = priority->value();
+  realTime.cpu = cpu->value();
+  realTime.lockMemory = true;
+
+  // the bridge logs to stdout; keep it out of the table
+  fflush(stdout);
+  int savedStdout = dup(STDOUT_FILENO);
+  int devNull = open("/dev/null", O_WRONLY);
+  dup2(devNull, STDOUT_FILENO);
+  RunResult idle = run(nullptr, port->value(), seconds->value(), rate->value(), 0, 0);
+  RunResult loaded = run(nullptr, port->value() + 1, seconds->value(), rate->value(), cpuThreads,
+                         ioLoadThreads->value());
+  RunResult realTimeLoaded = run(&realTime, port->value() + 2, seconds->value(), rate->value(), cpuThreads,
+                                 ioLoadThreads->value());
+  fflush(stdout);
+  dup2(savedStdout, STDOUT_FILENO);
+  close(devNull);
+  close(savedStdout);
+
+  printf("\n%.0f commands/s, load: %d spinning, %d fsync threads; lateness of send() (us)\n", rate->value(),
+         cpuThreads, ioLoadThreads->value());
+  printf("%-17s %-6s %9s %9s %9s %9s %9s\n", "run", "part", "p50", "p99", "p99.9", "max", "stddev");
+  struct Row {
+    const char *name;
+    const RunResult *result;
+  };
+  for (auto row : {Row{"idle", &idle}, Row{"loaded", &loaded}, Row{"loaded+realtime", &realTimeLoaded}}) {
+    if (!row.result->ok) {
+      printf("%-17s failed (%zu commands seen)\n", row.name, row.result->commands);
+      continue;
+    }
+    struct Part {
+      const char *name;
+      const Lateness *lateness;
+    };
+    for (auto part : {Part{"wake", &row.result->wake}, Part{"path", &row.result->path},
+                      Part{"total", &row.result->total}}) {
+      const Lateness &l = *part.lateness;
+      printf("%-17s %-6s %9.0f %9.0f %9.0f %9.0f %9.0f\n", row.name, part.name, l.p50, l.p99, l.p999, l.max,
+             l.stddev);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,243 @@
+// Simulator-driven trajectory planner benchmark.
+//
+// Flies synthetic, time-compressed satellite passes against SimPTZ through
+// CamPTZ:
+// - direct: every target forwarded as it comes (what gpredict -> rotctld ->
+//   CamPTZ does today)
+// - planned: through TrajectoryStage
+// - wrap / planned+wrap: with a flip-capable head and WrapStage knowing the
+//   pass in advance, pre-positioned before it starts
+// - velocity / wrap+velocity: CamPTZ's velocity drive, tracking with speed
+//   commands, alone and behind WrapStage
+// Reports RMS / max pointing error and motor restarts per pass. All runs go
+// in parallel after a common pre-positioning window, each on its own
+// VirtualClock, so real-length passes take seconds; --realtime runs them on
+// the steady clock instead.
+//
+//   planner_bench --pass-seconds=600 --update-interval=1000 --preposition-seconds=60
+
+#include "popl.hpp"
+#include "pipeline/Pipeline.hpp"
+#include "pipeline/Stages.hpp"
+#include "pipeline/Trajectory.hpp"
+#include "pipeline/Wrap.hpp"
+#include "rotators/CamPTZ.hpp"
+#include "transport/SimPTZ.hpp"
+#include <cmath>
+#include <iostream>
+
+static const double degToRad = M_PI / 180.0;
+
+// straight ground track past the station, flat earth
+struct PassGeometry {
+  const char *name;
+  double heading;       // (deg) direction of travel
+  double offset;        // (km) closest approach, to the right of the track
+  double altitude = 500;
+  double halfLength = 2000;  // (km) track before / after closest approach
+
+  // f in [0, 1] along the pass
+  void At(double f, double &azi, double &ele) const {
+    double along = (-1 + 2 * f) * halfLength;
+    double h = heading * degToRad;
+    double east = along * std::sin(h) + offset * std::cos(h);
+    double north = along * std::cos(h) - offset * std::sin(h);
+    azi = wrapAzimuth(std::atan2(east, north) / degToRad);
+    ele = std::atan2(altitude, std::hypot(east, north)) / degToRad;
+  }
+};
+
+static double separation(double azi1, double ele1, double azi2, double ele2)
+{
+  double c = std::sin(ele1 * degToRad) * std::sin(ele2 * degToRad)
+           + std::cos(ele1 * degToRad) * std::cos(ele2 * degToRad) * std::cos((azi1 - azi2) * degToRad);
+  return std::acos((std::max)(-1.0, (std::min)(1.0, c))) / degToRad;
+}
+
+struct RunResult {
+  double rms = 0;
+  double max = 0;
+  uint64_t restarts = 0;
+  uint64_t frames = 0;
+  uint64_t queries = 0;
+};
+
+enum BenchMode {
+  MODE_DIRECT = 0,
+  MODE_PLANNED = 1,
+  MODE_WRAP = 2,
+  MODE_PLANNED_WRAP = 3,
+  MODE_VELOCITY = 4,
+  MODE_WRAP_VELOCITY = 5
+};
+
+static const char *modeNames[] = {"direct", "planned", "wrap", "planned+wrap", "velocity", "wrap+velocity"};
+
+static RunResult runPass(const PassGeometry &pass, BenchMode mode, double passSeconds, int updateInterval,
+                         double prepositionSeconds, bool realtime)
+{
+  VirtualClock virtualClock;
+  Clock *clock = realtime ? Clock::Steady() : &virtualClock;
+  ClockThread attach(clock);
+
+  double startAzi, startEle;
+  pass.At(0, startAzi, startEle);
+
+  SimPTZ::Params simParams;
+  simParams.initialPan = startAzi;
+  simParams.initialTilt = 90 - startEle;
+  simParams.tiltMin = -90;  // flip-capable
+  auto simOwned = std::make_unique<SimPTZ>(simParams, pass.name);
+  SimPTZ *sim = simOwned.get();
+
+  auto sink = std::make_unique<CamPTZ>();
+  sink->Initialize("", 0, 0, 0, false, false);
+  sink->SetTransport(std::move(simOwned));
+  if (mode == MODE_VELOCITY || mode == MODE_WRAP_VELOCITY) {
+    VelocityTracker::Params azi, ele;
+    azi.maxSpeed = simParams.panSpeed;
+    azi.minPosition = 0;
+    azi.maxPosition = 359.99;
+    ele.maxSpeed = simParams.tiltSpeed;
+    sink->SetVelocityParams(azi, ele);
+  }
+
+  Pipeline pipeline;
+  if (mode == MODE_PLANNED || mode == MODE_PLANNED_WRAP) {
+    TrajectoryStage::AxisLimits azi = {simParams.panSpeed, 10, simParams.panSpeed};
+    TrajectoryStage::AxisLimits ele = {simParams.tiltSpeed, 5, simParams.tiltSpeed};
+    pipeline.AddStage(std::make_unique<TrajectoryStage>(azi, ele, simParams.restartDelay, 1.0, 10, 50));
+  }
+
+  auto start = clock->Now() + std::chrono::milliseconds((int)(prepositionSeconds * 1000));
+  if (mode == MODE_WRAP || mode == MODE_PLANNED_WRAP || mode == MODE_WRAP_VELOCITY) {
+    WrapStage::Params wrapParams;
+    wrapParams.flip = true;
+    wrapParams.aziSpeed = simParams.panSpeed;
+    wrapParams.eleSpeed = simParams.tiltSpeed;
+    wrapParams.lead = prepositionSeconds;
+    auto wrap = std::make_unique<WrapStage>(wrapParams);
+
+    // the tracking program's prediction of the pass, 100 samples
+    double passStart = clock->UnixTime() + prepositionSeconds;
+    std::vector<PassPlanPoint> plan;
+    for (int i = 0; i <= 100; i++) {
+      PassPlanPoint point;
+      point.time = passStart + passSeconds * i / 100;
+      pass.At(i / 100.0, point.azi, point.ele);
+      plan.push_back(point);
+    }
+    wrap->SetPlan(plan);
+    pipeline.AddStage(std::move(wrap));
+  }
+
+  pipeline.SetSink(std::move(sink));
+  pipeline.SetClock(clock);
+  pipeline.Start();
+  clock->SleepUntil(start);
+
+  auto nextUpdate = start;
+  double sumSquares = 0;
+  RunResult result;
+  int samples = 0;
+
+  while (true) {
+    auto now = clock->Now();
+    double f = std::chrono::duration<double>(now - start).count() / passSeconds;
+    if (f > 1) {
+      break;
+    }
+
+    double azi, ele;
+    pass.At(f, azi, ele);
+
+    if (now >= nextUpdate) {
+      // what the tracking program sends
+      RotatorRequest req;
+      req.cmd = CHANGE_AZI;
+      req.payload.ChangeAzi.aziRequested = azi;
+      pipeline.Request(req, [](RotatorResponse) {});
+      req.cmd = CHANGE_ELE;
+      req.payload.ChangeEle.eleRequested = ele;
+      pipeline.Request(req, [](RotatorResponse) {});
+      nextUpdate += std::chrono::milliseconds(updateInterval);
+    }
+
+    double pan, tilt;
+    sim->GetPosition(pan, tilt);
+    double headAzi = pan, headEle = 90 - tilt;
+    if (headEle > 90) {
+      // flipped over the zenith
+      headAzi = wrapAzimuth(headAzi + 180);
+      headEle = 180 - headEle;
+    }
+    double error = separation(azi, ele, headAzi, headEle);
+    sumSquares += error * error;
+    result.max = (std::max)(result.max, error);
+    samples++;
+
+    clock->SleepFor(std::chrono::milliseconds(20));
+  }
+
+  result.rms = std::sqrt(sumSquares / (std::max)(1, samples));
+  result.restarts = sim->MotorRestarts();
+  result.frames = sim->FramesReceived();
+  result.queries = sim->QueriesReceived();
+  pipeline.Terminate();
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  popl::OptionParser op("Allowed options");
+  auto helpOption = op.add<popl::Switch>("h", "help", "produce help message");
+  auto passSeconds = op.add<popl::Implicit<double>>("", "pass-seconds", "Duration of each (time-compressed) pass", 60.0);
+  auto updateInterval = op.add<popl::Implicit<int>>("", "update-interval", "Target update interval of the tracking program (ms)", 1000);
+  auto prepositionSeconds = op.add<popl::Implicit<double>>("", "preposition-seconds", "Time before each pass for pre-positioning", 20.0);
+  auto realtime = op.add<popl::Switch>("", "realtime", "Run on the steady clock instead of virtual time");
+  op.parse(argc, argv);
+
+  if (helpOption->is_set()) {
+    std::cout << op << "\n";
+    return 0;
+  }
+
+  const PassGeometry passes[] = {
+    {"low-east", 0, 800},
+    {"overhead", 30, 100},
+    {"north-cross", 200, 350},
+  };
+
+  struct Run {
+    const PassGeometry *pass;
+    BenchMode mode;
+    RunResult result;
+    std::thread thread;
+  };
+  std::vector<Run> runs;
+  for (const auto &pass : passes) {
+    for (int mode = MODE_DIRECT; mode <= MODE_WRAP_VELOCITY; mode++) {
+      runs.push_back(Run{&pass, (BenchMode)mode, RunResult(), std::thread()});
+    }
+  }
+
+  for (auto &run : runs) {
+    run.thread = std::thread([&run, &passSeconds, &updateInterval, &prepositionSeconds, &realtime]() {
+      run.result = runPass(*run.pass, run.mode, passSeconds->value(), updateInterval->value(),
+                           prepositionSeconds->value(), realtime->is_set());
+    });
+  }
+  for (auto &run : runs) {
+    run.thread.join();
+  }
+
+  printf("\n%-12s %-13s %10s %10s %9s %7s %8s\n", "pass", "mode", "rms(deg)", "max(deg)", "restarts", "frames",
+         "queries");
+  for (auto &run : runs) {
+    printf("%-12s %-13s %10.3f %10.3f %9llu %7llu %8llu\n", run.pass->name, modeNames[run.mode],
+           run.result.rms, run.result.max,
+           (unsigned long long)run.result.restarts, (unsigned long long)run.result.frames,
+           (unsigned long long)run.result.queries);
+  }
+  return 0;
+}
@@ -0,0 +1,205 @@
+// Shared-memory channel vs rotctld over loopback.
+//
+// One bridge with a simulated CamPTZ head, a shared-memory source and
+// telemetry stage, and a rotctld source. A consumer attached to the segment
+// like another process would be:
+// - reads the telemetry in a loop while the bridge samples and publishes
+//   (ns per read, retries due to overlapping updates)
+// - pushes set-position commands and spins on the telemetry until each is
+//   reported done (round trip), with the ring polled every --poll us
+// and a rotctld client does the same set / get over TCP loopback.
+//
+//   shm_bench --requests=5000 --poll=100 --port=45950
+
+#include "popl.hpp"
+#include "pipeline/Pipeline.hpp"
+#include "transport/ShmChannel.hpp"
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/tcp.h>
+
+struct Latency {
+  double p50 = 0, p99 = 0;  // (us)
+};
+
+static Latency summarize(std::vector<double> values)
+{
+  Latency result;
+  if (values.empty()) {
+    return result;
+  }
+  std::sort(values.begin(), values.end());
+  result.p50 = values[values.size() / 2];
+  result.p99 = values[(size_t)(values.size() * 0.99)];
+  return result;
+}
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// sends command and waits for lines reply lines
+static bool exchange(int sock, std::string &buffered, const std::string &command, int lines)
+{
+  if (send_fixed(sock, command.data(), command.size(), 0) < 0) {
+    return false;
+  }
+  for (int i = 0; i < lines; i++) {
+    size_t end;
+    while ((end = buffered.find('\n')) == std::string::npos) {
+      char buf[256];
+      int ret = recv(sock, buf, sizeof(buf), 0);
+      if (ret <= 0) {
+        return false;
+      }
+      buffered.append(buf, ret);
+    }
+    buffered.erase(0, end + 1);
+  }
+  return true;
+}
+
+static int connectLoopback(int port)
+{
+  int sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 50; attempt++) {
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      int one = 1;
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+      return sock;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  CLOSE_SOCKET(sock);
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{
+  popl::OptionParser op("Allowed options");
+  auto helpOption = op.add<popl::Switch>("h", "help", "produce help message");
+  auto requests = op.add<popl::Implicit<int>>("", "requests", "Commands per measurement", 5000);
+  auto reads = op.add<popl::Implicit<int>>("", "reads", "Telemetry reads", 5000000);
+  auto poll = op.add<popl::Implicit<int>>("", "poll", "Command ring poll interval of the bridge (us); 0: spin", 100);
+  auto port = op.add<popl::Implicit<int>>("", "port", "Loopback port of the rotctld source", 45950);
+  auto name = op.add<popl::Implicit<std::string>>("", "name", "Shared-memory channel", "/rbridge-bench");
+  op.parse(argc, argv);
+
+  if (helpOption->is_set()) {
+    std::cout << op << "\n";
+    return 0;
+  }
+
+  // the bridge logs every request to stdout
+  fflush(stdout);
+  int savedStdout = dup(STDOUT_FILENO);
+  int devNull = open("/dev/null", O_WRONLY);
+  dup2(devNull, STDOUT_FILENO);
+
+  Pipeline pipeline;
+  bool configured =
+    pipeline.AddConfigLine("source shm name=" + name->value() + " sample=10 poll=" + std::to_string(poll->value())) &&
+    pipeline.AddConfigLine("source rotctld host=127.0.0.1 port=" + std::to_string(port->value())) &&
+    pipeline.AddConfigLine("stage telemetry name=" + name->value()) &&
+    pipeline.AddConfigLine("sink camptz transport=sim smart-sink=0 keepalive=0 presets=0");
+  if (!configured) {
+    dup2(savedStdout, STDOUT_FILENO);
+    fprintf(stderr, "shm_bench: bad pipeline\n");
+    return 1;
+  }
+  pipeline.Start();
+
+  // as another process would
+  std::unique_ptr<ShmChannel> consumer;
+  for (int attempt = 0; attempt < 50 && consumer == nullptr; attempt++) {
+    consumer = ShmChannel::Attach(name->value());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  if (consumer == nullptr) {
+    pipeline.Terminate();
+    dup2(savedStdout, STDOUT_FILENO);
+    fprintf(stderr, "shm_bench: cannot attach to %s\n", name->value().c_str());
+    return 1;
+  }
+
+  // reads while the sampler publishes every 10 ms
+  ShmTelemetry telemetry;
+  int failedReads = 0;
+  auto readStart = std::chrono::steady_clock::now();
+  for (int i = 0; i < reads->value(); i++) {
+    if (!consumer->Read(telemetry)) {
+      failedReads++;
+    }
+  }
+  double readNs = since(readStart) * 1e3 / reads->value();
+
+  int count = requests->value();
+  std::vector<double> shmSet, shmGet, tcpSet, tcpGet;
+  bool ok = true;
+  for (int i = 0; i < count && ok; i++) {
+    ShmCommand command = {};
+    command.type = SHM_SET_POSITION;
+    command.azi = 180 + (i % 20) * 0.1;
+    command.ele = 45 + (i % 10) * 0.1;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t seq = consumer->Push(command);
+    // until done, for at most a second
+    while (ok && (!consumer->Read(telemetry) || telemetry.commandDone < seq)) {
+      ok = seq != 0 && since(start) < 1e6;
+      std::this_thread::yield();
+    }
+    shmSet.push_back(since(start));
+
+    start = std::chrono::steady_clock::now();
+    consumer->Read(telemetry);
+    shmGet.push_back(since(start));
+  }
+
+  int sock = connectLoopback(port->value());
+  std::string buffered;
+  for (int i = 0; i < count && ok && sock >= 0; i++) {
+    char command[64];
+    snprintf(command, sizeof(command), "P %.2f %.2f\n", 180 + (i % 20) * 0.1, 45 + (i % 10) * 0.1);
+    auto start = std::chrono::steady_clock::now();
+    ok = exchange(sock, buffered, command, 1);
+    tcpSet.push_back(since(start));
+
+    start = std::chrono::steady_clock::now();
+    ok = ok && exchange(sock, buffered, "p\n", 2);
+    tcpGet.push_back(since(start));
+  }
+  if (sock >= 0) {
+    CLOSE_SOCKET(sock);
+  }
+
+  consumer.reset();
+  pipeline.Terminate();
+  fflush(stdout);
+  dup2(savedStdout, STDOUT_FILENO);
+  close(devNull);
+  close(savedStdout);
+
+  if (!ok || sock < 0) {
+    fprintf(stderr, "shm_bench: a request failed\n");
+    return 1;
+  }
+
+  printf("\ntelemetry read: %.1f ns, %d of %d reads gave up\n", readNs, failedReads, reads->value());
+  printf("%d commands each, simulated head, ring polled every %d us\n", count, poll->value());
+  printf("%-22s %9s %9s\n", "path", "p50(us)", "p99(us)");
+  struct Row {
+    const char *name;
+    Latency latency;
+  };
+  for (auto &row : {Row{"shm set (until done)", summarize(shmSet)}, Row{"rotctld tcp set", summarize(tcpSet)},
+                    Row{"shm position read", summarize(shmGet)}, Row{"rotctld tcp poll", summarize(tcpGet)}}) {
+    printf("%-22s %9.2f %9.2f\n", row.name, row.latency.p50, row.latency.p99);
+  }
+  return 0;
+}
@@ -0,0 +1,274 @@
+// smartSink policy replay, in simulated time.
+//
+// Feeds a recorded target stream through the per-axis AxisTracker that
+// CamPTZ uses and through a plain forwarder, against a model of a head that
+// stops and restarts its motor on every position command, and reports device
+// commands, suppressions, replays and pointing error. Nothing sleeps: a pass
+// of any length replays in milliseconds, so the policy parameters can be
+// swept against real sessions.
+//
+// Input, one of:
+//   --trace=<file>  CHANGE_AZI / CHANGE_ELE requests of a session trace (--trace-out)
+//   --pass=<file>   `unix-time azi ele` lines, the target sent at that time
+// Without input a built-in pass (slew onto a slow pass, targets repeated
+// between changes, as gpredict does) is used.
+//
+//   tracking_bench --trace=session.rbt --hold-threshold=0.5 --drop-rate=0.05
+
+#include "popl.hpp"
+#include "rotators/AxisTracker.hpp"
+#include "trace/TraceLog.hpp"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+struct TargetEvent {
+  double time;  // (s) from the start of the session
+  int axis;     // 0 azi, 1 ele
+  double value;
+};
+
+// one axis of the head, as SimPTZ models it
+struct ModelAxis {
+  double speed;
+  double restartDelay;
+  double pos = 0;
+  double target = 0;
+  double startAt = 0;
+  uint64_t restarts = 0;
+
+  void Command(double now, double value) {
+    target = value;
+    startAt = now + restartDelay;
+    restarts++;
+  }
+
+  void Advance(double now, double dt) {
+    if (now < startAt) {
+      return;
+    }
+    double step = speed * dt;
+    double d = target - pos;
+    pos = std::abs(d) <= step ? target : pos + (d > 0 ? step : -step);
+  }
+};
+
+struct RunResult {
+  uint64_t commands = 0;
+  uint64_t restarts = 0;
+  AxisTracker::Stats stats[2];
+  double rms[2] = {0, 0};
+  double max[2] = {0, 0};
+};
+
+struct BenchParams {
+  AxisTracker::Params tracker;
+  double panSpeed, tiltSpeed, restartDelay;
+  double sampleInterval;
+  double dropRate;
+};
+
+static bool loadTrace(std::string path, std::vector<TargetEvent> &events)
+{
+  TraceReader reader;
+  if (!reader.Open(path)) {
+    return false;
+  }
+  TraceRecord record;
+  while (reader.Next(record)) {
+    RotatorRequest req;
+    if (record.header.type != TRACE_SINK_REQUEST || !TraceDecodeRequest(record.payload, req)) {
+      continue;
+    }
+    double time = record.header.timestampNs / 1e9;
+    if (req.cmd == CHANGE_AZI) {
+      events.push_back(TargetEvent{time, 0, req.payload.ChangeAzi.aziRequested});
+    } else if (req.cmd == CHANGE_ELE) {
+      events.push_back(TargetEvent{time, 1, req.payload.ChangeEle.eleRequested});
+    }
+  }
+  return true;
+}
+
+static bool loadPass(std::string path, std::vector<TargetEvent> &events)
+{
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "tracking_bench: cannot open %s\n", path.c_str());
+    return false;
+  }
+  std::string line;
+  double first = -1;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    double time, azi, ele;
+    if (!(fields >> time >> azi >> ele)) {
+      continue;
+    }
+    if (first < 0) {
+      first = time;
+    }
+    events.push_back(TargetEvent{time - first, 0, azi});
+    events.push_back(TargetEvent{time - first, 1, ele});
+  }
+  return true;
+}
+
+static void builtinPass(std::vector<TargetEvent> &events)
+{
+  // head parked at 0/0; pass rises in the south-east, 1 s updates, the
+  // tracking program rounding to 0.1 deg so most updates repeat the last one
+  for (int t = 0; t <= 600; t++) {
+    double f = t / 600.0;
+    double azi = std::round((120 + 120 * f) * 10) / 10;
+    double ele = std::round((5 + 55 * std::sin(M_PI * f)) * 10) / 10;
+    events.push_back(TargetEvent{(double)t, 0, azi});
+    events.push_back(TargetEvent{(double)t, 1, ele});
+  }
+}
+
+static RunResult run(const std::vector<TargetEvent> &events, const BenchParams &params, bool smartSink)
+{
+  const double dt = 0.01;
+  ModelAxis axes[2] = {{params.panSpeed, params.restartDelay}, {params.tiltSpeed, params.restartDelay}};
+  AxisTracker::Params aziParams = params.tracker, eleParams = params.tracker;
+  aziParams.periodic = true;
+  AxisTracker trackers[2] = {AxisTracker(aziParams), AxisTracker(eleParams)};
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  RunResult result;
+
+  auto command = [&](double now, int axis, double value) {
+    result.commands++;
+    if (uniform(rng) >= params.dropRate) {
+      axes[axis].Command(now, value);
+    }
+  };
+
+  bool targetValid[2] = {false, false};
+  double target[2] = {0, 0};
+  double sumSquares[2] = {0, 0};
+  int samples = 0;
+  double nextSample = 0;
+  double end = events.empty() ? 0 : events.back().time + 10;
+  size_t next = 0;
+
+  for (double now = 0; now <= end; now += dt) {
+    for (; next < events.size() && events[next].time <= now; next++) {
+      const TargetEvent &event = events[next];
+      target[event.axis] = event.value;
+      targetValid[event.axis] = true;
+      if (!smartSink || trackers[event.axis].OnTarget(now, event.value) == AxisTracker::SEND) {
+        command(now, event.axis, event.value);
+      }
+    }
+
+    for (int axis = 0; axis < 2; axis++) {
+      axes[axis].Advance(now, dt);
+    }
+
+    if (smartSink && now >= nextSample) {
+      // what CamPTZ's tracker thread does every trackerInterval
+      nextSample += params.sampleInterval;
+      for (int axis = 0; axis < 2; axis++) {
+        if (trackers[axis].NeedsSampling()) {
+          trackers[axis].OnPosition(now, axes[axis].pos);
+        }
+        if (auto resend = trackers[axis].OnTick(now)) {
+          command(now, axis, *resend);
+        }
+      }
+    }
+
+    if (targetValid[0] && targetValid[1]) {
+      for (int axis = 0; axis < 2; axis++) {
+        double error = std::abs(target[axis] - axes[axis].pos);
+        if (axis == 0) {
+          error = (std::min)(error, 360 - error);
+        }
+        sumSquares[axis] += error * error;
+        result.max[axis] = (std::max)(result.max[axis], error);
+      }
+      samples++;
+    }
+  }
+
+  for (int axis = 0; axis < 2; axis++) {
+    result.rms[axis] = std::sqrt(sumSquares[axis] / (std::max)(1, samples));
+    result.stats[axis] = trackers[axis].GetStats();
+  }
+  result.restarts = axes[0].restarts + axes[1].restarts;
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  popl::OptionParser op("Allowed options");
+  auto helpOption = op.add<popl::Switch>("h", "help", "produce help message");
+  auto tracePath = op.add<popl::Value<std::string>>("", "trace", "Session trace to take the targets from");
+  auto passPath = op.add<popl::Value<std::string>>("", "pass", "Target file of `unix-time azi ele` lines");
+  AxisTracker::Params defaults;
+  auto tolerance = op.add<popl::Implicit<double>>("", "tolerance", "Arrival tolerance (deg)", defaults.tolerance);
+  auto slewThreshold = op.add<popl::Implicit<double>>("", "slew-threshold", "Steps larger than this are slews (deg)", defaults.slewThreshold);
+  auto holdThreshold = op.add<popl::Implicit<double>>("", "hold-threshold", "Smaller changes are held while tracking (deg)", defaults.holdThreshold);
+  auto maxHold = op.add<popl::Implicit<double>>("", "max-hold", "Longest a changed target is held (s)", defaults.maxHold);
+  auto stallSpeed = op.add<popl::Implicit<double>>("", "stall-speed", "Slower counts as stopped (deg/s)", defaults.stallSpeed);
+  auto stallTime = op.add<popl::Implicit<double>>("", "stall-time", "Stopped short for this long -> replay (s)", defaults.stallTime);
+  auto sampleInterval = op.add<popl::Implicit<int>>("", "sample-interval", "Position sampling interval (ms)", 500);
+  auto panSpeed = op.add<popl::Implicit<double>>("", "pan-speed", "Head pan speed (deg/s)", 20.0);
+  auto tiltSpeed = op.add<popl::Implicit<double>>("", "tilt-speed", "Head tilt speed (deg/s)", 10.0);
+  auto restartDelay = op.add<popl::Implicit<double>>("", "restart-delay", "Motor restart delay per command (s)", 0.3);
+  auto dropRate = op.add<popl::Implicit<double>>("", "drop-rate", "Fraction of position commands the head loses", 0.0);
+  op.parse(argc, argv);
+
+  if (helpOption->is_set()) {
+    std::cout << op << "\n";
+    return 0;
+  }
+
+  std::vector<TargetEvent> events;
+  if (tracePath->is_set()) {
+    if (!loadTrace(tracePath->value(), events)) {
+      return 1;
+    }
+  } else if (passPath->is_set()) {
+    if (!loadPass(passPath->value(), events)) {
+      return 1;
+    }
+  } else {
+    builtinPass(events);
+  }
+  if (events.empty()) {
+    fprintf(stderr, "tracking_bench: no position changes in the input\n");
+    return 1;
+  }
+
+  BenchParams params;
+  params.tracker.tolerance = tolerance->value();
+  params.tracker.slewThreshold = slewThreshold->value();
+  params.tracker.holdThreshold = holdThreshold->value();
+  params.tracker.maxHold = maxHold->value();
+  params.tracker.stallSpeed = stallSpeed->value();
+  params.tracker.stallTime = stallTime->value();
+  params.sampleInterval = sampleInterval->value() / 1000.0;
+  params.panSpeed = panSpeed->value();
+  params.tiltSpeed = tiltSpeed->value();
+  params.restartDelay = restartDelay->value();
+  params.dropRate = dropRate->value();
+
+  printf("%zu target updates over %.0f s\n\n", events.size(), events.back().time);
+  printf("%-10s %9s %9s %10s %9s %9s %9s %9s %9s\n", "policy", "commands", "restarts", "suppressed", "replayed",
+         "rms-azi", "rms-ele", "max-azi", "max-ele");
+  for (int smartSink = 0; smartSink <= 1; smartSink++) {
+    RunResult result = run(events, params, smartSink);
+    printf("%-10s %9llu %9llu %10llu %9llu %9.3f %9.3f %9.3f %9.3f\n", smartSink ? "smartSink" : "direct",
+           (unsigned long long)result.commands, (unsigned long long)result.restarts,
+           (unsigned long long)(result.stats[0].suppressed + result.stats[1].suppressed),
+           (unsigned long long)(result.stats[0].replayed + result.stats[1].replayed),
+           result.rms[0], result.rms[1], result.max[0], result.max[1]);
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Time source and timed waits of the bridge.
+//
+// Everything that reads the time, sleeps or waits with a timeout goes through
+// a Clock, so the same code runs on the steady clock or in virtual time.
+// Waits take the caller's mutex / condition variable like
+// std::condition_variable::wait_until; waking them goes through Notify().
+class Clock {
+public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+  using Duration = std::chrono::steady_clock::duration;
+
+  virtual ~Clock() = default;
+
+  virtual TimePoint Now() = 0;
+  // (s) unix time, for pass plans and ephemerides
+  virtual double UnixTime() = 0;
+
+  // true if pred() holds, false on the deadline
+  virtual bool WaitUntil(std::unique_lock<std::mutex> &lk, std::condition_variable &cv, TimePoint deadline,
+                         const std::function<bool()> &pred) = 0;
+  // in place of cv.notify_all()
+  virtual void Notify(std::condition_variable &cv) = 0;
+
+  // threads that drive time forward when all of them wait (VirtualClock)
+  virtual void Attach() {}
+  virtual void Detach() {}
+
+  // a thread attached from before it runs, so time cannot move past work it
+  // has yet to do; for the bridge's own worker threads
+  std::thread Spawn(std::function<void()> body);
+
+  bool Wait(std::unique_lock<std::mutex> &lk, std::condition_variable &cv, const std::function<bool()> &pred) {
+    return WaitUntil(lk, cv, TimePoint::max(), pred);
+  }
+  bool WaitFor(std::unique_lock<std::mutex> &lk, std::condition_variable &cv, Duration timeout,
+               const std::function<bool()> &pred) {
+    return WaitUntil(lk, cv, Now() + timeout, pred);
+  }
+  void SleepUntil(TimePoint deadline);
+  void SleepFor(Duration duration) { SleepUntil(Now() + duration); }
+
+  // (s) Now() as a plain number, any epoch
+  double Seconds() { return std::chrono::duration<double>(Now().time_since_epoch()).count(); }
+
+  // the process-wide steady clock, the default everywhere
+  static Clock *Steady();
+
+protected:
+  // Spawn(): counted in the spawning thread, taken over by the new one
+  virtual void reserve() {}
+  virtual void adopt() {}
+};
+
+class SteadyClock : public Clock {
+public:
+  virtual TimePoint Now() override;
+  virtual double UnixTime() override;
+  virtual bool WaitUntil(std::unique_lock<std::mutex> &lk, std::condition_variable &cv, TimePoint deadline,
+                         const std::function<bool()> &pred) override;
+  virtual void Notify(std::condition_variable &cv) override;
+};
+
+// Discrete-event time for tests and benchmarks.
+//
+// Time stands still while any attached thread runs. Once every attached
+// thread is blocked in a wait on this clock and none has a wake-up pending,
+// Now() jumps to the earliest deadline and those waiters wake, so simulated
+// hours take as long as the work done in them. Threads that block elsewhere
+// (sockets) must not attach; they still see virtual time in their waits.
+// Worker threads are started with Spawn() so they count before they run.
+// Advance() moves time by hand, e.g. with nothing attached.
+class VirtualClock : public Clock {
+private:
+  struct Waiter {
+    std::condition_variable *cv;
+    TimePoint deadline;
+    bool attached;
+    bool woken = false;
+  };
+
+  std::mutex mutex;
+  TimePoint now;
+  double unixEpoch;  // (s) unix time at construction
+  TimePoint start;
+  std::vector<Waiter *> waiters;
+  int attached = 0;
+  int attachedWaiting = 0;
+
+  void wake(TimePoint until);   // with mutex held
+  void autoAdvance();            // with mutex held
+  bool isAttached();
+
+protected:
+  virtual void reserve() override;
+  virtual void adopt() override;
+
+public:
+  // unixEpoch: unix time at the start, 0 for the current time
+  explicit VirtualClock(double unixEpoch = 0);
+
+  virtual TimePoint Now() override;
+  virtual double UnixTime() override;
+  virtual bool WaitUntil(std::unique_lock<std::mutex> &lk, std::condition_variable &cv, TimePoint deadline,
+                         const std::function<bool()> &pred) override;
+  virtual void Notify(std::condition_variable &cv) override;
+  virtual void Attach() override;
+  virtual void Detach() override;
+
+  void Advance(Duration duration);
+};
+
+// attaches the current thread for its scope
+class ClockThread {
+private:
+  Clock *clock;
+
+public:
+  explicit ClockThread(Clock *clock) : clock(clock) { clock->Attach(); }
+  ~ClockThread() { clock->Detach(); }
+  ClockThread(const ClockThread &) = delete;
+  ClockThread &operator=(const ClockThread &) = delete;
+};
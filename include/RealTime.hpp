@@ -0,0 +1,22 @@
+#pragma once
+
+// Real-time mode of the threads on the command path to a device (the
+// pipeline dispatcher and CamPTZ's worker and tracker threads), so commands
+// go out on time under load from logging, clients and other processes.
+//
+// Each thread enters it itself when it starts: SCHED_FIFO at priority, pinned
+// to cpu. lockMemory locks the process's pages (mlockall) and keeps malloc
+// from handing memory back, so the hot path takes no page faults once warm.
+// Needs CAP_SYS_NICE / CAP_IPC_LOCK or matching rlimits; what is refused is
+// reported and left out, the rest still applies.
+struct RealTimeParams {
+  int priority = 0;         // SCHED_FIFO 1..99; 0: normal scheduling
+  int cpu = -1;             // -1: not pinned (or as inherited)
+  bool lockMemory = false;
+
+  bool Enabled() const { return priority > 0 || cpu >= 0 || lockMemory; }
+};
+
+// applies params to the calling thread; who names it in warnings. False if
+// any part was refused
+bool EnterRealTime(const char *who, const RealTimeParams &params);
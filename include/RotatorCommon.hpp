@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <cerrno>
 #include <string>
 #include <queue>
 #include <thread>
@@ -10,6 +12,11 @@
 #include <optional>
 #include <chrono>
 #include <thread>
+#include <memory>
+#include <vector>
+
+#include "Clock.hpp"
+#include "RealTime.hpp"
 
 /* NETWORK */
 #ifndef WIN32
@@ -84,11 +91,18 @@ inline void CloseWinSock2(void)
 }
 #endif
 
+// a peer that went away fails the send with EPIPE instead of raising SIGPIPE,
+// which would end the process (and any embedding one); every socket send
+// passes it. Windows has no SIGPIPE.
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 inline int send_fixed(int sockfd, const char *buf, size_t buflen, int opts) {
   int ret;
-  int bytes_written = 0;
+  size_t bytes_written = 0;
   while (bytes_written < buflen) {
-    ret = send(sockfd, buf + bytes_written, buflen - bytes_written, opts);
+    ret = send(sockfd, buf + bytes_written, buflen - bytes_written, opts | MSG_NOSIGNAL);
     if (ret < 0) {
       return ret;
     }
@@ -98,13 +112,17 @@ inline int send_fixed(int sockfd, const char *buf, size_t buflen, int opts) {
   return bytes_written;
 }
 
+// -1 as well if the peer closes before buflen bytes arrived
 inline int recv_fixed(int sockfd, char *buf, size_t buflen, int opts) {
   int ret;
-  int bytes_read = 0;
+  size_t bytes_read = 0;
   while (bytes_read < buflen) {
     ret = recv(sockfd, buf + bytes_read, buflen - bytes_read, opts);
-    if (ret < 0) {
-      return ret;
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return -1;
     }
 
     bytes_read += ret;
@@ -157,6 +175,88 @@ class ThreadsafeQueue {
   }
 };
 
+// bounded lock-free MPMC queue (Dmitry Vyukov's array-based design);
+// push() fails instead of blocking when the queue is full
+template<typename T>
+class LockFreeQueue {
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> buffer_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> enqueuePos_;
+  alignas(64) std::atomic<size_t> dequeuePos_;
+
+ public:
+  // capacity is rounded up to a power of two
+  explicit LockFreeQueue(size_t capacity = 1024) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+
+    buffer_.reset(new Cell[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; i++) {
+      buffer_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueuePos_.store(0, std::memory_order_relaxed);
+    dequeuePos_.store(0, std::memory_order_relaxed);
+  }
+
+  LockFreeQueue(const LockFreeQueue<T> &) = delete;
+  LockFreeQueue& operator=(const LockFreeQueue<T> &) = delete;
+
+  bool push(T item) {
+    Cell *cell;
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &buffer_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->data = std::move(item);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  std::optional<T> pop() {
+    Cell *cell;
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &buffer_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return {};  // empty
+      } else {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    T tmp = std::move(cell->data);
+    cell->data = T();
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return tmp;
+  }
+};
+
 enum RotatorCmd {
   CHANGE_AZI,
   CHANGE_ELE,
@@ -164,9 +264,27 @@ enum RotatorCmd {
   GET_ELE,
   CAMPTZ_PRESET_CALL,
   CAMPTZ_PRESET_SET,
-  CAMPTZ_PRESET_CLEAR
+  CAMPTZ_PRESET_CLEAR,
+  ROTATOR_STOP,
+  ROTATOR_PARK,
+  ROTATOR_MOVE,
+  ROTATOR_RESET,
+  CAMPTZ_SPEED,
+  ROTATOR_PRESET_HINT
+};
+
+// direction bits of ROTATOR_MOVE, same values as hamlib's ROT_MOVE_*
+enum RotatorMoveDirection {
+  MOVE_UP = 2,
+  MOVE_DOWN = 4,
+  MOVE_CCW = 8,   // left
+  MOVE_CW = 16    // right
 };
 
+// shared between a caller and the requests it waits for; set once the caller
+// gave up on them
+using CancelToken = std::shared_ptr<std::atomic<bool>>;
+
 // ele = 0 means pointing the antenna to horizon
 // ele = 90 means pointing the antenna to the sky
 struct RotatorRequest {
@@ -181,7 +299,33 @@ struct RotatorRequest {
     struct {
       char presetIdx;
     } CamPTZPreset;
-  } payload;
+    struct {
+      int direction;  // RotatorMoveDirection bits
+      int speed;      // 1 (slowest) .. 100 (fastest)
+    } Move;
+    struct {
+      int pan;        // signed Pelco-D speed steps, -0x3F..0x3F; + is right
+      int tilt;       // + is up
+    } CamPTZSpeed;
+    struct {
+      double azi;     // a position the rotator will be sent to; sinks with
+      double ele;     // device presets keep one for it, others ignore it
+    } PresetHint;
+  } payload = {};  // requests are copied whole, whatever cmd uses of it
+
+  // when the caller stops waiting (max(): never), or earlier if it cancels;
+  // set by ResponseLatch / RequestSync, carried along by the stages
+  Clock::TimePoint deadline = Clock::TimePoint::max();
+  CancelToken cancel;
+
+  bool Expired(Clock::TimePoint now) const {
+    return now >= deadline || (cancel && cancel->load());
+  }
+  // position changes and queries nobody waits for are dropped before they
+  // reach the device; stop, park, moves and resets always go out
+  bool Droppable() const {
+    return cmd == CHANGE_AZI || cmd == CHANGE_ELE || cmd == GET_AZI || cmd == GET_ELE;
+  }
 };
 
 struct RotatorResponse {
@@ -196,6 +340,88 @@ struct RotatorResponse {
   } payload;
 };
 
+using RotatorCallback = std::function<void(RotatorResponse)>;
+
+// asynchronous request entry, same contract as RotatorController::Request:
+// returns false if the request could not be submitted (callback is not called)
+using RotatorRequestHandler = std::function<bool(RotatorRequest, RotatorCallback)>;
+
+// Collects the responses of several requests submitted through an async handler.
+// The state is shared with the callbacks, so a response arriving after Wait()
+// timed out is simply dropped. The requests carry the latch's deadline and
+// cancel token; a Wait() that times out cancels whatever is still queued.
+class ResponseLatch {
+  struct State {
+    Clock *clock;
+    std::mutex mutex;
+    std::condition_variable event;
+    std::vector<std::optional<RotatorResponse>> responses;
+    size_t remaining;
+  };
+  std::shared_ptr<State> state;
+  Clock::TimePoint deadline = Clock::TimePoint::max();
+  CancelToken cancel = std::make_shared<std::atomic<bool>>(false);
+
+public:
+  // timeout in milliseconds from now, for Wait() and the requests; 0 for none
+  explicit ResponseLatch(size_t count, Clock *clock = Clock::Steady(), int timeout_msec = 0)
+    : state(std::make_shared<State>()) {
+    state->clock = clock;
+    state->responses.resize(count);
+    state->remaining = count;
+    if (timeout_msec > 0) {
+      deadline = clock->Now() + std::chrono::milliseconds(timeout_msec);
+    }
+  }
+
+  bool Submit(const RotatorRequestHandler &handler, RotatorRequest req, size_t idx) {
+    std::shared_ptr<State> st = state;
+    req.deadline = (std::min)(req.deadline, deadline);
+    req.cancel = cancel;
+    bool ret = handler(req, [st, idx](RotatorResponse resp) {
+      std::lock_guard<std::mutex> lk(st->mutex);
+      if (!st->responses[idx].has_value()) {
+        st->responses[idx] = resp;
+        st->remaining--;
+      }
+      st->clock->Notify(st->event);
+    });
+
+    if (!ret) {
+      // never going to be answered
+      RotatorResponse resp;
+      resp.success = false;
+      std::lock_guard<std::mutex> lk(st->mutex);
+      st->responses[idx] = resp;
+      st->remaining--;
+    }
+    return ret;
+  }
+
+  // timeout in milliseconds; 0 for the latch's deadline, if any. True if
+  // every response arrived.
+  bool Wait(int timeout_msec = 0) {
+    std::unique_lock<std::mutex> lk(state->mutex);
+    auto done = [this] { return state->remaining == 0; };
+    Clock::TimePoint until = timeout_msec == 0
+      ? deadline : state->clock->Now() + std::chrono::milliseconds(timeout_msec);
+    if (state->clock->WaitUntil(lk, state->event, until, done)) {
+      return true;
+    }
+    // the rest may still sit in a queue; nobody needs them any more
+    cancel->store(true);
+    return false;
+  }
+
+  std::optional<RotatorResponse> Get(size_t idx) {
+    std::lock_guard<std::mutex> lk(state->mutex);
+    return state->responses[idx];
+  }
+};
+
+class TraceRecorder;
+class IoReactor;
+
 class RotatorController {
 public:
   enum RotatorStatus {
@@ -203,47 +429,65 @@ public:
     ROTATING
   };
 
+  virtual ~RotatorController() = default;
+
   virtual void Start() = 0;
   virtual void Terminate() = 0;
 
   virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) = 0;
 
-  // synchronized version; timeout in milliseconds; 0 for unlimited
+  // optional: record device traffic
+  virtual void SetTraceRecorder(TraceRecorder *) {}
+
+  // time source of every timer and timeout; before Start()
+  virtual void SetClock(Clock *clock) { this->clock = clock; }
+
+  // optional: real-time mode for the threads that send to the device;
+  // before Start()
+  virtual void SetRealTime(const RealTimeParams &) {}
+
+  // synchronized version; timeout in milliseconds; 0 for unlimited. On a
+  // timeout the request is cancelled, and its late response goes to the
+  // latch's shared state rather than this stack frame.
   inline std::optional<RotatorResponse> RequestSync(
     RotatorRequest req,
     int timeout_msec = 0
   ) {
-    std::optional<RotatorResponse> respTemp;
-    std::mutex cv_m;
-    std::condition_variable cv;
-    std::unique_lock<std::mutex> lk(cv_m);  // locks the lock
-
-    bool ret = this->Request(req, [&](RotatorResponse resp) {
-      respTemp = resp;
-      cv.notify_all();
-    });
+    ResponseLatch latch(1, clock, timeout_msec);
+    bool ret = latch.Submit([this](RotatorRequest req, RotatorCallback callback) {
+      return this->Request(req, callback);
+    }, req, 0);
 
     // failed to submit
     if (!ret) {
-      return respTemp;
+      return {};
     }
 
-    // atomically unlock and wait; lock when cv is signaled
-    if (timeout_msec == 0) {
-      cv.wait(lk);
-    } else {
-      cv.wait_for(lk, std::chrono::milliseconds(timeout_msec));  
-    }
-    
-    return respTemp;
+    latch.Wait();
+    return latch.Get(0);
   }
+
+protected:
+  Clock *clock = Clock::Steady();
 };
 
 class PseudoRotator {
 public:
+  virtual ~PseudoRotator() = default;
+
   virtual void Start() = 0;
   virtual void Terminate() = 0;
   virtual void WaitForClose() = 0;
 
-  virtual bool SetRequestHandler(std::function<RotatorResponse(RotatorRequest)> callback) = 0;
+  virtual bool SetRequestHandler(RotatorRequestHandler callback) = 0;
+
+  // optional: record inbound commands
+  virtual void SetTraceRecorder(TraceRecorder *) {}
+
+  // time source of request timeouts and sharing windows; before Start()
+  virtual void SetClock(Clock *) {}
+
+  // optional: serve sockets from a reactor shared with other sources, which
+  // runs until they are terminated; before Start()
+  virtual void SetReactor(IoReactor *) {}
 };
\ No newline at end of file
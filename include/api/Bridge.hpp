@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+// In-process bridge for programs that link librbridge: one pipeline (see
+// Pipeline for its config lines), driven by calls instead of a rotctld
+// connection. Sources are optional; a configured rotctld source keeps serving
+// other clients next to the embedding program.
+//
+// This is the stable C++ API: the header includes nothing of the tree, and
+// the state sits behind a pointer, so the class layout does not change with
+// the internals. rbridge.h is the same API for C. Pipeline, CamPTZ and the
+// other headers are usable as well, but follow the tree.
+//
+// Angles are in degrees, before the pipeline's stages: elevation 0 is the
+// horizon, 90 the zenith. Calls are thread safe. The synchronous ones wait
+// for the device up to the timeout; the asynchronous ones call done from a
+// pipeline thread, which must not block in it.
+class Bridge {
+public:
+  enum Result {
+    OK = 0,
+    NOT_RUNNING = -1,  // not started, or stopped
+    TIMEOUT = -2,
+    FAILED = -3,       // refused by the pipeline or the device
+    BAD_CONFIG = -4
+  };
+
+  // same bits as hamlib's ROT_MOVE_*
+  enum Direction {
+    UP = 2,
+    DOWN = 4,
+    CCW = 8,
+    CW = 16
+  };
+
+  // bumped when an existing call changes; new calls do not bump it
+  static const int ApiVersion = 1;
+
+  using Done = std::function<void(Result)>;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+public:
+  Bridge();
+  ~Bridge();
+  Bridge(const Bridge &) = delete;
+  Bridge &operator=(const Bridge &) = delete;
+
+  // before Start()
+  Result LoadConfig(const std::string &path);
+  Result AddConfigLine(const std::string &line);
+  // of each synchronous call (ms), 1000 by default
+  void SetTimeout(int msec);
+  // positions younger than this (ms) are served without a device query;
+  // concurrent polls always share one query
+  void SetQueryShare(int msec);
+
+  Result Start();
+  void Stop();
+  bool Running() const;
+
+  Result SetPosition(double azi, double ele);
+  Result GetPosition(double &azi, double &ele);
+  Result StopMotion();
+  Result Park();
+  // direction: Direction bits; speed 1 (slowest) .. 100 (fastest)
+  Result Move(int direction, int speed);
+
+  // queued behind the pending requests; done (may be empty) gets the outcome
+  Result SetPositionAsync(double azi, double ele, Done done);
+};
@@ -0,0 +1,60 @@
+#ifndef RBRIDGE_H
+#define RBRIDGE_H
+
+/*
+ * C ABI of librbridge: a thin wrapper of Bridge (api/Bridge.hpp), which
+ * documents the behaviour. Functions return RBRIDGE_OK or one of the
+ * negative RBRIDGE_E* codes and never throw. A handle may be used from
+ * several threads, except rbridge_destroy().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RBRIDGE_API_VERSION 1
+
+#define RBRIDGE_OK 0
+#define RBRIDGE_ENOTRUNNING -1
+#define RBRIDGE_ETIMEOUT -2
+#define RBRIDGE_EFAILED -3
+#define RBRIDGE_ECONFIG -4
+
+#define RBRIDGE_MOVE_UP 2
+#define RBRIDGE_MOVE_DOWN 4
+#define RBRIDGE_MOVE_CCW 8
+#define RBRIDGE_MOVE_CW 16
+
+typedef struct rbridge rbridge;
+
+/* called from a pipeline thread with the outcome; must not block */
+typedef void (*rbridge_done)(void *context, int result);
+
+/* of the library linked at run time, to compare with RBRIDGE_API_VERSION */
+int rbridge_api_version(void);
+
+rbridge *rbridge_create(void);
+void rbridge_destroy(rbridge *bridge);
+
+int rbridge_load_config(rbridge *bridge, const char *path);
+int rbridge_config_line(rbridge *bridge, const char *line);
+void rbridge_set_timeout(rbridge *bridge, int msec);
+void rbridge_set_query_share(rbridge *bridge, int msec);
+
+int rbridge_start(rbridge *bridge);
+void rbridge_stop(rbridge *bridge);
+
+int rbridge_set_position(rbridge *bridge, double azi, double ele);
+int rbridge_get_position(rbridge *bridge, double *azi, double *ele);
+int rbridge_stop_motion(rbridge *bridge);
+int rbridge_park(rbridge *bridge);
+int rbridge_move(rbridge *bridge, int direction, int speed);
+
+/* done may be NULL */
+int rbridge_set_position_async(rbridge *bridge, double azi, double ele, rbridge_done done, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "pipeline/Pipeline.hpp"
+
+// Position-dependent pointing corrections (mount tilt, non-orthogonality,
+// backlash), measured on a grid of azimuth / elevation nodes:
+//   device = true + correction(true)
+//
+// Grid file, one node per line ('#' starts a comment), every combination of
+// the azimuth and elevation values present must be given:
+//   <azi> <ele> <dazi> <dele>
+// Azimuth is periodic over 360; outside the elevation nodes the nearest row
+// applies.
+//
+// On load the grid is resampled (bilinear or Catmull-Rom spline) into a flat
+// table of `tableRes` degree cells, so a lookup is an index computation and
+// a bilinear blend of four neighbouring entries.
+class CalibrationGrid {
+public:
+  enum Interpolation {
+    INTERP_BILINEAR,
+    INTERP_SPLINE
+  };
+
+  struct Node {
+    double azi, ele;
+    double dAzi, dEle;
+  };
+
+private:
+  struct Cell {
+    float dAzi, dEle;
+  };
+
+  std::vector<Cell> table;  // row-major: ele rows of aziCells
+  int aziCells = 0, eleCells = 0;
+  double tableRes = 0.5;
+  double eleMin = 0;
+
+public:
+  bool Load(std::string path, Interpolation interp, double tableRes);
+  bool Build(const std::vector<Node> &nodes, Interpolation interp, double tableRes);
+  static bool Save(std::string path, const std::vector<Node> &nodes);
+  bool Loaded() const { return !table.empty(); }
+
+  void Correction(double azi, double ele, double &dAzi, double &dEle) const;
+
+  // true -> device
+  void Forward(double azi, double ele, double &deviceAzi, double &deviceEle) const;
+  // device -> true, by fixed-point iteration
+  void Inverse(double deviceAzi, double deviceEle, double &azi, double &ele) const;
+};
+
+// applies a CalibrationGrid on the command path and inverts it on GET_*
+// replies; the axis not being changed is taken from the latest target
+class CalibrationStage : public PipelineStage {
+private:
+  CalibrationGrid grid;
+
+  std::mutex stateMutex;
+  double targetAzi = 0, targetEle = 0;
+
+public:
+  explicit CalibrationStage(CalibrationGrid grid);
+
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
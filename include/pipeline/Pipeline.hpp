@@ -0,0 +1,163 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+#include <istream>
+#include <map>
+
+// key=value parameters of one pipeline config line
+class PipelineParams {
+private:
+  std::map<std::string, std::string> values;
+
+public:
+  // the rest of a config line: key=value tokens, a bare key is key=1
+  void Parse(std::istream &tokens);
+  void Set(std::string key, std::string value) { values[key] = value; }
+  bool Has(std::string key) const { return values.count(key) > 0; }
+
+  std::string GetString(std::string key, std::string defaultValue) const;
+  int GetInt(std::string key, int defaultValue) const;
+  double GetDouble(std::string key, double defaultValue) const;
+  bool GetBool(std::string key, bool defaultValue) const;
+};
+
+// A transform between the sources and the sink. A stage is itself a
+// RotatorController: it gets requests from upstream, and forwards (possibly
+// modified, merged or dropped) requests to its downstream.
+class PipelineStage : public RotatorController {
+protected:
+  RotatorController *downstream = nullptr;
+
+public:
+  void SetDownstream(RotatorController *downstream) { this->downstream = downstream; }
+
+  virtual void Start() override {}
+  virtual void Terminate() override {}
+};
+
+// sources -> ingress queue -> stage -> ... -> stage -> sink
+//
+// Sources submit requests asynchronously into a lock-free ingress queue; a
+// dispatcher thread runs them through the stages into the sink. Responses
+// travel back through the callbacks, so no source thread is parked per
+// in-flight request on the way down. Requests carry the deadline and cancel
+// token of their caller; position changes and queries past them are answered
+// as failed instead of being run, here and in the sinks' queues.
+//
+// Only the ingress is a queue: the dispatcher calls the stages and the sink
+// directly, so a request reaches the device without another thread hop.
+// A stage that holds requests back keeps them itself (coalesce's pending
+// target, trajectory's tick thread), and the sinks queue per device.
+//
+// Config file, one element per line ('#' starts a comment):
+//   source rotctld host=0.0.0.0 port=4533 gpredict-workaround=1 share-window=100
+//                  arbitration=none|owner|priority|lww hold-off=2000 owner-idle=0
+//                  priorities=10.0.0.2:10,10.0.0.3:5
+//   source gs232 transport=pty link=/tmp/ttyGS232 variant=a|b
+//   source easycomm transport=tcp port=4534
+//   source rotctld transport=unix link=/tmp/rbridge.sock
+//   source rotctld transport=udp port=4540
+// Every stream source takes transport=tcp|pty|unix|udp, host, port, link
+// (pty symlink or Unix socket path) and the share-window / arbitration
+// options shown for rotctld; Unix socket clients have the priority of
+// "unix". hold-off (ms) is for priority and lww; an owner keeps the rotator
+// until it disconnects, or until it has not moved it for owner-idle (ms) if
+// that is not 0. On udp, rotctld acknowledges set_pos without waiting for the
+// device and only the newest target is kept while one is in flight.
+//   source shm name=/rbridge sample=100 poll=1000
+//   stage offset azi=-9 ele=0
+//   stage limit azi-min=0 azi-max=360 ele-min=0 ele-max=90
+//   stage filter alpha=0.5 reset=10
+//   stage coalesce
+//   stage trajectory azi-speed=20 azi-accel=10 azi-device-speed=20 ele-speed=10 ele-accel=5
+//                    ele-device-speed=10 restart-delay=0.3 tolerance=1 slew=10 tick=50
+//   stage wrap azi-min=0 azi-max=450 flip=0 azi-speed=20 ele-speed=10 plan=/path/passes.txt
+//              lead=60 pass-gap=120 preset-ahead=3600
+//   stage backlash azi-backlash=0.3 azi-deadband=0.05 ele-backlash=0.2 ele-deadband=0.05
+//                  resolution=0.01 azi-min=0 azi-max=360 ele-min=0 ele-max=90
+//   stage calibration grid=/path/grid.txt interp=bilinear|spline table-res=0.5
+//   stage telemetry name=/rbridge
+//   sink camptz host=192.168.3.136 port=4196 smart-sink=1 keepalive=1 preset-reset=1
+//               park-azi=0 park-ele=0
+//               track-tolerance=0.5 track-slew=5 track-hold=0 track-max-hold=5
+//               track-stall-speed=0.5 track-stall-time=1.5
+//               drive=position|velocity vel-pan-speed=20 vel-tilt-speed=10 vel-kp=0.8
+//               vel-ki=0.1 vel-slew=5 vel-tolerance=0.2 vel-sample=2
+//               io-timeout=1000 watchdog=5 breaker-failures=3 breaker-open=1 breaker-max-open=30
+//               presets=8 preset-first=20 preset-positions=180:0,90:45 preset-tolerance=1
+//               preset-speed=40 preset-min-saving=1 preset-idle=30
+//   sink camptz transport=serial device=/dev/ttyUSB0 baud=2400 frame-gap=0
+//   sink camptz transport=sim sim-pan-speed=20 sim-tilt-speed=10 sim-restart-delay=0.3
+//   sink rotctld host=127.0.0.1 port=4533 suppress=1000 subscribe=500 io-timeout=1000
+// Stages are chained in file order. A fanout sink takes its members from the
+// following `member` lines:
+//   sink fanout policy=all|quorum|first quorum=2 position=primary|fused primary=0
+//   member camptz host=192.168.3.136 port=4196
+//   member camptz host=192.168.3.137 port=4196
+class Pipeline : public RotatorController {
+private:
+  std::vector<std::unique_ptr<PseudoRotator>> sources;
+  std::vector<std::unique_ptr<PipelineStage>> stages;
+  std::unique_ptr<RotatorController> sink;
+
+  std::string logName = "Pipeline";
+  bool sourcesEnabled = true;
+  bool sourcesStarted = false;
+  TraceRecorder *trace = nullptr;
+  uint16_t traceChannel = 0;
+  IoReactor *reactor = nullptr;
+  RealTimeParams realTime;  // dispatcher, and handed to the sink
+
+  using pipelineJob = std::pair<RotatorRequest, RotatorCallback>;
+  LockFreeQueue<pipelineJob> ingress;
+  std::atomic<size_t> ingressPending{0};
+  std::atomic<uint64_t> expiredRequests{0};
+  std::atomic<uint64_t> dispatchedRequests{0};
+
+  // dispatcher parking; only touched when the queue runs empty
+  std::mutex dispatcherMutex;
+  std::condition_variable dispatcherEvent;
+  std::atomic<bool> dispatcherSleeping{false};
+  std::atomic<bool> threadClosing{false};
+  std::thread dispatcher;
+
+  RotatorController *head();
+  static void threadMain(Pipeline *self);
+
+public:
+  Pipeline();
+  virtual ~Pipeline();
+
+  bool LoadConfig(std::string path);
+  bool AddConfigLine(std::string line);
+  // a sink, and members for a fanout one; path names the config in errors
+  bool Validate(std::string path) const;
+
+  void AddSource(std::unique_ptr<PseudoRotator> source);
+  void AddStage(std::unique_ptr<PipelineStage> stage);
+  void SetSink(std::unique_ptr<RotatorController> sink);
+  RotatorController *Sink() { return sink.get(); }
+
+  // e.g. for replaying a trace straight into the stages and sink
+  void SetSourcesEnabled(bool sourcesEnabled);
+  // one of several in a process (PipelineHost): named in the log, sink
+  // requests traced on their own channel, sources served by a shared reactor
+  void SetName(std::string name);
+  void SetTraceChannel(uint16_t channel) { traceChannel = channel; }
+  void SetReactor(IoReactor *reactor);
+
+  virtual void Start() override;
+  virtual void Terminate() override;
+  void WaitForClose();
+
+  // ingress; called by the sources
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+  virtual void SetTraceRecorder(TraceRecorder *trace) override;
+  // the dispatcher and the sink's device threads; the dispatcher then skips
+  // its per-request log lines, which would put stdout on the hot path
+  virtual void SetRealTime(const RealTimeParams &params) override;
+
+  uint64_t DispatchedRequests() const { return dispatchedRequests.load(); }
+  uint64_t ExpiredRequests() const { return expiredRequests.load(); }
+  size_t PendingRequests() const { return ingressPending.load(); }
+};
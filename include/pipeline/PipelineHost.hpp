@@ -0,0 +1,95 @@
+#pragma once
+
+#include "pipeline/Pipeline.hpp"
+#include "transport/Reactor.hpp"
+
+// Many independent pipelines (typically one per rotator) in one process.
+//
+// Pipelines are dealt round-robin onto shards, one per allowed CPU core
+// unless configured. A shard is one reactor thread serving the TCP sockets
+// of its pipelines' sources (epoll / uring backend; with the blocking
+// backend the sources keep their thread per client). Every thread a pipeline
+// starts inherits its shard's core and a thread name of its own ("rb<n>:<name>"),
+// which is how CPU time per pipeline is told apart. Each pipeline keeps its
+// own dispatcher, sink threads and source workers, and the reactor thread
+// never blocks, so a device that stops answering holds up only its own
+// pipeline. Sink requests of pipeline n (1-based, in config order) are
+// traced on channel n of the shared trace.
+//
+// Config file: host-wide settings, then one section per pipeline, made of
+// the usual pipeline config lines (see Pipeline) and/or a file of them:
+//   host shards=4 pin=1 stats=60 lock-memory=0
+//   pipeline north realtime=50
+//   source rotctld port=4533
+//   sink camptz host=192.168.3.136
+//   pipeline south shard=1 config=/etc/rbridge/south.conf
+// shards=0 is one per core, pin=0 leaves the scheduler to place the
+// threads, stats=<s> logs the per-pipeline stats periodically (0: only at
+// exit). realtime=<priority> runs the pipeline's dispatcher and device
+// threads SCHED_FIFO on its shard's core; lock-memory=1 locks the process's
+// memory for all of them (see RealTime).
+class PipelineHost {
+public:
+  struct PipelineStats {
+    std::string name;
+    int shard;
+    uint64_t dispatched;
+    uint64_t expired;
+    size_t pending;
+    int threads;
+    double cpu;  // (s) user + system, of the threads alive now
+  };
+
+private:
+  struct Shard {
+    int cpu = -1;  // pinned to; -1: not pinned
+    std::unique_ptr<IoReactor> reactor;
+    std::thread thread;
+  };
+
+  struct Member {
+    std::string name;
+    int shard = -1;  // -1: round-robin
+    int realTimePriority = 0;
+    std::string threadName;
+    std::unique_ptr<Pipeline> pipeline;
+  };
+
+  int shardCount = 0;
+  bool pin = true;
+  int statsInterval = 0;  // (s)
+  bool lockMemory = false;
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::vector<Member> members;  // the last one takes the section's lines
+  TraceRecorder *trace = nullptr;
+  bool started = false;
+
+  std::mutex statsMutex;
+  std::condition_variable statsEvent;
+  bool statsClosing = false;
+  std::thread statsThread;
+
+  bool has(const std::string &name) const;
+  void startShards();
+  void startPipeline(Member &member);
+  void statsMain();
+
+public:
+  ~PipelineHost();
+
+  bool LoadConfig(std::string path);
+  bool AddConfigLine(std::string line);
+  // every pipeline complete; path names the config in errors
+  bool Validate(std::string path) const;
+
+  void SetTraceRecorder(TraceRecorder *trace);
+
+  void Start();
+  void WaitForClose();
+  void Terminate();
+
+  size_t Size() const { return members.size(); }
+  std::vector<PipelineStats> Stats() const;
+  void PrintStats() const;
+};
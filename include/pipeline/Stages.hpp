@@ -0,0 +1,131 @@
+#pragma once
+
+#include "pipeline/Pipeline.hpp"
+#include <cmath>
+
+// wraps azimuth into [0, 360)
+inline double wrapAzimuth(double azi) {
+  azi = std::fmod(azi, 360.0);
+  if (azi < 0) {
+    azi += 360;
+  }
+  return azi;
+}
+
+// shortest signed azimuth difference, in (-180, 180]
+inline double azimuthDelta(double from, double to) {
+  double delta = wrapAzimuth(to - from);
+  if (delta > 180) {
+    delta -= 360;
+  }
+  return delta;
+}
+
+// constant azimuth / elevation offset; removed again from GET_* replies
+class OffsetStage : public PipelineStage {
+private:
+  double aziOffset;
+  double eleOffset;
+
+public:
+  OffsetStage(double aziOffset, double eleOffset);
+
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
+
+// clamps position changes into the mechanical range
+class LimitStage : public PipelineStage {
+private:
+  double aziMin, aziMax;
+  double eleMin, eleMax;
+
+public:
+  LimitStage(double aziMin, double aziMax, double eleMin, double eleMax);
+
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
+
+// exponential smoothing of the target stream; jumps larger than
+// resetThreshold (deg) are passed through unfiltered
+class FilterStage : public PipelineStage {
+private:
+  double alpha;
+  double resetThreshold;
+
+  std::mutex stateMutex;
+  bool aziValid = false, eleValid = false;
+  double aziState = 0, eleState = 0;
+
+public:
+  FilterStage(double alpha, double resetThreshold);
+
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
+
+// keeps at most one position change per axis in flight downstream; newer
+// targets replace the queued one (latest wins), which is answered as done
+class CoalesceStage : public PipelineStage {
+private:
+  struct AxisState {
+    bool inFlight = false;
+    std::optional<std::pair<RotatorRequest, RotatorCallback>> pending;
+  };
+
+  std::mutex stateMutex;
+  AxisState axes[2];
+
+  bool forward(int axis, RotatorRequest req, RotatorCallback callback);
+
+public:
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
+
+// Backlash / deadband compensation, in front of the sink. Per axis:
+// - targets are rounded to the device resolution (0.01 deg in Pelco frames)
+//   and a move closer than `deadband` to the last one sent is answered
+//   without a device command;
+// - the command overshoots by half the backlash in the direction of
+//   approach, so the load (not the motor) ends up on target whichever side
+//   it came from; GET_* replies are corrected back.
+// Direction is the sign of the raw difference to the last target, i.e.
+// mechanical azimuth as the sink sees it (put `wrap` before this stage, and
+// give this one wrap's range, so targets past 360 are compensated too).
+class BacklashStage : public PipelineStage {
+public:
+  struct AxisParams {
+    double backlash = 0;     // (deg) total play of the gear train
+    double deadband = 0.01;  // (deg) smaller moves are suppressed
+    double min = 0, max = 360;  // (deg) range of the axis; compensation stays inside
+
+    // the elevation axis: horizon to zenith
+    static AxisParams Elevation() {
+      AxisParams params;
+      params.max = 90;
+      return params;
+    }
+  };
+
+private:
+  struct AxisState {
+    bool valid = false;
+    double target = 0;  // last target sent, before compensation
+    int direction = 0;  // of the last move, -1 / 0 / +1
+  };
+
+  AxisParams params[2];
+  double resolution;
+
+  std::mutex stateMutex;
+  AxisState axes[2];
+
+  std::atomic<uint64_t> forwarded{0}, suppressed{0};
+
+  double compensate(int axis, double target, bool &suppress);
+  double correction(int axis);
+
+public:
+  BacklashStage(AxisParams azi, AxisParams ele, double resolution);
+
+  virtual void Terminate() override;
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "pipeline/Pipeline.hpp"
+#include "transport/ShmChannel.hpp"
+
+// Publishes what flows through it into the telemetry of a shared-memory
+// channel (ShmChannel), whichever source it came from: position changes as
+// the target, GET_* replies as the position, failed requests as a fault.
+// Requests pass on unchanged. Put it first to publish the sources' frame of
+// reference (the one ShmSource commands are in), last for the device's.
+class TelemetryStage : public PipelineStage {
+private:
+  std::string channelName;
+  std::shared_ptr<ShmChannel> channel;
+
+  // the axes are answered separately; a position goes out once both were seen
+  std::mutex positionMutex;
+  bool aziValid = false, eleValid = false;
+  double azi = 0, ele = 0;
+
+  void publishReply(ShmChannel *published, int axis, const RotatorResponse &resp);
+
+public:
+  explicit TelemetryStage(std::string channelName);
+
+  virtual void Start() override;
+  virtual void Terminate() override;
+
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
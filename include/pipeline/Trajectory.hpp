@@ -0,0 +1,85 @@
+#pragma once
+
+#include "pipeline/Pipeline.hpp"
+
+// Slew-rate-aware trajectory planner, for heads that stop and restart their
+// motor on every position command (3025).
+//
+// Targets from the sources are not forwarded one by one. Per axis the stage
+// keeps
+// - the target stream, extrapolated with its estimated velocity
+// - a reference trajectory following it within maxSpeed / maxAccel
+// - a model of the device: restartDelay after each command, then deviceSpeed
+// A tick thread issues a waypoint when the reference has passed the last one
+// (or moved away from it by more than `tolerance` while the device is idle).
+// The waypoint leads the reference by the restart delay plus `tolerance`, so
+// the head gets ahead and waits instead of chasing: the pointing error stays
+// within about +-tolerance at one restart per 2 * tolerance of travel.
+// Jumps larger than slewThreshold are commanded straight to the predicted
+// arrival point.
+//
+// Position changes are answered as soon as they are taken; GET_* and other
+// commands pass through, and STOP / MOVE / PARK / RESET / presets suspend
+// planning until the next position change.
+class TrajectoryStage : public PipelineStage {
+public:
+  struct AxisLimits {
+    double maxSpeed;     // (deg/s) of the reference
+    double maxAccel;     // (deg/s^2) of the reference
+    double deviceSpeed;  // (deg/s) slew speed of the device
+  };
+
+private:
+  using timePoint = Clock::TimePoint;
+
+  struct Axis {
+    AxisLimits limits;
+    bool wraps = false;  // azimuth: unwrapped internally, wrapped downstream
+
+    bool active = false;
+    bool seeded = false;  // device position known
+    timePoint activatedAt;
+
+    // target stream (unwrapped)
+    double target = 0, targetVel = 0;
+    timePoint targetAt;
+
+    // reference trajectory
+    double ref = 0, refVel = 0;
+
+    // device model
+    bool commanded = false;
+    double cmdPos = 0, modelPos = 0;
+    timePoint cmdAt;
+  };
+
+  Axis axes[2];  // 0: azimuth, 1: elevation
+  double restartDelay;
+  double tolerance;
+  double slewThreshold;
+  int tickInterval;  // (ms)
+  const double maxExtrapolation = 10.0;  // (s)
+  const double seedTimeout = 1.0;  // (s)
+
+  std::mutex stateMutex;
+  std::condition_variable tickEvent;
+  bool threadClosing = false;
+  std::thread ticker;
+
+  std::atomic<uint64_t> targetsTaken{0}, waypointsIssued{0};
+
+  static void threadMain(TrajectoryStage *self);
+  void onTarget(int axisIdx, double value, timePoint now);
+  void seed(int axisIdx);
+  // returns the waypoint to issue, if any
+  std::optional<double> advanceAxis(Axis &axis, double dt, timePoint now);
+  void issue(int axisIdx, double waypoint);
+
+public:
+  TrajectoryStage(AxisLimits aziLimits, AxisLimits eleLimits,
+                  double restartDelay, double tolerance, double slewThreshold, int tickInterval);
+
+  virtual void Start() override;
+  virtual void Terminate() override;
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
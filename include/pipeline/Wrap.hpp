@@ -0,0 +1,98 @@
+#pragma once
+
+#include "pipeline/Pipeline.hpp"
+
+// one sample of an upcoming pass, geographic
+struct PassPlanPoint {
+  double time;  // (s) unix time
+  double azi;
+  double ele;
+};
+
+// Cable-wrap / azimuth unwinding planner.
+//
+// Maps geographic targets onto the mechanical azimuth range of the head
+// [aziMin, aziMax] (e.g. 0..360 for the 3025, 0..450 for a G-5500), keeping
+// track of where the head actually is instead of wrapping into [0, 360):
+// every target has the candidates azi + k * 360 inside the range and, with
+// flip mode on capable hardware, (azi + 180 + k * 360, 180 - ele). Without
+// a plan the candidate reachable soonest from the current pose is taken.
+//
+// With a pass plan (file of `unix-time azi ele` lines, reloaded when it
+// changes, or SetPlan()) each pass is solved as a whole before it starts:
+// the sequence of candidates with the least motion that the head cannot
+// follow in time, so a north crossing or a zenith pass is taken on the side
+// (or flipped) where no unwind is needed mid-pass. The head is pre-positioned
+// to the start pose `lead` seconds before the pass. Passes starting within
+// presetAhead seconds are announced downstream (ROTATOR_PRESET_HINT) with
+// their start pose as solved from anywhere, so a sink with device presets can
+// have one ready for the pre-positioning.
+//
+// GET_* replies are mapped back to geographic azimuth / elevation.
+class WrapStage : public PipelineStage {
+public:
+  struct Params {
+    double aziMin = 0, aziMax = 360;  // mechanical range, at least 360 wide
+    bool flip = false;                // elevation up to 180 on the far side
+    double aziSpeed = 20, eleSpeed = 10;  // (deg/s) for travel times
+    std::string planPath;
+    double lead = 60;                 // (s) pre-positioning before a pass
+    double passGap = 120;             // (s) plan samples further apart start a new pass
+    double presetAhead = 3600;        // (s) pass starts hinted this far ahead, 0: none
+  };
+
+private:
+  struct Pose {
+    bool flipped = false;
+    double azi = 0;  // mechanical
+    double ele = 0;  // mechanical, > 90 when flipped
+  };
+
+  struct PlannedPass {
+    size_t first, last;  // plan samples [first, last]
+    std::vector<Pose> poses;
+    bool prepositioned = false;
+    bool hinted = false;
+  };
+
+  Params params;
+
+  std::mutex stateMutex;
+  std::vector<PassPlanPoint> plan;
+  std::vector<PlannedPass> passes;
+  bool poseValid = false;
+  Pose current;
+  double targetAzi = 0, targetEle = 0;
+
+  std::condition_variable tickEvent;
+  bool threadClosing = false;
+  std::thread ticker;
+  time_t planMtime = 0;
+
+  std::atomic<uint64_t> unwinds{0}, flips{0};
+
+  static void threadMain(WrapStage *self);
+  void reloadPlan();
+  void refreshPose();  // device position, before solving a pass from an unknown pose
+  void solvePasses();
+  // least excess motion through the pass, from `from` (nullptr: anywhere)
+  // reached untilStart seconds ahead
+  std::vector<Pose> solvePass(const PlannedPass &pass, const Pose *from, double untilStart, double &excess) const;
+  std::vector<Pose> candidates(double azi, double ele) const;
+  double travelTime(const Pose &from, const Pose &to) const;
+  Pose choose(double now);
+  const PlannedPass *activePass(double now) const;
+  // req keeps the caller's deadline and cancel token; its command and payload
+  // are replaced
+  void command(RotatorRequest req, const Pose &pose, RotatorCmd cmd, RotatorCallback callback);
+
+public:
+  explicit WrapStage(Params params);
+
+  // replaces the plan file's content
+  void SetPlan(std::vector<PassPlanPoint> plan);
+
+  virtual void Start() override;
+  virtual void Terminate() override;
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+enum AxisTrackingState {
+  AXIS_IDLE,      // at rest on the last target; nothing sampled
+  AXIS_SLEWING,   // large move underway; small retargets are held until arrival
+  AXIS_TRACKING,  // following a moving target in small steps
+  AXIS_SETTLED,   // arrived; IDLE after settleTime without new targets
+  AXIS_FAULT      // no progress after maxReplays; retried after faultRetry
+};
+
+const char *AxisTrackingStateName(AxisTrackingState state);
+
+// Per-axis send / suppress / replay policy for heads that restart their motor
+// on every position command (what CamPTZ's smartSink does).
+//
+// Pure logic without threads or clocks: the owner feeds targets, sampled
+// positions and ticks with its own notion of time (seconds, any epoch), so the
+// same machine runs against the device and in simulated time.
+//
+//   IDLE/SETTLED --target--> TRACKING (small step) / SLEWING (> slewThreshold);
+//                            steps below holdThreshold are held up to maxHold
+//   SLEWING --position within tolerance--> SETTLED, held target sent -> TRACKING
+//   SLEWING/TRACKING --no motion for stallTime--> replay, maxReplays -> FAULT
+//   SETTLED --settleTime--> IDLE
+//   FAULT --target or faultRetry--> SLEWING
+class AxisTracker {
+public:
+  struct Params {
+    bool periodic = false;       // azimuth: deltas modulo 360
+    double tolerance = 0.5;      // (deg) arrived when this close to the command
+    double slewThreshold = 5;    // (deg) larger steps are slews
+    double holdThreshold = 0;    // (deg) smaller changes are held (up to maxHold) outside slews
+    double maxHold = 5;          // (s) a held target goes out after this at the latest
+    double stallSpeed = 0.5;     // (deg/s) slower than this counts as stopped
+    double stallTime = 1.5;      // (s) stopped short of the command for this long -> replay
+    int maxReplays = 3;
+    double settleTime = 2;       // (s)
+    double faultRetry = 5;       // (s)
+  };
+
+  enum Action {
+    SEND,
+    SUPPRESS
+  };
+
+  struct Stats {
+    uint64_t sent = 0;
+    uint64_t suppressed = 0;
+    uint64_t replayed = 0;
+    uint64_t faults = 0;
+  };
+
+private:
+  Params params;
+  AxisTrackingState state = AXIS_IDLE;
+  Stats stats;
+
+  bool commandValid = false;
+  double commanded = 0, commandTime = 0;
+  std::optional<double> held;
+  double heldSince = 0;
+
+  bool positionValid = false;
+  double position = 0, positionTime = 0;
+  double velocity = 0;            // (deg/s) from consecutive samples
+  std::optional<double> stalledSince;
+  int replays = 0;
+  double stateSince = 0;
+
+  double delta(double from, double to) const;
+  void enter(AxisTrackingState next, double now);
+  double send(double now, double target);
+
+public:
+  AxisTracker();
+  explicit AxisTracker(Params params);
+
+  // a new target from upstream
+  Action OnTarget(double now, double target);
+  // a sampled device position
+  void OnPosition(double now, double position);
+  // a position command was rejected by the device
+  void OnCommandFailed(double now);
+  // timers; a value is a target to (re)send now
+  std::optional<double> OnTick(double now);
+
+  // whether the owner should be sampling positions
+  bool NeedsSampling() const;
+  AxisTrackingState State() const { return state; }
+  double Velocity() const { return velocity; }
+  const Stats &GetStats() const { return stats; }
+};
@@ -1,6 +1,12 @@
 #pragma once
 
 #include "RotatorCommon.hpp"
+#include "rotators/AxisTracker.hpp"
+#include "rotators/CircuitBreaker.hpp"
+#include "rotators/PresetBank.hpp"
+#include "rotators/VelocityTracker.hpp"
+#include "transport/DeviceTransport.hpp"
+#include <memory>
 
 class CamPTZ : public RotatorController {
 private:
@@ -8,15 +14,13 @@ private:
   double aziOffset;  // (-360, 360), wrap
   double eleOffset;  // (-90, 90), no-wrap
 
-  std::string tcpHost;
-  int tcpPort;
-
-  int sock;
+  std::unique_ptr<DeviceTransport> transport;
   bool sockConnected = false;
-  bool threadClosing = false;
-  bool threadExited = true;
+  std::atomic<bool> threadClosing{false};
+  std::atomic<bool> threadExited{true};
 
   std::thread worker;
+  RealTimeParams realTime;  // worker and tracker thread
 
   using threadJob = std::pair<RotatorRequest, std::function<void(RotatorResponse)>>;
   ThreadsafeQueue<threadJob> jobQueue;
@@ -24,38 +28,143 @@ private:
   // signal mechanism
   std::mutex jobEventMutex;
   std::condition_variable jobEvent;
+  std::atomic<uint64_t> expiredRequests{0};  // dropped past their deadline
 
-  // smartSink: suppress subsequent (but same) pos change for a moving motor
-  // - Condition 1: Requesting for same target movement
-  // - Condition 2: Previous effective request is in 7 seconds
-  // - Condition 3: Motor is moving with >5deg/sec past 1 second
-  //   - Suppress subsequent sampling if already got one
+  // smartSink: a per-axis AxisTracker decides which position changes reach
+  // the device (suppressing repeats and retargets mid-slew, replaying
+  // commands the head stopped short of); positions are sampled every
+  // trackerInterval while an axis is active. Times are Clock::Seconds().
   bool smartSink;
-  const double changeEffectiveMargin = 7.0;  // (s)
-  const int smartSinkSamplingInterval = 1000; // (ms)
-  const double smartSinkAngularVelocityMargin = 5; // deg per sec
-  std::chrono::steady_clock::time_point lastPosChange;
-  double lastAziTargetted = 0.0, lastEleTargetted = 0.0;
-  std::atomic<bool> smartSinkSampling;
-  double smartSinkLastAzi, smartSinkLastEle;
-  double smartSinkThisAzi, smartSinkThisEle;
-  std::chrono::steady_clock::time_point smartSinkLastQuery;
-  std::atomic<bool> smartSinkTargetChanged; // 
+  const int trackerInterval = 500; // (ms)
+  std::mutex trackerMutex;
+  AxisTracker trackers[2];  // azi, ele
+  double lastAziTargetted = 0.0, lastEleTargetted = 0.0;  // latest requested, for keep-alive
+  std::thread trackerThread;
+
+  // velocity drive mode (SetVelocityParams): instead of position commands,
+  // targets feed a per-axis VelocityTracker, and the tracker thread sends
+  // speed frames (CAMPTZ_SPEED) with absolute moves for slews and settling.
+  // Azimuth is tracked in device units (offset applied, [0, 360)), where
+  // the pan end stop is. Takes the place of smartSink and keep-alive.
+  bool velocityMode = false;
+  VelocityTracker velocityTrackers[2];  // azi, ele; under trackerMutex
+  int speedSent[2] = {0, 0};            // device's speed steps as last commanded
+
+  bool presetReset = false;
+
+  double parkAzi = 0, parkEle = 0;
+
+  // preset bank (SetPresetParams): park, fixed positions and the starts of
+  // upcoming passes (ROTATOR_PRESET_HINT) get device presets, programmed
+  // when the head rests there or, after presetIdle without targets, on a
+  // visit that returns afterwards. Large moves onto them recall the preset.
+  // Worker thread only; device units, tilt signed (past the zenith < 0).
+  PresetBank presets;
+  std::vector<std::pair<double, double>> presetPositions;  // (azi, ele), pinned
+  double presetIdle = 30;          // (s) 0: no visits
+  const double presetPoll = 0.5;   // (s) position samples while recalling / visiting
+  bool headTargetValid[2] = {false, false};
+  double headTarget[2] = {0, 0};   // last sent, or where a recall takes the head
+  double headSeen[2] = {0, 0};
+  double headSeenAt[2] = {-1e9, -1e9};
+  double lastTargetAt = 0;         // (s) of the last new target or manual command
+  double presetPolledAt = 0;
+  int recalling = -1;              // bank index the head is slewing to
+  double recallTarget[2] = {0, 0};
+  double recallStarted = 0, recallTime = 0;
+  int visiting = -1;               // bank index of a programming visit
+  double visitReturn[2] = {0, 0};
+  double visitStarted = 0, visitTime = 0;
 
   bool rotatorKeepAlive;
+  std::atomic<bool> keepAliveHeld{false};  // after STOP / MOVE until the next position change
   const int keepAliveInterval = 5000; // (ms)
   std::thread keepAliveThread;
 
-  void connStart();
+  // link supervision (SetLinkParams): every device operation has a deadline
+  // (ioTimeout); an I/O error closes the link and the next job reopens it.
+  // Repeated failures open the circuit breaker: requests fail right away
+  // while the worker probes the head in the background. The watchdog fails
+  // what is queued and aborts the link when one job runs past watchdogTimeout.
+  int ioTimeout = 1000;         // (ms)
+  double watchdogTimeout = 5;   // (s)
+  const int watchdogInterval = 500; // (ms)
+  std::mutex breakerMutex;
+  CircuitBreaker breaker;
+  std::atomic<double> jobStartedAt{0};  // (s) trackerNow() when the running job began, 0: idle
+  std::atomic<uint64_t> watchdogTrips{0};
+  std::thread watchdogThread;
+
+  TraceRecorder *trace = nullptr;
+
+  bool connStart();
   void connTerminate();
+  void startHelpers();
   static void threadMain(CamPTZ *self);
 
-  bool RequestImpl(RotatorRequest req, std::function<void(RotatorResponse)> callback, bool noSmartSink);
+  // worker side of the link supervision
+  bool linkReady();
+  bool probeDevice();
+  void linkFailed();
+  void watchdogMain();
+  static void failJob(threadJob &job);
+
+  // Pelco-D frames of the worker
+  double deviceTilt(double ele);
+  bool sendPosition(int axis, double device);
+  bool sendPreset(uint8_t cmd2, int slot);
+  bool readPosition(int axis, double &device);
+
+  // worker side of the preset bank
+  bool presetMove(int axis, double target);
+  void presetSeen(int axis, double device);
+  void presetHalt();
+  bool presetTick();
+  double presetDue();
+  void finishRecall();
+  bool recallPreset(const double target[2]);
+
+  // device I/O; also records the frames into the trace when enabled
+  // Write-only frames are coalesced into txPending and go out in one write
+  // once the job queue drains or with the next query (linked to the read of
+  // its reply, DeviceTransport::Transact); their callbacks are deferred until
+  // then. Both are reserved up front, so the hot path does not allocate.
+  std::string txPending;
+  std::vector<std::function<void(RotatorResponse)>> txPendingCallbacks;
+  int sendFrame(const char *buf, size_t buflen);
+  int recvFrame(char *buf, size_t buflen);
+  void completeWrite(std::function<void(RotatorResponse)> callback, bool error);
+  bool flushFrames();
+  void completePending(bool success);
+
+  double trackerNow();
+  void trackerMain();
+  void logTransition(int axis, AxisTrackingState before);
+  double deviceAzi(double azi);
+  void velocityMain();
+  // bypassTracker: replays and keep-alive refreshes, straight to the queue
+  bool RequestImpl(RotatorRequest req, std::function<void(RotatorResponse)> callback, bool bypassTracker);
 
 public:
   void Initialize(std::string tcpHost, int tcpPort, double aziOffset, double eleOffset, bool smartSink, bool keepAlive);
+  // replace the TCP link set up by Initialize(), before Start()
+  void SetTransport(std::unique_ptr<DeviceTransport> transport);
+  // clear the factory presets (power-on self test, auto zero-returning) after Start()
+  void SetPresetReset(bool presetReset);
+  void SetParkPosition(double parkAzi, double parkEle);
+  // reserve a bank of device presets for park, these (azi, ele) positions and
+  // hinted pass starts, programmed after idle (s) without targets; before Start()
+  void SetPresetParams(PresetBank::Params params, std::vector<std::pair<double, double>> positions, double idle);
+  // smartSink policy, before Start(); azimuth is made periodic
+  void SetTrackerParams(AxisTracker::Params azi, AxisTracker::Params ele);
+  // track with speed commands instead (velocity drive mode), before Start()
+  void SetVelocityParams(VelocityTracker::Params azi, VelocityTracker::Params ele);
+  // device I/O deadline (ms), watchdog (s) and circuit breaker, before Start()
+  void SetLinkParams(int ioTimeout, double watchdogTimeout, CircuitBreaker::Params breaker);
 
   virtual void Start() override;
   virtual void Terminate() override;
   virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+  virtual void SetTraceRecorder(TraceRecorder *trace) override;
+  virtual void SetRealTime(const RealTimeParams &params) override;
 };
\ No newline at end of file
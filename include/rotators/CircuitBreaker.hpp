@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+enum CircuitState {
+  CIRCUIT_CLOSED,     // healthy: requests go to the device
+  CIRCUIT_OPEN,       // failing: requests are refused until retryAt
+  CIRCUIT_HALF_OPEN   // one probe is underway; its outcome decides
+};
+
+const char *CircuitStateName(CircuitState state);
+
+// Fail-fast policy for a device link that keeps failing (CamPTZ).
+//
+// After failureThreshold consecutive failures the circuit opens: requests are
+// refused right away instead of queueing behind a device that does not
+// answer, and after openTime the owner probes the device. A good probe closes
+// the circuit, a bad one opens it again for twice as long, up to maxOpenTime.
+// Like AxisTracker: no threads or clocks, time (seconds, any epoch) is a
+// parameter.
+//
+//   CLOSED --failureThreshold failures / Trip()--> OPEN
+//   OPEN --openTime--> HALF_OPEN (probe) --success--> CLOSED
+//                                        --failure--> OPEN (openTime doubled)
+class CircuitBreaker {
+public:
+  struct Params {
+    int failureThreshold = 3;
+    double openTime = 1;        // (s) before the first probe
+    double maxOpenTime = 30;    // (s) cap of the backoff
+  };
+
+  struct Stats {
+    uint64_t trips = 0;
+    uint64_t rejected = 0;
+    uint64_t probes = 0;
+  };
+
+private:
+  Params params;
+  CircuitState state = CIRCUIT_CLOSED;
+  Stats stats;
+
+  int failures = 0;          // consecutive
+  double openFor = 0;        // (s) current backoff
+  double retryAt = 0;
+
+  void open(double now, double duration);
+
+public:
+  CircuitBreaker();
+  explicit CircuitBreaker(Params params);
+
+  // whether a request may go to the device; counts the refusals
+  bool Allow();
+  // OPEN long enough: enters HALF_OPEN, the owner probes now
+  bool ProbeDue(double now);
+  void OnSuccess();
+  void OnFailure(double now);
+  // open right away (a stalled worker)
+  void Trip(double now);
+
+  CircuitState State() const { return state; }
+  // (s) when an OPEN circuit is due for a probe
+  double RetryAt() const { return retryAt; }
+  const Stats &GetStats() const { return stats; }
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "rotators/StreamSource.hpp"
+
+// EasyComm II (space or newline separated tokens such as "AZ123.4 EL45.6").
+class EasyComm : public StreamSource {
+protected:
+  virtual std::string processLine(ClientSession &session, const std::string &line) override;
+
+public:
+  EasyComm();
+
+  void Initialize(Transport transport, std::string tcpHost, int tcpPort, std::string ptyLink);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+
+// Composite sink: drives several co-mounted rotators as one.
+//
+// Position changes and presets go to every member. All members are issued
+// from the same dispatch pass, so each member's worker gets the command at
+// the same time and no other request can interleave between them.
+class FanOut : public RotatorController {
+public:
+  enum AggregatePolicy {
+    AGGREGATE_ALL,     // success when every member succeeded
+    AGGREGATE_QUORUM,  // success once `quorum` members succeeded
+    AGGREGATE_FIRST    // success on the first member to succeed
+  };
+
+  enum PositionSource {
+    POSITION_PRIMARY,  // GET_* from the primary member only
+    POSITION_FUSED     // GET_* from every member, averaged
+  };
+
+private:
+  std::vector<std::unique_ptr<RotatorController>> members;
+  AggregatePolicy policy = AGGREGATE_ALL;
+  int quorum = 1;
+  PositionSource positionSource = POSITION_PRIMARY;
+  size_t primaryIdx = 0;
+
+  // serializes dispatch passes
+  std::mutex dispatchMutex;
+
+  bool dispatchAll(RotatorRequest req, std::function<void(RotatorResponse)> callback);
+  bool queryFused(RotatorRequest req, std::function<void(RotatorResponse)> callback);
+
+public:
+  void Initialize(AggregatePolicy policy, int quorum, PositionSource positionSource, size_t primaryIdx);
+  void AddMember(std::unique_ptr<RotatorController> member);
+  size_t MemberCount() const { return members.size(); }
+
+  virtual void Start() override;
+  virtual void Terminate() override;
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+  virtual void SetTraceRecorder(TraceRecorder *trace) override;
+  virtual void SetClock(Clock *clock) override;
+  virtual void SetRealTime(const RealTimeParams &params) override;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "rotators/StreamSource.hpp"
+
+// Yaesu GS-232A/B controller emulation (CR-terminated commands), for
+// tracking programs that drive a serial rotator controller.
+class GS232 : public StreamSource {
+private:
+  bool gs232b = false;  // reply format: B "AZ=aaa  EL=eee", A "+0aaa+0eee"
+
+  void move(ClientSession &session, int direction);
+
+protected:
+  virtual std::string processLine(ClientSession &session, const std::string &line) override;
+
+public:
+  GS232();
+
+  void Initialize(Transport transport, std::string tcpHost, int tcpPort, std::string ptyLink, bool gs232b);
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+// Streaming line framing for text protocol sources (rotctld, GS-232,
+// EasyComm). Feed whatever recv()/read() returned; complete lines come out
+// without their terminator, empty lines are skipped.
+class LineReader {
+private:
+  std::string buffer;
+  std::string terminators;
+  size_t maxLine;
+
+public:
+  explicit LineReader(std::string terminators = "\n", size_t maxLine = 1024);
+
+  void Append(const char *data, size_t len);
+
+  // next complete line; false if none is buffered yet
+  bool Next(std::string &line);
+
+  // whatever is left without a terminator, as one line (gpredict on Windows
+  // omits the trailing newline); false if nothing is buffered
+  bool TakePartial(std::string &line);
+};
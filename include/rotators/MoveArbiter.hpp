@@ -0,0 +1,46 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+#include <map>
+
+// Decides which client of a source may move the rotator.
+class MoveArbiter {
+public:
+  enum Policy {
+    ARBITRATION_NONE,      // every move goes through (previous behaviour)
+    ARBITRATION_OWNER,     // first mover owns the rotator until it disconnects
+                           //   (or stays idle for ownerIdle, if set)
+    ARBITRATION_PRIORITY,  // higher priority preempts; equal or lower waits
+                           //   for holdOff after the holder's last move
+    ARBITRATION_LWW        // last writer wins, other clients held off for holdOff
+  };
+
+private:
+  Policy policy = ARBITRATION_NONE;
+  int holdOff = 0;  // (ms)
+  int ownerIdle = 0;  // (ms) owner: released after this long without a move, 0: never
+  Clock *clock = Clock::Steady();
+  std::map<std::string, int> priorities;  // client address -> priority, default 0
+
+  std::mutex stateMutex;
+  bool held = false;
+  uint64_t holder = 0;
+  int holderPriority = 0;
+  Clock::TimePoint holderLastMove;
+
+  bool idleFor(Clock::TimePoint now, int period) const;
+
+public:
+  void Initialize(Policy policy, int holdOff, int ownerIdle, std::map<std::string, int> priorities);
+  void SetClock(Clock *clock) { this->clock = clock; }
+
+  static bool ParsePolicy(std::string name, Policy &policy);
+  // "addr:prio,addr:prio"
+  static std::map<std::string, int> ParsePriorities(std::string spec);
+
+  int PriorityOf(std::string clientAddr) const;
+
+  // true if clientId may move now; the client becomes the holder
+  bool AcquireMove(uint64_t clientId, int priority);
+  void Release(uint64_t clientId);
+};
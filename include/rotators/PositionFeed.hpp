@@ -0,0 +1,62 @@
+#pragma once
+
+#include "rotators/PositionQuery.hpp"
+#include <map>
+
+// Server-push position updates for the clients of a source that asked for
+// them (rotctld's \subscribe), from one sampler thread shared by all of them.
+//
+// Each subscriber has an interval and a threshold: every interval it gets
+// the current position, or with a threshold only once the position moved
+// further than that since its last push. Due times are aligned to multiples
+// of the interval, so subscribers with the same (or a multiple) interval
+// share one sample. Samples go through the source's PositionQuery, so they
+// are also shared with the `p` polls of clients that did not subscribe.
+class PositionFeed {
+public:
+  // writes one update to the client; must not block
+  using Push = std::function<void(const PositionQuery::Position &pos)>;
+
+  static constexpr int minInterval = 100;  // (ms) faster subscriptions are clamped
+
+private:
+  struct Subscriber {
+    std::chrono::milliseconds interval;
+    double threshold;  // (deg) 0: every interval
+    Push push;
+    Clock::TimePoint due;
+    bool pushed = false;
+    double lastAzi = 0, lastEle = 0;
+  };
+
+  PositionQuery *query = nullptr;
+  Clock *clock = Clock::Steady();
+
+  std::mutex stateMutex;
+  std::condition_variable stateEvent;
+  std::map<uint64_t, Subscriber> subscribers;
+  Clock::TimePoint epoch;
+  bool changed = false;  // subscribers added since the sampler last looked
+  bool closing = false;
+  std::thread sampler;
+
+  std::atomic<uint64_t> samples{0};
+  std::atomic<uint64_t> pushes{0};
+
+  Clock::TimePoint nextDue(Clock::TimePoint now, std::chrono::milliseconds interval) const;
+  void samplerMain();
+
+public:
+  ~PositionFeed();
+
+  void Initialize(PositionQuery *query, Clock *clock);
+
+  // replaces an earlier subscription of the same client; interval in ms
+  void Subscribe(uint64_t clientId, int interval, double threshold, Push push);
+  // no push to the client is running or follows once this returns
+  void Unsubscribe(uint64_t clientId);
+  void Stop();
+
+  uint64_t Samples() const { return samples.load(); }
+  uint64_t Pushes() const { return pushes.load(); }
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+
+// Single-flight position query shared by every client of a source.
+//
+// Clients asking while a query is in flight wait for that query instead of
+// starting their own, and a result younger than the sharing window is
+// served without touching the device at all. QueryAsync() joins the same
+// single flight without blocking; a query gone unanswered for longer than
+// the request timeout is given up on, and the next caller starts another.
+class PositionQuery {
+public:
+  struct Position {
+    bool valid = false;
+    double azi = 0;
+    double ele = 0;
+    Clock::TimePoint sampledAt;
+  };
+
+private:
+  RotatorRequestHandler requestHandler;
+  int shareWindow = 0;        // (ms) 0: share in-flight queries only
+  int requestTimeout = 1000;  // (ms)
+  Clock *clock = Clock::Steady();
+
+  std::mutex stateMutex;
+  std::condition_variable stateEvent;
+  bool inFlight = false;
+  Clock::TimePoint inFlightSince;
+  uint64_t generation = 0;
+  uint64_t queryId = 0;  // of the query in flight
+  Position last;
+  std::vector<std::function<void(const Position &pos)>> waiters;  // QueryAsync()
+
+  // under stateMutex: whether a query of the caller's should start
+  bool startQuery();
+  // a query's result: wakes the blocked callers, then runs the waiters
+  void finish(uint64_t id, const Position &pos);
+
+  std::atomic<uint64_t> deviceQueries{0};
+  std::atomic<uint64_t> sharedQueries{0};
+
+public:
+  void Initialize(RotatorRequestHandler requestHandler, int shareWindow, int requestTimeout);
+  void SetClock(Clock *clock) { this->clock = clock; }
+
+  Position Query();
+  // done is called once the shared query is answered, possibly right away
+  // on this thread; an unanswered query leaves it waiting for the next one
+  void QueryAsync(std::function<void(const Position &pos)> done);
+
+  uint64_t DeviceQueries() const { return deviceQueries.load(); }
+  uint64_t SharedQueries() const { return sharedQueries.load(); }
+};
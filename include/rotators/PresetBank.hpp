@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Which positions get one of the device presets reserved for the bridge, and
+// when recalling one beats an absolute move (CamPTZ). A preset recall slews
+// both axes at the head's top speed, faster than an absolute move; Pelco-D
+// can only store the position the head is at, so a position gets its preset
+// when the head rests there.
+//
+// Positions are pinned (park, fixed targets: never evicted) or hinted (the
+// start of an upcoming pass: the least recently used one makes room). A
+// target within tolerance of a programmed preset is reached by recalling it,
+// followed by an absolute move for the remainder, when that is estimated to
+// arrive at least minSaving sooner. Like AxisTracker: no threads or clocks,
+// time (seconds, any epoch) is a parameter. Positions are the device's
+// (pan [0, 360) with an end stop, tilt), in degrees.
+class PresetBank {
+public:
+  struct Params {
+    int firstSlot = 20;          // device presets firstSlot .. firstSlot + slots - 1
+    int slots = 0;               // 0: no bank
+    double tolerance = 1;        // (deg) targets this close are served by a preset
+    double panSpeed = 20;        // (deg/s) of absolute moves
+    double tiltSpeed = 10;
+    double presetSpeed = 40;     // (deg/s) of preset recalls, both axes
+    double restartDelay = 0.3;   // (s) before the motor moves after a command
+    double minSaving = 1;        // (s) smaller savings move directly
+  };
+
+  struct Position {
+    double pan = 0;
+    double tilt = 0;
+  };
+
+  struct Stats {
+    uint64_t programmed = 0;
+    uint64_t recalls = 0;
+    uint64_t evictions = 0;
+    double saved = 0;  // (s) estimated
+  };
+
+private:
+  struct Entry {
+    bool used = false;
+    Position position;
+    bool pinned = false;
+    bool programmed = false;
+    double lastUse = 0;   // (s) added, hinted again or recalled
+    uint64_t order = 0;   // of addition; programmed first come first served
+  };
+
+  Params params;
+  std::vector<Entry> entries;
+  Stats stats;
+  uint64_t added = 0;
+
+  bool near(const Position &a, const Position &b, double within) const;
+
+public:
+  PresetBank();
+  explicit PresetBank(Params params);
+
+  bool Enabled() const { return !entries.empty(); }
+  // a position worth a preset; an existing one within tolerance is reused.
+  // Returns its index, -1 if every slot holds a pinned position
+  int Add(double now, Position position, bool pinned);
+  void Remove(int index);
+  // next position to program: pinned ones first, then in order of addition; -1: none
+  int NextUnprogrammed() const;
+  // an unprogrammed position within tolerance of the head; -1: none
+  int FindUnprogrammed(Position head) const;
+  // the device stored the preset of index with the head at position
+  void Programmed(int index, Position position);
+  // a programmed preset that takes the head from `from` to `to` at least
+  // minSaving sooner than an absolute move, counted as recalled; -1: none
+  int Recall(double now, Position from, Position to);
+
+  // (s) of an absolute move, or of a recall of index plus the remainder to `to`
+  double MoveTime(Position from, Position to) const;
+  double RecallTime(int index, Position from, Position to) const;
+
+  // (azi, ele) pairs from "azi:ele,azi:ele"
+  static std::vector<std::pair<double, double>> ParsePositions(std::string spec);
+
+  Position At(int index) const { return entries[index].position; }
+  bool IsProgrammed(int index) const { return entries[index].programmed; }
+  bool IsPinned(int index) const { return entries[index].pinned; }
+  int Slot(int index) const { return params.firstSlot + index; }
+  const Stats &GetStats() const { return stats; }
+};
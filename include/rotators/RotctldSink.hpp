@@ -0,0 +1,91 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+#include "transport/TcpTransport.hpp"
+#include <deque>
+
+// Sink driving a rotator behind a downstream hamlib rotctld (e.g. G-5500).
+//
+// One persistent TCP connection, pipelined: the worker writes commands as
+// they come and a reader thread matches the `RPRT n` / position replies to
+// them in order, so a slow daemon never holds back the next write.
+// - queued CHANGE_AZI / CHANGE_ELE merge into one `P azi ele`, latest wins
+// - GET_AZI / GET_ELE join a `p` that is already on the wire, so a client
+//   polling both axes costs one query
+// - a `P` for the target sent less than suppressWindow ago is answered
+//   without being sent (same idea as CamPTZ's smartSink)
+// - if the daemon is another bridge, it is asked to push the position
+//   (`\subscribe`) and GET_AZI / GET_ELE are answered from the last push;
+//   a hamlib rotctld rejects the command and is polled as before
+// The connection is re-established on the next request after an error.
+class RotctldSink : public RotatorController {
+private:
+  std::string host;
+  int port;
+  int suppressWindow = 1000;  // (ms), 0: send every position change
+  int subscribeInterval = 500;  // (ms), 0: always poll
+  const int reconnectInterval = 1000;  // (ms)
+  int ioTimeout = 1000;  // (ms) for the position query on connecting
+
+  std::unique_ptr<TcpTransport> conn;
+  std::atomic<bool> connected{false};
+  Clock::TimePoint lastConnectAttempt;
+
+  std::atomic<bool> threadClosing{false};
+  std::atomic<bool> threadExited{true};
+  std::thread worker;
+  std::thread reader;
+
+  using threadJob = std::pair<RotatorRequest, std::function<void(RotatorResponse)>>;
+  ThreadsafeQueue<threadJob> jobQueue;
+  std::mutex jobEventMutex;
+  std::condition_variable jobEvent;
+
+  // replies expected from the daemon, in command order
+  struct PendingReply {
+    bool position;  // `p`: two lines (or RPRT on error); otherwise RPRT
+    std::vector<threadJob> jobs;
+    bool subscribe = false;  // `\subscribe`: its RPRT tells whether pushes come
+  };
+  std::mutex pendingMutex;
+  std::deque<PendingReply> pending;
+  // pushed by the daemon (`POS azi ele` lines), under pendingMutex
+  bool pushing = false;
+  bool pushedValid = false;
+  double pushedAzi = 0, pushedEle = 0;
+  Clock::TimePoint pushedAt;
+
+  // position change state, worker thread only
+  bool targetKnown = false;
+  double targetAzi = 0, targetEle = 0;
+  bool sentValid = false;  // cleared by STOP / MOVE / PARK / RESET
+  double sentAzi = 0, sentEle = 0;
+  Clock::TimePoint sentAt;
+
+  std::atomic<uint64_t> movesSent{0}, movesSuppressed{0};
+  std::atomic<uint64_t> queriesSent{0}, queriesJoined{0}, queriesPushed{0};
+  std::atomic<uint64_t> expiredRequests{0};
+
+  bool connStart();
+  void connTerminate();
+  static void threadMain(RotctldSink *self);
+  static void readerMain(RotctldSink *self);
+
+  // worker side of a batch
+  void flushMove(std::string &out, std::vector<threadJob> &moveJobs);
+  void queuePosition(std::string &out, threadJob job);
+  void failPending();
+  static void answer(std::vector<threadJob> &jobs, bool success, double azi = 0, double ele = 0);
+
+public:
+  void Initialize(std::string host, int port, int suppressWindow);
+  // position push interval asked of the daemon (ms); 0 polls with `p`
+  void SetSubscription(int interval);
+  // a daemon that accepts but does not answer the first query within this
+  // (ms) is dropped
+  void SetIoTimeout(int timeout);
+
+  virtual void Start() override;
+  virtual void Terminate() override;
+  virtual bool Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) override;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+#include "rotators/PositionQuery.hpp"
+#include "transport/ShmChannel.hpp"
+
+// Source for co-located processes: takes commands from the ring of a
+// shared-memory channel (ShmChannel) and samples the head's position into its
+// telemetry, which they read without a system call. Each command's outcome
+// is published as commandDone / commandResult; set positions are published
+// as the target.
+//
+// The ring is polled every pollInterval (us), or spun on with 0 when a core
+// can be spared for the lowest command latency. With sampleInterval 0 the
+// telemetry only has what a telemetry stage publishes.
+class ShmSource : public PseudoRotator {
+private:
+  std::string channelName;
+  int sampleInterval = 100;  // (ms)
+  int pollInterval = 1000;   // (us)
+  const int requestTimeout = 1000;  // (ms)
+
+  std::shared_ptr<ShmChannel> channel;
+  RotatorRequestHandler requestHandler;
+  PositionQuery positionQuery;
+  Clock *clock = Clock::Steady();
+
+  std::mutex stateMutex;
+  std::condition_variable stateEvent;
+  bool closing = true;
+  std::thread commandThread;
+  std::thread sampleThread;
+
+  void run(const ShmCommand &command);
+  void commandMain();
+  void sampleMain();
+
+public:
+  virtual ~ShmSource();
+
+  void Initialize(std::string channelName, int sampleInterval, int pollInterval);
+
+  virtual void Start() override;
+  virtual void Terminate() override;
+  virtual void WaitForClose() override;
+
+  virtual bool SetRequestHandler(RotatorRequestHandler callback) override;
+  virtual void SetClock(Clock *clock) override;
+};
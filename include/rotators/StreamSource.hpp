@@ -0,0 +1,154 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+#include "rotators/LineReader.hpp"
+#include "rotators/MoveArbiter.hpp"
+#include "rotators/PositionFeed.hpp"
+#include "rotators/PositionQuery.hpp"
+#include "transport/Reactor.hpp"
+#include <deque>
+
+// Common base of the line-oriented protocol sources (rotctld, GS-232,
+// EasyComm). Owns the transport (a TCP listener with one thread per client,
+// the same on a Unix domain socket for local clients, a pseudo-terminal for
+// programs that only speak serial, or UDP datagrams), the line framing and
+// the shared request path; subclasses only implement processLine().
+//
+// With the epoll / uring I/O backend the TCP listener and its clients are
+// served by one reactor thread instead, which hands received bytes to a small
+// worker pool; a session is run by at most one worker at a time, so its
+// lines keep their order. The reactor is the source's own, or one shared with
+// the sources of other pipelines (SetReactor); the workers are always the
+// source's, so a slow pipeline only holds up its own clients.
+//
+// On UDP each datagram is `<seq> <lines>` and its reply `<seq> <reply>`.
+// Senders are told apart by address; a datagram whose sequence number is not
+// above the last one taken from its sender arrived late or twice and is
+// dropped. A sender silent for longer than datagramPeerTimeout starts over,
+// so a restarted client with a fresh sequence is heard again. One loop
+// receives for every sender, so nothing it runs may wait for the device.
+class StreamSource : public PseudoRotator {
+public:
+  enum Transport {
+    TRANSPORT_TCP,
+    TRANSPORT_PTY,
+    TRANSPORT_UNIX,
+    TRANSPORT_UDP
+  };
+
+  static bool ParseTransport(std::string name, Transport &transport);
+
+protected:
+  struct ClientSession {
+    int fd;
+    bool isSocket;
+    bool isDatagram = false;  // replies only go back with the datagram's own
+    // datagrams: sends a reply of its own later, with the current datagram's
+    // sequence number, for commands answered off the receive loop
+    std::function<void(const std::string &text)> sendReply;
+    uint64_t clientId;
+    int clientPriority;
+    int moveSpeed = 100;  // GS-232: set by this client's X1..X4, 1..100
+    bool closing = false;
+    // replies and position pushes never interleave on the stream
+    std::shared_ptr<std::mutex> writeMutex = std::make_shared<std::mutex>();
+  };
+
+  std::string sourceName;  // log prefix
+  Transport transport = TRANSPORT_TCP;
+  std::string tcpHost;
+  int tcpPort = 0;
+  std::string ptyLink;     // optional symlink to the pty slave, e.g. /tmp/ttyGS232,
+                           // or the path of the Unix domain socket
+
+  std::string lineTerminators;
+  bool flushPartialLines = false;  // take a read without terminator as a full line
+
+  RotatorRequestHandler requestHandler;
+  const int requestTimeout = 1000; // (ms)
+
+  // multi-client: position polls are single-flighted, moves are arbitrated
+  int queryShareWindow = 0; // (ms)
+  PositionQuery positionQuery;
+  MoveArbiter arbiter;
+  PositionFeed positionFeed;
+
+  TraceRecorder *trace = nullptr;
+  Clock *clock = Clock::Steady();
+
+  // runs one complete line; returns the reply (may be empty)
+  virtual std::string processLine(ClientSession &session, const std::string &line) = 0;
+
+  // fire-and-forget request into the pipeline, for protocols without replies
+  bool submit(RotatorRequest req);
+
+  // position pushes to this client from the shared sampler (PositionFeed),
+  // formatted by the protocol; interval in ms, 0 to stop
+  void subscribe(ClientSession &session, int interval, double threshold,
+                 std::function<std::string(const PositionQuery::Position &pos)> format);
+
+private:
+  struct ReactorSession {
+    ClientSession session;
+    LineReader reader;
+    std::string input;     // received, not yet taken by a worker
+    bool queued = false;   // on the run queue or with a worker
+    bool closed = false;   // the reactor is done with the socket
+  };
+
+  int sock = -1;
+  std::atomic<bool> threadClosing{false};
+  const int datagramPeerTimeout = 10000;  // (ms)
+  std::thread worker;
+
+  std::mutex clientsMutex;
+  std::vector<std::thread> clientWorkers;
+  std::atomic<uint64_t> nextClientId{1};
+
+  // IO_EPOLL / IO_URING
+  const int ioWorkers = 4;
+  std::unique_ptr<IoReactor> ownReactor;
+  IoReactor *sharedReactor = nullptr;
+  IoReactor *reactor = nullptr;  // one of the two, while serving
+  std::condition_variable closeEvent;  // WaitForClose() on a shared reactor
+  std::mutex sessionsMutex;
+  std::condition_variable sessionsEvent;
+  std::map<int, std::shared_ptr<ReactorSession>> sessions;
+  std::deque<std::shared_ptr<ReactorSession>> runQueue;
+  std::vector<std::thread> ioWorkerThreads;
+
+  bool listenTcp();
+  bool listenUnix();
+  bool listenStream();
+  std::string endpoint() const;
+  void serveDatagrams();
+  void acceptLoop();
+  void servePty();
+  void serveConnection(ClientSession session);
+  // runs the complete lines in reader; the replies, to go out in one write
+  std::string processInput(ClientSession &session, LineReader &reader);
+  bool startReactor();
+  void serveReactor();
+  void leaveSharedReactor();
+  void acceptSession(int fd, const sockaddr_in &addr);
+  void ioWorkerMain();
+  void closeSession(ReactorSession &session);
+  static void threadMain(StreamSource *self);
+  static bool pushWrite(const ClientSession &session, const std::string &text);
+
+public:
+  StreamSource(std::string sourceName, std::string lineTerminators);
+
+  void SetTransport(Transport transport, std::string tcpHost, int tcpPort, std::string ptyLink);
+  // polls within shareWindow (ms) of the last device query reuse its result
+  void SetQuerySharing(int shareWindow);
+  void SetArbitration(MoveArbiter::Policy policy, int holdOff, int ownerIdle, std::map<std::string, int> priorities);
+
+  virtual void Start() override;
+  virtual void WaitForClose() override;
+  virtual void Terminate() override;
+  virtual bool SetRequestHandler(RotatorRequestHandler callback) override;
+  virtual void SetTraceRecorder(TraceRecorder *trace) override;
+  virtual void SetClock(Clock *clock) override;
+  virtual void SetReactor(IoReactor *reactor) override;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+enum VelocityTrackingState {
+  VELOCITY_IDLE,      // on the last target, motor stopped; nothing sampled
+  VELOCITY_SLEWING,   // absolute move towards a distant target
+  VELOCITY_TRACKING,  // following a moving target with speed commands
+  VELOCITY_SETTLING   // target stopped: absolute move onto it
+};
+
+const char *VelocityTrackingStateName(VelocityTrackingState state);
+
+// Per-axis closed-loop tracking with continuous speed commands, for heads
+// that restart their motor on every position command but not on speed
+// changes (CamPTZ's velocity drive mode).
+//
+// A PI controller on the pointing error, fed forward with the rate of the
+// target, picks one of the device's speed steps (Pelco-D 0..0x3F, signed by
+// direction); the target is extrapolated at that rate between updates.
+// Between position samples the position is dead-reckoned from the speed
+// commanded, so the head is sampled only every sampleInterval while tracking.
+// Large errors and a target that stopped moving fall back to absolute
+// positioning. Like AxisTracker: no threads or clocks, time (seconds, any
+// epoch) is a parameter.
+//
+//   IDLE --target beyond tolerance--> TRACKING / SLEWING (error > slewThreshold)
+//   SLEWING --error below slewThreshold / 2--> TRACKING (target moving)
+//                                          --> IDLE (target still, within tolerance)
+//   TRACKING --error above slewThreshold--> SLEWING
+//            --no target change for staleTime--> SETTLING
+//   SETTLING --within tolerance--> IDLE; --target moves--> TRACKING / SLEWING
+class VelocityTracker {
+public:
+  struct Params {
+    bool periodic = false;       // deltas modulo 360 (pan without an end stop)
+    double maxSpeed = 20;        // (deg/s) at the top speed step
+    int maxStep = 0x3F;
+    double kp = 0.8;             // (1/s)
+    double ki = 0.1;             // (1/s^2)
+    double slewThreshold = 5;    // (deg) larger errors are slews
+    double tolerance = 0.2;      // (deg) settled when this close to a still target
+    double staleTime = 3;        // (s) no target change for this long: the target stopped
+    double sampleInterval = 2;   // (s) between position samples while tracking
+    double minPosition = -1e9;   // absolute moves are kept within these
+    double maxPosition = 1e9;
+  };
+
+  struct Stats {
+    uint64_t speedChanges = 0;
+    uint64_t positions = 0;
+    uint64_t slews = 0;
+  };
+
+private:
+  Params params;
+  VelocityTrackingState state = VELOCITY_IDLE;
+  Stats stats;
+
+  bool targetValid = false;
+  double target = 0;
+  double changeTime = 0;          // of the last target change
+  double rate = 0;                // (deg/s) of the target
+  bool rateValid = false;
+
+  bool positionValid = false;
+  double estimate = 0, estimateTime = 0;  // dead-reckoned position
+  double sampleTime = 0;
+
+  double commanded = 0;           // last absolute move
+  int step = 0;
+  double integral = 0;
+  double lastTick = 0;
+
+  double delta(double from, double to) const;
+  double reference(double now) const;
+  bool targetMoving(double now) const;
+  void enter(VelocityTrackingState next);
+  double lead(double now, double ref, double error) const;
+  double moveTo(double position);
+
+public:
+  VelocityTracker();
+  explicit VelocityTracker(Params params);
+
+  // a new target from upstream
+  void OnTarget(double now, double target);
+  // a sampled device position
+  void OnPosition(double now, double position);
+  // manual control took over: stop driving until the next target
+  void Reset();
+  // timers and the controller; a value is an absolute move to send now, the
+  // speed to command is Step()
+  std::optional<double> OnTick(double now);
+
+  // whether the owner should sample the position before the next tick
+  bool NeedsSampling(double now) const;
+  // an absolute move of this axis is underway; a speed command for the
+  // other axis would cut it off (Pelco-D speed frames carry both axes)
+  bool InAbsoluteMove() const { return state == VELOCITY_SLEWING || state == VELOCITY_SETTLING; }
+  // signed speed step, -maxStep..maxStep
+  int Step() const { return step; }
+  VelocityTrackingState State() const { return state; }
+  const Stats &GetStats() const { return stats; }
+};
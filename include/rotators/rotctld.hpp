@@ -1,32 +1,66 @@
 #pragma once
 
-#include "RotatorCommon.hpp"
+#include "rotators/StreamSource.hpp"
 
-class rotctld : PseudoRotator {
+class rotctld : public StreamSource {
 private:
-  std::string tcpHost;
-  int tcpPort;
+  // reported by \dump_caps / \dump_state
+  const double minAzi = 0, maxAzi = 360;
+  const double minEle = 0, maxEle = 90;
 
-  int sock;
-  bool sockActive = false;
-  bool threadClosing = false;
-  bool threadExited = true;
-  bool gpredictBugWalkaround;
+  // hamlib net rotctl protocol; one entry per command
+  using CommandArgs = std::vector<std::string>;
+  using CommandValues = std::vector<std::pair<std::string, std::string>>;  // (label, value)
+  struct CommandEntry {
+    char shortName;         // '\0' if long form only
+    const char *longName;
+    int argCount;
+    int (rotctld::*handler)(ClientSession &session, const CommandArgs &args, CommandValues &values);
+    int optionalArgs = 0;   // taken as well where the next tokens are numbers
+  };
+  static const CommandEntry commandTable[];
 
-  std::thread worker;
-  std::vector<std::thread> clientWorkers;
-  std::function<RotatorResponse(RotatorRequest)> requestHandler;
+  int cmdSetPos(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdGetPos(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdMove(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdStop(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdPark(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdReset(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdGetInfo(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdDumpCaps(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdDumpState(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdSubscribe(ClientSession &session, const CommandArgs &args, CommandValues &values);
+  int cmdQuit(ClientSession &session, const CommandArgs &args, CommandValues &values);
 
-  void connStart();
-  void connTerminate();
-  static void connThreadMain(rotctld *self, int connSock, struct sockaddr_in clientAddr);
-  static void threadMain(rotctld *self);
+  // p's values (or error) for a position sample
+  static int positionValues(const PositionQuery::Position &pos, CommandValues &values);
+  // one command's reply, plain or in the extended format of separator sep
+  static std::string formatReply(const std::string &name, const CommandArgs &args, const CommandValues &values,
+                                 int status, char sep);
+
+  // forwards one request to the sink and waits for it; hamlib status code.
+  // Datagram clients are not waited for: the request is only submitted.
+  int requestAndWait(ClientSession &session, RotatorRequest req);
+
+  // datagram set_pos, latest wins: at most one target is with the sink, and
+  // one arriving meanwhile replaces whichever was waiting for it
+  struct TargetSlot {
+    std::mutex mutex;
+    bool inFlight = false;
+    bool pending = false;
+    double azi = 0, ele = 0;
+  };
+  std::shared_ptr<TargetSlot> targetSlot = std::make_shared<TargetSlot>();
+  void setTarget(double azi, double ele);
+  static void submitTarget(std::shared_ptr<TargetSlot> slot, RotatorRequestHandler handler, Clock *clock,
+                           int timeout, double azi, double ele);
+
+protected:
+  // runs every command on one line; returns the whole reply
+  virtual std::string processLine(ClientSession &session, const std::string &line) override;
 
 public:
-  void Initialize(std::string tcpHost, int tcpPort, bool gpredictBugWalkaround);
+  rotctld();
 
-  virtual void Start() override;
-  virtual void WaitForClose() override;
-  virtual void Terminate() override;
-  virtual bool SetRequestHandler(std::function<RotatorResponse(RotatorRequest)> callback) override;
-};
\ No newline at end of file
+  void Initialize(std::string tcpHost, int tcpPort, bool gpredictBugWalkaround);
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Binary session trace
+//
+// File layout (host byte order, little-endian on every platform we run on):
+//   header: char magic[8] = "RBTRACE", uint32_t version, uint32_t flags
+//   record: TraceRecordHeader, payload, zero padding up to 8-byte boundary
+//
+// Records are 8-byte aligned so an uncompressed trace can be mmap-ed and
+// walked in place. A path ending with ".gz" is written and read through
+// zlib when the bridge is built with it.
+
+enum TraceRecordType : uint16_t {
+  TRACE_SOURCE_COMMAND = 1,  // raw bytes received by a source (e.g. a rotctld line)
+  TRACE_SINK_REQUEST = 2,    // RotatorRequest forwarded into the sink
+  TRACE_DEVICE_TX = 3,       // frame written to the device
+  TRACE_DEVICE_RX = 4        // frame read from the device
+};
+
+struct TraceRecordHeader {
+  uint32_t length;       // payload length, excluding header and padding
+  uint16_t type;         // TraceRecordType
+  uint16_t channel;      // source connection / device index / pipeline, 0 if unused
+  uint64_t timestampNs;  // since the trace was opened
+};
+static_assert(sizeof(TraceRecordHeader) == 16, "trace record header must stay packed");
+
+struct TraceRecord {
+  TraceRecordHeader header;
+  std::vector<char> payload;
+};
+
+// RotatorRequest <-> payload of TRACE_SINK_REQUEST: the command byte and one
+// double-sized argument, two doubles (azi, ele) for ROTATOR_PRESET_HINT
+std::vector<char> TraceEncodeRequest(const RotatorRequest &req);
+bool TraceDecodeRequest(const std::vector<char> &payload, RotatorRequest &req);
+
+// Append-only recorder. Record() only copies into an in-memory buffer;
+// a writer thread flushes it to disk, so the request path never waits on I/O.
+class TraceRecorder {
+private:
+  std::string path;
+  FILE *file = nullptr;
+  void *gzFile = nullptr;
+
+  std::chrono::steady_clock::time_point startTime;
+
+  std::mutex bufferMutex;
+  std::condition_variable bufferEvent;
+  std::vector<char> pending;
+  bool threadClosing = false;
+  std::thread writer;
+
+  const size_t flushThreshold = 64 * 1024;        // (bytes) wake writer early
+  const size_t maxPending = 16 * 1024 * 1024;     // (bytes) drop beyond this
+  const int flushInterval = 200;                  // (ms)
+  std::atomic<uint64_t> droppedRecords{0};
+
+  bool writeRaw(const char *buf, size_t len);
+  static void threadMain(TraceRecorder *self);
+
+public:
+  ~TraceRecorder();
+
+  bool Open(std::string path);
+  void Close();
+  bool IsOpen() const { return file != nullptr || gzFile != nullptr; }
+
+  void Record(TraceRecordType type, uint16_t channel, const char *data, size_t len);
+  void RecordRequest(const RotatorRequest &req, uint16_t channel = 0);
+
+  uint64_t DroppedRecords() const { return droppedRecords.load(); }
+};
+
+class TraceReader {
+private:
+  FILE *file = nullptr;
+  void *gzFile = nullptr;
+
+  bool readRaw(char *buf, size_t len);
+
+public:
+  ~TraceReader();
+
+  bool Open(std::string path);
+  void Close();
+
+  // false on end of file or truncated record
+  bool Next(TraceRecord &record);
+};
+
+// Feeds TRACE_SINK_REQUEST records of a trace into a sink, either with the
+// recorded timing (realtime) or back to back. A trace of several pipelines
+// (PipelineHost) has each one's requests on its own channel; channel picks
+// one of them, -1 takes every record.
+class TraceReplayer {
+public:
+  struct Stats {
+    uint64_t replayed = 0;
+    uint64_t failed = 0;
+    uint64_t skipped = 0;
+  };
+
+  static Stats Replay(std::string path, RotatorController &sink, bool realtime, int timeout_msec = 1000,
+                      int channel = -1);
+};
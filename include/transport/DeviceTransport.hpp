@@ -0,0 +1,38 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+
+// Byte stream to a device, under the sink's protocol logic.
+// Send/Recv transfer the whole buffer (like send_fixed / recv_fixed) and
+// return its length, or -1 on error.
+class DeviceTransport {
+public:
+  virtual ~DeviceTransport() = default;
+
+  virtual bool Open() = 0;
+  virtual void Close() = 0;
+
+  virtual int Send(const char *buf, size_t buflen) = 0;
+  virtual int Recv(char *buf, size_t buflen) = 0;
+
+  // a query and its reply: tx (may be empty) out, then rx filled; the
+  // length of rx, or -1 if either part failed
+  virtual int Transact(const char *tx, size_t txlen, char *rx, size_t rxlen) {
+    if (txlen > 0 && Send(tx, txlen) == -1) {
+      return -1;
+    }
+    return Recv(rx, rxlen);
+  }
+
+  // for log lines
+  virtual std::string Describe() const = 0;
+
+  // (ms) deadline of each Send / Recv / Transact; past it they fail, and the
+  // link should be reopened (a late reply would be taken for the next one)
+  virtual void SetIoTimeout(int) {}
+  // from another thread: fail an operation blocked on the device now
+  virtual void Abort() {}
+
+  // simulated devices follow the sink's clock
+  virtual void SetClock(Clock *) {}
+};
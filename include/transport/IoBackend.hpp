@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+// How sockets are served, chosen once at startup (--io-backend):
+// - blocking: a thread per client, send_fixed / recv_fixed (every platform)
+// - epoll: one reactor thread per source, lines handed to a worker pool;
+//   device sockets stay blocking
+// - uring: the reactor on io_uring (multishot accept / recv into a registered
+//   buffer ring), device query-reply pairs as linked send/recv
+// uring falls back to epoll where the kernel refuses io_uring, epoll to
+// blocking off Linux.
+enum IoBackend {
+  IO_BLOCKING,
+  IO_EPOLL,
+  IO_URING
+};
+
+bool ParseIoBackend(std::string name, IoBackend &backend);
+const char *IoBackendName(IoBackend backend);
+
+// returns the backend actually in effect
+IoBackend SetIoBackend(IoBackend backend);
+// for sockets opened from now on
+IoBackend CurrentIoBackend();
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "RotatorCommon.hpp"
+#include "transport/IoBackend.hpp"
+
+// Readiness / completion loop for the socket sources (IO_EPOLL, IO_URING).
+//
+// Runs on one thread: Listen(), Watch() and Remove() are called before Run()
+// or from the handlers and posted tasks, which run on that thread and must
+// not block. Post() and Stop() may be called from anywhere, so one reactor
+// can serve the sockets of several sources (PipelineHost's shards).
+class IoReactor {
+public:
+  // a new connection on a listening socket
+  using AcceptHandler = std::function<void(int fd, const sockaddr_in &addr)>;
+  // bytes received; len <= 0 once the peer closed or on error, after which
+  // the socket is no longer watched (the owner closes it)
+  using DataHandler = std::function<void(const char *data, int len)>;
+
+  virtual ~IoReactor() = default;
+
+  virtual bool Listen(int fd, AcceptHandler handler) = 0;
+  virtual bool Watch(int fd, DataHandler handler) = 0;
+  // stops watching fd without calling its handler again; the owner closes it
+  virtual void Remove(int fd) = 0;
+
+  // runs task on the reactor thread, in order of posting
+  virtual void Post(std::function<void()> task) = 0;
+
+  // until Stop(); false if the loop failed
+  virtual bool Run() = 0;
+  virtual void Stop() = 0;
+
+  // nullptr for IO_BLOCKING or if the backend cannot be set up
+  static std::unique_ptr<IoReactor> Create(IoBackend backend);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "transport/DeviceTransport.hpp"
+
+// Direct POSIX serial port (8N1, raw). Frames can be paced with an
+// inter-frame gap counted in character times at the configured baud rate;
+// with no gap, a coalesced buffer of several frames goes out in one write().
+class SerialTransport : public DeviceTransport {
+private:
+  std::string device;
+  int baud;
+  int frameSize;      // (bytes) frame boundary for pacing
+  double frameGap;    // (character times) idle time between frames, 0: none
+  int recvTimeout;    // (ms)
+
+  int fd = -1;
+  std::chrono::steady_clock::time_point lineIdleAt;  // when the last written byte has left the UART
+
+  double charTime() const;  // (s) 10 bits per character
+  int writeAll(const char *buf, size_t buflen);
+
+public:
+  SerialTransport(std::string device, int baud, int frameSize, double frameGap, int recvTimeout);
+
+  virtual bool Open() override;
+  virtual void Close() override;
+  virtual int Send(const char *buf, size_t buflen) override;
+  virtual int Recv(char *buf, size_t buflen) override;
+  virtual std::string Describe() const override;
+  virtual void SetIoTimeout(int timeout) override { recvTimeout = timeout; }
+};
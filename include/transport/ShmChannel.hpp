@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+// Shared-memory channel between the bridge and co-located consumers
+// (tracker, SDR recorder, logger): one POSIX shared-memory segment
+// (/dev/shm/<name>) holding
+// - the telemetry: last position read from the device, last target, state
+//   and timestamps, behind a seqlock. Readers never block the bridge and
+//   make no system call; a read that overlapped an update is retried
+// - a lock-free single-producer single-consumer command ring: one consumer
+//   process pushes, the bridge pops
+// Plain data only, native byte order; another language maps the layout
+// below, checking magic, version and size first.
+//
+// The bridge creates the segment (Create) and unlinks it when the last
+// element using it goes away; consumers Attach. The bridge's writers in one
+// process (ShmSource, TelemetryStage) share one mapping and writer lock.
+
+enum ShmCommandType : uint32_t {
+  SHM_SET_POSITION = 1,
+  SHM_STOP = 2,
+  SHM_PARK = 3,
+  SHM_MOVE = 4
+};
+
+struct ShmCommand {
+  uint64_t seq;        // set by Push(): 1, 2, ...
+  uint32_t type;       // ShmCommandType
+  int32_t direction;   // SHM_MOVE: RotatorMoveDirection bits
+  int32_t speed;       // SHM_MOVE: 1 (slowest) .. 100 (fastest)
+  int32_t reserved;
+  double azi, ele;     // SHM_SET_POSITION
+};
+
+enum ShmState : uint32_t {
+  SHM_IDLE = 0,    // at the target, or no target yet
+  SHM_MOVING = 1,  // the last position is further than settleTolerance from the target
+  SHM_FAULT = 2    // the last device request failed
+};
+
+enum ShmFlags : uint32_t {
+  SHM_POSITION_VALID = 1,
+  SHM_TARGET_VALID = 2
+};
+
+struct ShmTelemetry {
+  uint32_t flags;          // ShmFlags
+  uint32_t state;          // ShmState
+  double azi, ele;         // last position read from the device
+  double targetAzi, targetEle;
+  int64_t positionTime;    // (ns) Unix time of the position
+  int64_t targetTime;      // (ns) of the target
+  int64_t updateTime;      // (ns) of this record
+  uint64_t commandDone;    // seq of the last ring command completed
+  int32_t commandResult;   // its outcome: 0 done, -1 failed
+  uint32_t reserved;
+};
+
+struct ShmSegment {
+  static const uint32_t Magic = 0x4D534252;  // "RBSM"
+  static const uint32_t Version = 1;
+  static const uint32_t RingSize = 64;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;           // sizeof(ShmSegment)
+  int32_t bridgePid;
+
+  alignas(64) std::atomic<uint64_t> telemetrySeq;  // odd while written
+  ShmTelemetry telemetry;
+
+  alignas(64) std::atomic<uint64_t> ringHead;      // commands pushed; written by the consumer
+  alignas(64) std::atomic<uint64_t> ringTail;      // commands popped; written by the bridge
+  alignas(64) ShmCommand ring[RingSize];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the segment needs address-free atomics");
+
+class ShmChannel {
+public:
+  static constexpr double settleTolerance = 1.0;  // (deg)
+
+private:
+  std::string name;
+  ShmSegment *segment = nullptr;
+  bool owner = false;
+
+  // bridge side: the record being written, updated field by field
+  std::mutex writerMutex;
+  ShmTelemetry shadow = {};
+
+  ShmChannel() = default;
+  void publish();  // with writerMutex held
+
+public:
+  ~ShmChannel();
+
+  // bridge side; nullptr if the segment cannot be set up, or a live bridge
+  // already serves it
+  static std::shared_ptr<ShmChannel> Create(const std::string &name);
+  // consumer side; nullptr if there is no (compatible) segment
+  static std::unique_ptr<ShmChannel> Attach(const std::string &name);
+
+  const std::string &Name() const { return name; }
+
+  // bridge side; unixTime (s)
+  void PublishPosition(bool valid, double azi, double ele, double unixTime);
+  // axis 0: azimuth, 1: elevation
+  void PublishTarget(int axis, double value, double unixTime);
+  void PublishCommandDone(uint64_t seq, bool success, double unixTime);
+  std::optional<ShmCommand> Pop();
+
+  // consumer side: false if no consistent record was read in a few tries
+  bool Read(ShmTelemetry &telemetry) const;
+  // the command's seq, 0 if the ring is full
+  uint64_t Push(ShmCommand command);
+};
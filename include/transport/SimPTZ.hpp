@@ -0,0 +1,80 @@
+#pragma once
+
+#include "transport/DeviceTransport.hpp"
+#include <deque>
+#include <map>
+
+// In-process model of the 3025 PTZ speaking Pelco-D, used in place of a
+// real link for replay, tests and benchmarks.
+//
+// Behaviour modelled after the hardware:
+// - every absolute position frame (0x4B / 0x4D) stops the motor, which only
+//   starts moving towards the new target after restartDelay
+// - the axes then move at a fixed maximum speed
+// - pan positions are absolute in [0, 360) with an end stop at 0/360 unless
+//   panContinuous, so 359 -> 1 travels the long way round
+// - pan/tilt speed frames drive the axes continuously until a stop frame
+// - preset call slews both axes at presetSpeed
+// - tilt stays in [tiltMin, 180]
+class SimPTZ : public DeviceTransport {
+public:
+  struct Params {
+    double panSpeed = 20.0;      // (deg/s)
+    double tiltSpeed = 10.0;     // (deg/s)
+    double presetSpeed = 40.0;   // (deg/s)
+    double restartDelay = 0.3;   // (s)
+    bool panContinuous = false;
+    double initialPan = 0.0;     // device units (deg)
+    double initialTilt = 90.0;   // device units, 90 - elevation
+    double tiltMin = 0.0;        // < 0: tilts past the zenith (flip mode), sent as 360 + tilt
+  };
+
+private:
+  struct Axis {
+    double pos = 0;
+    double target = 0;
+    bool moving = false;       // towards target
+    double velocity = 0;       // (deg/s) manual speed mode, signed
+    double speedLimit = 0;     // (deg/s) for the current target move
+    Clock::TimePoint startAt;  // motor restart
+  };
+
+  Params params;
+  std::string name;
+  Clock *clock = Clock::Steady();
+
+  mutable std::mutex stateMutex;
+  Axis pan, tilt;
+  std::map<int, std::pair<double, double>> presets;
+  Clock::TimePoint lastUpdate;
+
+  std::string rxPartial;       // bytes towards the next frame
+  std::deque<char> txQueue;    // replies for Recv()
+
+  uint64_t framesReceived = 0;
+  uint64_t motorRestarts = 0;
+  uint64_t queriesReceived = 0;
+
+  void advance(Clock::TimePoint now);
+  void advanceAxis(Axis &axis, double dt, Clock::TimePoint now, bool wrap);
+  void handleFrame(const unsigned char *frame);
+  void startMove(Axis &axis, double target, double speed, Clock::TimePoint now);
+  void queueReply(unsigned char cmd2, double value);
+
+public:
+  SimPTZ(Params params, std::string name = "sim");
+
+  virtual bool Open() override;
+  virtual void Close() override;
+  virtual int Send(const char *buf, size_t buflen) override;
+  virtual int Recv(char *buf, size_t buflen) override;
+  virtual std::string Describe() const override;
+  virtual void SetClock(Clock *clock) override;
+
+  // observation, in device units
+  void GetPosition(double &panPos, double &tiltPos);
+  uint64_t FramesReceived() const;
+  uint64_t MotorRestarts() const;
+  // position queries among FramesReceived()
+  uint64_t QueriesReceived() const;
+};
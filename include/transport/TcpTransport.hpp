@@ -0,0 +1,50 @@
+#pragma once
+
+#include "transport/DeviceTransport.hpp"
+#include "transport/Uring.hpp"
+
+// device behind a TCP-to-serial converter
+//
+// With the uring I/O backend, Send / Recv / Transact go through a small
+// io_uring of their own on the registered socket: a query and its reply are
+// one linked send -> recv submission, one system call per round trip.
+// Every operation has a deadline (SetIoTimeout): a converter that accepts
+// the connection but whose head stopped answering fails the read instead of
+// blocking the sink forever.
+class TcpTransport : public DeviceTransport {
+private:
+  std::string tcpHost;
+  int tcpPort;
+  int sock = -1;
+  std::mutex sockMutex;   // Close against Abort from another thread
+  int ioTimeout = 1000;   // (ms)
+
+  std::mutex ringMutex;
+  std::unique_ptr<UringQueue> ring;
+
+  // (tx, txlen) linked before (rx, rxlen), either may be empty; each of them
+  // is linked to a timeout
+  int uringTransfer(const char *tx, size_t txlen, char *rx, size_t rxlen);
+  // recv_fixed within ioTimeout
+  int recvWithin(char *buf, size_t buflen);
+
+public:
+  TcpTransport(std::string tcpHost, int tcpPort);
+
+  virtual bool Open() override;
+  virtual void Close() override;
+  virtual int Send(const char *buf, size_t buflen) override;
+  virtual int Recv(char *buf, size_t buflen) override;
+  virtual int Transact(const char *tx, size_t txlen, char *rx, size_t rxlen) override;
+  virtual std::string Describe() const override;
+  virtual void SetIoTimeout(int timeout) override;
+  virtual void Abort() override;
+
+  // for line protocols: whatever is available, blocking until at least one
+  // byte arrives; 0 on orderly close, -1 on error
+  int RecvSome(char *buf, size_t buflen);
+  // the same, failing with -1 once deadline has passed
+  int RecvSomeUntil(char *buf, size_t buflen, std::chrono::steady_clock::time_point deadline);
+  // wake a reader blocked in Recv/RecvSome from another thread
+  void Shutdown();
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef RBRIDGE_HAVE_IO_URING
+#include <linux/io_uring.h>
+#else
+struct io_uring_sqe;
+struct io_uring_cqe;
+#endif
+
+// Minimal io_uring on the raw syscalls (no liburing): one submission and one
+// completion ring, owned by a single thread.
+class UringQueue {
+private:
+  int ringFd = -1;
+
+  void *sqMap = nullptr, *cqMap = nullptr, *sqeMap = nullptr;
+  size_t sqMapSize = 0, cqMapSize = 0, sqeMapSize = 0;
+
+  unsigned *sqHead = nullptr, *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+  unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+  io_uring_sqe *sqes = nullptr;
+  io_uring_cqe *cqes = nullptr;
+
+  unsigned sqLocalTail = 0;   // queued, not yet published
+  unsigned toSubmit = 0;
+  uint64_t enters = 0;
+
+  // provided buffers (ProvideBuffers)
+  char *bufBase = nullptr;
+  unsigned bufCount = 0, bufSize = 0;
+  uint16_t bufGroup = 0;
+
+  bool queueProvide(unsigned first, unsigned count);
+
+public:
+  UringQueue() = default;
+  ~UringQueue();
+  UringQueue(const UringQueue &) = delete;
+  UringQueue &operator=(const UringQueue &) = delete;
+
+  // false if the kernel (or a seccomp policy) refuses io_uring
+  bool Init(unsigned entries);
+  static bool Available();
+
+  // a zeroed entry, submitted with the next Submit(); nullptr when full
+  io_uring_sqe *GetSqe();
+  // hands queued entries to the kernel and waits for waitFor completions;
+  // one io_uring_enter. Returns -errno on failure.
+  int Submit(unsigned waitFor = 0);
+
+  // next completion without waiting; release it with SeenCqe()
+  io_uring_cqe *PeekCqe();
+  void SeenCqe();
+
+  int RegisterFiles(const int *fds, unsigned count);
+
+  // a pool of count buffers of size bytes in the kernel, for
+  // IOSQE_BUFFER_SELECT receives in group; handed over with the next Submit()
+  bool ProvideBuffers(uint16_t group, unsigned count, unsigned size);
+  char *Buffer(unsigned id) { return bufBase + (size_t)id * bufSize; }
+  // back to the pool once the completion that used it is handled
+  void RecycleBuffer(unsigned id);
+
+  // io_uring_enter calls so far
+  uint64_t Enters() const { return enters; }
+};
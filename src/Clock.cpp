@@ -0,0 +1,218 @@
+#include "Clock.hpp"
+#include <algorithm>
+
+Clock *Clock::Steady()
+{
+  static SteadyClock steady;
+  return &steady;
+}
+
+void Clock::SleepUntil(TimePoint deadline)
+{
+  std::mutex mutex;
+  std::condition_variable event;
+  std::unique_lock<std::mutex> lk(mutex);
+  WaitUntil(lk, event, deadline, [] { return false; });
+}
+
+std::thread Clock::Spawn(std::function<void()> body)
+{
+  reserve();
+  return std::thread([this, body]() {
+    adopt();
+    body();
+    Detach();
+  });
+}
+
+Clock::TimePoint SteadyClock::Now()
+{
+  return std::chrono::steady_clock::now();
+}
+
+double SteadyClock::UnixTime()
+{
+  return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool SteadyClock::WaitUntil(std::unique_lock<std::mutex> &lk, std::condition_variable &cv, TimePoint deadline,
+                            const std::function<bool()> &pred)
+{
+  if (deadline == TimePoint::max()) {
+    cv.wait(lk, pred);
+    return true;
+  }
+  return cv.wait_until(lk, deadline, pred);
+}
+
+void SteadyClock::Notify(std::condition_variable &cv)
+{
+  cv.notify_all();
+}
+
+// the VirtualClock this thread is attached to, and how often
+static thread_local struct {
+  VirtualClock *clock = nullptr;
+  int depth = 0;
+} attachment;
+
+VirtualClock::VirtualClock(double unixEpoch)
+  : now(std::chrono::steady_clock::now()), start(now)
+{
+  if (unixEpoch == 0) {
+    unixEpoch = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+  this->unixEpoch = unixEpoch;
+}
+
+Clock::TimePoint VirtualClock::Now()
+{
+  std::lock_guard<std::mutex> lk(mutex);
+  return now;
+}
+
+double VirtualClock::UnixTime()
+{
+  std::lock_guard<std::mutex> lk(mutex);
+  return unixEpoch + std::chrono::duration<double>(now - start).count();
+}
+
+bool VirtualClock::isAttached()
+{
+  return attachment.clock == this && attachment.depth > 0;
+}
+
+void VirtualClock::wake(TimePoint until)
+{
+  for (Waiter *waiter : waiters) {
+    if (!waiter->woken && waiter->deadline <= until) {
+      waiter->woken = true;
+      waiter->cv->notify_all();
+    }
+  }
+}
+
+void VirtualClock::autoAdvance()
+{
+  if (attached == 0 || attachedWaiting < attached) {
+    return;
+  }
+
+  TimePoint earliest = TimePoint::max();
+  for (Waiter *waiter : waiters) {
+    if (waiter->woken) {
+      // about to run
+      return;
+    }
+    earliest = (std::min)(earliest, waiter->deadline);
+  }
+  if (earliest == TimePoint::max()) {
+    // everyone waits for an event from outside
+    return;
+  }
+
+  now = (std::max)(now, earliest);
+  wake(now);
+}
+
+bool VirtualClock::WaitUntil(std::unique_lock<std::mutex> &lk, std::condition_variable &cv, TimePoint deadline,
+                             const std::function<bool()> &pred)
+{
+  bool attachedThread = isAttached();
+
+  while (!pred()) {
+    Waiter waiter{&cv, deadline, attachedThread};
+    {
+      std::lock_guard<std::mutex> clk(mutex);
+      if (now >= deadline) {
+        return false;
+      }
+      waiters.push_back(&waiter);
+      if (attachedThread) {
+        attachedWaiting++;
+      }
+      autoAdvance();
+    }
+
+    // woken through Notify() or time, or pred() turned true on a plain
+    // notify; the short real timeout covers a Notify() that lands between
+    // registering above and blocking on cv
+    while (true) {
+      {
+        std::lock_guard<std::mutex> clk(mutex);
+        if (waiter.woken) {
+          break;
+        }
+      }
+      if (pred()) {
+        break;
+      }
+      cv.wait_for(lk, std::chrono::milliseconds(1));
+    }
+
+    {
+      std::lock_guard<std::mutex> clk(mutex);
+      waiters.erase(std::find(waiters.begin(), waiters.end(), &waiter));
+      if (attachedThread) {
+        attachedWaiting--;
+      }
+      autoAdvance();
+    }
+  }
+  return true;
+}
+
+void VirtualClock::Notify(std::condition_variable &cv)
+{
+  std::lock_guard<std::mutex> lk(mutex);
+  for (Waiter *waiter : waiters) {
+    if (waiter->cv == &cv) {
+      waiter->woken = true;
+    }
+  }
+  cv.notify_all();
+}
+
+void VirtualClock::Attach()
+{
+  if (attachment.clock == this) {
+    attachment.depth++;
+    return;
+  }
+  attachment.clock = this;
+  attachment.depth = 1;
+
+  std::lock_guard<std::mutex> lk(mutex);
+  attached++;
+}
+
+void VirtualClock::reserve()
+{
+  std::lock_guard<std::mutex> lk(mutex);
+  attached++;
+}
+
+void VirtualClock::adopt()
+{
+  attachment.clock = this;
+  attachment.depth = 1;
+}
+
+void VirtualClock::Detach()
+{
+  if (attachment.clock != this || --attachment.depth > 0) {
+    return;
+  }
+  attachment.clock = nullptr;
+
+  std::lock_guard<std::mutex> lk(mutex);
+  attached--;
+  autoAdvance();
+}
+
+void VirtualClock::Advance(Duration duration)
+{
+  std::lock_guard<std::mutex> lk(mutex);
+  now += duration;
+  wake(now);
+}
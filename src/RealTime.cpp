@@ -0,0 +1,87 @@
+#include "RealTime.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#ifdef __linux__
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+// touched once per thread, so its stack is mapped (and locked) before use
+static const size_t stackPrefault = 128 * 1024;
+
+#ifdef __linux__
+static bool lockMemory()
+{
+  static std::once_flag once;
+  static bool locked = false;
+  std::call_once(once, []() {
+    // freed memory stays mapped, and large blocks come from the locked heap
+    // instead of fresh mmaps
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      fprintf(stderr, "RealTime: mlockall: %s\n", strerror(errno));
+      return;
+    }
+    locked = true;
+  });
+  return locked;
+}
+
+static void prefaultStack()
+{
+  volatile char stack[stackPrefault];
+  for (size_t i = 0; i < sizeof(stack); i += 4096) {
+    stack[i] = 0;
+  }
+}
+#endif
+
+bool EnterRealTime(const char *who, const RealTimeParams &params)
+{
+  bool ok = true;
+#ifdef __linux__
+  if (params.lockMemory) {
+    ok &= lockMemory();
+    prefaultStack();
+  }
+
+  if (params.cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(params.cpu, &set);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+      fprintf(stderr, "RealTime: %s: cannot pin to cpu %d: %s\n", who, params.cpu, strerror(ret));
+      ok = false;
+    }
+  }
+
+  if (params.priority > 0) {
+    struct sched_param sched;
+    memset(&sched, 0, sizeof(sched));
+    sched.sched_priority = params.priority;
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sched);
+    if (ret != 0) {
+      fprintf(stderr, "RealTime: %s: SCHED_FIFO %d refused: %s\n", who, params.priority, strerror(ret));
+      ok = false;
+    }
+  }
+
+  if (ok) {
+    printf("RealTime: %s: SCHED_%s %d, cpu %d%s\n", who, params.priority > 0 ? "FIFO" : "OTHER", params.priority,
+           params.cpu, params.lockMemory ? ", memory locked" : "");
+  }
+#else
+  if (params.Enabled()) {
+    fprintf(stderr, "RealTime: %s: not supported on this platform\n", who);
+    ok = false;
+  }
+#endif
+  return ok;
+}
@@ -0,0 +1,220 @@
+#include "api/Bridge.hpp"
+#include "pipeline/Pipeline.hpp"
+#include "rotators/PositionQuery.hpp"
+#include <shared_mutex>
+
+struct Bridge::Impl {
+  Pipeline pipeline;
+  PositionQuery query;
+  int timeout = 1000;  // (ms)
+  int queryShare = 0;  // (ms)
+
+  // shared by the calls while they submit, exclusive for Start() / Stop()
+  mutable std::shared_mutex stateMutex;
+  bool running = false;
+  bool stopped = false;  // a Pipeline is started once
+
+  bool submit(RotatorRequest req, RotatorCallback callback) {
+    std::shared_lock<std::shared_mutex> lk(stateMutex);
+    return running && pipeline.Request(req, callback);
+  }
+
+  Result request(std::vector<RotatorRequest> reqs) {
+    if (!Running()) {
+      return NOT_RUNNING;
+    }
+    ResponseLatch latch(reqs.size(), Clock::Steady(), timeout);
+    RotatorRequestHandler handler = [this](RotatorRequest req, RotatorCallback callback) {
+      return submit(req, callback);
+    };
+    for (size_t i = 0; i < reqs.size(); i++) {
+      latch.Submit(handler, reqs[i], i);
+    }
+    if (!latch.Wait()) {
+      return TIMEOUT;
+    }
+    for (size_t i = 0; i < reqs.size(); i++) {
+      if (!latch.Get(i)->success) {
+        return FAILED;
+      }
+    }
+    return OK;
+  }
+
+  bool Running() const {
+    std::shared_lock<std::shared_mutex> lk(stateMutex);
+    return running;
+  }
+};
+
+static RotatorRequest positionRequest(RotatorCmd cmd, double value)
+{
+  RotatorRequest req;
+  req.cmd = cmd;
+  if (cmd == CHANGE_AZI) {
+    req.payload.ChangeAzi.aziRequested = value;
+  } else {
+    req.payload.ChangeEle.eleRequested = value;
+  }
+  return req;
+}
+
+Bridge::Bridge()
+  : impl(std::make_unique<Impl>())
+{
+}
+
+Bridge::~Bridge()
+{
+  Stop();
+}
+
+Bridge::Result Bridge::LoadConfig(const std::string &path)
+{
+  if (impl->Running()) {
+    return BAD_CONFIG;
+  }
+  return impl->pipeline.LoadConfig(path) ? OK : BAD_CONFIG;
+}
+
+Bridge::Result Bridge::AddConfigLine(const std::string &line)
+{
+  if (impl->Running()) {
+    return BAD_CONFIG;
+  }
+  return impl->pipeline.AddConfigLine(line) ? OK : BAD_CONFIG;
+}
+
+void Bridge::SetTimeout(int msec)
+{
+  impl->timeout = msec;
+}
+
+void Bridge::SetQueryShare(int msec)
+{
+  impl->queryShare = msec;
+}
+
+Bridge::Result Bridge::Start()
+{
+  std::unique_lock<std::shared_mutex> lk(impl->stateMutex);
+  if (impl->running) {
+    return OK;
+  }
+  if (impl->stopped) {
+    fprintf(stderr, "Bridge: cannot start again after Stop()\n");
+    return NOT_RUNNING;
+  }
+  if (!impl->pipeline.Validate("bridge config")) {
+    return BAD_CONFIG;
+  }
+
+  SOCKET_INIT();
+  Impl *state = impl.get();
+  impl->query.Initialize([state](RotatorRequest req, RotatorCallback callback) {
+    return state->submit(req, callback);
+  }, impl->queryShare, impl->timeout);
+  impl->pipeline.Start();
+  impl->running = true;
+  return OK;
+}
+
+void Bridge::Stop()
+{
+  {
+    std::unique_lock<std::shared_mutex> lk(impl->stateMutex);
+    if (!impl->running) {
+      return;
+    }
+    impl->running = false;
+    impl->stopped = true;
+  }
+  // requests queued before are answered or expire with their callers
+  impl->pipeline.Terminate();
+  SOCKET_EXIT();
+}
+
+bool Bridge::Running() const
+{
+  return impl->Running();
+}
+
+Bridge::Result Bridge::SetPosition(double azi, double ele)
+{
+  return impl->request({positionRequest(CHANGE_AZI, azi), positionRequest(CHANGE_ELE, ele)});
+}
+
+Bridge::Result Bridge::GetPosition(double &azi, double &ele)
+{
+  if (!impl->Running()) {
+    return NOT_RUNNING;
+  }
+  PositionQuery::Position pos = impl->query.Query();
+  if (!pos.valid) {
+    return FAILED;
+  }
+  azi = pos.azi;
+  ele = pos.ele;
+  return OK;
+}
+
+Bridge::Result Bridge::StopMotion()
+{
+  RotatorRequest req;
+  req.cmd = ROTATOR_STOP;
+  return impl->request({req});
+}
+
+Bridge::Result Bridge::Park()
+{
+  RotatorRequest req;
+  req.cmd = ROTATOR_PARK;
+  return impl->request({req});
+}
+
+Bridge::Result Bridge::Move(int direction, int speed)
+{
+  RotatorRequest req;
+  req.cmd = ROTATOR_MOVE;
+  req.payload.Move.direction = direction;
+  req.payload.Move.speed = (std::max)(1, (std::min)(100, speed));
+  return impl->request({req});
+}
+
+Bridge::Result Bridge::SetPositionAsync(double azi, double ele, Done done)
+{
+  // the second response completes the pair
+  struct Pair {
+    std::mutex mutex;
+    int remaining = 2;
+    bool success = true;
+    Done done;
+  };
+  auto pair = std::make_shared<Pair>();
+  pair->done = done;
+  auto callback = [pair](RotatorResponse resp) {
+    bool success;
+    {
+      std::lock_guard<std::mutex> lk(pair->mutex);
+      pair->success &= resp.success;
+      if (--pair->remaining > 0) {
+        return;
+      }
+      success = pair->success;
+    }
+    if (pair->done) {
+      pair->done(success ? OK : FAILED);
+    }
+  };
+
+  if (!impl->submit(positionRequest(CHANGE_AZI, azi), callback)) {
+    return impl->Running() ? FAILED : NOT_RUNNING;
+  }
+  if (!impl->submit(positionRequest(CHANGE_ELE, ele), callback)) {
+    // the azimuth still completes the pair, as failed
+    RotatorResponse resp;
+    resp.success = false;
+    callback(resp);
+  }
+  return OK;
+}
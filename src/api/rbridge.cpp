@@ -0,0 +1,127 @@
+#include "api/rbridge.h"
+#include "api/Bridge.hpp"
+#include <cstdio>
+#include <exception>
+#include <new>
+
+static_assert(RBRIDGE_API_VERSION == Bridge::ApiVersion, "rbridge.h and Bridge.hpp disagree");
+static_assert(RBRIDGE_ENOTRUNNING == Bridge::NOT_RUNNING && RBRIDGE_ETIMEOUT == Bridge::TIMEOUT &&
+              RBRIDGE_EFAILED == Bridge::FAILED && RBRIDGE_ECONFIG == Bridge::BAD_CONFIG,
+              "rbridge.h and Bridge.hpp disagree on the results");
+
+struct rbridge {
+  Bridge bridge;
+};
+
+// no exception crosses into C
+template<typename F>
+static int guarded(const char *call, F f)
+{
+  try {
+    return f();
+  } catch (const std::exception &e) {
+    fprintf(stderr, "rbridge: %s: %s\n", call, e.what());
+  } catch (...) {
+    fprintf(stderr, "rbridge: %s: unknown exception\n", call);
+  }
+  return RBRIDGE_EFAILED;
+}
+
+extern "C" {
+
+int rbridge_api_version(void)
+{
+  return Bridge::ApiVersion;
+}
+
+rbridge *rbridge_create(void)
+{
+  return new (std::nothrow) rbridge();
+}
+
+void rbridge_destroy(rbridge *bridge)
+{
+  guarded("rbridge_destroy", [bridge]() {
+    delete bridge;
+    return RBRIDGE_OK;
+  });
+}
+
+int rbridge_load_config(rbridge *bridge, const char *path)
+{
+  return guarded("rbridge_load_config", [=]() { return (int)bridge->bridge.LoadConfig(path); });
+}
+
+int rbridge_config_line(rbridge *bridge, const char *line)
+{
+  return guarded("rbridge_config_line", [=]() { return (int)bridge->bridge.AddConfigLine(line); });
+}
+
+void rbridge_set_timeout(rbridge *bridge, int msec)
+{
+  bridge->bridge.SetTimeout(msec);
+}
+
+void rbridge_set_query_share(rbridge *bridge, int msec)
+{
+  bridge->bridge.SetQueryShare(msec);
+}
+
+int rbridge_start(rbridge *bridge)
+{
+  return guarded("rbridge_start", [=]() { return (int)bridge->bridge.Start(); });
+}
+
+void rbridge_stop(rbridge *bridge)
+{
+  guarded("rbridge_stop", [=]() {
+    bridge->bridge.Stop();
+    return RBRIDGE_OK;
+  });
+}
+
+int rbridge_set_position(rbridge *bridge, double azi, double ele)
+{
+  return guarded("rbridge_set_position", [=]() { return (int)bridge->bridge.SetPosition(azi, ele); });
+}
+
+int rbridge_get_position(rbridge *bridge, double *azi, double *ele)
+{
+  return guarded("rbridge_get_position", [=]() {
+    double gotAzi = 0, gotEle = 0;
+    int ret = bridge->bridge.GetPosition(gotAzi, gotEle);
+    if (ret == RBRIDGE_OK) {
+      *azi = gotAzi;
+      *ele = gotEle;
+    }
+    return ret;
+  });
+}
+
+int rbridge_stop_motion(rbridge *bridge)
+{
+  return guarded("rbridge_stop_motion", [=]() { return (int)bridge->bridge.StopMotion(); });
+}
+
+int rbridge_park(rbridge *bridge)
+{
+  return guarded("rbridge_park", [=]() { return (int)bridge->bridge.Park(); });
+}
+
+int rbridge_move(rbridge *bridge, int direction, int speed)
+{
+  return guarded("rbridge_move", [=]() { return (int)bridge->bridge.Move(direction, speed); });
+}
+
+int rbridge_set_position_async(rbridge *bridge, double azi, double ele, rbridge_done done, void *context)
+{
+  return guarded("rbridge_set_position_async", [=]() {
+    Bridge::Done callback;
+    if (done != nullptr) {
+      callback = [done, context](Bridge::Result result) { done(context, result); };
+    }
+    return (int)bridge->bridge.SetPositionAsync(azi, ele, callback);
+  });
+}
+
+}
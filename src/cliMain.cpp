@@ -2,22 +2,60 @@
 #include <iostream>
 #include "rotators/CamPTZ.hpp"
 #include "rotators/rotctld.hpp"
+#include "rotators/RotctldSink.hpp"
+#include "pipeline/Pipeline.hpp"
+#include "pipeline/PipelineHost.hpp"
+#include "trace/TraceLog.hpp"
+#include "transport/IoBackend.hpp"
+#include "transport/SerialTransport.hpp"
+#include "transport/SimPTZ.hpp"
 #include "RotatorCommon.hpp"
 
-// TODO: split pipeline
 int main(int argc, char *argv[]) {
   popl::OptionParser op("Allowed options");
   auto helpOption   = op.add<popl::Switch>("h", "help", "produce help message");
+  auto pipelineConfig = op.add<popl::Value<std::string>>("", "pipeline", "Pipeline config file; replaces the source/sink options below");
+  auto hostConfig = op.add<popl::Value<std::string>>("", "pipelines", "Host config file: several independent pipelines in this process, sharded across the CPU cores; replaces --pipeline and the source/sink options");
+  auto extraSources = op.add<popl::Value<std::string>>("", "source", "Additional source as a pipeline config line without the leading 'source', e.g. \"gs232 transport=pty link=/tmp/ttyGS232\"; repeatable");
+  auto shmChannel = op.add<popl::Implicit<std::string>>("", "shm", "Serve local processes through this shared-memory channel: commands (source shm) and telemetry (stage telemetry, after the other stages)", "/rbridge");
   auto srcTcpHost = op.add<popl::Implicit<std::string>>("", "rotctld-tcp-host", "TCP host to bind for source", "0.0.0.0");
   auto srcTcpPort = op.add<popl::Implicit<int>>("", "rotctld-tcp-port", "TCP port to bind for source", 4533);
+  auto srcUnixPath = op.add<popl::Implicit<std::string>>("", "rotctld-unix", "Also serve rotctld on this Unix domain socket, for local clients", "/tmp/rbridge.sock");
+  auto srcUdpPort = op.add<popl::Implicit<int>>("", "rotctld-udp-port", "Also take rotctld commands as sequence-numbered UDP datagrams ('<seq> P <azi> <ele>') on this port; late datagrams are dropped, position targets latest-wins", 4540);
+  auto srcQueryShare = op.add<popl::Implicit<int>>("", "rotctld-query-share", "Serve position polls from a device query younger than this (ms); concurrent polls always share one query", 0);
+  auto srcArbitration = op.add<popl::Implicit<std::string>>("", "rotctld-arbitration", "Move arbitration between clients: none, owner, priority, lww", "none");
+  auto srcHoldOff = op.add<popl::Implicit<int>>("", "rotctld-hold-off", "Arbitration hold-off (ms)", 2000);
+  auto srcOwnerIdle = op.add<popl::Implicit<int>>("", "rotctld-owner-idle", "Owner arbitration: release after this long without a move (ms), 0: until disconnect", 0);
+  auto srcPriorities = op.add<popl::Implicit<std::string>>("", "rotctld-priorities", "Client priorities for priority arbitration, as addr:prio,addr:prio", "");
   auto sinkTcpHost = op.add<popl::Implicit<std::string>>("", "rotator-tcp-host", "TCP host of rotator", "192.168.3.136");
   auto sinkTcpPort  = op.add<popl::Implicit<int>>("", "rotator-tcp-port", "TCP port of rotator", 4196);
+  auto sinkSerial = op.add<popl::Value<std::string>>("", "rotator-serial", "Serial device of rotator, instead of TCP");
+  auto sinkBaud = op.add<popl::Implicit<int>>("", "rotator-baud", "Baud rate of the rotator serial device", 2400);
+  auto sinkFrameGap = op.add<popl::Implicit<double>>("", "rotator-frame-gap", "Idle time between frames on the serial device (character times)", 0.0);
+  auto sinkIoTimeout = op.add<popl::Implicit<int>>("", "rotator-io-timeout", "Deadline of each exchange with the rotator (ms)", 1000);
+  auto sinkWatchdog = op.add<popl::Implicit<double>>("", "rotator-watchdog", "Abort the rotator link when one request runs longer than this (s)", 5.0);
+  auto sinkSim = op.add<popl::Switch>("", "rotator-sim", "Drive a simulated PTZ instead of a device");
+  auto sinkRotctld = op.add<popl::Switch>("", "rotator-rotctld", "Rotator is a hamlib rotctld at the rotator TCP host/port");
+  auto sinkSubscribe = op.add<popl::Implicit<int>>("", "rotator-subscribe", "Ask the downstream rotctld to push the position every <ms> instead of polling it (0: poll), for --rotator-rotctld", 500);
   auto disablePresetReset = op.add<popl::Switch>("", "disable-preset-reset", "Disable preset reset");
+  auto sinkPresets = op.add<popl::Implicit<int>>("", "rotator-presets", "Device presets (from 20 on) kept for park and fixed positions, recalled for large moves (0: none)", 8);
+  auto sinkPresetPositions = op.add<popl::Implicit<std::string>>("", "rotator-preset-positions", "Fixed positions worth a preset besides park, as azi:ele,azi:ele", "");
   auto disableGpredictWalkaround = op.add<popl::Switch>("", "disable-workaround-for-gpredict", "Disable Gpredict walkaround");
   auto sinkAziOffset  = op.add<popl::Implicit<double>>("", "sink-azi-offset", "azi offset of rotator", -9.0);
   auto sinkEleOffset  = op.add<popl::Implicit<double>>("", "sink-ele-offset", "ele offset of rotator", 0.0);
   auto disableSmartSink = op.add<popl::Switch>("", "disable-smart-sink", "Disable smart sink");
+  auto sinkVelocity = op.add<popl::Switch>("", "sink-velocity", "Track with pan/tilt speed commands instead of position commands");
+  auto sinkPanSpeed = op.add<popl::Implicit<double>>("", "sink-pan-speed", "Pan speed of the rotator at the top speed step (deg/s), for --sink-velocity", 20.0);
+  auto sinkTiltSpeed = op.add<popl::Implicit<double>>("", "sink-tilt-speed", "Tilt speed of the rotator at the top speed step (deg/s), for --sink-velocity", 10.0);
   auto disableSinkKeepAlive = op.add<popl::Switch>("", "disable-sink-keepalive", "Disable sink keepalive (5sec rotate cmd autoreplay)");
+  auto traceRecordPath = op.add<popl::Value<std::string>>("", "trace-record", "Record source commands, sink requests and device frames into a binary trace (.gz to compress)");
+  auto replayPath = op.add<popl::Value<std::string>>("", "replay", "Replay sink requests from a trace instead of serving rotctld");
+  auto replayFast = op.add<popl::Switch>("", "replay-fast", "Replay as fast as possible instead of at recorded timing");
+  auto replayChannel = op.add<popl::Implicit<int>>("", "replay-channel", "Replay only the sink requests of this pipeline (1-based, in --pipelines order) of a multi-pipeline trace; -1: all", -1);
+  auto realTimePriority = op.add<popl::Implicit<int>>("", "realtime", "Run the dispatcher and the device threads SCHED_FIFO at this priority (with --pipelines: realtime= in the host config)", 50);
+  auto realTimeCpu = op.add<popl::Implicit<int>>("", "realtime-cpu", "Pin the real-time threads to this CPU", 0);
+  auto lockMemory = op.add<popl::Switch>("", "lock-memory", "Lock the process memory (mlockall) for the real-time threads");
+  auto ioBackend = op.add<popl::Implicit<std::string>>("", "io-backend", "Socket I/O: blocking (thread per client), epoll, uring (falls back to epoll); epoll by default with --pipelines", "blocking");
 
   op.parse(argc, argv);
 
@@ -31,65 +69,157 @@ int main(int argc, char *argv[]) {
 
   SOCKET_INIT();
 
-  auto source = rotctld();
-  source.Initialize(srcTcpHost->value(), srcTcpPort->value(), !disableGpredictWalkaround->is_set());
-
-  auto sink = CamPTZ();
-  sink.Initialize(
-    sinkTcpHost->value(), sinkTcpPort->value(), sinkAziOffset->value(), sinkEleOffset->value(),
-    !disableSmartSink->value(),
-    !disableSinkKeepAlive->value()
-  );
-
-  source.SetRequestHandler([&](RotatorRequest req) -> RotatorResponse {
-    // Visualize
-    if (req.cmd == CHANGE_AZI) {
-      printf("[Pipeline] Requested new Azi change, newAzi=%lf\n", req.payload.ChangeAzi.aziRequested);
-    } else if (req.cmd == CHANGE_ELE) {
-      printf("[Pipeline] Requested new Ele change, newEle=%lf\n", req.payload.ChangeEle.eleRequested);
+  IoBackend backend;
+  if (!ParseIoBackend(ioBackend->value(), backend)) {
+    fprintf(stderr, "main: unknown I/O backend %s\n", ioBackend->value().c_str());
+    return 1;
+  }
+  if (hostConfig->is_set() && !ioBackend->is_set()) {
+    // the shards' reactors serve the sources
+    backend = IO_EPOLL;
+  }
+  SetIoBackend(backend);
+
+  TraceRecorder trace;
+  if (traceRecordPath->is_set() && !trace.Open(traceRecordPath->value())) {
+    return 1;
+  }
+
+  if (hostConfig->is_set()) {
+    PipelineHost host;
+    if (!host.LoadConfig(hostConfig->value())) {
+      return 1;
+    }
+    if (trace.IsOpen()) {
+      host.SetTraceRecorder(&trace);
     }
+    host.Start();
+    host.WaitForClose();
+    trace.Close();
 
-    auto ret = sink.RequestSync(req, 1000);
-    if (!ret.has_value()) {
-      fprintf(stderr, "main: Error while processing request\n");
-      RotatorResponse resp;
-      resp.success = false;
+    SOCKET_EXIT();
+    return 0;
+  }
 
-      return resp;
+  Pipeline pipeline;
+  if (pipelineConfig->is_set()) {
+    if (!pipeline.LoadConfig(pipelineConfig->value())) {
+      return 1;
     }
+  } else {
+    // default: one rotctld feeding one CamPTZ
+    auto source = std::make_unique<rotctld>();
+    source->Initialize(srcTcpHost->value(), srcTcpPort->value(), !disableGpredictWalkaround->is_set());
+    source->SetQuerySharing(srcQueryShare->value());
 
-    return ret.value();
-  });
-  
-  sink.Start();
-  source.Start();
-
-  if (!disablePresetReset->is_set()) {
-    // disable power-on self test
-    RotatorRequest req;
-    req.cmd = CAMPTZ_PRESET_CLEAR;
-    req.payload.CamPTZPreset.presetIdx = 156;
-    sink.Request(req, [](RotatorResponse resp) {
-      if (resp.success) {
-        printf("[Pipeline] Power-on self test for CamPTZ disabled.\n");
-      } else {
-        printf("[Pipeline] ERR while disabling Power-on self test for CamPTZ.\n");
+    MoveArbiter::Policy policy;
+    if (!MoveArbiter::ParsePolicy(srcArbitration->value(), policy)) {
+      fprintf(stderr, "main: unknown arbitration policy %s\n", srcArbitration->value().c_str());
+      return 1;
+    }
+    source->SetArbitration(
+      policy, srcHoldOff->value(), srcOwnerIdle->value(), MoveArbiter::ParsePriorities(srcPriorities->value())
+    );
+    pipeline.AddSource(std::move(source));
+
+    if (sinkRotctld->is_set()) {
+      auto sink = std::make_unique<RotctldSink>();
+      sink->Initialize(sinkTcpHost->value(), sinkTcpPort->value(), disableSmartSink->is_set() ? 0 : 1000);
+      sink->SetSubscription(sinkSubscribe->value());
+      sink->SetIoTimeout(sinkIoTimeout->value());
+      pipeline.SetSink(std::move(sink));
+    } else {
+      auto sink = std::make_unique<CamPTZ>();
+      sink->Initialize(
+        sinkTcpHost->value(), sinkTcpPort->value(), sinkAziOffset->value(), sinkEleOffset->value(),
+        !disableSmartSink->value(),
+        !disableSinkKeepAlive->value()
+      );
+      sink->SetPresetReset(!disablePresetReset->is_set());
+      if (sinkVelocity->is_set()) {
+        VelocityTracker::Params azi, ele;
+        azi.maxSpeed = sinkPanSpeed->value();
+        azi.minPosition = 0;
+        azi.maxPosition = 359.99;
+        ele.maxSpeed = sinkTiltSpeed->value();
+        sink->SetVelocityParams(azi, ele);
+      }
+      sink->SetLinkParams(sinkIoTimeout->value(), sinkWatchdog->value(), CircuitBreaker::Params());
+      if (sinkPresets->is_set()) {
+        PresetBank::Params bank;
+        bank.slots = sinkPresets->value();
+        bank.panSpeed = sinkPanSpeed->value();
+        bank.tiltSpeed = sinkTiltSpeed->value();
+        sink->SetPresetParams(bank, PresetBank::ParsePositions(sinkPresetPositions->value()), 30);
       }
-    });
-
-    // disable automatic zero-returning
-    req.payload.CamPTZPreset.presetIdx = 130;
-    sink.Request(req, [](RotatorResponse resp) {
-      if (resp.success) {
-        printf("[Pipeline] Automatic zero-returning for CamPTZ disabled.\n");
-      } else {
-        printf("[Pipeline] ERR while disabling automatic zero-returning for CamPTZ.\n");
+      if (sinkSim->is_set()) {
+        sink->SetTransport(std::make_unique<SimPTZ>(SimPTZ::Params()));
+      } else if (sinkSerial->is_set()) {
+        sink->SetTransport(std::make_unique<SerialTransport>(
+          sinkSerial->value(), sinkBaud->value(), 7, sinkFrameGap->value(), sinkIoTimeout->value()
+        ));
       }
-    });
+      pipeline.SetSink(std::move(sink));
+    }
+  }
+
+  for (size_t i = 0; i < extraSources->count(); i++) {
+    if (!pipeline.AddConfigLine("source " + extraSources->value(i))) {
+      return 1;
+    }
+  }
+  // same command parser and multi-client options as the TCP listener
+  std::string rotctldOptions =
+    " share-window=" + std::to_string(srcQueryShare->value()) + " arbitration=" + srcArbitration->value() +
+    " hold-off=" + std::to_string(srcHoldOff->value()) + " owner-idle=" + std::to_string(srcOwnerIdle->value()) +
+    (srcPriorities->value().empty() ? "" : " priorities=" + srcPriorities->value());
+  if (srcUnixPath->is_set()) {
+    if (!pipeline.AddConfigLine("source rotctld transport=unix link=" + srcUnixPath->value() + rotctldOptions)) {
+      return 1;
+    }
+  }
+  if (srcUdpPort->is_set()) {
+    if (!pipeline.AddConfigLine("source rotctld transport=udp host=" + srcTcpHost->value() +
+                                " port=" + std::to_string(srcUdpPort->value()) + rotctldOptions)) {
+      return 1;
+    }
+  }
+  if (shmChannel->is_set()) {
+    if (!pipeline.AddConfigLine("source shm name=" + shmChannel->value()) ||
+        !pipeline.AddConfigLine("stage telemetry name=" + shmChannel->value())) {
+      return 1;
+    }
+  }
+
+  if (trace.IsOpen()) {
+    pipeline.SetTraceRecorder(&trace);
+  }
+
+  RealTimeParams realTime;
+  realTime.priority = realTimePriority->is_set() ? realTimePriority->value() : 0;
+  realTime.cpu = realTimeCpu->is_set() ? realTimeCpu->value() : -1;
+  realTime.lockMemory = lockMemory->is_set();
+  pipeline.SetRealTime(realTime);
+
+  if (replayPath->is_set()) {
+    pipeline.SetSourcesEnabled(false);
+    pipeline.Start();
+    auto stats = TraceReplayer::Replay(replayPath->value(), pipeline, !replayFast->is_set(), 1000,
+                                       replayChannel->value());
+    printf("[Replay] replayed=%llu failed=%llu skipped=%llu\n",
+           (unsigned long long)stats.replayed, (unsigned long long)stats.failed,
+           (unsigned long long)stats.skipped);
+    pipeline.Terminate();
+    trace.Close();
+
+    SOCKET_EXIT();
+    return 0;
   }
 
-  source.WaitForClose();
+  pipeline.Start();
+  pipeline.WaitForClose();
+  trace.Close();
   
   SOCKET_EXIT();
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,236 @@
+#include "pipeline/Calibration.hpp"
+#include "pipeline/Stages.hpp"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+bool CalibrationGrid::Load(std::string path, Interpolation interp, double tableRes)
+{
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "CalibrationGrid: cannot open %s\n", path.c_str());
+    return false;
+  }
+
+  std::vector<Node> nodes;
+  std::string line;
+  while (std::getline(file, line)) {
+    auto comment = line.find('#');
+    if (comment != std::string::npos) {
+      line = line.substr(0, comment);
+    }
+    std::istringstream fields(line);
+    Node node;
+    if (fields >> node.azi >> node.ele >> node.dAzi >> node.dEle) {
+      nodes.push_back(node);
+    }
+  }
+
+  if (!Build(nodes, interp, tableRes)) {
+    fprintf(stderr, "CalibrationGrid: %s is not a complete grid\n", path.c_str());
+    return false;
+  }
+  printf("CalibrationGrid: %zu nodes from %s, table %dx%d at %.2f deg\n",
+         nodes.size(), path.c_str(), aziCells, eleCells, tableRes);
+  return true;
+}
+
+bool CalibrationGrid::Save(std::string path, const std::vector<Node> &nodes)
+{
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    perror("Error writing calibration grid");
+    return false;
+  }
+
+  fprintf(file, "# azi ele dazi dele  (device = true + d)\n");
+  for (const auto &node : nodes) {
+    fprintf(file, "%.3f %.3f %.4f %.4f\n", node.azi, node.ele, node.dAzi, node.dEle);
+  }
+  fclose(file);
+  return true;
+}
+
+// Catmull-Rom through p1..p2
+static double catmullRom(double p0, double p1, double p2, double p3, double t)
+{
+  return 0.5 * (2 * p1 + (p2 - p0) * t + (2 * p0 - 5 * p1 + 4 * p2 - p3) * t * t
+                + (3 * p1 - p0 - 3 * p2 + p3) * t * t * t);
+}
+
+bool CalibrationGrid::Build(const std::vector<Node> &nodes, Interpolation interp, double tableRes)
+{
+  std::vector<double> azis, eles;
+  std::map<std::pair<double, double>, std::pair<double, double>> values;
+  for (const auto &node : nodes) {
+    double azi = wrapAzimuth(node.azi);
+    azis.push_back(azi);
+    eles.push_back(node.ele);
+    values[std::make_pair(azi, node.ele)] = std::make_pair(node.dAzi, node.dEle);
+  }
+  std::sort(azis.begin(), azis.end());
+  azis.erase(std::unique(azis.begin(), azis.end()), azis.end());
+  std::sort(eles.begin(), eles.end());
+  eles.erase(std::unique(eles.begin(), eles.end()), eles.end());
+
+  if (azis.empty() || values.size() != azis.size() * eles.size() || tableRes <= 0) {
+    return false;
+  }
+
+  int nAzi = (int)azis.size(), nEle = (int)eles.size();
+  // node value, azimuth index periodic and elevation index clamped
+  auto at = [&](int a, int e) {
+    a = ((a % nAzi) + nAzi) % nAzi;
+    e = (std::max)(0, (std::min)(nEle - 1, e));
+    return values[std::make_pair(azis[a], eles[e])];
+  };
+
+  auto sample = [&](double azi, double ele, double &dAzi, double &dEle) {
+    // azimuth interval, periodic
+    int a = (int)(std::upper_bound(azis.begin(), azis.end(), azi) - azis.begin()) - 1;
+    double a0 = a < 0 ? azis[nAzi - 1] - 360 : azis[a];
+    double a1 = a + 1 < nAzi ? azis[a + 1] : azis[0] + 360;
+    double u = a1 > a0 ? (azi - a0) / (a1 - a0) : 0;
+
+    ele = (std::max)(eles.front(), (std::min)(eles.back(), ele));
+    int e = (std::min)((int)(std::upper_bound(eles.begin(), eles.end(), ele) - eles.begin()) - 1, nEle - 1);
+    double v = e + 1 < nEle ? (ele - eles[e]) / (eles[e + 1] - eles[e]) : 0;
+
+    if (interp == INTERP_SPLINE) {
+      double rowsAzi[4], rowsEle[4];
+      for (int j = 0; j < 4; j++) {
+        auto p0 = at(a - 1, e - 1 + j), p1 = at(a, e - 1 + j), p2 = at(a + 1, e - 1 + j), p3 = at(a + 2, e - 1 + j);
+        rowsAzi[j] = catmullRom(p0.first, p1.first, p2.first, p3.first, u);
+        rowsEle[j] = catmullRom(p0.second, p1.second, p2.second, p3.second, u);
+      }
+      dAzi = catmullRom(rowsAzi[0], rowsAzi[1], rowsAzi[2], rowsAzi[3], v);
+      dEle = catmullRom(rowsEle[0], rowsEle[1], rowsEle[2], rowsEle[3], v);
+    } else {
+      auto p00 = at(a, e), p10 = at(a + 1, e), p01 = at(a, e + 1), p11 = at(a + 1, e + 1);
+      dAzi = (1 - v) * ((1 - u) * p00.first + u * p10.first) + v * ((1 - u) * p01.first + u * p11.first);
+      dEle = (1 - v) * ((1 - u) * p00.second + u * p10.second) + v * ((1 - u) * p01.second + u * p11.second);
+    }
+  };
+
+  this->tableRes = tableRes;
+  eleMin = eles.front();
+  aziCells = (std::max)(1, (int)std::lround(360 / tableRes));
+  eleCells = (int)std::floor((eles.back() - eles.front()) / tableRes) + 1;
+  table.assign((size_t)aziCells * eleCells, Cell{0, 0});
+  for (int r = 0; r < eleCells; r++) {
+    for (int c = 0; c < aziCells; c++) {
+      double dAzi, dEle;
+      sample(c * tableRes, eleMin + r * tableRes, dAzi, dEle);
+      table[(size_t)r * aziCells + c] = Cell{(float)dAzi, (float)dEle};
+    }
+  }
+  return true;
+}
+
+void CalibrationGrid::Correction(double azi, double ele, double &dAzi, double &dEle) const
+{
+  double x = wrapAzimuth(azi) / tableRes;
+  int c0 = (int)x;
+  double fx = x - c0;
+  c0 %= aziCells;
+  int c1 = c0 + 1 == aziCells ? 0 : c0 + 1;
+
+  double y = (std::max)(0.0, (std::min)((double)(eleCells - 1), (ele - eleMin) / tableRes));
+  int r0 = (int)y;
+  double fy = y - r0;
+  int r1 = (std::min)(r0 + 1, eleCells - 1);
+
+  const Cell &p00 = table[(size_t)r0 * aziCells + c0], &p10 = table[(size_t)r0 * aziCells + c1];
+  const Cell &p01 = table[(size_t)r1 * aziCells + c0], &p11 = table[(size_t)r1 * aziCells + c1];
+  dAzi = (1 - fy) * ((1 - fx) * p00.dAzi + fx * p10.dAzi) + fy * ((1 - fx) * p01.dAzi + fx * p11.dAzi);
+  dEle = (1 - fy) * ((1 - fx) * p00.dEle + fx * p10.dEle) + fy * ((1 - fx) * p01.dEle + fx * p11.dEle);
+}
+
+void CalibrationGrid::Forward(double azi, double ele, double &deviceAzi, double &deviceEle) const
+{
+  double dAzi, dEle;
+  Correction(azi, ele, dAzi, dEle);
+  deviceAzi = wrapAzimuth(azi + dAzi);
+  deviceEle = ele + dEle;
+}
+
+void CalibrationGrid::Inverse(double deviceAzi, double deviceEle, double &azi, double &ele) const
+{
+  // corrections vary slowly over the sky, so this converges in a few steps
+  azi = deviceAzi;
+  ele = deviceEle;
+  for (int i = 0; i < 4; i++) {
+    double dAzi, dEle;
+    Correction(azi, ele, dAzi, dEle);
+    azi = wrapAzimuth(deviceAzi - dAzi);
+    ele = deviceEle - dEle;
+  }
+}
+
+CalibrationStage::CalibrationStage(CalibrationGrid grid)
+  : grid(std::move(grid))
+{
+}
+
+bool CalibrationStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  double deviceAzi, deviceEle;
+
+  switch (req.cmd) {
+  case CHANGE_AZI: {
+    {
+      std::lock_guard<std::mutex> lk(stateMutex);
+      targetAzi = req.payload.ChangeAzi.aziRequested;
+      grid.Forward(targetAzi, targetEle, deviceAzi, deviceEle);
+    }
+    req.payload.ChangeAzi.aziRequested = deviceAzi;
+    return downstream->Request(req, callback);
+  }
+
+  case CHANGE_ELE: {
+    {
+      std::lock_guard<std::mutex> lk(stateMutex);
+      targetEle = req.payload.ChangeEle.eleRequested;
+      grid.Forward(targetAzi, targetEle, deviceAzi, deviceEle);
+    }
+    req.payload.ChangeEle.eleRequested = deviceEle;
+    return downstream->Request(req, callback);
+  }
+
+  case GET_AZI:
+    return downstream->Request(req, [this, callback](RotatorResponse resp) {
+      double azi, ele;
+      {
+        std::lock_guard<std::mutex> lk(stateMutex);
+        double unusedAzi, deviceEle;
+        grid.Forward(targetAzi, targetEle, unusedAzi, deviceEle);
+        grid.Inverse(resp.payload.aziResp.azi, deviceEle, azi, ele);
+      }
+      resp.payload.aziResp.azi = azi;
+      callback(resp);
+    });
+
+  case GET_ELE:
+    return downstream->Request(req, [this, callback](RotatorResponse resp) {
+      double azi, ele;
+      {
+        std::lock_guard<std::mutex> lk(stateMutex);
+        double deviceAzi, unusedEle;
+        grid.Forward(targetAzi, targetEle, deviceAzi, unusedEle);
+        grid.Inverse(deviceAzi, resp.payload.eleResp.ele, azi, ele);
+      }
+      resp.payload.eleResp.ele = ele;
+      callback(resp);
+    });
+
+  case ROTATOR_PRESET_HINT:
+    grid.Forward(req.payload.PresetHint.azi, req.payload.PresetHint.ele, deviceAzi, deviceEle);
+    req.payload.PresetHint.azi = deviceAzi;
+    req.payload.PresetHint.ele = deviceEle;
+    return downstream->Request(req, callback);
+
+  default:
+    return downstream->Request(req, callback);
+  }
+}
@@ -0,0 +1,620 @@
+#include "pipeline/Pipeline.hpp"
+#include "pipeline/Calibration.hpp"
+#include "pipeline/Stages.hpp"
+#include "pipeline/Telemetry.hpp"
+#include "pipeline/Trajectory.hpp"
+#include "pipeline/Wrap.hpp"
+#include "rotators/CamPTZ.hpp"
+#include "rotators/EasyComm.hpp"
+#include "rotators/FanOut.hpp"
+#include "rotators/GS232.hpp"
+#include "rotators/RotctldSink.hpp"
+#include "rotators/ShmSource.hpp"
+#include "rotators/rotctld.hpp"
+#include "trace/TraceLog.hpp"
+#include "transport/SerialTransport.hpp"
+#include "transport/SimPTZ.hpp"
+#include <fstream>
+#include <sstream>
+
+void PipelineParams::Parse(std::istream &tokens)
+{
+  std::string token;
+  while (tokens >> token) {
+    auto eq = token.find('=');
+    if (eq == std::string::npos) {
+      Set(token, "1");
+    } else {
+      Set(token.substr(0, eq), token.substr(eq + 1));
+    }
+  }
+}
+
+std::string PipelineParams::GetString(std::string key, std::string defaultValue) const
+{
+  auto it = values.find(key);
+  return it == values.end() ? defaultValue : it->second;
+}
+
+int PipelineParams::GetInt(std::string key, int defaultValue) const
+{
+  auto it = values.find(key);
+  return it == values.end() ? defaultValue : std::stoi(it->second);
+}
+
+double PipelineParams::GetDouble(std::string key, double defaultValue) const
+{
+  auto it = values.find(key);
+  return it == values.end() ? defaultValue : std::stod(it->second);
+}
+
+bool PipelineParams::GetBool(std::string key, bool defaultValue) const
+{
+  auto it = values.find(key);
+  if (it == values.end()) {
+    return defaultValue;
+  }
+  return it->second == "1" || it->second == "true" || it->second == "yes" || it->second == "on";
+}
+
+// element factories; new source / stage / sink types are registered here
+
+// transport and multi-client options shared by every stream source
+static bool configureStreamSource(StreamSource *source, const PipelineParams &params, int defaultPort)
+{
+  StreamSource::Transport transport;
+  if (!StreamSource::ParseTransport(params.GetString("transport", "tcp"), transport)) {
+    fprintf(stderr, "Pipeline: unknown transport '%s'\n", params.GetString("transport", "").c_str());
+    return false;
+  }
+  source->SetTransport(
+    transport, params.GetString("host", "0.0.0.0"), params.GetInt("port", defaultPort),
+    params.GetString("link", "")
+  );
+
+  source->SetQuerySharing(params.GetInt("share-window", 0));
+
+  MoveArbiter::Policy policy;
+  if (!MoveArbiter::ParsePolicy(params.GetString("arbitration", "none"), policy)) {
+    fprintf(stderr, "Pipeline: unknown arbitration policy '%s'\n", params.GetString("arbitration", "").c_str());
+    return false;
+  }
+  source->SetArbitration(
+    policy, params.GetInt("hold-off", 2000), params.GetInt("owner-idle", 0),
+    MoveArbiter::ParsePriorities(params.GetString("priorities", ""))
+  );
+  return true;
+}
+
+static std::unique_ptr<PseudoRotator> createSource(std::string type, const PipelineParams &params)
+{
+  if (type == "rotctld") {
+    auto source = std::make_unique<rotctld>();
+    source->Initialize(
+      params.GetString("host", "0.0.0.0"), params.GetInt("port", 4533),
+      params.GetBool("gpredict-workaround", true)
+    );
+    if (!configureStreamSource(source.get(), params, 4533)) {
+      return nullptr;
+    }
+    return source;
+  } else if (type == "gs232") {
+    auto source = std::make_unique<GS232>();
+    source->Initialize(StreamSource::TRANSPORT_TCP, "0.0.0.0", 4535, "", params.GetString("variant", "b") == "b");
+    if (!configureStreamSource(source.get(), params, 4535)) {
+      return nullptr;
+    }
+    return source;
+  } else if (type == "easycomm") {
+    auto source = std::make_unique<EasyComm>();
+    source->Initialize(StreamSource::TRANSPORT_TCP, "0.0.0.0", 4534, "");
+    if (!configureStreamSource(source.get(), params, 4534)) {
+      return nullptr;
+    }
+    return source;
+  } else if (type == "shm") {
+    auto source = std::make_unique<ShmSource>();
+    source->Initialize(params.GetString("name", "/rbridge"), params.GetInt("sample", 100), params.GetInt("poll", 1000));
+    return source;
+  }
+
+  return nullptr;
+}
+
+static std::unique_ptr<PipelineStage> createStage(std::string type, const PipelineParams &params)
+{
+  if (type == "offset") {
+    return std::make_unique<OffsetStage>(params.GetDouble("azi", 0), params.GetDouble("ele", 0));
+  } else if (type == "limit") {
+    return std::make_unique<LimitStage>(
+      params.GetDouble("azi-min", 0), params.GetDouble("azi-max", 360),
+      params.GetDouble("ele-min", 0), params.GetDouble("ele-max", 90)
+    );
+  } else if (type == "filter") {
+    return std::make_unique<FilterStage>(params.GetDouble("alpha", 0.5), params.GetDouble("reset", 10));
+  } else if (type == "coalesce") {
+    return std::make_unique<CoalesceStage>();
+  } else if (type == "trajectory") {
+    TrajectoryStage::AxisLimits azi = {
+      params.GetDouble("azi-speed", 20), params.GetDouble("azi-accel", 10), params.GetDouble("azi-device-speed", 20)
+    };
+    TrajectoryStage::AxisLimits ele = {
+      params.GetDouble("ele-speed", 10), params.GetDouble("ele-accel", 5), params.GetDouble("ele-device-speed", 10)
+    };
+    return std::make_unique<TrajectoryStage>(
+      azi, ele, params.GetDouble("restart-delay", 0.3), params.GetDouble("tolerance", 1.0),
+      params.GetDouble("slew", 10), params.GetInt("tick", 50)
+    );
+  } else if (type == "wrap") {
+    WrapStage::Params wrap;
+    wrap.aziMin = params.GetDouble("azi-min", wrap.aziMin);
+    wrap.aziMax = params.GetDouble("azi-max", wrap.aziMax);
+    wrap.flip = params.GetBool("flip", wrap.flip);
+    wrap.aziSpeed = params.GetDouble("azi-speed", wrap.aziSpeed);
+    wrap.eleSpeed = params.GetDouble("ele-speed", wrap.eleSpeed);
+    wrap.planPath = params.GetString("plan", "");
+    wrap.lead = params.GetDouble("lead", wrap.lead);
+    wrap.passGap = params.GetDouble("pass-gap", wrap.passGap);
+    wrap.presetAhead = params.GetDouble("preset-ahead", wrap.presetAhead);
+    return std::make_unique<WrapStage>(wrap);
+  } else if (type == "backlash") {
+    BacklashStage::AxisParams azi, ele = BacklashStage::AxisParams::Elevation();
+    azi.backlash = params.GetDouble("azi-backlash", azi.backlash);
+    azi.deadband = params.GetDouble("azi-deadband", azi.deadband);
+    ele.backlash = params.GetDouble("ele-backlash", ele.backlash);
+    ele.deadband = params.GetDouble("ele-deadband", ele.deadband);
+    azi.min = params.GetDouble("azi-min", azi.min);
+    azi.max = params.GetDouble("azi-max", azi.max);
+    ele.min = params.GetDouble("ele-min", ele.min);
+    ele.max = params.GetDouble("ele-max", ele.max);
+    return std::make_unique<BacklashStage>(azi, ele, params.GetDouble("resolution", 0.01));
+  } else if (type == "calibration") {
+    std::string interp = params.GetString("interp", "bilinear");
+    CalibrationGrid grid;
+    if (!grid.Load(params.GetString("grid", ""),
+                   interp == "spline" ? CalibrationGrid::INTERP_SPLINE : CalibrationGrid::INTERP_BILINEAR,
+                   params.GetDouble("table-res", 0.5))) {
+      return nullptr;
+    }
+    return std::make_unique<CalibrationStage>(std::move(grid));
+  } else if (type == "telemetry") {
+    return std::make_unique<TelemetryStage>(params.GetString("name", "/rbridge"));
+  }
+
+  return nullptr;
+}
+
+// nullptr keeps the sink's own TCP link
+static std::unique_ptr<DeviceTransport> createDeviceTransport(const PipelineParams &params)
+{
+  std::string type = params.GetString("transport", "tcp");
+  if (type == "serial") {
+    return std::make_unique<SerialTransport>(
+      params.GetString("device", "/dev/ttyUSB0"), params.GetInt("baud", 2400),
+      7, params.GetDouble("frame-gap", 0), params.GetInt("recv-timeout", 1000)
+    );
+  } else if (type == "sim") {
+    SimPTZ::Params sim;
+    sim.panSpeed = params.GetDouble("sim-pan-speed", sim.panSpeed);
+    sim.tiltSpeed = params.GetDouble("sim-tilt-speed", sim.tiltSpeed);
+    sim.presetSpeed = params.GetDouble("sim-preset-speed", sim.presetSpeed);
+    sim.restartDelay = params.GetDouble("sim-restart-delay", sim.restartDelay);
+    sim.panContinuous = params.GetBool("sim-pan-continuous", sim.panContinuous);
+    sim.tiltMin = params.GetDouble("sim-tilt-min", sim.tiltMin);
+    return std::make_unique<SimPTZ>(sim);
+  } else if (type != "tcp") {
+    fprintf(stderr, "Pipeline: unknown device transport '%s', using tcp\n", type.c_str());
+  }
+  return nullptr;
+}
+
+static std::unique_ptr<RotatorController> createSink(std::string type, const PipelineParams &params)
+{
+  if (type == "camptz") {
+    auto sink = std::make_unique<CamPTZ>();
+    sink->Initialize(
+      params.GetString("host", "192.168.3.136"), params.GetInt("port", 4196),
+      params.GetDouble("azi-offset", 0), params.GetDouble("ele-offset", 0),
+      params.GetBool("smart-sink", true), params.GetBool("keepalive", true)
+    );
+    sink->SetPresetReset(params.GetBool("preset-reset", true));
+    sink->SetParkPosition(params.GetDouble("park-azi", 0), params.GetDouble("park-ele", 0));
+    AxisTracker::Params tracker;
+    tracker.tolerance = params.GetDouble("track-tolerance", tracker.tolerance);
+    tracker.slewThreshold = params.GetDouble("track-slew", tracker.slewThreshold);
+    tracker.holdThreshold = params.GetDouble("track-hold", tracker.holdThreshold);
+    tracker.maxHold = params.GetDouble("track-max-hold", tracker.maxHold);
+    tracker.stallSpeed = params.GetDouble("track-stall-speed", tracker.stallSpeed);
+    tracker.stallTime = params.GetDouble("track-stall-time", tracker.stallTime);
+    sink->SetTrackerParams(tracker, tracker);
+    if (params.GetString("drive", "position") == "velocity") {
+      VelocityTracker::Params azi, ele;
+      azi.maxSpeed = params.GetDouble("vel-pan-speed", 20);
+      azi.minPosition = 0;
+      azi.maxPosition = 359.99;
+      ele.maxSpeed = params.GetDouble("vel-tilt-speed", 10);
+      for (auto velocity : {&azi, &ele}) {
+        velocity->kp = params.GetDouble("vel-kp", velocity->kp);
+        velocity->ki = params.GetDouble("vel-ki", velocity->ki);
+        velocity->slewThreshold = params.GetDouble("vel-slew", velocity->slewThreshold);
+        velocity->tolerance = params.GetDouble("vel-tolerance", velocity->tolerance);
+        velocity->sampleInterval = params.GetDouble("vel-sample", velocity->sampleInterval);
+      }
+      sink->SetVelocityParams(azi, ele);
+    }
+    PresetBank::Params bank;
+    bank.slots = params.GetInt("presets", bank.slots);
+    bank.firstSlot = params.GetInt("preset-first", bank.firstSlot);
+    bank.tolerance = params.GetDouble("preset-tolerance", bank.tolerance);
+    bank.presetSpeed = params.GetDouble("preset-speed", bank.presetSpeed);
+    bank.minSaving = params.GetDouble("preset-min-saving", bank.minSaving);
+    bank.panSpeed = params.GetDouble("vel-pan-speed", bank.panSpeed);
+    bank.tiltSpeed = params.GetDouble("vel-tilt-speed", bank.tiltSpeed);
+    sink->SetPresetParams(bank, PresetBank::ParsePositions(params.GetString("preset-positions", "")),
+                          params.GetDouble("preset-idle", 30));
+    CircuitBreaker::Params breaker;
+    breaker.failureThreshold = params.GetInt("breaker-failures", breaker.failureThreshold);
+    breaker.openTime = params.GetDouble("breaker-open", breaker.openTime);
+    breaker.maxOpenTime = params.GetDouble("breaker-max-open", breaker.maxOpenTime);
+    sink->SetLinkParams(
+      params.GetInt("io-timeout", params.GetInt("recv-timeout", 1000)), params.GetDouble("watchdog", 5), breaker
+    );
+    if (auto transport = createDeviceTransport(params)) {
+      sink->SetTransport(std::move(transport));
+    }
+    return sink;
+  } else if (type == "rotctld") {
+    auto sink = std::make_unique<RotctldSink>();
+    sink->Initialize(
+      params.GetString("host", "127.0.0.1"), params.GetInt("port", 4533), params.GetInt("suppress", 1000)
+    );
+    sink->SetSubscription(params.GetInt("subscribe", 500));
+    sink->SetIoTimeout(params.GetInt("io-timeout", 1000));
+    return sink;
+  } else if (type == "fanout") {
+    // members follow as `member <sink type> ...` lines
+    auto sink = std::make_unique<FanOut>();
+    std::string policy = params.GetString("policy", "all");
+    std::string position = params.GetString("position", "primary");
+    sink->Initialize(
+      policy == "first" ? FanOut::AGGREGATE_FIRST :
+        policy == "quorum" ? FanOut::AGGREGATE_QUORUM : FanOut::AGGREGATE_ALL,
+      params.GetInt("quorum", 1),
+      position == "fused" ? FanOut::POSITION_FUSED : FanOut::POSITION_PRIMARY,
+      params.GetInt("primary", 0)
+    );
+    return sink;
+  }
+
+  return nullptr;
+}
+
+Pipeline::Pipeline()
+  : ingress(256)
+{
+}
+
+Pipeline::~Pipeline()
+{
+  if (dispatcher.joinable()) {
+    Terminate();
+  }
+}
+
+bool Pipeline::AddConfigLine(std::string line)
+{
+  auto comment = line.find('#');
+  if (comment != std::string::npos) {
+    line = line.substr(0, comment);
+  }
+
+  std::istringstream tokens(line);
+  std::string kind, type;
+  if (!(tokens >> kind)) {
+    return true;  // empty line
+  }
+  if (!(tokens >> type)) {
+    fprintf(stderr, "Pipeline: missing type after '%s'\n", kind.c_str());
+    return false;
+  }
+
+  PipelineParams params;
+  params.Parse(tokens);
+
+  try {
+    if (kind == "source") {
+      auto source = createSource(type, params);
+      if (source == nullptr) {
+        fprintf(stderr, "Pipeline: unknown source type '%s'\n", type.c_str());
+        return false;
+      }
+      AddSource(std::move(source));
+    } else if (kind == "stage") {
+      auto stage = createStage(type, params);
+      if (stage == nullptr) {
+        fprintf(stderr, "Pipeline: unknown stage type '%s'\n", type.c_str());
+        return false;
+      }
+      AddStage(std::move(stage));
+    } else if (kind == "sink") {
+      auto sink = createSink(type, params);
+      if (sink == nullptr) {
+        fprintf(stderr, "Pipeline: unknown sink type '%s'\n", type.c_str());
+        return false;
+      }
+      SetSink(std::move(sink));
+    } else if (kind == "member") {
+      auto fanOut = dynamic_cast<FanOut *>(sink.get());
+      if (fanOut == nullptr) {
+        fprintf(stderr, "Pipeline: 'member' must follow a fanout sink\n");
+        return false;
+      }
+      auto member = createSink(type, params);
+      if (member == nullptr) {
+        fprintf(stderr, "Pipeline: unknown sink type '%s'\n", type.c_str());
+        return false;
+      }
+      fanOut->AddMember(std::move(member));
+    } else {
+      fprintf(stderr, "Pipeline: unknown element '%s'\n", kind.c_str());
+      return false;
+    }
+  } catch (const std::exception &e) {
+    // std::stoi / std::stod on malformed values
+    fprintf(stderr, "Pipeline: bad parameter for %s %s: %s\n", kind.c_str(), type.c_str(), e.what());
+    return false;
+  }
+
+  return true;
+}
+
+bool Pipeline::LoadConfig(std::string path)
+{
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    fprintf(stderr, "Pipeline: unable to open %s\n", path.c_str());
+    return false;
+  }
+
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(file, line)) {
+    lineNo++;
+    if (!AddConfigLine(line)) {
+      fprintf(stderr, "Pipeline: %s:%d: invalid line\n", path.c_str(), lineNo);
+      return false;
+    }
+  }
+
+  return Validate(path);
+}
+
+bool Pipeline::Validate(std::string path) const
+{
+  if (sink == nullptr) {
+    fprintf(stderr, "Pipeline: %s has no sink\n", path.c_str());
+    return false;
+  }
+
+  auto fanOut = dynamic_cast<FanOut *>(sink.get());
+  if (fanOut != nullptr && fanOut->MemberCount() == 0) {
+    fprintf(stderr, "Pipeline: %s has a fanout sink without members\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void Pipeline::AddSource(std::unique_ptr<PseudoRotator> source)
+{
+  source->SetRequestHandler([this](RotatorRequest req, RotatorCallback callback) {
+    return this->Request(req, callback);
+  });
+  if (trace != nullptr) {
+    source->SetTraceRecorder(trace);
+  }
+  if (reactor != nullptr) {
+    source->SetReactor(reactor);
+  }
+  sources.push_back(std::move(source));
+}
+
+void Pipeline::AddStage(std::unique_ptr<PipelineStage> stage)
+{
+  if (!stages.empty()) {
+    stages.back()->SetDownstream(stage.get());
+  }
+  stage->SetDownstream(sink.get());
+  stages.push_back(std::move(stage));
+}
+
+void Pipeline::SetSink(std::unique_ptr<RotatorController> sink)
+{
+  this->sink = std::move(sink);
+  if (!stages.empty()) {
+    stages.back()->SetDownstream(this->sink.get());
+  }
+  if (trace != nullptr) {
+    this->sink->SetTraceRecorder(trace);
+  }
+}
+
+void Pipeline::SetSourcesEnabled(bool sourcesEnabled)
+{
+  this->sourcesEnabled = sourcesEnabled;
+}
+
+void Pipeline::SetName(std::string name)
+{
+  logName = "Pipeline " + name;
+}
+
+void Pipeline::SetReactor(IoReactor *reactor)
+{
+  this->reactor = reactor;
+  for (auto &source : sources) {
+    source->SetReactor(reactor);
+  }
+}
+
+void Pipeline::SetRealTime(const RealTimeParams &params)
+{
+  this->realTime = params;
+}
+
+void Pipeline::SetTraceRecorder(TraceRecorder *trace)
+{
+  this->trace = trace;
+  for (auto &source : sources) {
+    source->SetTraceRecorder(trace);
+  }
+  if (sink != nullptr) {
+    sink->SetTraceRecorder(trace);
+  }
+}
+
+RotatorController *Pipeline::head()
+{
+  if (!stages.empty()) {
+    return stages.front().get();
+  }
+  return sink.get();
+}
+
+void Pipeline::Start()
+{
+  // one time source for the whole graph
+  sink->SetClock(clock);
+  if (realTime.Enabled()) {
+    sink->SetRealTime(realTime);
+  }
+  for (auto &stage : stages) {
+    stage->SetClock(clock);
+  }
+  for (auto &source : sources) {
+    source->SetClock(clock);
+  }
+
+  sink->Start();
+  for (auto &stage : stages) {
+    stage->Start();
+  }
+
+  threadClosing = false;
+  dispatcher = clock->Spawn([this]() { Pipeline::threadMain(this); });
+
+  if (sourcesEnabled) {
+    for (auto &source : sources) {
+      source->Start();
+    }
+    sourcesStarted = true;
+  }
+}
+
+void Pipeline::WaitForClose()
+{
+  if (!sourcesStarted) {
+    return;
+  }
+  for (auto &source : sources) {
+    source->WaitForClose();
+  }
+}
+
+void Pipeline::Terminate()
+{
+  if (sourcesStarted) {
+    for (auto &source : sources) {
+      source->Terminate();
+    }
+    sourcesStarted = false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(dispatcherMutex);
+    threadClosing = true;
+  }
+  clock->Notify(dispatcherEvent);
+  if (dispatcher.joinable()) {
+    dispatcher.join();
+  }
+
+  for (auto it = stages.rbegin(); it != stages.rend(); it++) {
+    (*it)->Terminate();
+  }
+  sink->Terminate();
+  printf("%s: %llu requests expired in the ingress queue\n", logName.c_str(),
+         (unsigned long long)expiredRequests.load());
+}
+
+bool Pipeline::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  // counted before it is visible, so the dispatcher never takes it first
+  // and underflows the count
+  ingressPending++;
+  if (!ingress.push(std::make_pair(req, callback))) {
+    ingressPending--;
+    fprintf(stderr, "%s: ingress queue full, request dropped\n", logName.c_str());
+    return false;
+  }
+
+  if (dispatcherSleeping.load()) {
+    std::lock_guard<std::mutex> lk(dispatcherMutex);
+    clock->Notify(dispatcherEvent);
+  }
+  return true;
+}
+
+void Pipeline::threadMain(Pipeline *self)
+{
+  RotatorController *head = self->head();
+  bool realTime = self->realTime.Enabled();
+  if (realTime) {
+    EnterRealTime((self->logName + " dispatcher").c_str(), self->realTime);
+  }
+
+  while (!self->threadClosing) {
+    auto job = self->ingress.pop();
+    if (!job.has_value()) {
+      std::unique_lock<std::mutex> lk(self->dispatcherMutex);
+      self->dispatcherSleeping = true;
+      self->clock->Wait(lk, self->dispatcherEvent, [self] {
+        return self->threadClosing || self->ingressPending.load() > 0;
+      });
+      self->dispatcherSleeping = false;
+      continue;
+    }
+    self->ingressPending--;
+    self->dispatchedRequests++;
+
+    RotatorRequest &req = job->first;
+    if (req.Droppable() && req.Expired(self->clock->Now())) {
+      // the source gave up while it sat in the ingress queue
+      self->expiredRequests++;
+      RotatorResponse resp;
+      resp.success = false;
+      job->second(resp);
+      continue;
+    }
+    // in real-time mode stdout stays off the hot path
+    if (!realTime) {
+      if (req.cmd == CHANGE_AZI) {
+        printf("[%s] Requested new Azi change, newAzi=%lf\n", self->logName.c_str(),
+               req.payload.ChangeAzi.aziRequested);
+      } else if (req.cmd == CHANGE_ELE) {
+        printf("[%s] Requested new Ele change, newEle=%lf\n", self->logName.c_str(),
+               req.payload.ChangeEle.eleRequested);
+      }
+    }
+    if (self->trace != nullptr) {
+      self->trace->RecordRequest(req, self->traceChannel);
+    }
+
+    if (!head->Request(req, job->second)) {
+      fprintf(stderr, "%s: Error while processing request\n", self->logName.c_str());
+      RotatorResponse resp;
+      resp.success = false;
+      job->second(resp);
+    }
+  }
+}
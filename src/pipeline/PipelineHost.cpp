@@ -0,0 +1,409 @@
+#include "pipeline/PipelineHost.hpp"
+#include "transport/IoBackend.hpp"
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#endif
+
+// per thread name: threads and CPU seconds, of the threads alive now
+struct ThreadUsage {
+  int threads = 0;
+  double cpu = 0;
+};
+
+static std::vector<int> allowedCpus()
+{
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  return cpus;
+}
+
+// the calling thread, and the threads it starts from now on
+static void placeThread(const std::string &name, int cpu)
+{
+#ifdef __linux__
+  pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+      fprintf(stderr, "PipelineHost: cannot pin %s to cpu %d\n", name.c_str(), cpu);
+    }
+  }
+#endif
+}
+
+static std::map<std::string, ThreadUsage> threadUsage()
+{
+  std::map<std::string, ThreadUsage> usage;
+#ifdef __linux__
+  DIR *dir = opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return usage;
+  }
+  static const double ticks = sysconf(_SC_CLK_TCK);
+  while (struct dirent *entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    std::ifstream file(std::string("/proc/self/task/") + entry->d_name + "/stat");
+    std::string stat;
+    if (!std::getline(file, stat)) {
+      continue;
+    }
+    // pid (comm) state ppid ... utime stime: the name may hold spaces
+    auto open = stat.find('('), close = stat.rfind(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) {
+      continue;
+    }
+    std::istringstream fields(stat.substr(close + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int i = 0; i < 13 && fields >> field; i++) {
+      if (i == 11) {
+        utime = std::stoull(field);
+      } else if (i == 12) {
+        stime = std::stoull(field);
+      }
+    }
+    ThreadUsage &thread = usage[stat.substr(open + 1, close - open - 1)];
+    thread.threads++;
+    thread.cpu += (utime + stime) / ticks;
+  }
+  closedir(dir);
+#endif
+  return usage;
+}
+
+static double residentMegabytes()
+{
+#ifdef __linux__
+  std::ifstream file("/proc/self/statm");
+  unsigned long long size = 0, resident = 0;
+  if (file >> size >> resident) {
+    return resident * (double)sysconf(_SC_PAGESIZE) / (1024 * 1024);
+  }
+#endif
+  return 0;
+}
+
+static double processCpu()
+{
+#ifdef __linux__
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#else
+  return 0;
+#endif
+}
+
+static std::string shardThreadName(size_t index)
+{
+  return "rb-shard" + std::to_string(index);
+}
+
+PipelineHost::~PipelineHost()
+{
+  if (started) {
+    Terminate();
+  }
+}
+
+bool PipelineHost::has(const std::string &name) const
+{
+  for (auto &member : members) {
+    if (member.name == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PipelineHost::AddConfigLine(std::string line)
+{
+  auto comment = line.find('#');
+  if (comment != std::string::npos) {
+    line = line.substr(0, comment);
+  }
+
+  std::istringstream tokens(line);
+  std::string kind;
+  if (!(tokens >> kind)) {
+    return true;  // empty line
+  }
+
+  if (kind == "host") {
+    if (!members.empty()) {
+      fprintf(stderr, "PipelineHost: 'host' must come before the pipelines\n");
+      return false;
+    }
+    PipelineParams params;
+    params.Parse(tokens);
+    try {
+      shardCount = params.GetInt("shards", shardCount);
+      pin = params.GetBool("pin", pin);
+      statsInterval = params.GetInt("stats", statsInterval);
+      lockMemory = params.GetBool("lock-memory", lockMemory);
+    } catch (const std::exception &e) {
+      fprintf(stderr, "PipelineHost: bad parameter for host: %s\n", e.what());
+      return false;
+    }
+    return true;
+  }
+
+  if (kind == "pipeline") {
+    std::string name;
+    if (!(tokens >> name) || name.find('=') != std::string::npos) {
+      fprintf(stderr, "PipelineHost: missing name after 'pipeline'\n");
+      return false;
+    }
+    if (has(name)) {
+      fprintf(stderr, "PipelineHost: pipeline '%s' defined twice\n", name.c_str());
+      return false;
+    }
+    PipelineParams params;
+    params.Parse(tokens);
+
+    Member member;
+    member.name = name;
+    try {
+      member.shard = params.GetInt("shard", -1);
+      member.realTimePriority = params.GetInt("realtime", 0);
+    } catch (const std::exception &e) {
+      fprintf(stderr, "PipelineHost: bad parameter for pipeline %s: %s\n", name.c_str(), e.what());
+      return false;
+    }
+    uint16_t index = members.size() + 1;
+    member.threadName = ("rb" + std::to_string(index) + ":" + name).substr(0, 15);
+    member.pipeline = std::make_unique<Pipeline>();
+    member.pipeline->SetName(name);
+    member.pipeline->SetTraceChannel(index);
+    if (trace != nullptr) {
+      member.pipeline->SetTraceRecorder(trace);
+    }
+    if (params.Has("config") && !member.pipeline->LoadConfig(params.GetString("config", ""))) {
+      return false;
+    }
+    members.push_back(std::move(member));
+    return true;
+  }
+
+  if (members.empty()) {
+    fprintf(stderr, "PipelineHost: '%s' outside a pipeline section\n", kind.c_str());
+    return false;
+  }
+  return members.back().pipeline->AddConfigLine(line);
+}
+
+bool PipelineHost::LoadConfig(std::string path)
+{
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    fprintf(stderr, "PipelineHost: unable to open %s\n", path.c_str());
+    return false;
+  }
+
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(file, line)) {
+    lineNo++;
+    if (!AddConfigLine(line)) {
+      fprintf(stderr, "PipelineHost: %s:%d: invalid line\n", path.c_str(), lineNo);
+      return false;
+    }
+  }
+
+  return Validate(path);
+}
+
+bool PipelineHost::Validate(std::string path) const
+{
+  if (members.empty()) {
+    fprintf(stderr, "PipelineHost: %s has no pipeline\n", path.c_str());
+    return false;
+  }
+  for (auto &member : members) {
+    if (!member.pipeline->Validate(path + " (pipeline " + member.name + ")")) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PipelineHost::SetTraceRecorder(TraceRecorder *trace)
+{
+  this->trace = trace;
+  for (auto &member : members) {
+    member.pipeline->SetTraceRecorder(trace);
+  }
+}
+
+void PipelineHost::startShards()
+{
+  std::vector<int> cpus = allowedCpus();
+  size_t count = shardCount;
+  if (count == 0) {
+    count = (std::min)((std::max)(cpus.size(), (size_t)1), members.size());
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    auto shard = std::make_unique<Shard>();
+    if (pin && !cpus.empty()) {
+      shard->cpu = cpus[i % cpus.size()];
+    }
+    shard->reactor = IoReactor::Create(CurrentIoBackend());
+    if (shard->reactor != nullptr) {
+      Shard *self = shard.get();
+      shard->thread = std::thread([self, i]() {
+        placeThread(shardThreadName(i), self->cpu);
+        self->reactor->Run();
+      });
+    }
+    shards.push_back(std::move(shard));
+  }
+}
+
+void PipelineHost::startPipeline(Member &member)
+{
+  Shard &shard = *shards[member.shard];
+  member.pipeline->SetReactor(shard.reactor.get());
+  if (member.realTimePriority > 0 || lockMemory) {
+    // pinned as inherited from the starter below
+    RealTimeParams realTime;
+    realTime.priority = member.realTimePriority;
+    realTime.lockMemory = lockMemory;
+    member.pipeline->SetRealTime(realTime);
+  }
+
+  // every thread the pipeline starts inherits the name and core of this one
+  std::thread starter([this, &member, &shard]() {
+    placeThread(member.threadName, shard.cpu);
+    member.pipeline->Start();
+  });
+  starter.join();
+}
+
+void PipelineHost::Start()
+{
+  startShards();
+  for (size_t i = 0; i < members.size(); i++) {
+    Member &member = members[i];
+    if (member.shard >= (int)shards.size()) {
+      fprintf(stderr, "PipelineHost: %s: no shard %d, using %d\n", member.name.c_str(), member.shard,
+              member.shard % (int)shards.size());
+    }
+    member.shard = member.shard < 0 ? i % shards.size() : member.shard % shards.size();
+    startPipeline(member);
+  }
+  started = true;
+
+  bool sharedReactors = shards.front()->reactor != nullptr;
+  printf("PipelineHost: %zu pipelines on %zu shards, %s backend%s\n", members.size(), shards.size(),
+         IoBackendName(CurrentIoBackend()), sharedReactors ? "" : " (no shared reactors: thread per client)");
+
+  if (statsInterval > 0) {
+    statsClosing = false;
+    statsThread = std::thread(&PipelineHost::statsMain, this);
+  }
+}
+
+void PipelineHost::WaitForClose()
+{
+  for (auto &member : members) {
+    member.pipeline->WaitForClose();
+  }
+}
+
+void PipelineHost::Terminate()
+{
+  if (!started) {
+    return;
+  }
+  if (statsThread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lk(statsMutex);
+      statsClosing = true;
+    }
+    statsEvent.notify_all();
+    statsThread.join();
+  }
+
+  // while the threads are still there to be counted
+  PrintStats();
+
+  for (auto &member : members) {
+    member.pipeline->Terminate();
+  }
+  // the sources left their reactors in Terminate()
+  for (auto &shard : shards) {
+    if (shard->reactor != nullptr) {
+      shard->reactor->Stop();
+      shard->thread.join();
+    }
+  }
+  shards.clear();
+  started = false;
+}
+
+std::vector<PipelineHost::PipelineStats> PipelineHost::Stats() const
+{
+  auto usage = threadUsage();
+  std::vector<PipelineStats> stats;
+  for (auto &member : members) {
+    const ThreadUsage &threads = usage[member.threadName];
+    stats.push_back(PipelineStats{
+      member.name, member.shard, member.pipeline->DispatchedRequests(), member.pipeline->ExpiredRequests(),
+      member.pipeline->PendingRequests(), threads.threads, threads.cpu
+    });
+  }
+  return stats;
+}
+
+void PipelineHost::PrintStats() const
+{
+  for (auto &stats : Stats()) {
+    printf("PipelineHost: %s shard=%d requests=%llu expired=%llu pending=%zu threads=%d cpu=%.2fs\n",
+           stats.name.c_str(), stats.shard, (unsigned long long)stats.dispatched, (unsigned long long)stats.expired,
+           stats.pending, stats.threads, stats.cpu);
+  }
+
+  auto usage = threadUsage();
+  int threads = 0;
+  double shardCpu = 0;
+  for (auto &thread : usage) {
+    threads += thread.second.threads;
+  }
+  for (size_t i = 0; i < shards.size(); i++) {
+    shardCpu += usage[shardThreadName(i)].cpu;
+  }
+  printf("PipelineHost: %zu pipelines, %zu shards, %d threads, rss=%.1fMB, cpu=%.2fs (reactors %.2fs)\n",
+         members.size(), shards.size(), threads, residentMegabytes(), processCpu(), shardCpu);
+}
+
+void PipelineHost::statsMain()
+{
+  std::unique_lock<std::mutex> lk(statsMutex);
+  while (!statsEvent.wait_for(lk, std::chrono::seconds(statsInterval), [this] { return statsClosing; })) {
+    lk.unlock();
+    PrintStats();
+    lk.lock();
+  }
+}
@@ -0,0 +1,261 @@
+#include "pipeline/Stages.hpp"
+
+OffsetStage::OffsetStage(double aziOffset, double eleOffset)
+  : aziOffset(aziOffset), eleOffset(eleOffset)
+{
+}
+
+bool OffsetStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  switch (req.cmd) {
+  case CHANGE_AZI:
+    req.payload.ChangeAzi.aziRequested = wrapAzimuth(req.payload.ChangeAzi.aziRequested + aziOffset);
+    return downstream->Request(req, callback);
+
+  case CHANGE_ELE:
+    req.payload.ChangeEle.eleRequested += eleOffset;
+    return downstream->Request(req, callback);
+
+  case GET_AZI:
+    return downstream->Request(req, [this, callback](RotatorResponse resp) {
+      resp.payload.aziResp.azi = wrapAzimuth(resp.payload.aziResp.azi - aziOffset);
+      callback(resp);
+    });
+
+  case GET_ELE:
+    return downstream->Request(req, [this, callback](RotatorResponse resp) {
+      resp.payload.eleResp.ele -= eleOffset;
+      callback(resp);
+    });
+
+  case ROTATOR_PRESET_HINT:
+    req.payload.PresetHint.azi = wrapAzimuth(req.payload.PresetHint.azi + aziOffset);
+    req.payload.PresetHint.ele += eleOffset;
+    return downstream->Request(req, callback);
+
+  default:
+    return downstream->Request(req, callback);
+  }
+}
+
+LimitStage::LimitStage(double aziMin, double aziMax, double eleMin, double eleMax)
+  : aziMin(aziMin), aziMax(aziMax), eleMin(eleMin), eleMax(eleMax)
+{
+}
+
+bool LimitStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  if (req.cmd == CHANGE_AZI) {
+    double &azi = req.payload.ChangeAzi.aziRequested;
+    azi = (std::max)(aziMin, (std::min)(aziMax, azi));
+  } else if (req.cmd == CHANGE_ELE) {
+    double &ele = req.payload.ChangeEle.eleRequested;
+    ele = (std::max)(eleMin, (std::min)(eleMax, ele));
+  } else if (req.cmd == ROTATOR_PRESET_HINT) {
+    double &azi = req.payload.PresetHint.azi, &ele = req.payload.PresetHint.ele;
+    azi = (std::max)(aziMin, (std::min)(aziMax, azi));
+    ele = (std::max)(eleMin, (std::min)(eleMax, ele));
+  }
+
+  return downstream->Request(req, callback);
+}
+
+FilterStage::FilterStage(double alpha, double resetThreshold)
+  : alpha(alpha), resetThreshold(resetThreshold)
+{
+}
+
+bool FilterStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  if (req.cmd == CHANGE_AZI) {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    double target = req.payload.ChangeAzi.aziRequested;
+    double delta = azimuthDelta(aziState, target);
+    if (!aziValid || std::abs(delta) > resetThreshold) {
+      aziState = target;
+      aziValid = true;
+    } else {
+      aziState = wrapAzimuth(aziState + alpha * delta);
+    }
+    req.payload.ChangeAzi.aziRequested = aziState;
+  } else if (req.cmd == CHANGE_ELE) {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    double target = req.payload.ChangeEle.eleRequested;
+    double delta = target - eleState;
+    if (!eleValid || std::abs(delta) > resetThreshold) {
+      eleState = target;
+      eleValid = true;
+    } else {
+      eleState += alpha * delta;
+    }
+    req.payload.ChangeEle.eleRequested = eleState;
+  }
+
+  return downstream->Request(req, callback);
+}
+
+bool CoalesceStage::forward(int axis, RotatorRequest req, RotatorCallback callback)
+{
+  // called with inFlight already set for this axis
+  bool ret = downstream->Request(req, [this, axis, callback](RotatorResponse resp) {
+    callback(resp);
+
+    std::optional<std::pair<RotatorRequest, RotatorCallback>> next;
+    {
+      std::lock_guard<std::mutex> lk(stateMutex);
+      next.swap(axes[axis].pending);
+      if (!next.has_value()) {
+        axes[axis].inFlight = false;
+      }
+    }
+
+    if (next.has_value() && !forward(axis, next->first, next->second)) {
+      RotatorResponse respFail;
+      respFail.success = false;
+      next->second(respFail);
+    }
+  });
+
+  if (!ret) {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    axes[axis].inFlight = false;
+  }
+  return ret;
+}
+
+bool CoalesceStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  int axis;
+  if (req.cmd == CHANGE_AZI) {
+    axis = 0;
+  } else if (req.cmd == CHANGE_ELE) {
+    axis = 1;
+  } else {
+    return downstream->Request(req, callback);
+  }
+
+  bool queued = false;
+  std::optional<std::pair<RotatorRequest, RotatorCallback>> superseded;
+  {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    if (axes[axis].inFlight) {
+      superseded.swap(axes[axis].pending);
+      axes[axis].pending = std::make_pair(req, callback);
+      queued = true;
+    } else {
+      axes[axis].inFlight = true;
+    }
+  }
+
+  if (superseded.has_value()) {
+    // replaced by a newer target before reaching the sink
+    RotatorResponse resp;
+    resp.success = true;
+    superseded->second(resp);
+  }
+
+  if (queued) {
+    return true;
+  }
+
+  return forward(axis, req, callback);
+}
+
+BacklashStage::BacklashStage(AxisParams azi, AxisParams ele, double resolution)
+  : params{azi, ele}, resolution(resolution)
+{
+}
+
+void BacklashStage::Terminate()
+{
+  printf("Backlash: %llu moves forwarded, %llu suppressed\n",
+         (unsigned long long)forwarded.load(), (unsigned long long)suppressed.load());
+}
+
+double BacklashStage::compensate(int axis, double target, bool &suppress)
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  AxisState &state = axes[axis];
+  const AxisParams &axisParams = params[axis];
+
+  target = std::round(target / resolution) * resolution;
+  if (state.valid && std::abs(target - state.target) < axisParams.deadband - resolution / 2) {
+    suppress = true;
+    return 0;
+  }
+
+  if (state.valid && target != state.target) {
+    state.direction = target > state.target ? 1 : -1;
+  }
+  state.valid = true;
+  state.target = target;
+  suppress = false;
+
+  // never pushed past either end of the range by the compensation alone: the
+  // sink would wrap it into a full turn (360 itself is azimuth 0 to a Pelco
+  // head, hence the step back from an azimuth maximum)
+  double lower = axisParams.min;
+  double upper = axis == 0 ? axisParams.max - resolution : axisParams.max;
+  double device = target + state.direction * axisParams.backlash / 2;
+  device = (std::max)((std::min)(target, lower), (std::min)((std::max)(target, upper), device));
+  return std::round(device / resolution) * resolution;
+}
+
+double BacklashStage::correction(int axis)
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  return axes[axis].valid ? axes[axis].direction * params[axis].backlash / 2 : 0;
+}
+
+bool BacklashStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  bool suppress = false;
+
+  switch (req.cmd) {
+  case CHANGE_AZI:
+    req.payload.ChangeAzi.aziRequested = compensate(0, req.payload.ChangeAzi.aziRequested, suppress);
+    break;
+
+  case CHANGE_ELE:
+    req.payload.ChangeEle.eleRequested = compensate(1, req.payload.ChangeEle.eleRequested, suppress);
+    break;
+
+  case GET_AZI:
+    return downstream->Request(req, [this, callback](RotatorResponse resp) {
+      // mechanical, as wrap re-anchors on it: kept in range, never wrapped
+      const AxisParams &azi = params[0];
+      resp.payload.aziResp.azi = (std::max)(azi.min, (std::min)(azi.max, resp.payload.aziResp.azi - correction(0)));
+      callback(resp);
+    });
+
+  case GET_ELE:
+    return downstream->Request(req, [this, callback](RotatorResponse resp) {
+      const AxisParams &ele = params[1];
+      resp.payload.eleResp.ele = (std::max)(ele.min, (std::min)(ele.max, resp.payload.eleResp.ele - correction(1)));
+      callback(resp);
+    });
+
+  case ROTATOR_PRESET_HINT:
+    // a position to come, not a move
+    return downstream->Request(req, callback);
+
+  default: {
+    // presets, parking and manual moves leave the approach direction unknown
+    std::lock_guard<std::mutex> lk(stateMutex);
+    axes[0] = AxisState();
+    axes[1] = AxisState();
+    return downstream->Request(req, callback);
+  }
+  }
+
+  if (suppress) {
+    suppressed++;
+    RotatorResponse resp;
+    resp.success = true;
+    callback(resp);
+    return true;
+  }
+
+  forwarded++;
+  return downstream->Request(req, callback);
+}
@@ -0,0 +1,83 @@
+#include "pipeline/Telemetry.hpp"
+
+TelemetryStage::TelemetryStage(std::string channelName)
+  : channelName(channelName)
+{
+}
+
+void TelemetryStage::Start()
+{
+  channel = ShmChannel::Create(channelName);
+  if (channel == nullptr) {
+    fprintf(stderr, "TelemetryStage: %s unavailable, not publishing\n", channelName.c_str());
+  }
+}
+
+void TelemetryStage::Terminate()
+{
+  channel.reset();
+}
+
+void TelemetryStage::publishReply(ShmChannel *published, int axis, const RotatorResponse &resp)
+{
+  bool valid;
+  double pubAzi, pubEle;
+  {
+    std::lock_guard<std::mutex> lk(positionMutex);
+    if (resp.success) {
+      if (axis == 0) {
+        azi = resp.payload.aziResp.azi;
+        aziValid = true;
+      } else {
+        ele = resp.payload.eleResp.ele;
+        eleValid = true;
+      }
+      if (!aziValid || !eleValid) {
+        return;
+      }
+    }
+    valid = resp.success;
+    pubAzi = azi;
+    pubEle = ele;
+  }
+  published->PublishPosition(valid, pubAzi, pubEle, clock->UnixTime());
+}
+
+bool TelemetryStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  // Terminate() comes after the last request
+  std::shared_ptr<ShmChannel> published = channel;
+  if (published == nullptr) {
+    return downstream->Request(req, callback);
+  }
+
+  switch (req.cmd) {
+  case CHANGE_AZI:
+    published->PublishTarget(0, req.payload.ChangeAzi.aziRequested, clock->UnixTime());
+    break;
+  case CHANGE_ELE:
+    published->PublishTarget(1, req.payload.ChangeEle.eleRequested, clock->UnixTime());
+    break;
+  case GET_AZI:
+  case GET_ELE: {
+    int axis = req.cmd == GET_AZI ? 0 : 1;
+    return downstream->Request(req, [this, published, req, axis, callback](RotatorResponse resp) {
+      // dropped past its deadline says nothing about the device
+      if (resp.success || !req.Expired(clock->Now())) {
+        publishReply(published.get(), axis, resp);
+      }
+      callback(resp);
+    });
+  }
+  default:
+    break;
+  }
+
+  Clock *clock = this->clock;
+  return downstream->Request(req, [published, clock, req, callback](RotatorResponse resp) {
+    if (!resp.success && !req.Expired(clock->Now())) {
+      published->PublishPosition(false, 0, 0, clock->UnixTime());
+    }
+    callback(resp);
+  });
+}
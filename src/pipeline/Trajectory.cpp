@@ -0,0 +1,262 @@
+#include "pipeline/Trajectory.hpp"
+#include "pipeline/Stages.hpp"
+
+static double secondsBetween(Clock::TimePoint from, Clock::TimePoint to)
+{
+  return std::chrono::duration<double>(to - from).count();
+}
+
+TrajectoryStage::TrajectoryStage(
+  AxisLimits aziLimits, AxisLimits eleLimits,
+  double restartDelay, double tolerance, double slewThreshold, int tickInterval)
+  : restartDelay(restartDelay), tolerance(tolerance), slewThreshold(slewThreshold), tickInterval(tickInterval)
+{
+  axes[0].limits = aziLimits;
+  axes[0].wraps = true;
+  axes[1].limits = eleLimits;
+}
+
+void TrajectoryStage::Start()
+{
+  threadClosing = false;
+  ticker = clock->Spawn([this]() { TrajectoryStage::threadMain(this); });
+}
+
+void TrajectoryStage::Terminate()
+{
+  {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    threadClosing = true;
+  }
+  clock->Notify(tickEvent);
+  if (ticker.joinable()) {
+    ticker.join();
+  }
+
+  printf("TrajectoryStage: %llu targets taken, %llu waypoints issued\n",
+         (unsigned long long)targetsTaken.load(), (unsigned long long)waypointsIssued.load());
+}
+
+bool TrajectoryStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  auto now = clock->Now();
+
+  switch (req.cmd) {
+  case CHANGE_AZI:
+  case CHANGE_ELE: {
+    int axisIdx = req.cmd == CHANGE_AZI ? 0 : 1;
+    bool needSeed;
+    {
+      std::lock_guard<std::mutex> lk(stateMutex);
+      needSeed = !axes[axisIdx].active;
+      onTarget(axisIdx, req.cmd == CHANGE_AZI ? req.payload.ChangeAzi.aziRequested
+                                              : req.payload.ChangeEle.eleRequested, now);
+    }
+    targetsTaken++;
+    if (needSeed) {
+      seed(axisIdx);
+    }
+
+    // the planner owns the device commands from here
+    RotatorResponse resp;
+    resp.success = true;
+    callback(resp);
+    return true;
+  }
+
+  case GET_AZI:
+  case GET_ELE:
+  case ROTATOR_PRESET_HINT:
+    return downstream->Request(req, callback);
+
+  default: {
+    // manual control or presets: hands off until the next position change
+    std::lock_guard<std::mutex> lk(stateMutex);
+    for (auto &axis : axes) {
+      axis.active = false;
+    }
+  }
+    return downstream->Request(req, callback);
+  }
+}
+
+void TrajectoryStage::onTarget(int axisIdx, double value, timePoint now)
+{
+  Axis &axis = axes[axisIdx];
+
+  if (!axis.active) {
+    axis.active = true;
+    axis.seeded = false;
+    axis.commanded = false;
+    axis.activatedAt = now;
+    axis.target = axis.ref = value;
+    axis.targetVel = axis.refVel = 0;
+    axis.targetAt = now;
+    return;
+  }
+
+  double unwrapped = axis.wraps ? axis.target + azimuthDelta(axis.target, value) : value;
+  double elapsed = secondsBetween(axis.targetAt, now);
+  double predicted = axis.target + axis.targetVel * (std::min)(elapsed, maxExtrapolation);
+
+  if (std::abs(unwrapped - predicted) > slewThreshold) {
+    // a new pass or a manual jump, not a continuation
+    axis.targetVel = 0;
+  } else if (elapsed > 0.05) {
+    double velocity = (unwrapped - axis.target) / elapsed;
+    axis.targetVel = 0.3 * axis.targetVel + 0.7 * velocity;
+    axis.targetVel = (std::max)(-axis.limits.maxSpeed, (std::min)(axis.limits.maxSpeed, axis.targetVel));
+  }
+
+  axis.target = unwrapped;
+  axis.targetAt = now;
+}
+
+void TrajectoryStage::seed(int axisIdx)
+{
+  RotatorRequest req;
+  req.cmd = axisIdx == 0 ? GET_AZI : GET_ELE;
+  downstream->Request(req, [this, axisIdx](RotatorResponse resp) {
+    if (!resp.success) {
+      return;  // seedTimeout assumes the head is on target
+    }
+
+    std::lock_guard<std::mutex> lk(stateMutex);
+    Axis &axis = axes[axisIdx];
+    if (!axis.active || axis.seeded) {
+      return;
+    }
+    if (axisIdx == 0) {
+      axis.modelPos = axis.ref + azimuthDelta(axis.ref, resp.payload.aziResp.azi);
+    } else {
+      axis.modelPos = resp.payload.eleResp.ele;
+    }
+    axis.seeded = true;
+  });
+}
+
+std::optional<double> TrajectoryStage::advanceAxis(Axis &axis, double dt, timePoint now)
+{
+  if (!axis.active) {
+    return {};
+  }
+
+  if (!axis.seeded) {
+    if (secondsBetween(axis.activatedAt, now) < seedTimeout) {
+      return {};
+    }
+    axis.modelPos = axis.ref;
+    axis.seeded = true;
+  }
+
+  // device model: idle for restartDelay after a command, then slews
+  if (axis.commanded) {
+    double running = (std::min)(dt, secondsBetween(axis.cmdAt, now) - restartDelay);
+    if (running > 0) {
+      double step = axis.limits.deviceSpeed * running;
+      double remaining = axis.cmdPos - axis.modelPos;
+      axis.modelPos += std::abs(remaining) <= step ? remaining : (remaining > 0 ? step : -step);
+    }
+  }
+
+  double ahead = (std::min)(secondsBetween(axis.targetAt, now), maxExtrapolation);
+  double desired = axis.target + axis.targetVel * ahead;
+
+  auto command = [&](double waypoint) {
+    axis.commanded = true;
+    axis.cmdPos = waypoint;
+    axis.cmdAt = now;
+    return waypoint;
+  };
+
+  if (std::abs(desired - axis.ref) > slewThreshold || (!axis.commanded && std::abs(desired - axis.modelPos) > slewThreshold)) {
+    // slew straight to where the target will be on arrival
+    axis.ref = desired;
+    axis.refVel = axis.targetVel;
+    double travel = std::abs(desired - axis.modelPos) / axis.limits.deviceSpeed;
+    return command(desired + axis.targetVel * (restartDelay + travel));
+  }
+
+  // reference trajectory: follow the target within speed / acceleration limits
+  const double gain = 1.0;  // (1/s) position error to velocity
+  double wantVel = axis.targetVel + gain * (desired - axis.ref);
+  wantVel = (std::max)(-axis.limits.maxSpeed, (std::min)(axis.limits.maxSpeed, wantVel));
+  double maxDelta = axis.limits.maxAccel * dt;
+  axis.refVel += (std::max)(-maxDelta, (std::min)(maxDelta, wantVel - axis.refVel));
+  axis.ref += axis.refVel * dt;
+
+  double direction = axis.refVel > 0.01 ? 1 : (axis.refVel < -0.01 ? -1 : 0);
+  double lead = direction * (std::abs(axis.refVel) * restartDelay + tolerance);
+
+  if (!axis.commanded) {
+    return command(axis.ref + lead);
+  }
+
+  bool moving = std::abs(axis.modelPos - axis.cmdPos) > 1e-6;
+  if (moving) {
+    return {};  // every new command would restart the motor
+  }
+
+  bool needed;
+  if (direction != 0) {
+    // reference caught up with the waypoint, or the target turned around
+    needed = (axis.ref - axis.cmdPos) * direction >= 0
+          || std::abs(axis.ref - axis.cmdPos) > std::abs(lead) + tolerance;
+  } else {
+    needed = std::abs(axis.ref - axis.cmdPos) > tolerance / 2;
+  }
+
+  if (needed) {
+    return command(axis.ref + lead);
+  }
+  return {};
+}
+
+void TrajectoryStage::issue(int axisIdx, double waypoint)
+{
+  RotatorRequest req;
+  if (axisIdx == 0) {
+    req.cmd = CHANGE_AZI;
+    req.payload.ChangeAzi.aziRequested = wrapAzimuth(waypoint);
+  } else {
+    req.cmd = CHANGE_ELE;
+    req.payload.ChangeEle.eleRequested = waypoint;
+  }
+
+  waypointsIssued++;
+  downstream->Request(req, [](RotatorResponse resp) {
+    if (!resp.success) {
+      fprintf(stderr, "TrajectoryStage: waypoint rejected downstream\n");
+    }
+  });
+}
+
+void TrajectoryStage::threadMain(TrajectoryStage *self)
+{
+  auto lastTick = self->clock->Now();
+
+  while (true) {
+    std::optional<double> waypoints[2];
+    {
+      std::unique_lock<std::mutex> lk(self->stateMutex);
+      self->clock->WaitFor(lk, self->tickEvent, std::chrono::milliseconds(self->tickInterval), [self]
+                           { return self->threadClosing; });
+      if (self->threadClosing) {
+        break;
+      }
+
+      auto now = self->clock->Now();
+      double dt = secondsBetween(lastTick, now);
+      lastTick = now;
+      for (int i = 0; i < 2; i++) {
+        waypoints[i] = self->advanceAxis(self->axes[i], dt, now);
+      }
+    }
+
+    for (int i = 0; i < 2; i++) {
+      if (waypoints[i].has_value()) {
+        self->issue(i, waypoints[i].value());
+      }
+    }
+  }
+}
@@ -0,0 +1,410 @@
+#include "pipeline/Wrap.hpp"
+#include "pipeline/Stages.hpp"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <sys/stat.h>
+
+WrapStage::WrapStage(Params params)
+  : params(params)
+{
+  if (params.aziMax - params.aziMin < 360) {
+    fprintf(stderr, "WrapStage: azimuth range %.1f..%.1f narrower than 360, extended\n",
+            params.aziMin, params.aziMax);
+    this->params.aziMax = params.aziMin + 360;
+  }
+}
+
+void WrapStage::SetPlan(std::vector<PassPlanPoint> plan)
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  this->plan = std::move(plan);
+  solvePasses();
+}
+
+void WrapStage::reloadPlan()
+{
+  struct stat st;
+  if (params.planPath.empty() || stat(params.planPath.c_str(), &st) != 0 || st.st_mtime == planMtime) {
+    return;
+  }
+  planMtime = st.st_mtime;
+
+  std::ifstream file(params.planPath);
+  std::vector<PassPlanPoint> loaded;
+  std::string line;
+  while (std::getline(file, line)) {
+    auto comment = line.find('#');
+    if (comment != std::string::npos) {
+      line = line.substr(0, comment);
+    }
+    std::istringstream fields(line);
+    PassPlanPoint point;
+    if (fields >> point.time >> point.azi >> point.ele) {
+      loaded.push_back(point);
+    }
+  }
+
+  printf("WrapStage: loaded %zu plan samples from %s\n", loaded.size(), params.planPath.c_str());
+  std::lock_guard<std::mutex> lk(stateMutex);
+  plan = std::move(loaded);
+  solvePasses();
+}
+
+void WrapStage::solvePasses()
+{
+  std::sort(plan.begin(), plan.end(), [](const PassPlanPoint &a, const PassPlanPoint &b) {
+    return a.time < b.time;
+  });
+
+  // poses are solved when a pass comes up, from wherever the head is then
+  passes.clear();
+  for (size_t i = 0; i < plan.size(); i++) {
+    if (i == 0 || plan[i].time - plan[i - 1].time > params.passGap) {
+      PlannedPass pass;
+      pass.first = i;
+      pass.last = i;
+      passes.push_back(pass);
+    } else {
+      passes.back().last = i;
+    }
+  }
+}
+
+std::vector<WrapStage::Pose> WrapStage::candidates(double azi, double ele) const
+{
+  std::vector<Pose> result;
+  for (int flipped = 0; flipped <= (params.flip ? 1 : 0); flipped++) {
+    double base = wrapAzimuth(flipped ? azi + 180 : azi);
+    double mechEle = flipped ? 180 - ele : ele;
+    // upper bound exclusive: 360 on a 0..360 head is 0 on the wire
+    for (double a = base + 360 * std::ceil((params.aziMin - base) / 360); a < params.aziMax; a += 360) {
+      result.push_back(Pose{flipped != 0, a, mechEle});
+    }
+  }
+  return result;
+}
+
+double WrapStage::travelTime(const Pose &from, const Pose &to) const
+{
+  return (std::max)(std::abs(to.azi - from.azi) / params.aziSpeed, std::abs(to.ele - from.ele) / params.eleSpeed);
+}
+
+const WrapStage::PlannedPass *WrapStage::activePass(double now) const
+{
+  for (const auto &pass : passes) {
+    if (!pass.poses.empty() && now >= plan[pass.first].time - params.lead && now <= plan[pass.last].time) {
+      return &pass;
+    }
+  }
+  return nullptr;
+}
+
+WrapStage::Pose WrapStage::choose(double now)
+{
+  auto options = candidates(targetAzi, targetEle);
+
+  const PlannedPass *pass = activePass(now);
+  if (pass != nullptr) {
+    // follow the solved pose of the nearest plan sample
+    auto begin = plan.begin() + pass->first, end = plan.begin() + pass->last + 1;
+    auto it = std::lower_bound(begin, end, now, [](const PassPlanPoint &p, double t) { return p.time < t; });
+    if (it == end) {
+      it = end - 1;
+    } else if (it != begin && now - (it - 1)->time < it->time - now) {
+      it = it - 1;
+    }
+    const Pose &ref = pass->poses[it - begin];
+
+    const Pose *best = nullptr;
+    for (const auto &option : options) {
+      if (option.flipped == ref.flipped && (best == nullptr || std::abs(option.azi - ref.azi) < std::abs(best->azi - ref.azi))) {
+        best = &option;
+      }
+    }
+    if (best != nullptr) {
+      return *best;
+    }
+  }
+
+  // no plan: whatever the head reaches soonest, staying in the current mode on ties
+  const Pose *best = nullptr;
+  double bestCost = std::numeric_limits<double>::infinity();
+  double center = (params.aziMin + params.aziMax) / 2;
+  for (const auto &option : options) {
+    double cost = poseValid ? travelTime(current, option) + (option.flipped != current.flipped ? 1e-3 : 0)
+                            : std::abs(option.azi - center) / 360 + (option.flipped ? 1 : 0);
+    if (cost < bestCost) {
+      bestCost = cost;
+      best = &option;
+    }
+  }
+  return *best;
+}
+
+void WrapStage::command(RotatorRequest req, const Pose &pose, RotatorCmd cmd, RotatorCallback callback)
+{
+  req.cmd = cmd;
+  if (cmd == CHANGE_AZI) {
+    req.payload.ChangeAzi.aziRequested = pose.azi;
+  } else {
+    req.payload.ChangeEle.eleRequested = pose.ele;
+  }
+
+  if (!downstream->Request(req, callback)) {
+    fprintf(stderr, "WrapStage: downstream rejected position change\n");
+    RotatorResponse resp;
+    resp.success = false;
+    callback(resp);
+  }
+}
+
+bool WrapStage::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  switch (req.cmd) {
+  case CHANGE_AZI:
+  case CHANGE_ELE: {
+    Pose pose;
+    bool otherAxis;
+    {
+      std::lock_guard<std::mutex> lk(stateMutex);
+      if (req.cmd == CHANGE_AZI) {
+        targetAzi = req.payload.ChangeAzi.aziRequested;
+      } else {
+        targetEle = req.payload.ChangeEle.eleRequested;
+      }
+
+      Pose previous = current;
+      bool wasValid = poseValid;
+      pose = choose(clock->UnixTime());
+
+      if (wasValid && pose.flipped != previous.flipped) {
+        flips++;
+        printf("WrapStage: %s\n", pose.flipped ? "flipping over the zenith" : "leaving flip mode");
+      } else if (wasValid && std::abs(pose.azi - previous.azi) > 180) {
+        unwinds++;
+        printf("WrapStage: unwinding azimuth %.1f -> %.1f\n", previous.azi, pose.azi);
+      }
+
+      // a new candidate or mode moves the other axis as well
+      otherAxis = wasValid && (req.cmd == CHANGE_AZI ? std::abs(pose.ele - previous.ele) > 1e-6
+                                                     : std::abs(pose.azi - previous.azi) > 1e-6);
+      current = pose;
+      poseValid = true;
+    }
+
+    command(req, pose, req.cmd, callback);
+    if (otherAxis) {
+      command(req, pose, req.cmd == CHANGE_AZI ? CHANGE_ELE : CHANGE_AZI, [](RotatorResponse) {});
+    }
+    return true;
+  }
+
+  case GET_AZI:
+    return downstream->Request(req, [this, callback](RotatorResponse resp) {
+      if (resp.success) {
+        std::lock_guard<std::mutex> lk(stateMutex);
+        double mechAzi = resp.payload.aziResp.azi;
+        if (!poseValid) {
+          // re-anchor the accumulated rotation after manual control
+          current.flipped = false;
+          current.azi = mechAzi;
+          poseValid = true;
+        }
+        resp.payload.aziResp.azi = wrapAzimuth(current.flipped ? mechAzi - 180 : mechAzi);
+      }
+      callback(resp);
+    });
+
+  case GET_ELE:
+    return downstream->Request(req, [callback](RotatorResponse resp) {
+      if (resp.payload.eleResp.ele > 90) {
+        resp.payload.eleResp.ele = 180 - resp.payload.eleResp.ele;
+      }
+      callback(resp);
+    });
+
+  case ROTATOR_STOP:
+  case ROTATOR_PRESET_HINT:
+    return downstream->Request(req, callback);
+
+  default: {
+    // manual control, park or presets: pose unknown until the next GET_AZI
+    std::lock_guard<std::mutex> lk(stateMutex);
+    poseValid = false;
+  }
+    return downstream->Request(req, callback);
+  }
+}
+
+void WrapStage::Start()
+{
+  reloadPlan();
+  threadClosing = false;
+  ticker = clock->Spawn([this]() { WrapStage::threadMain(this); });
+}
+
+void WrapStage::Terminate()
+{
+  {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    threadClosing = true;
+  }
+  clock->Notify(tickEvent);
+  if (ticker.joinable()) {
+    ticker.join();
+  }
+
+  printf("WrapStage: %llu unwinds, %llu flips\n",
+         (unsigned long long)unwinds.load(), (unsigned long long)flips.load());
+}
+
+void WrapStage::refreshPose()
+{
+  double now = clock->UnixTime();
+  {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    if (poseValid) {
+      return;
+    }
+    bool upcoming = false;
+    for (const auto &pass : passes) {
+      upcoming |= !pass.prepositioned && now >= plan[pass.first].time - params.lead && now <= plan[pass.last].time;
+    }
+    if (!upcoming) {
+      return;
+    }
+  }
+
+  // solving a pass from an unknown pose would pick the start side blindly
+  ResponseLatch latch(2, clock, 1000);
+  RotatorRequestHandler handler = [this](RotatorRequest req, RotatorCallback callback) {
+    return downstream->Request(req, callback);
+  };
+  RotatorRequest req;
+  req.cmd = GET_AZI;
+  latch.Submit(handler, req, 0);
+  req.cmd = GET_ELE;
+  latch.Submit(handler, req, 1);
+  if (!latch.Wait() || !latch.Get(0)->success || !latch.Get(1)->success) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lk(stateMutex);
+  if (!poseValid) {
+    current.azi = latch.Get(0)->payload.aziResp.azi;
+    current.ele = latch.Get(1)->payload.eleResp.ele;
+    current.flipped = current.ele > 90;
+    poseValid = true;
+  }
+}
+
+std::vector<WrapStage::Pose> WrapStage::solvePass(const PlannedPass &pass, const Pose *from, double untilStart,
+                                                  double &excess) const
+{
+  size_t n = pass.last - pass.first + 1;
+  std::vector<std::vector<Pose>> options(n);
+  std::vector<std::vector<double>> cost(n);
+  std::vector<std::vector<int>> previous(n);
+  for (size_t j = 0; j < n; j++) {
+    const auto &point = plan[pass.first + j];
+    options[j] = candidates(point.azi, point.ele);
+    cost[j].assign(options[j].size(), std::numeric_limits<double>::infinity());
+    previous[j].assign(options[j].size(), -1);
+  }
+  // flip only where it saves motion
+  auto flipCost = [](const Pose &pose) { return pose.flipped ? 1e-3 : 0; };
+  for (size_t c = 0; c < options[0].size(); c++) {
+    double t = from != nullptr ? travelTime(*from, options[0][c]) : 0;
+    cost[0][c] = (std::max)(0.0, t - untilStart) + 1e-3 * t + flipCost(options[0][c]);
+  }
+  for (size_t j = 1; j < n; j++) {
+    double dt = plan[pass.first + j].time - plan[pass.first + j - 1].time;
+    for (size_t c = 0; c < options[j].size(); c++) {
+      for (size_t p = 0; p < options[j - 1].size(); p++) {
+        double t = travelTime(options[j - 1][p], options[j][c]);
+        double total = cost[j - 1][p] + (std::max)(0.0, t - dt) + 1e-3 * t + flipCost(options[j][c]);
+        if (total < cost[j][c]) {
+          cost[j][c] = total;
+          previous[j][c] = (int)p;
+        }
+      }
+    }
+  }
+
+  int c = (int)(std::min_element(cost[n - 1].begin(), cost[n - 1].end()) - cost[n - 1].begin());
+  excess = cost[n - 1][c];
+  std::vector<Pose> poses(n);
+  for (size_t j = n; j-- > 0;) {
+    poses[j] = options[j][c];
+    c = previous[j][c];
+  }
+  return poses;
+}
+
+void WrapStage::threadMain(WrapStage *self)
+{
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(self->stateMutex);
+      self->clock->WaitFor(lk, self->tickEvent, std::chrono::milliseconds(500), [self] { return self->threadClosing; });
+      if (self->threadClosing) {
+        break;
+      }
+    }
+
+    self->reloadPlan();
+    self->refreshPose();
+
+    std::optional<Pose> preposition;
+    std::vector<Pose> hints;
+    {
+      std::lock_guard<std::mutex> lk(self->stateMutex);
+      double now = self->clock->UnixTime();
+      for (auto &pass : self->passes) {
+        const auto &plan = self->plan;
+        double untilStart = plan[pass.first].time - now;
+        if (!pass.hinted && untilStart > self->params.lead && untilStart <= self->params.presetAhead) {
+          // where the pass will most likely start, whatever the pose by then
+          double excess;
+          hints.push_back(self->solvePass(pass, nullptr, 0, excess)[0]);
+          pass.hinted = true;
+        }
+
+        if (pass.prepositioned || now < plan[pass.first].time - self->params.lead || now > plan[pass.last].time) {
+          continue;
+        }
+
+        // least excess motion through the whole pass, from the current pose
+        double excess;
+        pass.poses = self->solvePass(pass, self->poseValid ? &self->current : nullptr, (std::max)(0.0, untilStart),
+                                     excess);
+        pass.prepositioned = true;
+
+        printf("WrapStage: pass at %.0f solved (%zu samples, %s, start azimuth %.1f, %.1f s of excess motion)\n",
+               plan[pass.first].time, pass.poses.size(), pass.poses[0].flipped ? "flipped" : "normal",
+               pass.poses[0].azi, excess);
+
+        if (now < plan[pass.first].time) {
+          preposition = pass.poses[0];
+          self->current = pass.poses[0];
+          self->poseValid = true;
+        }
+      }
+    }
+
+    for (const auto &pose : hints) {
+      RotatorRequest req;
+      req.cmd = ROTATOR_PRESET_HINT;
+      req.payload.PresetHint.azi = pose.azi;
+      req.payload.PresetHint.ele = pose.ele;
+      self->downstream->Request(req, [](RotatorResponse) {});
+    }
+
+    if (preposition.has_value()) {
+      self->command(RotatorRequest(), preposition.value(), CHANGE_AZI, [](RotatorResponse) {});
+      self->command(RotatorRequest(), preposition.value(), CHANGE_ELE, [](RotatorResponse) {});
+    }
+  }
+}
@@ -0,0 +1,232 @@
+#include "rotators/AxisTracker.hpp"
+#include <cmath>
+
+// below half a Pelco-D position unit: the same command
+static const double sameTarget = 0.005;
+
+const char *AxisTrackingStateName(AxisTrackingState state)
+{
+  switch (state) {
+  case AXIS_IDLE: return "IDLE";
+  case AXIS_SLEWING: return "SLEWING";
+  case AXIS_TRACKING: return "TRACKING";
+  case AXIS_SETTLED: return "SETTLED";
+  case AXIS_FAULT: return "FAULT";
+  }
+  return "?";
+}
+
+AxisTracker::AxisTracker()
+{
+}
+
+AxisTracker::AxisTracker(Params params)
+  : params(params)
+{
+}
+
+double AxisTracker::delta(double from, double to) const
+{
+  double d = to - from;
+  if (params.periodic) {
+    d = std::fmod(d, 360.0);
+    if (d > 180) {
+      d -= 360;
+    } else if (d <= -180) {
+      d += 360;
+    }
+  }
+  return d;
+}
+
+void AxisTracker::enter(AxisTrackingState next, double now)
+{
+  if (next != state) {
+    state = next;
+    stateSince = now;
+  }
+  if (next != AXIS_SLEWING && next != AXIS_TRACKING) {
+    stalledSince.reset();
+  }
+}
+
+double AxisTracker::send(double now, double target)
+{
+  commandValid = true;
+  commanded = target;
+  commandTime = now;
+  held.reset();
+  stalledSince.reset();
+  stats.sent++;
+  return target;
+}
+
+AxisTracker::Action AxisTracker::OnTarget(double now, double target)
+{
+  if (!commandValid) {
+    // position unknown: treat as a slew
+    send(now, target);
+    enter(AXIS_SLEWING, now);
+    return SEND;
+  }
+
+  double step = std::abs(delta(commanded, target));
+  if (step < sameTarget && state != AXIS_FAULT) {
+    held.reset();
+    stats.suppressed++;
+    return SUPPRESS;
+  }
+
+  bool hold = false;
+  switch (state) {
+  case AXIS_SLEWING:
+    // still on the way; retarget only for another slew
+    hold = step <= params.slewThreshold;
+    break;
+
+  case AXIS_IDLE:
+  case AXIS_SETTLED:
+  case AXIS_TRACKING:
+    hold = step < params.holdThreshold;
+    break;
+
+  default:
+    break;
+  }
+
+  if (hold) {
+    if (!held.has_value()) {
+      heldSince = now;
+    }
+    held = target;
+    stats.suppressed++;
+    return SUPPRESS;
+  }
+
+  // out of a fault the head's progress is unknown: a slew, like the retry
+  bool slew = step > params.slewThreshold || state == AXIS_FAULT;
+  replays = 0;
+  send(now, target);
+  enter(slew ? AXIS_SLEWING : AXIS_TRACKING, now);
+  return SEND;
+}
+
+void AxisTracker::OnPosition(double now, double pos)
+{
+  if (positionValid && now > positionTime) {
+    velocity = delta(position, pos) / (now - positionTime);
+  }
+  position = pos;
+  positionTime = now;
+  positionValid = true;
+
+  if (!commandValid) {
+    return;
+  }
+
+  double error = std::abs(delta(pos, commanded));
+  switch (state) {
+  case AXIS_SLEWING:
+  case AXIS_TRACKING:
+    if (error <= params.tolerance) {
+      replays = 0;
+      enter(AXIS_SETTLED, now);
+    } else if (std::abs(velocity) < params.stallSpeed) {
+      if (!stalledSince.has_value()) {
+        stalledSince = now;
+      }
+    } else {
+      stalledSince.reset();
+    }
+    break;
+
+  case AXIS_SETTLED:
+    if (error > 2 * params.tolerance) {
+      // pushed off target
+      enter(AXIS_TRACKING, now);
+    }
+    break;
+
+  case AXIS_FAULT:
+    if (error <= params.tolerance) {
+      replays = 0;
+      enter(AXIS_SETTLED, now);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void AxisTracker::OnCommandFailed(double now)
+{
+  if (state != AXIS_FAULT) {
+    stats.faults++;
+  }
+  enter(AXIS_FAULT, now);
+}
+
+std::optional<double> AxisTracker::OnTick(double now)
+{
+  switch (state) {
+  case AXIS_SETTLED:
+    // held during the slew: out on arrival; held small step: after maxHold
+    if (held.has_value() && (heldSince <= stateSince || now - heldSince >= params.maxHold)) {
+      double target = *held;
+      double step = std::abs(delta(commanded, target));
+      send(now, target);
+      enter(step > params.slewThreshold ? AXIS_SLEWING : AXIS_TRACKING, now);
+      return target;
+    }
+    if (!held.has_value() && now - stateSince >= params.settleTime) {
+      enter(AXIS_IDLE, now);
+    }
+    break;
+
+  case AXIS_IDLE:
+    if (held.has_value() && now - heldSince >= params.maxHold) {
+      double target = send(now, *held);
+      enter(AXIS_TRACKING, now);
+      return target;
+    }
+    break;
+
+  case AXIS_SLEWING:
+  case AXIS_TRACKING:
+    if (held.has_value() && now - heldSince >= params.maxHold) {
+      return send(now, *held);
+    }
+    if (stalledSince.has_value() && now - *stalledSince >= params.stallTime) {
+      if (replays >= params.maxReplays) {
+        stats.faults++;
+        enter(AXIS_FAULT, now);
+        break;
+      }
+      // the head stopped short: the command was lost or cut off
+      replays++;
+      stats.replayed++;
+      return send(now, held.value_or(commanded));
+    }
+    break;
+
+  case AXIS_FAULT:
+    if (commandValid && now - stateSince >= params.faultRetry) {
+      replays = 0;
+      stats.replayed++;
+      double target = send(now, held.value_or(commanded));
+      enter(AXIS_SLEWING, now);
+      return target;
+    }
+    break;
+
+  default:
+    break;
+  }
+  return std::nullopt;
+}
+
+bool AxisTracker::NeedsSampling() const
+{
+  return state != AXIS_IDLE;
+}
@@ -1,186 +1,404 @@
 #include "rotators/CamPTZ.hpp"
+#include "trace/TraceLog.hpp"
+#include "transport/TcpTransport.hpp"
 #include <cstring>
 #include <cassert>
 #include <cmath>
+#include <limits>
+
+// (deg) the head is at a position this close to it
+static const double presetArrival = 0.05;
+// below half a Pelco-D position unit: the same position
+static const double samePosition = 0.005;
+// (bytes) of write frames coalesced at most, in practice: 7-byte frames
+static const size_t txReserve = 256;
 
 void CamPTZ::Initialize(
   std::string tcpHost, int tcpPort,
   double aziOffset, double eleOffset, bool smartSink, bool keepAlive)
 {
-  this->tcpHost = tcpHost;
-  this->tcpPort = tcpPort;
+  this->transport = std::make_unique<TcpTransport>(tcpHost, tcpPort);
   this->aziOffset = aziOffset;
   this->eleOffset = eleOffset;
   this->smartSink = smartSink;
   this->rotatorKeepAlive = keepAlive;
+  SetTrackerParams(AxisTracker::Params(), AxisTracker::Params());
 }
 
-void CamPTZ::connStart()
+void CamPTZ::SetTrackerParams(AxisTracker::Params azi, AxisTracker::Params ele)
 {
-  int status;
+  azi.periodic = true;
+  ele.periodic = false;
+  trackers[0] = AxisTracker(azi);
+  trackers[1] = AxisTracker(ele);
+}
 
-  sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-  if (sock == -1) {
-    SOCKET_PRINT_ERROR("Error creating socket");
-    return;
+void CamPTZ::SetVelocityParams(VelocityTracker::Params azi, VelocityTracker::Params ele)
+{
+  velocityMode = true;
+  velocityTrackers[0] = VelocityTracker(azi);
+  velocityTrackers[1] = VelocityTracker(ele);
+}
+
+void CamPTZ::SetLinkParams(int ioTimeout, double watchdogTimeout, CircuitBreaker::Params breaker)
+{
+  this->ioTimeout = ioTimeout;
+  this->watchdogTimeout = watchdogTimeout;
+  this->breaker = CircuitBreaker(breaker);
+}
+
+void CamPTZ::SetTransport(std::unique_ptr<DeviceTransport> transport)
+{
+  this->transport = std::move(transport);
+}
+
+void CamPTZ::SetTraceRecorder(TraceRecorder *trace)
+{
+  this->trace = trace;
+}
+
+void CamPTZ::SetRealTime(const RealTimeParams &params)
+{
+  this->realTime = params;
+}
+
+void CamPTZ::SetPresetReset(bool presetReset)
+{
+  this->presetReset = presetReset;
+}
+
+void CamPTZ::SetParkPosition(double parkAzi, double parkEle)
+{
+  this->parkAzi = parkAzi;
+  this->parkEle = parkEle;
+}
+
+void CamPTZ::SetPresetParams(PresetBank::Params params, std::vector<std::pair<double, double>> positions, double idle)
+{
+  this->presets = PresetBank(params);
+  this->presetPositions = positions;
+  this->presetIdle = idle;
+}
+
+int CamPTZ::sendFrame(const char *buf, size_t buflen)
+{
+  if (trace != nullptr) {
+    trace->Record(TRACE_DEVICE_TX, 0, buf, buflen);
   }
+  txPending.append(buf, buflen);
+  return (int)buflen;
+}
 
-  struct sockaddr_in hostAddr;
-  hostAddr.sin_family = AF_INET;
-  struct hostent *h = gethostbyname(tcpHost.c_str());
-  if (h == nullptr) {
-    fprintf(stderr, "Error during gethostbyname()\n");
-    CLOSE_SOCKET(sock);
-    return;
+bool CamPTZ::flushFrames()
+{
+  bool error = false;
+  if (!txPending.empty()) {
+    error = transport->Send(txPending.data(), txPending.size()) == -1;
+    txPending.clear();
   }
+  completePending(!error);
+  return !error;
+}
 
-  memcpy((char *)&hostAddr.sin_addr.s_addr, h->h_addr_list[0], h->h_length);
-  hostAddr.sin_port = htons(tcpPort);
+void CamPTZ::completePending(bool success)
+{
+  RotatorResponse resp;
+  resp.success = success;
+  for (auto &callback : txPendingCallbacks) {
+    callback(resp);
+  }
+  txPendingCallbacks.clear();
+}
 
-  status = connect(sock, (struct sockaddr *)&hostAddr, sizeof(hostAddr));
-  if (status == -1) {
-    SOCKET_PRINT_ERROR("Error connecting to target");
-    CLOSE_SOCKET(sock);
+void CamPTZ::completeWrite(std::function<void(RotatorResponse)> callback, bool error)
+{
+  if (error) {
+    RotatorResponse resp;
+    resp.success = false;
+    callback(resp);
     return;
   }
+  txPendingCallbacks.push_back(callback);
+}
+
+int CamPTZ::recvFrame(char *buf, size_t buflen)
+{
+  // the query frame (and anything queued before it) goes out together with
+  // the read of the reply; queued writes fail with the exchange
+  int ret = transport->Transact(txPending.data(), txPending.size(), buf, buflen);
+  txPending.clear();
+  completePending(ret != -1);
+  if (trace != nullptr && ret > 0) {
+    trace->Record(TRACE_DEVICE_RX, 0, buf, ret);
+  }
+  if (ret != -1) {
+    // only a reply shows the head is alive; writes also succeed into a
+    // converter whose head is gone
+    std::lock_guard<std::mutex> lk(breakerMutex);
+    breaker.OnSuccess();
+  }
+  return ret;
+}
+
+bool CamPTZ::connStart()
+{
+  if (!transport->Open()) {
+    return false;
+  }
+  transport->SetIoTimeout(ioTimeout);
+  printf("CamPTZ Thread: Connected to %s.\n", transport->Describe().c_str());
 
   sockConnected = true;
+  return true;
+}
 
-  // keepalive
-  if (rotatorKeepAlive) {
-    lastPosChange = std::chrono::steady_clock::now();
+void CamPTZ::startHelpers()
+{
+  watchdogThread = clock->Spawn([this]() { this->watchdogMain(); });
+
+  // keepalive; the velocity drive refreshes the device itself
+  if (rotatorKeepAlive && !velocityMode) {
     printf("CamPTZ Thread: Keep-alive started.\n");
-    keepAliveThread = std::thread([this]() {
-      bool error = false;
-      while (!error) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(this->keepAliveInterval));
+    keepAliveThread = clock->Spawn([this]() {
+      RotatorRequestHandler direct = [this](RotatorRequest req, RotatorCallback callback) {
+        return this->RequestImpl(req, callback, true);
+      };
+
+      while (true) {
+        {
+          std::unique_lock<std::mutex> lk(this->jobEventMutex);
+          if (this->clock->WaitFor(lk, this->jobEvent, std::chrono::milliseconds(this->keepAliveInterval),
+                                   [this] { return this->threadClosing.load(); })) {
+            return;
+          }
+        }
+        if (this->keepAliveHeld) {
+          continue;
+        }
 
         printf("CamPTZ Thread: Requesting keep-alive.\n");
-        RotatorRequest req;
-        req.cmd = CHANGE_AZI;
-        req.payload.ChangeAzi.aziRequested = this->lastAziTargetted;
-        auto ret = this->RequestSync(req, 1000);
-        if (!ret.has_value()) {
-          error = true;
+        RotatorRequest reqAzi, reqEle;
+        reqAzi.cmd = CHANGE_AZI;
+        reqEle.cmd = CHANGE_ELE;
+        {
+          std::lock_guard<std::mutex> lk(this->trackerMutex);
+          reqAzi.payload.ChangeAzi.aziRequested = this->lastAziTargetted;
+          reqEle.payload.ChangeEle.eleRequested = this->lastEleTargetted;
         }
 
-        req.cmd = CHANGE_ELE;
-        req.payload.ChangeEle.eleRequested = this->lastEleTargetted;
-        ret = this->RequestSync(req, 1000);
-        if (!ret.has_value()) {
-          error = true;
+        // refreshes on purpose: past the tracker, which would suppress them
+        ResponseLatch latch(2, this->clock, 1000);
+        latch.Submit(direct, reqAzi, 0);
+        latch.Submit(direct, reqEle, 1);
+        if (!latch.Wait() || !latch.Get(0)->success || !latch.Get(1)->success) {
+          // the link supervision takes care of it; try again next time
+          printf("CamPTZ Thread: Keep-alive refresh failed.\n");
         }
       }
-
-      printf("CamPTZ Thread: Keep-alive exited due to error.\n");
     });
+  }
 
+  if (velocityMode) {
+    trackerThread = clock->Spawn([this]() { this->velocityMain(); });
+  } else if (smartSink) {
+    trackerThread = clock->Spawn([this]() { this->trackerMain(); });
   }
 }
 
 void CamPTZ::connTerminate()
 {
-  CLOSE_SOCKET(sock);
+  transport->Close();
+  sockConnected = false;
 }
 
-void CamPTZ::threadMain(CamPTZ *self)
+void CamPTZ::failJob(threadJob &job)
 {
-  self->connStart();
+  RotatorResponse resp;
+  resp.success = false;
+  job.second(resp);
+}
 
-  if (!self->sockConnected) {
-    fprintf(stderr, "CamPTZ Thread: Error connecting to target\n");
-    self->threadExited = true;
-    return;
+void CamPTZ::linkFailed()
+{
+  // frames queued for the link go down with it; a reply still on its way
+  // would be taken for the next query's, so the link is reopened
+  txPending.clear();
+  completePending(false);
+  connTerminate();
+
+  std::lock_guard<std::mutex> lk(breakerMutex);
+  CircuitState before = breaker.State();
+  breaker.OnFailure(trackerNow());
+  if (breaker.State() != before) {
+    fprintf(stderr, "CamPTZ Thread: device link %s -> %s, next probe in %.1f s\n", CircuitStateName(before),
+            CircuitStateName(breaker.State()), breaker.RetryAt() - trackerNow());
+  }
+}
+
+bool CamPTZ::probeDevice()
+{
+  // a position query: a converter accepting connections says nothing about
+  // the head behind it
+  double pan;
+  return readPosition(0, pan);
+}
+
+bool CamPTZ::linkReady()
+{
+  CircuitState state;
+  {
+    std::lock_guard<std::mutex> lk(breakerMutex);
+    breaker.ProbeDue(trackerNow());
+    state = breaker.State();
+  }
+  if (state == CIRCUIT_OPEN) {
+    return false;
+  }
+  if (state == CIRCUIT_CLOSED && sockConnected) {
+    return true;
+  }
+
+  // reopen after an error; from HALF_OPEN, only a head that answers closes
+  // the circuit again
+  if (!sockConnected && !connStart()) {
+    linkFailed();
+    return false;
+  }
+  if (state == CIRCUIT_HALF_OPEN) {
+    if (!probeDevice()) {
+      linkFailed();
+      return false;
+    }
+    printf("CamPTZ Thread: device link recovered.\n");
+  }
+  return true;
+}
+
+void CamPTZ::watchdogMain()
+{
+  double tripped = 0;  // start of the job last aborted
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(jobEventMutex);
+      if (clock->WaitFor(lk, jobEvent, std::chrono::milliseconds(watchdogInterval),
+                         [this] { return threadClosing.load(); })) {
+        return;
+      }
+    }
+
+    double started = jobStartedAt.load();
+    double now = trackerNow();
+    if (started <= 0 || started == tripped || now - started < watchdogTimeout) {
+      continue;
+    }
+    tripped = started;
+    watchdogTrips++;
+    fprintf(stderr, "CamPTZ Watchdog: worker stuck in one job for %.1f s, aborting the device link\n",
+            now - started);
+
+    {
+      std::lock_guard<std::mutex> lk(breakerMutex);
+      breaker.Trip(now);
+    }
+    transport->Abort();
+
+    // queued behind the stuck job: fail them now, not after it
+    while (auto job = jobQueue.pop()) {
+      failJob(*job);
+    }
+  }
+}
+
+void CamPTZ::threadMain(CamPTZ *self)
+{
+  if (self->realTime.Enabled()) {
+    EnterRealTime("CamPTZ worker", self->realTime);
+  }
+  self->txPending.reserve(txReserve);
+  self->txPendingCallbacks.reserve(txReserve / 7);
+  self->startHelpers();
+  if (!self->connStart()) {
+    fprintf(stderr, "CamPTZ Thread: Error connecting to target, retrying in the background\n");
+    std::lock_guard<std::mutex> lk(self->breakerMutex);
+    self->breaker.Trip(self->trackerNow());
   }
 
   while (!self->threadClosing) {
     bool error = false;
     std::optional<threadJob> job;
 
-    // Wait on job
+    // Wait on job, for the next probe of a failing device, or for the preset
+    // bank's next step
     {
       std::unique_lock<std::mutex> lk(self->jobEventMutex);
-      self->jobEvent.wait(lk, [self]
-                          { return (self->jobQueue.size() > 0) || (self->threadClosing); });
+      Clock::TimePoint wakeAt = Clock::TimePoint::max();
+      double due;
+      {
+        std::lock_guard<std::mutex> blk(self->breakerMutex);
+        due = self->breaker.State() == CIRCUIT_OPEN ? self->breaker.RetryAt() : self->presetDue();
+      }
+      if (due < std::numeric_limits<double>::infinity()) {
+        double wait = (std::max)(0.0, due - self->trackerNow());
+        wakeAt = self->clock->Now() + std::chrono::duration_cast<Clock::Duration>(
+          std::chrono::duration<double>(wait));
+      }
+      self->clock->WaitUntil(lk, self->jobEvent, wakeAt, [self]
+                               { return (self->jobQueue.size() > 0) || (self->threadClosing); });
 
       job = self->jobQueue.pop();
+      // queued until its caller gave up: the head gets no command (or query)
+      // nobody is waiting for
+      while (job.has_value() && job->first.Droppable() && job->first.Expired(self->clock->Now())) {
+        self->expiredRequests++;
+        RotatorResponse resp;
+        resp.success = false;
+        job->second(resp);
+        job = self->jobQueue.pop();
+      }
     }
 
-    assert(job.has_value());
-
-    switch (job->first.cmd)
-    {
-    case CHANGE_AZI: {
-      double aziDesired = job->first.payload.ChangeAzi.aziRequested;
-      aziDesired += self->aziOffset;
-      if (aziDesired < 0) {
-        aziDesired += 360;
-      } else if (aziDesired >= 360) {
-        aziDesired -= 360;
-      }
-
-      int aziInt = std::round(aziDesired * 100);
-      char aziCmd[] = {'\xFF', '\x00', '\x00', '\x4B', '\x00', '\x00', '\x00'};
-      aziCmd[4] = (char)(aziInt / 256);
-      aziCmd[5] = (char)(aziInt % 256);
-      aziCmd[6] = (char)(aziCmd[3] + aziCmd[4] + aziCmd[5]);
-
-      int ret = send_fixed(self->sock, aziCmd, sizeof(aziCmd), 0);
-      if (ret == -1) {
-        fprintf(stderr, "CamPTZ send error\n");
-        error = true;
+    if (!self->linkReady()) {
+      // queued before the circuit opened, or the link could not be reopened
+      if (job.has_value()) {
+        failJob(*job);
       }
+      continue;
+    }
 
-      RotatorResponse resp;
-      resp.success = !error;
-      job->second(resp);
-
-      break;
+    if (!job.has_value()) {
+      // woken up for closing, a probe or the preset bank, or everything
+      // queued had expired
+      if (!self->presetTick() || !self->flushFrames()) {
+        self->linkFailed();
+      }
+      continue;
     }
+    self->jobStartedAt = self->trackerNow();
 
+    switch (job->first.cmd)
+    {
+    case CHANGE_AZI:
     case CHANGE_ELE: {
-      double eleDesired = job->first.payload.ChangeEle.eleRequested;
-      eleDesired += self->eleOffset;
-      eleDesired = 90 - eleDesired;
+      int axis = job->first.cmd == CHANGE_AZI ? 0 : 1;
+      double device = axis == 0 ? self->deviceAzi(job->first.payload.ChangeAzi.aziRequested)
+                                : self->deviceTilt(job->first.payload.ChangeEle.eleRequested);
 
-      int eleInt = std::round(eleDesired * 100);
-      char eleCmd[] = {'\xFF', '\x00', '\x00', '\x4D', '\x00', '\x00', '\x00'};
-      eleCmd[4] = (char)(eleInt / 256);
-      eleCmd[5] = (char)(eleInt % 256);
-      eleCmd[6] = (char)(eleCmd[3] + eleCmd[4] + eleCmd[5]);
-
-      int ret = send_fixed(self->sock, eleCmd, sizeof(eleCmd), 0);
-      if (ret == -1) {
+      // a preset recall may take the head there instead
+      if (!self->presetMove(axis, device) && !self->sendPosition(axis, device)) {
         fprintf(stderr, "CamPTZ send error\n");
         error = true;
       }
 
-      // an dummy one as callback
-      RotatorResponse resp;
-      resp.success = !error;
-      job->second(resp);
-
+      self->completeWrite(job->second, error);
       break;
     }
 
     case GET_AZI: {
-      char aziCmd[] = {'\xFF', '\x00', '\x00', '\x51', '\x00', '\x00', '\x51'};
-      int ret = send_fixed(self->sock, aziCmd, sizeof(aziCmd), 0);
-      if (ret == -1) {
-        fprintf(stderr, "CamPTZ send error\n");
-        error = true;
-      }
-
-      char aziResp[7];
-      ret = recv_fixed(self->sock, aziResp, sizeof(aziResp), 0);
-      if (ret == -1) {
+      double aziGot = 0;
+      if (!self->readPosition(0, aziGot)) {
         fprintf(stderr, "CamPTZ recv error\n");
         error = true;
       }
-
-      double aziGot = 0;
-      aziGot += aziResp[4] * 256.0 + aziResp[5];
-      aziGot /= 100;
       aziGot -= self->aziOffset;
 
       RotatorResponse resp;
@@ -192,23 +410,11 @@ void CamPTZ::threadMain(CamPTZ *self)
     }
     
     case GET_ELE: {
-      char eleCmd[] = {'\xFF', '\x00', '\x00', '\x53', '\x00', '\x00', '\x53'};
-      int ret = send_fixed(self->sock, eleCmd, sizeof(eleCmd), 0);
-      if (ret == -1) {
-        fprintf(stderr, "CamPTZ send error\n");
-        error = true;
-      }
-
-      char eleResp[7];
-      ret = recv_fixed(self->sock, eleResp, sizeof(eleResp), 0);
-      if (ret == -1) {
+      double eleGot = 0;
+      if (!self->readPosition(1, eleGot)) {
         fprintf(stderr, "CamPTZ recv error\n");
         error = true;
       }
-
-      double eleGot = 0;
-      eleGot += eleResp[4] * 256.0 + eleResp[5];
-      eleGot /= 100;
       eleGot -= self->eleOffset;
       eleGot = 90 - eleGot;
 
@@ -224,45 +430,111 @@ void CamPTZ::threadMain(CamPTZ *self)
     case CAMPTZ_PRESET_CALL:
     case CAMPTZ_PRESET_SET:
     case CAMPTZ_PRESET_CLEAR: {
-      auto setPreset = [&](int presetIdx) {
-        char cmd[] = {'\xFF', '\x00', '\x00', '\x03', '\x00', presetIdx, '\x03' + presetIdx};
-        int ret = send_fixed(self->sock, cmd, sizeof(cmd), 0);
-        if (ret == -1) {
-          fprintf(stderr, "CamPTZ send error\n");
-          error = true;
-        }
-      };
+      uint8_t cmd2 = 0x05;
+      if (job->first.cmd == CAMPTZ_PRESET_CALL) {
+        cmd2 = 0x07;
+        // the head goes wherever that preset is
+        self->presetHalt();
+      } else if (job->first.cmd == CAMPTZ_PRESET_SET) {
+        cmd2 = 0x03;
+      }
 
-      auto clearPreset = [&](int presetIdx) {
-        char cmd[] = {'\xFF', '\x00', '\x00', '\x05', '\x00', presetIdx, '\x05' + presetIdx};
-        int ret = send_fixed(self->sock, cmd, sizeof(cmd), 0);
-        if (ret == -1) {
-          fprintf(stderr, "CamPTZ send error\n");
-          error = true;
-        }
-      };
+      if (!self->sendPreset(cmd2, (unsigned char)job->first.payload.CamPTZPreset.presetIdx)) {
+        fprintf(stderr, "CamPTZ send error\n");
+        error = true;
+      }
 
-      auto callPreset = [&](int presetIdx) {
-        char cmd[] = {'\xFF', '\x00', '\x00', '\x07', '\x00', presetIdx, '\x07' + presetIdx};
-        int ret = send_fixed(self->sock, cmd, sizeof(cmd), 0);
-        if (ret == -1) {
-          fprintf(stderr, "CamPTZ send error\n");
-          error = true;
-        }
-      };
+      self->completeWrite(job->second, error);
+      break;
+    }
 
-      if (job->first.cmd == CAMPTZ_PRESET_CALL) {
-        callPreset(job->first.payload.CamPTZPreset.presetIdx);
-      } else if (job->first.cmd == CAMPTZ_PRESET_SET) {
-        setPreset(job->first.payload.CamPTZPreset.presetIdx);
-      } else if (job->first.cmd == CAMPTZ_PRESET_CLEAR) {
-        clearPreset(job->first.payload.CamPTZPreset.presetIdx);
+    case ROTATOR_PRESET_HINT: {
+      if (self->presets.Enabled()) {
+        PresetBank::Position position;
+        position.pan = self->deviceAzi(job->first.payload.PresetHint.azi);
+        position.tilt = self->deviceTilt(job->first.payload.PresetHint.ele);
+        int index = self->presets.Add(self->trackerNow(), position, false);
+        if (index >= 0 && !self->presets.IsProgrammed(index)) {
+          printf("CamPTZ Thread: preset %d reserved for pan %.2f tilt %.2f\n", self->presets.Slot(index),
+                 position.pan, position.tilt);
+        }
       }
 
       RotatorResponse resp;
-      resp.success = !error;
+      resp.success = true;
       job->second(resp);
+      break;
+    }
+
+    case ROTATOR_STOP:
+    case ROTATOR_MOVE:
+    case ROTATOR_RESET: {
+      uint8_t cmd2 = 0, panSpeed = 0, tiltSpeed = 0;
+      if (job->first.cmd == ROTATOR_MOVE) {
+        // hamlib speed 1..100 to Pelco-D 0x00..0x3F
+        int speed = (std::max)(1, (std::min)(100, job->first.payload.Move.speed));
+        uint8_t pelcoSpeed = (uint8_t)std::round((speed - 1) * 0x3F / 99.0);
+        int direction = job->first.payload.Move.direction;
+
+        if (direction & MOVE_CW) {
+          cmd2 |= 0x02;
+          panSpeed = pelcoSpeed;
+        } else if (direction & MOVE_CCW) {
+          cmd2 |= 0x04;
+          panSpeed = pelcoSpeed;
+        }
+        if (direction & MOVE_UP) {
+          cmd2 |= 0x08;
+          tiltSpeed = pelcoSpeed;
+        } else if (direction & MOVE_DOWN) {
+          cmd2 |= 0x10;
+          tiltSpeed = pelcoSpeed;
+        }
+      } else if (job->first.cmd == ROTATOR_RESET) {
+        // Pelco-D extended command: remote reset
+        cmd2 = 0x0F;
+      }
+      self->presetHalt();
+
+      char cmd[] = {'\xFF', '\x00', '\x00', (char)cmd2, (char)panSpeed, (char)tiltSpeed,
+                    (char)(cmd2 + panSpeed + tiltSpeed)};
+      int ret = self->sendFrame(cmd, sizeof(cmd));
+      if (ret == -1) {
+        fprintf(stderr, "CamPTZ send error\n");
+        error = true;
+      }
+
+      self->completeWrite(job->second, error);
+      break;
+    }
+
+    case CAMPTZ_SPEED: {
+      // pan/tilt speed frame; both axes at once, 0 stops an axis
+      int pan = job->first.payload.CamPTZSpeed.pan, tilt = job->first.payload.CamPTZSpeed.tilt;
+      uint8_t cmd2 = 0;
+      if (pan > 0) {
+        cmd2 |= 0x02;
+      } else if (pan < 0) {
+        cmd2 |= 0x04;
+      }
+      if (tilt > 0) {
+        cmd2 |= 0x08;
+      } else if (tilt < 0) {
+        cmd2 |= 0x10;
+      }
+      uint8_t panSpeed = (uint8_t)(std::min)(std::abs(pan), 0x3F);
+      uint8_t tiltSpeed = (uint8_t)(std::min)(std::abs(tilt), 0x3F);
+      self->presetHalt();
 
+      char cmd[] = {'\xFF', '\x00', '\x00', (char)cmd2, (char)panSpeed, (char)tiltSpeed,
+                    (char)(cmd2 + panSpeed + tiltSpeed)};
+      int ret = self->sendFrame(cmd, sizeof(cmd));
+      if (ret == -1) {
+        fprintf(stderr, "CamPTZ send error\n");
+        error = true;
+      }
+
+      self->completeWrite(job->second, error);
       break;
     }
 
@@ -270,15 +542,21 @@ void CamPTZ::threadMain(CamPTZ *self)
       fprintf(stderr, "Unknown command in CamPTZ packet. Ignore.\n");
     }
 
-    // TODO: retry or cleanup
+    // nothing else waiting: put the coalesced frames on the wire
+    if (!error && self->jobQueue.size() == 0 && !self->flushFrames()) {
+      fprintf(stderr, "CamPTZ send error\n");
+      error = true;
+    }
+
+    self->jobStartedAt = 0;
     if (error) {
-      fprintf(stderr, "CamPTZ Thread: Sock error encountered, thread exiting\n");
-      self->threadExited = true;
-      return;
+      fprintf(stderr, "CamPTZ Thread: device I/O failed, reopening the link\n");
+      self->linkFailed();
     }
   }
 
   // TODO: cleanup, if needed
+  self->flushFrames();
   self->connTerminate();
   self->threadExited = true;
   return;
@@ -286,16 +564,557 @@ void CamPTZ::threadMain(CamPTZ *self)
 
 void CamPTZ::Start()
 {
-  worker = std::thread(CamPTZ::threadMain, this);
+  transport->SetClock(clock);
+  if (presets.Enabled()) {
+    double now = trackerNow();
+    lastTargetAt = now;
+    presets.Add(now, PresetBank::Position{deviceAzi(parkAzi), deviceTilt(parkEle)}, true);
+    for (auto &position : presetPositions) {
+      if (presets.Add(now, PresetBank::Position{deviceAzi(position.first), deviceTilt(position.second)}, true) < 0) {
+        fprintf(stderr, "CamPTZ: no preset left for %.2f %.2f\n", position.first, position.second);
+      }
+    }
+  }
+  worker = clock->Spawn([this]() { CamPTZ::threadMain(this); });
   threadExited = false;
   printf("CamPTZ Initialized.\n");
+
+  if (presetReset) {
+    // disable power-on self test
+    RotatorRequest req;
+    req.cmd = CAMPTZ_PRESET_CLEAR;
+    req.payload.CamPTZPreset.presetIdx = 156;
+    Request(req, [](RotatorResponse resp) {
+      if (resp.success) {
+        printf("CamPTZ: Power-on self test disabled.\n");
+      } else {
+        printf("CamPTZ: ERR while disabling Power-on self test.\n");
+      }
+    });
+
+    // disable automatic zero-returning
+    req.payload.CamPTZPreset.presetIdx = 130;
+    Request(req, [](RotatorResponse resp) {
+      if (resp.success) {
+        printf("CamPTZ: Automatic zero-returning disabled.\n");
+      } else {
+        printf("CamPTZ: ERR while disabling automatic zero-returning.\n");
+      }
+    });
+  }
 }
 
 bool CamPTZ::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback) {
+  if (velocityMode && (req.cmd == ROTATOR_STOP || req.cmd == ROTATOR_MOVE || req.cmd == ROTATOR_RESET)) {
+    // manual control: the velocity drive lets go until the next target
+    std::lock_guard<std::mutex> lk(trackerMutex);
+    for (int axis = 0; axis < 2; axis++) {
+      velocityTrackers[axis].Reset();
+      speedSent[axis] = 0;
+    }
+  }
+
+  switch (req.cmd) {
+  case ROTATOR_PARK: {
+    // an ordinary absolute move to the park position
+    RotatorRequest reqAzi;
+    reqAzi.cmd = CHANGE_AZI;
+    reqAzi.payload.ChangeAzi.aziRequested = parkAzi;
+    if (!RequestImpl(reqAzi, [](RotatorResponse) {}, false)) {
+      return false;
+    }
+
+    RotatorRequest reqEle;
+    reqEle.cmd = CHANGE_ELE;
+    reqEle.payload.ChangeEle.eleRequested = parkEle;
+    return RequestImpl(reqEle, callback, false);
+  }
+
+  case ROTATOR_STOP:
+  case ROTATOR_MOVE:
+    // manual control; keep-alive must not drive back to the last target
+    keepAliveHeld = true;
+    break;
+
+  case CHANGE_AZI:
+  case CHANGE_ELE:
+    keepAliveHeld = false;
+    break;
+
+  default:
+    break;
+  }
+
   return RequestImpl(req, callback, false);
 }
 
-bool CamPTZ::RequestImpl(RotatorRequest req, std::function<void(RotatorResponse)> callback, bool noSmartSink)
+double CamPTZ::deviceAzi(double azi)
+{
+  azi += aziOffset;
+  if (azi < 0) {
+    azi += 360;
+  } else if (azi >= 360) {
+    azi -= 360;
+  }
+  return azi;
+}
+
+double CamPTZ::deviceTilt(double ele)
+{
+  // signed: past the zenith (flip mode) it goes below 0
+  return 90 - (ele + eleOffset);
+}
+
+bool CamPTZ::sendPosition(int axis, double device)
+{
+  if (axis == 1 && device < 0) {
+    // past the zenith (flip mode): tilt wraps like pan
+    device += 360;
+  }
+
+  int value = std::round(device * 100);
+  char cmd[] = {'\xFF', '\x00', '\x00', axis == 0 ? '\x4B' : '\x4D', '\x00', '\x00', '\x00'};
+  cmd[4] = (char)(value / 256);
+  cmd[5] = (char)(value % 256);
+  cmd[6] = (char)(cmd[3] + cmd[4] + cmd[5]);
+  return sendFrame(cmd, sizeof(cmd)) != -1;
+}
+
+bool CamPTZ::sendPreset(uint8_t cmd2, int slot)
+{
+  char cmd[] = {'\xFF', '\x00', '\x00', (char)cmd2, '\x00', (char)slot, (char)(cmd2 + slot)};
+  return sendFrame(cmd, sizeof(cmd)) != -1;
+}
+
+bool CamPTZ::readPosition(int axis, double &device)
+{
+  char query[] = {'\xFF', '\x00', '\x00', axis == 0 ? '\x51' : '\x53', '\x00', '\x00', '\x00'};
+  query[6] = query[3];
+  sendFrame(query, sizeof(query));
+
+  char reply[7];
+  if (recvFrame(reply, sizeof(reply)) == -1) {
+    return false;
+  }
+  device = ((unsigned char)reply[4] * 256.0 + (unsigned char)reply[5]) / 100;
+  if (axis == 1 && device > 270) {
+    device -= 360;
+  }
+  presetSeen(axis, device);
+  return true;
+}
+
+bool CamPTZ::recallPreset(const double target[2])
+{
+  double now = trackerNow();
+  PresetBank::Position from, to{target[0], target[1]};
+  double *fromAxes[2] = {&from.pan, &from.tilt};
+  for (int axis = 0; axis < 2; axis++) {
+    if (headTargetValid[axis]) {
+      *fromAxes[axis] = headTarget[axis];
+    } else if (now - headSeenAt[axis] <= 2 * presetPoll) {
+      *fromAxes[axis] = headSeen[axis];
+    } else {
+      // no idea what a recall would save
+      return false;
+    }
+  }
+
+  int index = presets.Recall(now, from, to);
+  if (index < 0 || !sendPreset(0x07, presets.Slot(index))) {
+    return false;
+  }
+  PresetBank::Position preset = presets.At(index);
+  printf("CamPTZ Thread: recalling preset %d for pan %.2f tilt %.2f (%.1f s instead of %.1f s)\n",
+         presets.Slot(index), to.pan, to.tilt, presets.RecallTime(index, from, to), presets.MoveTime(from, to));
+
+  recalling = index;
+  recallStarted = now;
+  recallTime = presets.RecallTime(index, from, preset);
+  for (int axis = 0; axis < 2; axis++) {
+    recallTarget[axis] = target[axis];
+    headTarget[axis] = target[axis];
+    headTargetValid[axis] = true;
+  }
+  return true;
+}
+
+bool CamPTZ::presetMove(int axis, double target)
+{
+  if (!presets.Enabled()) {
+    return false;
+  }
+
+  if (recalling >= 0) {
+    if (std::abs(target - recallTarget[axis]) < samePosition) {
+      // a recall is taking the head there already
+      return true;
+    }
+    recalling = -1;
+  }
+  if (visiting >= 0) {
+    if (std::abs(target - visitReturn[axis]) < samePosition) {
+      // back there after the visit
+      return true;
+    }
+    printf("CamPTZ Thread: preset %d visit cut short by a new target\n", presets.Slot(visiting));
+    visiting = -1;
+  }
+  if (!headTargetValid[axis] || std::abs(target - headTarget[axis]) >= samePosition) {
+    lastTargetAt = trackerNow();
+  }
+
+  // a recall moves both axes: the other one to its latest target, which may
+  // still be queued behind this one
+  double to[2];
+  to[axis] = target;
+  {
+    std::lock_guard<std::mutex> lk(trackerMutex);
+    to[1 - axis] = axis == 0 ? deviceTilt(lastEleTargetted) : deviceAzi(lastAziTargetted);
+  }
+  if (recallPreset(to)) {
+    return true;
+  }
+
+  headTarget[axis] = target;
+  headTargetValid[axis] = true;
+  return false;
+}
+
+void CamPTZ::presetSeen(int axis, double device)
+{
+  if (!presets.Enabled()) {
+    return;
+  }
+  double now = trackerNow();
+  headSeen[axis] = device;
+  headSeenAt[axis] = now;
+  if (now - headSeenAt[1 - axis] > 2 * presetPoll) {
+    return;
+  }
+
+  PresetBank::Position head{headSeen[0], headSeen[1]};
+  if (recalling >= 0) {
+    PresetBank::Position preset = presets.At(recalling);
+    if (std::abs(head.pan - preset.pan) <= presetArrival && std::abs(head.tilt - preset.tilt) <= presetArrival) {
+      finishRecall();
+    }
+    return;
+  }
+
+  // resting on a target that wants a preset: store it, nothing has to move
+  if (!headTargetValid[0] || !headTargetValid[1] || std::abs(head.pan - headTarget[0]) > presetArrival ||
+      std::abs(head.tilt - headTarget[1]) > presetArrival) {
+    return;
+  }
+  int index = presets.FindUnprogrammed(head);
+  if (index >= 0 && sendPreset(0x03, presets.Slot(index))) {
+    presets.Programmed(index, head);
+    printf("CamPTZ Thread: preset %d programmed at pan %.2f tilt %.2f\n", presets.Slot(index), head.pan, head.tilt);
+  }
+}
+
+void CamPTZ::finishRecall()
+{
+  // the rest of the way, when the preset was only near the target
+  PresetBank::Position preset = presets.At(recalling);
+  double at[2] = {preset.pan, preset.tilt};
+  recalling = -1;
+  for (int axis = 0; axis < 2; axis++) {
+    if (std::abs(recallTarget[axis] - at[axis]) >= samePosition) {
+      sendPosition(axis, recallTarget[axis]);
+    }
+  }
+}
+
+void CamPTZ::presetHalt()
+{
+  // manual control: the head ends up wherever it is left
+  recalling = -1;
+  visiting = -1;
+  headTargetValid[0] = headTargetValid[1] = false;
+  lastTargetAt = trackerNow();
+}
+
+double CamPTZ::presetDue()
+{
+  if (!presets.Enabled()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  if (visiting >= 0) {
+    return presetPolledAt + presetPoll;
+  }
+  if (recalling >= 0) {
+    return (std::max)(recallStarted + recallTime, presetPolledAt + presetPoll);
+  }
+  if (presetIdle > 0 && headTargetValid[0] && headTargetValid[1] && presets.NextUnprogrammed() >= 0) {
+    return lastTargetAt + presetIdle;
+  }
+  return std::numeric_limits<double>::infinity();
+}
+
+bool CamPTZ::presetTick()
+{
+  double now = trackerNow();
+  if (now < presetDue()) {
+    return true;
+  }
+
+  if (recalling >= 0 || visiting >= 0) {
+    // arrivals are taken from the replies (presetSeen)
+    presetPolledAt = now;
+    double pan, tilt;
+    if (!readPosition(0, pan) || !readPosition(1, tilt)) {
+      return false;
+    }
+  }
+
+  if (recalling >= 0 && now - recallStarted > 2 * recallTime + 5) {
+    printf("CamPTZ Thread: preset %d not reached, moving on\n", presets.Slot(recalling));
+    finishRecall();
+  }
+
+  if (visiting >= 0) {
+    bool done = presets.IsProgrammed(visiting);
+    if (!done && now - visitStarted > 2 * visitTime + 5) {
+      printf("CamPTZ Thread: preset %d position not reached, dropped from the bank\n", presets.Slot(visiting));
+      presets.Remove(visiting);
+      done = true;
+    }
+    if (done) {
+      visiting = -1;
+      lastTargetAt = now;
+      if (!recallPreset(visitReturn)) {
+        for (int axis = 0; axis < 2; axis++) {
+          sendPosition(axis, visitReturn[axis]);
+          headTarget[axis] = visitReturn[axis];
+        }
+      }
+    }
+    return true;
+  }
+
+  if (recalling >= 0) {
+    return true;
+  }
+
+  // idle: go and program the next position, then come back
+  int index = presets.NextUnprogrammed();
+  if (index < 0) {
+    return true;
+  }
+  PresetBank::Position position = presets.At(index);
+  PresetBank::Position from{headTarget[0], headTarget[1]};
+  printf("CamPTZ Thread: idle, visiting pan %.2f tilt %.2f to program preset %d\n", position.pan, position.tilt,
+         presets.Slot(index));
+  visiting = index;
+  visitStarted = presetPolledAt = now;
+  visitTime = presets.MoveTime(from, position);
+  double target[2] = {position.pan, position.tilt};
+  for (int axis = 0; axis < 2; axis++) {
+    visitReturn[axis] = headTarget[axis];
+    sendPosition(axis, target[axis]);
+    headTarget[axis] = target[axis];
+  }
+  return true;
+}
+
+double CamPTZ::trackerNow()
+{
+  return clock->Seconds();
+}
+
+// called with trackerMutex held
+void CamPTZ::logTransition(int axis, AxisTrackingState before)
+{
+  AxisTrackingState after = trackers[axis].State();
+  if (after != before) {
+    printf("CamPTZ Thread: smartSink %s %s -> %s\n", axis == 0 ? "azi" : "ele",
+           AxisTrackingStateName(before), AxisTrackingStateName(after));
+  }
+}
+
+void CamPTZ::trackerMain()
+{
+  if (realTime.Enabled()) {
+    EnterRealTime("CamPTZ tracker", realTime);
+  }
+  RotatorRequestHandler direct = [this](RotatorRequest req, RotatorCallback callback) {
+    return this->RequestImpl(req, callback, true);
+  };
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(jobEventMutex);
+      if (clock->WaitFor(lk, jobEvent, std::chrono::milliseconds(trackerInterval),
+                         [this] { return threadClosing.load(); })) {
+        return;
+      }
+    }
+
+    bool sample;
+    {
+      std::lock_guard<std::mutex> lk(trackerMutex);
+      sample = trackers[0].NeedsSampling() || trackers[1].NeedsSampling();
+    }
+
+    std::optional<RotatorResponse> positions[2];
+    if (sample) {
+      RotatorRequest reqAzi, reqEle;
+      reqAzi.cmd = GET_AZI;
+      reqEle.cmd = GET_ELE;
+      ResponseLatch latch(2, clock, 1000);
+      latch.Submit(direct, reqAzi, 0);
+      latch.Submit(direct, reqEle, 1);
+      latch.Wait();
+      positions[0] = latch.Get(0);
+      positions[1] = latch.Get(1);
+    }
+
+    std::optional<double> resend[2];
+    {
+      std::lock_guard<std::mutex> lk(trackerMutex);
+      double now = trackerNow();
+      for (int axis = 0; axis < 2; axis++) {
+        AxisTrackingState before = trackers[axis].State();
+        if (positions[axis].has_value() && positions[axis]->success) {
+          trackers[axis].OnPosition(now, axis == 0 ? positions[axis]->payload.aziResp.azi
+                                                   : positions[axis]->payload.eleResp.ele);
+        }
+        resend[axis] = trackers[axis].OnTick(now);
+        logTransition(axis, before);
+      }
+    }
+
+    for (int axis = 0; axis < 2; axis++) {
+      if (!resend[axis].has_value()) {
+        continue;
+      }
+      printf("CamPTZ Thread: smartSink sending %s %.2f\n", axis == 0 ? "azi" : "ele", *resend[axis]);
+      RotatorRequest req;
+      if (axis == 0) {
+        req.cmd = CHANGE_AZI;
+        req.payload.ChangeAzi.aziRequested = *resend[axis];
+      } else {
+        req.cmd = CHANGE_ELE;
+        req.payload.ChangeEle.eleRequested = *resend[axis];
+      }
+      RequestImpl(req, [](RotatorResponse) {}, true);
+    }
+  }
+}
+
+void CamPTZ::velocityMain()
+{
+  if (realTime.Enabled()) {
+    EnterRealTime("CamPTZ tracker", realTime);
+  }
+  RotatorRequestHandler direct = [this](RotatorRequest req, RotatorCallback callback) {
+    return this->RequestImpl(req, callback, true);
+  };
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(jobEventMutex);
+      if (clock->WaitFor(lk, jobEvent, std::chrono::milliseconds(trackerInterval),
+                         [this] { return threadClosing.load(); })) {
+        return;
+      }
+    }
+
+    // only the axes that ask for it: between samples the trackers
+    // dead-reckon on the speed they commanded
+    std::vector<int> sampled;
+    {
+      std::lock_guard<std::mutex> lk(trackerMutex);
+      double now = trackerNow();
+      for (int axis = 0; axis < 2; axis++) {
+        if (velocityTrackers[axis].NeedsSampling(now)) {
+          sampled.push_back(axis);
+        }
+      }
+    }
+
+    std::optional<RotatorResponse> positions[2];
+    if (!sampled.empty()) {
+      ResponseLatch latch(sampled.size(), clock, 1000);
+      for (size_t i = 0; i < sampled.size(); i++) {
+        RotatorRequest req;
+        req.cmd = sampled[i] == 0 ? GET_AZI : GET_ELE;
+        latch.Submit(direct, req, i);
+      }
+      latch.Wait();
+      for (size_t i = 0; i < sampled.size(); i++) {
+        positions[sampled[i]] = latch.Get(i);
+      }
+    }
+
+    std::optional<double> moves[2];
+    std::optional<RotatorRequest> speed;
+    {
+      std::lock_guard<std::mutex> lk(trackerMutex);
+      double now = trackerNow();
+      for (int axis = 0; axis < 2; axis++) {
+        VelocityTrackingState before = velocityTrackers[axis].State();
+        if (positions[axis].has_value() && positions[axis]->success) {
+          velocityTrackers[axis].OnPosition(now, axis == 0 ? deviceAzi(positions[axis]->payload.aziResp.azi)
+                                                           : positions[axis]->payload.eleResp.ele);
+        }
+        moves[axis] = velocityTrackers[axis].OnTick(now);
+        VelocityTrackingState after = velocityTrackers[axis].State();
+        if (after != before) {
+          printf("CamPTZ Thread: velocity %s %s -> %s\n", axis == 0 ? "azi" : "ele",
+                 VelocityTrackingStateName(before), VelocityTrackingStateName(after));
+        }
+      }
+
+      // a speed frame sets both axes and would cut off an absolute move of
+      // the other one: held back until that move is over, unless a new one
+      // follows the frame anyway
+      bool held = false;
+      for (int axis = 0; axis < 2; axis++) {
+        held |= velocityTrackers[axis].InAbsoluteMove() && !moves[axis].has_value();
+      }
+      int steps[2] = {velocityTrackers[0].Step(), velocityTrackers[1].Step()};
+      if (!held && (steps[0] != speedSent[0] || steps[1] != speedSent[1])) {
+        RotatorRequest req;
+        req.cmd = CAMPTZ_SPEED;
+        req.payload.CamPTZSpeed.pan = steps[0];
+        req.payload.CamPTZSpeed.tilt = steps[1];
+        speed = req;
+        speedSent[0] = steps[0];
+        speedSent[1] = steps[1];
+      }
+      for (int axis = 0; axis < 2; axis++) {
+        if (moves[axis].has_value()) {
+          // an absolute move ends speed mode on that axis
+          speedSent[axis] = 0;
+        }
+      }
+    }
+
+    if (speed.has_value()) {
+      RequestImpl(*speed, [](RotatorResponse) {}, true);
+    }
+    for (int axis = 0; axis < 2; axis++) {
+      if (!moves[axis].has_value()) {
+        continue;
+      }
+      printf("CamPTZ Thread: velocity moving %s to %.2f\n", axis == 0 ? "azi" : "ele", *moves[axis]);
+      RotatorRequest req;
+      if (axis == 0) {
+        req.cmd = CHANGE_AZI;
+        req.payload.ChangeAzi.aziRequested = *moves[axis] - aziOffset;
+      } else {
+        req.cmd = CHANGE_ELE;
+        req.payload.ChangeEle.eleRequested = *moves[axis];
+      }
+      RequestImpl(req, [](RotatorResponse) {}, true);
+    }
+  }
+}
+
+bool CamPTZ::RequestImpl(RotatorRequest req, std::function<void(RotatorResponse)> callback, bool bypassTracker)
 {
   if (threadExited) {
     // error
@@ -304,134 +1123,116 @@ bool CamPTZ::RequestImpl(RotatorRequest req, std::function<void(RotatorResponse)
     return false;
   }
 
-  // smartSink related
-  bool suppressPushing = false;
-  if (!noSmartSink && smartSink) {
-    bool cond1 = (req.cmd == CHANGE_AZI && req.payload.ChangeAzi.aziRequested == lastAziTargetted) 
-              || (req.cmd == CHANGE_ELE && req.payload.ChangeEle.eleRequested == lastEleTargetted);
-    std::chrono::duration<double> elapsed_seconds = std::chrono::duration<double>(
-      std::chrono::steady_clock::now() - lastPosChange
-    );
-
-    bool cond2 = elapsed_seconds.count() < changeEffectiveMargin;
-
-    printf("CamPTZ Thread: SmartSink decision: cond1=%d, cond2=%d\n", cond1, cond2);
-
-    if (cond1 && cond2 && !smartSinkSampling.load()) {
-      // emit sampling
-      smartSinkSampling.store(true);
-      smartSinkTargetChanged.store(false);
-      
-      RotatorRequest reqQueryAzi;
-      reqQueryAzi.cmd = GET_AZI;
-      RequestImpl(reqQueryAzi, [&, req, callback](RotatorResponse resp) {
-        this->smartSinkLastAzi = resp.payload.aziResp.azi;
-        RotatorRequest reqQueryEle;
-        reqQueryEle.cmd = GET_ELE;
-        RequestImpl(reqQueryEle, [&, req, callback](RotatorResponse resp) {
-          this->smartSinkLastQuery = std::chrono::steady_clock::now();
-          this->smartSinkLastEle = resp.payload.eleResp.ele;
-
-          // wait for smartSinkSamplingInterval; a silly version since I don't have event queue
-          // and I don't want to block this working thread
-          auto nextTh = std::thread([&, req, callback]() {
-            std::this_thread::sleep_until(
-              this->smartSinkLastQuery + std::chrono::milliseconds(this->smartSinkSamplingInterval)
-            );
-
-            // sample again
-            RotatorRequest reqQueryAzi;
-            reqQueryAzi.cmd = GET_AZI;
-            RequestImpl(reqQueryAzi, [&, req, callback](RotatorResponse resp) {
-              this->smartSinkThisAzi = resp.payload.aziResp.azi;
-              RotatorRequest reqQueryEle;
-              reqQueryEle.cmd = GET_ELE;
-              RequestImpl(reqQueryEle, [&, req, callback](RotatorResponse resp) {
-                auto timeNow = std::chrono::steady_clock::now();
-                this->smartSinkThisEle = resp.payload.eleResp.ele;
-
-                // test if the delta is sufficient; or we need to replay the request
-                // (std::min) to walkaround this: https://stackoverflow.com/questions/13416418/define-nominmax-using-stdmin-max
-                double deltaAzi = (std::min)(
-                  360 - std::abs(smartSinkThisAzi - smartSinkLastAzi),
-                  std::abs(smartSinkThisAzi - smartSinkLastAzi)
-                );
-
-                double deltaEle = (std::min)(
-                  90 - std::abs(smartSinkThisEle - smartSinkLastEle),
-                  std::abs(smartSinkThisEle - smartSinkLastEle)
-                );
-
-                bool needReplay = deltaEle + deltaAzi < this->smartSinkAngularVelocityMargin;
-                printf(
-                  "CamPTZ Thread: SmartSink got deltaEle=%lf, deltaAzi=%lf, needReplay=%s\n",
-                  deltaEle, deltaAzi, needReplay ? "true" : "false"
-                );
-
-                if (needReplay && !smartSinkTargetChanged.load()) {
-                  // a dummy callback, since callback have been called
-                  RequestImpl(req, [](RotatorResponse) {}, false);
-                }
-
-                this->smartSinkSampling.store(false);
-              }, false);
-            }, false);
-          });
-          nextTh.detach();
-        }, false);
-      }, false);
-
-      suppressPushing = true;
-      // make callback by smartSink
-      RotatorResponse respFake;
-      respFake.success = true;
-      callback(respFake);
-    } else if (smartSinkSampling.load()) {
-      printf("CamPTZ Thread: In smartSink; Suppressing position change request with a fake callback\n");
-      suppressPushing = true;
-      // make callback by smartSink
+  if (req.cmd == CHANGE_AZI || req.cmd == CHANGE_ELE) {
+    int axis = req.cmd == CHANGE_AZI ? 0 : 1;
+    double target = axis == 0 ? req.payload.ChangeAzi.aziRequested : req.payload.ChangeEle.eleRequested;
+    AxisTracker::Action action = AxisTracker::SEND;
+    {
+      std::lock_guard<std::mutex> lk(trackerMutex);
+      (axis == 0 ? lastAziTargetted : lastEleTargetted) = target;
+      if (velocityMode && !bypassTracker) {
+        velocityTrackers[axis].OnTarget(trackerNow(), axis == 0 ? deviceAzi(target) : target);
+        action = AxisTracker::SUPPRESS;
+      } else if (smartSink && !bypassTracker) {
+        AxisTrackingState before = trackers[axis].State();
+        action = trackers[axis].OnTarget(trackerNow(), target);
+        logTransition(axis, before);
+      }
+    }
+
+    if (action == AxisTracker::SUPPRESS) {
+      // answered by smartSink or the velocity drive
       RotatorResponse respFake;
       respFake.success = true;
       callback(respFake);
+      return true;
     }
 
-    // recording
-    if (req.cmd == CHANGE_AZI) {
-      if (req.payload.ChangeAzi.aziRequested != lastAziTargetted) {
-        this->smartSinkTargetChanged.store(true);
-        lastPosChange = std::chrono::steady_clock::now();
-      }
-      lastAziTargetted = req.payload.ChangeAzi.aziRequested;
-    } else if (req.cmd == CHANGE_ELE) {
-      if (req.payload.ChangeEle.eleRequested != lastEleTargetted) {
-        this->smartSinkTargetChanged.store(true);
-        lastPosChange = std::chrono::steady_clock::now();
-      }
-      lastEleTargetted = req.payload.ChangeEle.eleRequested;
+    if (smartSink && !velocityMode) {
+      callback = [this, axis, callback](RotatorResponse resp) {
+        if (!resp.success) {
+          std::lock_guard<std::mutex> lk(trackerMutex);
+          AxisTrackingState before = trackers[axis].State();
+          trackers[axis].OnCommandFailed(trackerNow());
+          logTransition(axis, before);
+        }
+        callback(resp);
+      };
     }
   }
 
-  // actual job push code
-  if (!suppressPushing) {
-    jobQueue.push(std::make_pair(
-      req, callback
-    ));
-
-    std::unique_lock<std::mutex> lk(jobEventMutex);
-    jobEvent.notify_all();
+  bool allowed;
+  {
+    std::lock_guard<std::mutex> lk(breakerMutex);
+    allowed = breaker.Allow();
+  }
+  if (!allowed) {
+    // the device is failing: answer now instead of queueing behind it
+    RotatorResponse resp;
+    resp.success = false;
+    callback(resp);
+    return true;
   }
 
+  jobQueue.push(std::make_pair(
+    req, callback
+  ));
+
+  std::unique_lock<std::mutex> lk(jobEventMutex);
+  clock->Notify(jobEvent);
+
   return true;
 }
 
 void CamPTZ::Terminate()
 {
-  threadClosing = true;
-  std::unique_lock<std::mutex> lk(jobEventMutex);
-  // in rare case this could fail because of TSO?
-  // todo check this
-  jobEvent.notify_all();
+  {
+    std::unique_lock<std::mutex> lk(jobEventMutex);
+    threadClosing = true;
+    clock->Notify(jobEvent);
+  }
 
   worker.join();
+  if (keepAliveThread.joinable()) {
+    keepAliveThread.join();
+  }
+  if (trackerThread.joinable()) {
+    trackerThread.join();
+  }
+  if (watchdogThread.joinable()) {
+    watchdogThread.join();
+  }
+
+  if (velocityMode) {
+    std::lock_guard<std::mutex> lk(trackerMutex);
+    for (int axis = 0; axis < 2; axis++) {
+      const VelocityTracker::Stats &stats = velocityTrackers[axis].GetStats();
+      printf("CamPTZ: velocity %s: %llu speed changes, %llu absolute moves, %llu slews\n",
+             axis == 0 ? "azi" : "ele", (unsigned long long)stats.speedChanges,
+             (unsigned long long)stats.positions, (unsigned long long)stats.slews);
+    }
+  } else if (smartSink) {
+    std::lock_guard<std::mutex> lk(trackerMutex);
+    for (int axis = 0; axis < 2; axis++) {
+      const AxisTracker::Stats &stats = trackers[axis].GetStats();
+      printf("CamPTZ: smartSink %s: %llu sent, %llu suppressed, %llu replayed, %llu faults\n",
+             axis == 0 ? "azi" : "ele", (unsigned long long)stats.sent, (unsigned long long)stats.suppressed,
+             (unsigned long long)stats.replayed, (unsigned long long)stats.faults);
+    }
+  }
+  printf("CamPTZ: %llu requests expired in the queue\n", (unsigned long long)expiredRequests.load());
+  if (presets.Enabled()) {
+    const PresetBank::Stats &stats = presets.GetStats();
+    printf("CamPTZ: presets: %llu programmed, %llu recalls, %llu evictions, %.1f s of slewing saved\n",
+           (unsigned long long)stats.programmed, (unsigned long long)stats.recalls,
+           (unsigned long long)stats.evictions, stats.saved);
+  }
+  {
+    std::lock_guard<std::mutex> lk(breakerMutex);
+    const CircuitBreaker::Stats &stats = breaker.GetStats();
+    printf("CamPTZ: device link: %llu breaker trips, %llu requests failed fast, %llu probes, %llu watchdog trips\n",
+           (unsigned long long)stats.trips, (unsigned long long)stats.rejected, (unsigned long long)stats.probes,
+           (unsigned long long)watchdogTrips.load());
+  }
   threadExited = true;
 }
\ No newline at end of file
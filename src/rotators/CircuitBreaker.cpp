@@ -0,0 +1,80 @@
+#include "rotators/CircuitBreaker.hpp"
+#include <algorithm>
+
+const char *CircuitStateName(CircuitState state)
+{
+  switch (state) {
+  case CIRCUIT_CLOSED: return "CLOSED";
+  case CIRCUIT_OPEN: return "OPEN";
+  case CIRCUIT_HALF_OPEN: return "HALF_OPEN";
+  }
+  return "?";
+}
+
+CircuitBreaker::CircuitBreaker()
+{
+}
+
+CircuitBreaker::CircuitBreaker(Params params)
+  : params(params)
+{
+}
+
+void CircuitBreaker::open(double now, double duration)
+{
+  if (state == CIRCUIT_CLOSED) {
+    stats.trips++;
+  }
+  state = CIRCUIT_OPEN;
+  openFor = duration;
+  retryAt = now + duration;
+}
+
+bool CircuitBreaker::Allow()
+{
+  if (state == CIRCUIT_CLOSED) {
+    return true;
+  }
+  stats.rejected++;
+  return false;
+}
+
+bool CircuitBreaker::ProbeDue(double now)
+{
+  if (state != CIRCUIT_OPEN || now < retryAt) {
+    return false;
+  }
+  state = CIRCUIT_HALF_OPEN;
+  stats.probes++;
+  return true;
+}
+
+void CircuitBreaker::OnSuccess()
+{
+  state = CIRCUIT_CLOSED;
+  failures = 0;
+  openFor = 0;
+}
+
+void CircuitBreaker::OnFailure(double now)
+{
+  switch (state) {
+  case CIRCUIT_CLOSED:
+    if (++failures >= params.failureThreshold) {
+      open(now, params.openTime);
+    }
+    break;
+  case CIRCUIT_HALF_OPEN:
+    open(now, (std::min)(openFor * 2, params.maxOpenTime));
+    break;
+  case CIRCUIT_OPEN:
+    break;
+  }
+}
+
+void CircuitBreaker::Trip(double now)
+{
+  if (state == CIRCUIT_CLOSED) {
+    open(now, params.openTime);
+  }
+}
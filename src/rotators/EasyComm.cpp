@@ -0,0 +1,102 @@
+#include "rotators/EasyComm.hpp"
+#include <cctype>
+#include <sstream>
+
+EasyComm::EasyComm()
+  : StreamSource("EasyComm", "\r\n")
+{
+}
+
+void EasyComm::Initialize(Transport transport, std::string tcpHost, int tcpPort, std::string ptyLink)
+{
+  SetTransport(transport, tcpHost, tcpPort, ptyLink);
+}
+
+std::string EasyComm::processLine(ClientSession &session, const std::string &line)
+{
+  std::istringstream tokens(line);
+  std::string token;
+
+  std::optional<double> aziTarget, eleTarget;
+  std::optional<PositionQuery::Position> pos;
+  std::string reply;
+  int moveDirection = 0;
+  bool stop = false;
+
+  while (tokens >> token) {
+    for (auto &c : token) {
+      c = (char)std::toupper((unsigned char)c);
+    }
+
+    char buf[64];
+    if (token == "AZ" || token == "EL") {
+      // query; one device query serves the whole line
+      if (!pos.has_value()) {
+        pos = positionQuery.Query();
+      }
+      if (!pos->valid) {
+        // EasyComm has no error reply: nothing rather than a made-up 0/0
+        continue;
+      }
+      if (token == "AZ") {
+        snprintf(buf, sizeof(buf), "AZ%.1f", pos->azi);
+      } else {
+        snprintf(buf, sizeof(buf), "EL%.1f", pos->ele);
+      }
+      reply += reply.empty() ? buf : std::string(" ") + buf;
+    } else if (token.compare(0, 2, "AZ") == 0 || token.compare(0, 2, "EL") == 0) {
+      try {
+        double value = std::stod(token.substr(2));
+        if (token[0] == 'A') {
+          aziTarget = value;
+        } else {
+          eleTarget = value;
+        }
+      } catch (const std::exception &) {
+        fprintf(stderr, "EasyComm Thread: bad value in '%s'\n", token.c_str());
+      }
+    } else if (token == "SA" || token == "SE") {
+      stop = true;
+    } else if (token == "ML") {
+      moveDirection |= MOVE_CCW;
+    } else if (token == "MR") {
+      moveDirection |= MOVE_CW;
+    } else if (token == "MU") {
+      moveDirection |= MOVE_UP;
+    } else if (token == "MD") {
+      moveDirection |= MOVE_DOWN;
+    } else if (token == "VE") {
+      reply += reply.empty() ? "VERotator-Bridge" : " VERotator-Bridge";
+    }
+    // other EasyComm II tokens (radio frequency, mode, ...) are ignored
+  }
+
+  if (stop) {
+    RotatorRequest req;
+    req.cmd = ROTATOR_STOP;
+    submit(req);
+  }
+
+  if ((aziTarget.has_value() || eleTarget.has_value() || moveDirection != 0)
+      && arbiter.AcquireMove(session.clientId, session.clientPriority)) {
+    RotatorRequest req;
+    if (aziTarget.has_value()) {
+      req.cmd = CHANGE_AZI;
+      req.payload.ChangeAzi.aziRequested = *aziTarget;
+      submit(req);
+    }
+    if (eleTarget.has_value()) {
+      req.cmd = CHANGE_ELE;
+      req.payload.ChangeEle.eleRequested = *eleTarget;
+      submit(req);
+    }
+    if (moveDirection != 0) {
+      req.cmd = ROTATOR_MOVE;
+      req.payload.Move.direction = moveDirection;
+      req.payload.Move.speed = 50;
+      submit(req);
+    }
+  }
+
+  return reply.empty() ? reply : reply + "\n";
+}
@@ -0,0 +1,202 @@
+#include "rotators/FanOut.hpp"
+#include <cmath>
+
+void FanOut::Initialize(AggregatePolicy policy, int quorum, PositionSource positionSource, size_t primaryIdx)
+{
+  this->policy = policy;
+  this->quorum = quorum;
+  this->positionSource = positionSource;
+  this->primaryIdx = primaryIdx;
+}
+
+void FanOut::AddMember(std::unique_ptr<RotatorController> member)
+{
+  members.push_back(std::move(member));
+}
+
+void FanOut::Start()
+{
+  for (auto &member : members) {
+    member->Start();
+  }
+  printf("FanOut Initialized with %zu members.\n", members.size());
+}
+
+void FanOut::Terminate()
+{
+  for (auto &member : members) {
+    member->Terminate();
+  }
+}
+
+void FanOut::SetTraceRecorder(TraceRecorder *trace)
+{
+  for (auto &member : members) {
+    member->SetTraceRecorder(trace);
+  }
+}
+
+void FanOut::SetClock(Clock *clock)
+{
+  this->clock = clock;
+  for (auto &member : members) {
+    member->SetClock(clock);
+  }
+}
+
+void FanOut::SetRealTime(const RealTimeParams &params)
+{
+  for (auto &member : members) {
+    member->SetRealTime(params);
+  }
+}
+
+bool FanOut::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  if (members.empty()) {
+    return false;
+  }
+
+  switch (req.cmd) {
+  case GET_AZI:
+  case GET_ELE:
+    if (positionSource == POSITION_FUSED) {
+      return queryFused(req, callback);
+    }
+    return members[(std::min)(primaryIdx, members.size() - 1)]->Request(req, callback);
+
+  default:
+    return dispatchAll(req, callback);
+  }
+}
+
+bool FanOut::dispatchAll(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  struct Aggregate {
+    std::mutex mutex;
+    int succeeded = 0;
+    int responded = 0;
+    int expected;
+    bool done = false;
+  };
+
+  int needed;
+  switch (policy) {
+  case AGGREGATE_FIRST:
+    needed = 1;
+    break;
+  case AGGREGATE_QUORUM:
+    needed = (std::min)(quorum, (int)members.size());
+    break;
+  default:
+    needed = (int)members.size();
+  }
+
+  auto agg = std::make_shared<Aggregate>();
+  agg->expected = (int)members.size();
+
+  auto onResponse = [agg, needed, callback](bool success) {
+    bool fire = false;
+    RotatorResponse resp;
+    {
+      std::lock_guard<std::mutex> lk(agg->mutex);
+      agg->responded++;
+      if (success) {
+        agg->succeeded++;
+      }
+
+      if (agg->done) {
+        return;
+      }
+      if (agg->succeeded >= needed) {
+        fire = true;
+        resp.success = true;
+      } else if (agg->expected - agg->responded + agg->succeeded < needed) {
+        // not reachable any more
+        fire = true;
+        resp.success = false;
+      }
+      agg->done = fire;
+    }
+
+    if (fire) {
+      callback(resp);
+    }
+  };
+
+  // refused members count as failed, so the callback always fires
+  std::lock_guard<std::mutex> lk(dispatchMutex);
+  for (size_t i = 0; i < members.size(); i++) {
+    bool ret = members[i]->Request(req, [onResponse](RotatorResponse resp) {
+      onResponse(resp.success);
+    });
+
+    if (!ret) {
+      fprintf(stderr, "FanOut: member %zu refused request\n", i);
+      onResponse(false);
+    }
+  }
+
+  return true;
+}
+
+bool FanOut::queryFused(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  struct Fused {
+    std::mutex mutex;
+    int responded = 0;
+    int succeeded = 0;
+    int expected;
+    // azimuth is averaged as a unit vector so 359 and 1 fuse to 0
+    double sumSin = 0, sumCos = 0, sum = 0;
+  };
+
+  auto fused = std::make_shared<Fused>();
+  fused->expected = (int)members.size();
+  RotatorCmd cmd = req.cmd;
+
+  auto onResponse = [fused, cmd, callback](std::optional<RotatorResponse> resp) {
+    RotatorResponse out;
+    {
+      std::lock_guard<std::mutex> lk(fused->mutex);
+      fused->responded++;
+      if (resp.has_value() && resp->success) {
+        fused->succeeded++;
+        if (cmd == GET_AZI) {
+          double rad = resp->payload.aziResp.azi * M_PI / 180;
+          fused->sumSin += std::sin(rad);
+          fused->sumCos += std::cos(rad);
+        } else {
+          fused->sum += resp->payload.eleResp.ele;
+        }
+      }
+
+      if (fused->responded < fused->expected) {
+        return;
+      }
+
+      out.success = fused->succeeded > 0;
+      if (cmd == GET_AZI) {
+        double azi = std::atan2(fused->sumSin, fused->sumCos) * 180 / M_PI;
+        out.payload.aziResp.azi = azi < 0 ? azi + 360 : azi;
+      } else {
+        out.payload.eleResp.ele = fused->succeeded > 0 ? fused->sum / fused->succeeded : 0;
+      }
+    }
+
+    callback(out);
+  };
+
+  std::lock_guard<std::mutex> lk(dispatchMutex);
+  for (auto &member : members) {
+    bool ret = member->Request(req, [onResponse](RotatorResponse resp) {
+      onResponse(resp);
+    });
+
+    if (!ret) {
+      onResponse({});
+    }
+  }
+
+  return true;
+}
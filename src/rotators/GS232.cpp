@@ -0,0 +1,126 @@
+#include "rotators/GS232.hpp"
+#include <cctype>
+#include <cmath>
+
+GS232::GS232()
+  : StreamSource("GS232", "\r\n")
+{
+}
+
+void GS232::Initialize(Transport transport, std::string tcpHost, int tcpPort, std::string ptyLink, bool gs232b)
+{
+  SetTransport(transport, tcpHost, tcpPort, ptyLink);
+  this->gs232b = gs232b;
+}
+
+void GS232::move(ClientSession &session, int direction)
+{
+  if (!arbiter.AcquireMove(session.clientId, session.clientPriority)) {
+    return;
+  }
+
+  RotatorRequest req;
+  req.cmd = ROTATOR_MOVE;
+  req.payload.Move.direction = direction;
+  req.payload.Move.speed = session.moveSpeed;
+  submit(req);
+}
+
+std::string GS232::processLine(ClientSession &session, const std::string &rawLine)
+{
+  std::string line;
+  for (char c : rawLine) {
+    if (!std::isspace((unsigned char)c) || !line.empty()) {
+      line += (char)std::toupper((unsigned char)c);
+    }
+  }
+  if (line.empty()) {
+    return "";
+  }
+
+  char buf[64];
+  if (line == "C2" || line == "C" || line == "B") {
+    PositionQuery::Position pos = positionQuery.Query();
+    if (!pos.valid) {
+      // the device did not answer; a made-up 0/0 would be tracked from
+      return "?>\r";
+    }
+    int azi = (int)std::lround(pos.azi) % 360;
+    int ele = (int)std::lround(pos.ele);
+
+    if (line == "C2") {
+      if (gs232b) {
+        snprintf(buf, sizeof(buf), "AZ=%03d  EL=%03d\r", azi, ele);
+      } else {
+        snprintf(buf, sizeof(buf), "+0%03d+0%03d\r", azi, ele);
+      }
+    } else if (line == "C") {
+      snprintf(buf, sizeof(buf), gs232b ? "AZ=%03d\r" : "+0%03d\r", azi);
+    } else {
+      snprintf(buf, sizeof(buf), gs232b ? "EL=%03d\r" : "+0%03d\r", ele);
+    }
+    return buf;
+  }
+
+  switch (line[0]) {
+  case 'W':
+  case 'M': {
+    // Waaa eee / Maaa
+    double azi, ele;
+    int n = sscanf(line.c_str() + 1, "%lf %lf", &azi, &ele);
+    if (n < 1 || (line[0] == 'W' && n < 2)) {
+      break;
+    }
+    if (!arbiter.AcquireMove(session.clientId, session.clientPriority)) {
+      return "";
+    }
+
+    RotatorRequest req;
+    req.cmd = CHANGE_AZI;
+    req.payload.ChangeAzi.aziRequested = azi;
+    submit(req);
+    if (line[0] == 'W') {
+      req.cmd = CHANGE_ELE;
+      req.payload.ChangeEle.eleRequested = ele;
+      submit(req);
+    }
+    return "";
+  }
+
+  case 'S':
+  case 'A':
+  case 'E': {
+    // the sinks only know a full stop, so per-axis stops stop both
+    RotatorRequest req;
+    req.cmd = ROTATOR_STOP;
+    submit(req);
+    return "";
+  }
+
+  case 'R':
+    move(session, MOVE_CW);
+    return "";
+  case 'L':
+    move(session, MOVE_CCW);
+    return "";
+  case 'U':
+    move(session, MOVE_UP);
+    return "";
+  case 'D':
+    move(session, MOVE_DOWN);
+    return "";
+
+  case 'X':
+    if (line.size() == 2 && line[1] >= '1' && line[1] <= '4') {
+      session.moveSpeed = (line[1] - '0') * 25;
+      return "";
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  fprintf(stderr, "GS232 Thread: unknown command '%s'\n", line.c_str());
+  return "?>\r";
+}
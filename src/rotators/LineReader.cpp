@@ -0,0 +1,44 @@
+#include "rotators/LineReader.hpp"
+#include <cstdio>
+
+LineReader::LineReader(std::string terminators, size_t maxLine)
+  : terminators(terminators), maxLine(maxLine)
+{
+}
+
+void LineReader::Append(const char *data, size_t len)
+{
+  buffer.append(data, len);
+
+  if (buffer.size() > maxLine && buffer.find_first_of(terminators) == std::string::npos) {
+    fprintf(stderr, "LineReader: line longer than %zu bytes dropped\n", maxLine);
+    buffer.clear();
+  }
+}
+
+bool LineReader::Next(std::string &line)
+{
+  while (true) {
+    size_t end = buffer.find_first_of(terminators);
+    if (end == std::string::npos) {
+      return false;
+    }
+
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    if (!line.empty()) {
+      return true;
+    }
+  }
+}
+
+bool LineReader::TakePartial(std::string &line)
+{
+  if (buffer.empty()) {
+    return false;
+  }
+
+  line.swap(buffer);
+  buffer.clear();
+  return true;
+}
@@ -0,0 +1,97 @@
+#include "rotators/MoveArbiter.hpp"
+#include <sstream>
+
+void MoveArbiter::Initialize(Policy policy, int holdOff, int ownerIdle, std::map<std::string, int> priorities)
+{
+  this->policy = policy;
+  this->holdOff = holdOff;
+  this->ownerIdle = ownerIdle;
+  this->priorities = priorities;
+}
+
+bool MoveArbiter::ParsePolicy(std::string name, Policy &policy)
+{
+  if (name == "none") {
+    policy = ARBITRATION_NONE;
+  } else if (name == "owner") {
+    policy = ARBITRATION_OWNER;
+  } else if (name == "priority") {
+    policy = ARBITRATION_PRIORITY;
+  } else if (name == "lww") {
+    policy = ARBITRATION_LWW;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::map<std::string, int> MoveArbiter::ParsePriorities(std::string spec)
+{
+  std::map<std::string, int> result;
+  std::istringstream entries(spec);
+  std::string entry;
+  while (std::getline(entries, entry, ',')) {
+    auto colon = entry.rfind(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    result[entry.substr(0, colon)] = std::stoi(entry.substr(colon + 1));
+  }
+  return result;
+}
+
+int MoveArbiter::PriorityOf(std::string clientAddr) const
+{
+  auto it = priorities.find(clientAddr);
+  return it == priorities.end() ? 0 : it->second;
+}
+
+bool MoveArbiter::idleFor(Clock::TimePoint now, int period) const
+{
+  return now - holderLastMove >= std::chrono::milliseconds(period);
+}
+
+bool MoveArbiter::AcquireMove(uint64_t clientId, int priority)
+{
+  if (policy == ARBITRATION_NONE) {
+    return true;
+  }
+
+  auto now = clock->Now();
+  std::lock_guard<std::mutex> lk(stateMutex);
+
+  bool granted;
+  if (!held || holder == clientId) {
+    granted = true;
+  } else {
+    switch (policy) {
+    case ARBITRATION_OWNER:
+      granted = ownerIdle > 0 && idleFor(now, ownerIdle);
+      break;
+    case ARBITRATION_PRIORITY:
+      granted = priority > holderPriority || idleFor(now, holdOff);
+      break;
+    case ARBITRATION_LWW:
+      granted = idleFor(now, holdOff);
+      break;
+    default:
+      granted = true;
+    }
+  }
+
+  if (granted) {
+    held = true;
+    holder = clientId;
+    holderPriority = priority;
+    holderLastMove = now;
+  }
+  return granted;
+}
+
+void MoveArbiter::Release(uint64_t clientId)
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  if (held && holder == clientId) {
+    held = false;
+  }
+}
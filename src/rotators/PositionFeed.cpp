@@ -0,0 +1,121 @@
+#include "rotators/PositionFeed.hpp"
+#include <cmath>
+
+static double aziDistance(double a, double b)
+{
+  double d = std::fmod(std::abs(a - b), 360.0);
+  return d > 180 ? 360 - d : d;
+}
+
+PositionFeed::~PositionFeed()
+{
+  Stop();
+}
+
+void PositionFeed::Initialize(PositionQuery *query, Clock *clock)
+{
+  this->query = query;
+  this->clock = clock;
+  epoch = clock->Now();
+  closing = false;
+}
+
+Clock::TimePoint PositionFeed::nextDue(Clock::TimePoint now, std::chrono::milliseconds interval) const
+{
+  auto periods = (now - epoch) / interval + 1;
+  return epoch + periods * interval;
+}
+
+void PositionFeed::Subscribe(uint64_t clientId, int interval, double threshold, Push push)
+{
+  {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    if (closing) {
+      return;
+    }
+
+    Subscriber sub;
+    sub.interval = std::chrono::milliseconds((std::max)(interval, minInterval));
+    sub.threshold = threshold;
+    sub.push = push;
+    // the first update goes out right away
+    sub.due = clock->Now();
+    subscribers[clientId] = sub;
+    changed = true;
+
+    if (!sampler.joinable()) {
+      sampler = std::thread(&PositionFeed::samplerMain, this);
+    }
+  }
+  clock->Notify(stateEvent);
+}
+
+void PositionFeed::Unsubscribe(uint64_t clientId)
+{
+  // pushes run under stateMutex
+  std::lock_guard<std::mutex> lk(stateMutex);
+  subscribers.erase(clientId);
+}
+
+void PositionFeed::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    closing = true;
+    subscribers.clear();
+  }
+  clock->Notify(stateEvent);
+  if (sampler.joinable()) {
+    sampler.join();
+  }
+}
+
+void PositionFeed::samplerMain()
+{
+  std::unique_lock<std::mutex> lk(stateMutex);
+  while (!closing) {
+    if (subscribers.empty()) {
+      clock->Wait(lk, stateEvent, [this] { return closing || !subscribers.empty(); });
+      continue;
+    }
+
+    Clock::TimePoint due = Clock::TimePoint::max();
+    for (const auto &entry : subscribers) {
+      due = (std::min)(due, entry.second.due);
+    }
+    // a new subscription may be due earlier
+    changed = false;
+    if (clock->WaitUntil(lk, stateEvent, due, [this] { return closing || changed; })) {
+      continue;
+    }
+
+    lk.unlock();
+    PositionQuery::Position pos = query->Query();
+    samples++;
+    lk.lock();
+
+    auto now = clock->Now();
+    for (auto &entry : subscribers) {
+      Subscriber &sub = entry.second;
+      if (sub.due > now) {
+        continue;
+      }
+      sub.due = nextDue(now, sub.interval);
+
+      if (!pos.valid) {
+        // nothing to push; clients that care poll and see the error
+        continue;
+      }
+      if (sub.threshold > 0 && sub.pushed
+          && aziDistance(pos.azi, sub.lastAzi) <= sub.threshold
+          && std::abs(pos.ele - sub.lastEle) <= sub.threshold) {
+        continue;
+      }
+      sub.push(pos);
+      sub.pushed = true;
+      sub.lastAzi = pos.azi;
+      sub.lastEle = pos.ele;
+      pushes++;
+    }
+  }
+}
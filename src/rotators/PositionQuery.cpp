@@ -0,0 +1,165 @@
+#include "rotators/PositionQuery.hpp"
+
+void PositionQuery::Initialize(RotatorRequestHandler requestHandler, int shareWindow, int requestTimeout)
+{
+  this->requestHandler = requestHandler;
+  this->shareWindow = shareWindow;
+  this->requestTimeout = requestTimeout;
+}
+
+bool PositionQuery::startQuery()
+{
+  if (inFlight && clock->Now() - inFlightSince < std::chrono::milliseconds(requestTimeout)) {
+    return false;
+  }
+  // none, or one the device never answered
+  inFlight = true;
+  inFlightSince = clock->Now();
+  queryId++;
+  return true;
+}
+
+void PositionQuery::finish(uint64_t id, const Position &pos)
+{
+  std::vector<std::function<void(const Position &pos)>> done;
+  {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    if (id != queryId) {
+      // given up on and superseded; the newer query answers its callers
+      return;
+    }
+    last = pos;
+    inFlight = false;
+    generation++;
+    done.swap(waiters);
+  }
+  clock->Notify(stateEvent);
+
+  for (auto &waiter : done) {
+    waiter(pos);
+  }
+}
+
+PositionQuery::Position PositionQuery::Query()
+{
+  uint64_t id;
+  {
+    std::unique_lock<std::mutex> lk(stateMutex);
+
+    if (last.valid && shareWindow > 0
+        && clock->Now() - last.sampledAt < std::chrono::milliseconds(shareWindow)) {
+      sharedQueries++;
+      return last;
+    }
+
+    if (!startQuery()) {
+      // join the query in flight
+      uint64_t joined = generation;
+      sharedQueries++;
+      bool answered = clock->WaitFor(lk, stateEvent, std::chrono::milliseconds(requestTimeout), [&] {
+        return generation != joined;
+      });
+      if (!answered) {
+        // last is whatever came before the query we joined, however old
+        return Position();
+      }
+      return last;
+    }
+    id = queryId;
+  }
+
+  deviceQueries++;
+  ResponseLatch latch(2, clock, requestTimeout);
+  {
+    RotatorRequest req;
+    req.cmd = GET_AZI;
+    latch.Submit(requestHandler, req, 0);
+  }
+  {
+    RotatorRequest req;
+    req.cmd = GET_ELE;
+    latch.Submit(requestHandler, req, 1);
+  }
+
+  if (!latch.Wait()) {
+    fprintf(stderr, "PositionQuery: position query timed out.\n");
+  }
+
+  auto respAzi = latch.Get(0);
+  auto respEle = latch.Get(1);
+
+  Position pos;
+  pos.valid = respAzi.has_value() && respAzi->success && respEle.has_value() && respEle->success;
+  pos.azi = respAzi.has_value() ? respAzi->payload.aziResp.azi : 0;
+  pos.ele = respEle.has_value() ? respEle->payload.eleResp.ele : 0;
+  pos.sampledAt = clock->Now();
+
+  finish(id, pos);
+  return pos;
+}
+
+void PositionQuery::QueryAsync(std::function<void(const Position &pos)> done)
+{
+  uint64_t id;
+  {
+    std::unique_lock<std::mutex> lk(stateMutex);
+
+    if (last.valid && shareWindow > 0
+        && clock->Now() - last.sampledAt < std::chrono::milliseconds(shareWindow)) {
+      sharedQueries++;
+      Position pos = last;
+      lk.unlock();
+      done(pos);
+      return;
+    }
+
+    waiters.push_back(done);
+    if (!startQuery()) {
+      sharedQueries++;
+      return;
+    }
+    id = queryId;
+  }
+
+  deviceQueries++;
+  // the two axes answer on the sink's thread, in either order
+  struct Answer {
+    std::mutex mutex;
+    int remaining = 2;
+    Position pos;
+    bool aziValid = false, eleValid = false;
+  };
+  auto answer = std::make_shared<Answer>();
+  Clock *clock = this->clock;
+  auto callback = [this, answer, clock, id](int axis, RotatorResponse resp) {
+    Position pos;
+    {
+      std::lock_guard<std::mutex> lk(answer->mutex);
+      if (axis == 0) {
+        answer->aziValid = resp.success;
+        answer->pos.azi = resp.success ? resp.payload.aziResp.azi : 0;
+      } else {
+        answer->eleValid = resp.success;
+        answer->pos.ele = resp.success ? resp.payload.eleResp.ele : 0;
+      }
+      if (--answer->remaining > 0) {
+        return;
+      }
+      pos = answer->pos;
+      pos.valid = answer->aziValid && answer->eleValid;
+    }
+    pos.sampledAt = clock->Now();
+    finish(id, pos);
+  };
+
+  for (int axis = 0; axis < 2; axis++) {
+    RotatorRequest req;
+    req.cmd = axis == 0 ? GET_AZI : GET_ELE;
+    req.deadline = clock->Now() + std::chrono::milliseconds(requestTimeout);
+    if (!requestHandler(req, [callback, axis](RotatorResponse resp) { callback(axis, resp); })) {
+      RotatorResponse resp;
+      resp.success = false;
+      callback(axis, resp);
+    }
+  }
+}
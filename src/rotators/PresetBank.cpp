@@ -0,0 +1,152 @@
+#include "rotators/PresetBank.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+// below half a Pelco-D position unit: no remainder after a recall
+static const double samePosition = 0.005;
+
+PresetBank::PresetBank()
+{
+}
+
+PresetBank::PresetBank(Params params)
+  : params(params), entries((std::max)(0, params.slots))
+{
+}
+
+bool PresetBank::near(const Position &a, const Position &b, double within) const
+{
+  return std::abs(a.pan - b.pan) <= within && std::abs(a.tilt - b.tilt) <= within;
+}
+
+int PresetBank::Add(double now, Position position, bool pinned)
+{
+  int victim = -1;
+  for (int i = 0; i < (int)entries.size(); i++) {
+    Entry &entry = entries[i];
+    if (entry.used && near(entry.position, position, params.tolerance)) {
+      entry.lastUse = now;
+      entry.pinned |= pinned;
+      return i;
+    }
+    // a free slot, or else the least recently used hinted position
+    if (!entry.used) {
+      if (victim < 0 || entries[victim].used) {
+        victim = i;
+      }
+    } else if (!entry.pinned && (victim < 0 || (entries[victim].used && entry.lastUse < entries[victim].lastUse))) {
+      victim = i;
+    }
+  }
+  if (victim < 0) {
+    return -1;
+  }
+
+  if (entries[victim].used) {
+    stats.evictions++;
+  }
+  Entry &entry = entries[victim];
+  entry = Entry();
+  entry.used = true;
+  entry.position = position;
+  entry.pinned = pinned;
+  entry.lastUse = now;
+  entry.order = added++;
+  return victim;
+}
+
+void PresetBank::Remove(int index)
+{
+  entries[index] = Entry();
+}
+
+int PresetBank::NextUnprogrammed() const
+{
+  int next = -1;
+  for (int i = 0; i < (int)entries.size(); i++) {
+    const Entry &entry = entries[i];
+    if (!entry.used || entry.programmed) {
+      continue;
+    }
+    if (next < 0 || (entry.pinned && !entries[next].pinned) ||
+        (entry.pinned == entries[next].pinned && entry.order < entries[next].order)) {
+      next = i;
+    }
+  }
+  return next;
+}
+
+int PresetBank::FindUnprogrammed(Position head) const
+{
+  for (int i = 0; i < (int)entries.size(); i++) {
+    if (entries[i].used && !entries[i].programmed && near(entries[i].position, head, params.tolerance)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void PresetBank::Programmed(int index, Position position)
+{
+  entries[index].programmed = true;
+  entries[index].position = position;
+  stats.programmed++;
+}
+
+double PresetBank::MoveTime(Position from, Position to) const
+{
+  return params.restartDelay + (std::max)(std::abs(to.pan - from.pan) / params.panSpeed,
+                                          std::abs(to.tilt - from.tilt) / params.tiltSpeed);
+}
+
+double PresetBank::RecallTime(int index, Position from, Position to) const
+{
+  const Position &preset = entries[index].position;
+  double t = params.restartDelay + (std::max)(std::abs(preset.pan - from.pan), std::abs(preset.tilt - from.tilt)) /
+                                     params.presetSpeed;
+  if (!near(preset, to, samePosition)) {
+    t += MoveTime(preset, to);
+  }
+  return t;
+}
+
+int PresetBank::Recall(double now, Position from, Position to)
+{
+  double direct = MoveTime(from, to);
+  int best = -1;
+  double bestTime = direct - params.minSaving;
+  for (int i = 0; i < (int)entries.size(); i++) {
+    const Entry &entry = entries[i];
+    if (!entry.used || !entry.programmed || !near(entry.position, to, params.tolerance)) {
+      continue;
+    }
+    double t = RecallTime(i, from, to);
+    if (t <= bestTime) {
+      best = i;
+      bestTime = t;
+    }
+  }
+  if (best >= 0) {
+    entries[best].lastUse = now;
+    stats.recalls++;
+    stats.saved += direct - bestTime;
+  }
+  return best;
+}
+
+std::vector<std::pair<double, double>> PresetBank::ParsePositions(std::string spec)
+{
+  std::vector<std::pair<double, double>> result;
+  std::istringstream entries(spec);
+  std::string entry;
+  while (std::getline(entries, entry, ',')) {
+    auto colon = entry.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    result.emplace_back(strtod(entry.substr(0, colon).c_str(), nullptr), strtod(entry.substr(colon + 1).c_str(), nullptr));
+  }
+  return result;
+}
@@ -0,0 +1,434 @@
+#include "rotators/RotctldSink.hpp"
+#include "rotators/LineReader.hpp"
+#include <cmath>
+#include <cstring>
+
+void RotctldSink::Initialize(std::string host, int port, int suppressWindow)
+{
+  this->host = host;
+  this->port = port;
+  this->suppressWindow = suppressWindow;
+}
+
+void RotctldSink::SetSubscription(int interval)
+{
+  this->subscribeInterval = interval;
+}
+
+void RotctldSink::SetIoTimeout(int timeout)
+{
+  this->ioTimeout = timeout;
+}
+
+void RotctldSink::answer(std::vector<threadJob> &jobs, bool success, double azi, double ele)
+{
+  for (auto &job : jobs) {
+    RotatorResponse resp;
+    resp.success = success;
+    if (job.first.cmd == GET_AZI) {
+      resp.payload.aziResp.azi = azi;
+    } else if (job.first.cmd == GET_ELE) {
+      resp.payload.eleResp.ele = ele;
+    }
+    job.second(resp);
+  }
+}
+
+bool RotctldSink::connStart()
+{
+  conn = std::make_unique<TcpTransport>(host, port);
+  conn->SetIoTimeout(ioTimeout);
+  if (!conn->Open()) {
+    fprintf(stderr, "RotctldSink Thread: Error connecting to %s\n", conn->Describe().c_str());
+    return false;
+  }
+
+  // learn the current position, so a lone CHANGE_AZI / CHANGE_ELE can be
+  // completed into a `P` before any target is known
+  const char query[] = "p\n";
+  if (conn->Send(query, strlen(query)) == -1) {
+    conn->Close();
+    return false;
+  }
+
+  LineReader lines("\n");
+  std::vector<double> values;
+  std::string line;
+  char buf[256];
+  // the whole reply within ioTimeout; a trickle does not extend it
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ioTimeout);
+  while (values.size() < 2) {
+    int ret = conn->RecvSomeUntil(buf, sizeof(buf), deadline);
+    if (ret <= 0) {
+      fprintf(stderr, "RotctldSink Thread: No position from %s within %d ms\n", conn->Describe().c_str(), ioTimeout);
+      conn->Close();
+      return false;
+    }
+    lines.Append(buf, ret);
+    while (values.size() < 2 && lines.Next(line)) {
+      if (line.rfind("RPRT", 0) == 0) {
+        break;
+      }
+      values.push_back(atof(line.c_str()));
+    }
+    if (line.rfind("RPRT", 0) == 0) {
+      fprintf(stderr, "RotctldSink Thread: Initial position query failed: %s\n", line.c_str());
+      break;
+    }
+  }
+
+  if (values.size() == 2 && !targetKnown) {
+    targetKnown = true;
+    targetAzi = values[0];
+    targetEle = values[1];
+  }
+
+  printf("RotctldSink Thread: Connected to %s.\n", conn->Describe().c_str());
+  sentValid = false;
+  {
+    std::lock_guard<std::mutex> lk(pendingMutex);
+    pushing = false;
+    pushedValid = false;
+  }
+  connected = true;
+  reader = std::thread(RotctldSink::readerMain, this);
+
+  if (subscribeInterval > 0) {
+    // answered by the reader; polls go out as usual until it says yes
+    char line[32];
+    snprintf(line, sizeof(line), "\\subscribe %d\n", subscribeInterval);
+    {
+      std::lock_guard<std::mutex> lk(pendingMutex);
+      pending.push_back(PendingReply{false, {}, true});
+    }
+    if (conn->Send(line, strlen(line)) == -1) {
+      connected = false;
+      conn->Shutdown();
+    }
+  }
+  return true;
+}
+
+void RotctldSink::connTerminate()
+{
+  if (conn) {
+    conn->Shutdown();
+  }
+  if (reader.joinable()) {
+    reader.join();
+  }
+  if (conn) {
+    conn->Close();
+    conn.reset();
+  }
+  connected = false;
+}
+
+void RotctldSink::failPending()
+{
+  std::deque<PendingReply> failed;
+  {
+    std::lock_guard<std::mutex> lk(pendingMutex);
+    failed.swap(pending);
+  }
+  for (auto &reply : failed) {
+    answer(reply.jobs, false);
+  }
+}
+
+void RotctldSink::readerMain(RotctldSink *self)
+{
+  LineReader lines("\n");
+  std::string line;
+  char buf[1024];
+  bool haveAzi = false;
+  double azi = 0;
+
+  while (true) {
+    int ret = self->conn->RecvSome(buf, sizeof(buf));
+    if (ret <= 0) {
+      break;
+    }
+    lines.Append(buf, ret);
+
+    while (lines.Next(line)) {
+      std::vector<threadJob> jobs;
+      bool success = false;
+      double ele = 0;
+      {
+        std::lock_guard<std::mutex> lk(self->pendingMutex);
+        double pushedAzi, pushedEle;
+        if (sscanf(line.c_str(), "POS %lf %lf", &pushedAzi, &pushedEle) == 2) {
+          // not a reply: comes whenever the daemon samples
+          self->pushedValid = true;
+          self->pushedAzi = pushedAzi;
+          self->pushedEle = pushedEle;
+          self->pushedAt = self->clock->Now();
+          continue;
+        }
+        if (self->pending.empty()) {
+          fprintf(stderr, "RotctldSink Thread: Unexpected reply '%s'\n", line.c_str());
+          continue;
+        }
+
+        PendingReply &front = self->pending.front();
+        bool isReport = line.rfind("RPRT", 0) == 0;
+        if (front.subscribe) {
+          int code = -1;
+          self->pushing = isReport && sscanf(line.c_str(), "RPRT %d", &code) == 1 && code == 0;
+          printf("RotctldSink Thread: %s\n", self->pushing
+                 ? "Position pushed by the daemon" : "Daemon does not push positions, polling");
+          self->pending.pop_front();
+          continue;
+        } else if (front.position && !isReport) {
+          if (!haveAzi) {
+            azi = atof(line.c_str());
+            haveAzi = true;
+            continue;
+          }
+          ele = atof(line.c_str());
+          success = true;
+        } else {
+          int code = -1;
+          success = isReport && sscanf(line.c_str(), "RPRT %d", &code) == 1 && code == 0 && !front.position;
+        }
+
+        haveAzi = false;
+        jobs.swap(front.jobs);
+        self->pending.pop_front();
+      }
+      answer(jobs, success, azi, ele);
+    }
+  }
+
+  self->connected = false;
+  if (!self->threadClosing) {
+    fprintf(stderr, "RotctldSink Thread: Connection lost\n");
+  }
+  self->failPending();
+}
+
+void RotctldSink::flushMove(std::string &out, std::vector<threadJob> &moveJobs)
+{
+  if (moveJobs.empty()) {
+    return;
+  }
+
+  auto now = clock->Now();
+  bool sameTarget = sentValid
+    && std::abs(targetAzi - sentAzi) < 0.005 && std::abs(targetEle - sentEle) < 0.005;
+  if (sameTarget && now - sentAt < std::chrono::milliseconds(suppressWindow)) {
+    movesSuppressed += moveJobs.size();
+    answer(moveJobs, true);
+    moveJobs.clear();
+    return;
+  }
+
+  char line[64];
+  snprintf(line, sizeof(line), "P %.2f %.2f\n", targetAzi, targetEle);
+  out += line;
+  {
+    std::lock_guard<std::mutex> lk(pendingMutex);
+    pending.push_back(PendingReply{false, std::move(moveJobs)});
+  }
+  moveJobs.clear();
+
+  sentValid = true;
+  sentAzi = targetAzi;
+  sentEle = targetEle;
+  sentAt = now;
+  movesSent++;
+}
+
+void RotctldSink::queuePosition(std::string &out, threadJob job)
+{
+  std::unique_lock<std::mutex> lk(pendingMutex);
+  // a push goes stale once a few are missed (e.g. the daemon's device
+  // queries fail); a `p` then reports the error
+  if (pushing && pushedValid
+      && clock->Now() - pushedAt < std::chrono::milliseconds(3 * subscribeInterval)) {
+    double azi = pushedAzi, ele = pushedEle;
+    lk.unlock();
+    std::vector<threadJob> jobs{job};
+    answer(jobs, true, azi, ele);
+    queriesPushed++;
+    return;
+  }
+
+  for (auto it = pending.rbegin(); it != pending.rend(); it++) {
+    if (it->position) {
+      it->jobs.push_back(job);
+      queriesJoined++;
+      return;
+    }
+  }
+
+  out += "p\n";
+  pending.push_back(PendingReply{true, {job}});
+  queriesSent++;
+}
+
+void RotctldSink::threadMain(RotctldSink *self)
+{
+  while (!self->threadClosing) {
+    {
+      std::unique_lock<std::mutex> lk(self->jobEventMutex);
+      self->clock->Wait(lk, self->jobEvent, [self]
+                          { return (self->jobQueue.size() > 0) || (self->threadClosing); });
+    }
+    if (self->threadClosing) {
+      break;
+    }
+
+    if (!self->connected) {
+      self->connTerminate();
+      auto now = self->clock->Now();
+      if (now - self->lastConnectAttempt >= std::chrono::milliseconds(self->reconnectInterval)) {
+        self->lastConnectAttempt = now;
+        self->connStart();
+      }
+
+      if (!self->connected) {
+        // fail fast instead of queueing behind a dead link
+        while (auto job = self->jobQueue.pop()) {
+          RotatorResponse resp;
+          resp.success = false;
+          job->second(resp);
+        }
+        continue;
+      }
+    }
+
+    // take everything queued as one batch
+    std::string out;
+    std::vector<threadJob> moveJobs;
+    auto now = self->clock->Now();
+    while (auto job = self->jobQueue.pop()) {
+      const char *line = nullptr;
+      char moveLine[32];
+
+      if (job->first.Droppable() && job->first.Expired(now)) {
+        // its caller gave up while it was queued
+        self->expiredRequests++;
+        RotatorResponse resp;
+        resp.success = false;
+        job->second(resp);
+        continue;
+      }
+
+      switch (job->first.cmd) {
+      case CHANGE_AZI:
+        self->targetAzi = job->first.payload.ChangeAzi.aziRequested;
+        moveJobs.push_back(*job);
+        break;
+
+      case CHANGE_ELE:
+        self->targetEle = job->first.payload.ChangeEle.eleRequested;
+        moveJobs.push_back(*job);
+        break;
+
+      case GET_AZI:
+      case GET_ELE:
+        self->queuePosition(out, *job);
+        break;
+
+      case ROTATOR_STOP:
+        line = "S\n";
+        break;
+
+      case ROTATOR_PARK:
+        line = "K\n";
+        break;
+
+      case ROTATOR_RESET:
+        line = "R 1\n";  // ROT_RESET_ALL
+        break;
+
+      case ROTATOR_PRESET_HINT: {
+        // no presets behind rotctld
+        RotatorResponse resp;
+        resp.success = true;
+        job->second(resp);
+        break;
+      }
+
+      case ROTATOR_MOVE:
+        // direction bits and speed range are hamlib's
+        snprintf(moveLine, sizeof(moveLine), "M %d %d\n",
+                 job->first.payload.Move.direction, job->first.payload.Move.speed);
+        line = moveLine;
+        break;
+
+      default: {
+        fprintf(stderr, "RotctldSink Thread: Command %d not supported by rotctld\n", job->first.cmd);
+        RotatorResponse resp;
+        resp.success = false;
+        job->second(resp);
+        break;
+      }
+      }
+
+      if (line != nullptr) {
+        // keep the order against position changes queued before it
+        self->flushMove(out, moveJobs);
+        self->sentValid = false;
+        out += line;
+        std::lock_guard<std::mutex> lk(self->pendingMutex);
+        self->pending.push_back(PendingReply{false, {*job}});
+      }
+    }
+    self->flushMove(out, moveJobs);
+
+    if (!out.empty() && self->conn->Send(out.data(), out.size()) == -1) {
+      fprintf(stderr, "RotctldSink Thread: Send error\n");
+      // the reader wakes up and fails what is pending
+      self->connected = false;
+      self->conn->Shutdown();
+    }
+  }
+
+  self->connTerminate();
+  self->failPending();
+  self->threadExited = true;
+}
+
+void RotctldSink::Start()
+{
+  threadClosing = false;
+  threadExited = false;
+  worker = std::thread(RotctldSink::threadMain, this);
+  printf("RotctldSink Initialized for %s:%d.\n", host.c_str(), port);
+}
+
+void RotctldSink::Terminate()
+{
+  {
+    std::unique_lock<std::mutex> lk(jobEventMutex);
+    threadClosing = true;
+    clock->Notify(jobEvent);
+  }
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+
+  printf("RotctldSink: %llu position changes sent, %llu suppressed; %llu position queries sent, %llu joined, "
+         "%llu answered from pushes; %llu expired in the queue\n",
+         (unsigned long long)movesSent.load(), (unsigned long long)movesSuppressed.load(),
+         (unsigned long long)queriesSent.load(), (unsigned long long)queriesJoined.load(),
+         (unsigned long long)queriesPushed.load(), (unsigned long long)expiredRequests.load());
+}
+
+bool RotctldSink::Request(RotatorRequest req, std::function<void(RotatorResponse)> callback)
+{
+  if (threadExited) {
+    fprintf(stderr, "Worker closed, unable to request\n");
+    return false;
+  }
+
+  jobQueue.push(std::make_pair(req, callback));
+
+  std::unique_lock<std::mutex> lk(jobEventMutex);
+  clock->Notify(jobEvent);
+  return true;
+}
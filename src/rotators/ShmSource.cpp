@@ -0,0 +1,166 @@
+#include "rotators/ShmSource.hpp"
+
+ShmSource::~ShmSource()
+{
+  Terminate();
+}
+
+void ShmSource::Initialize(std::string channelName, int sampleInterval, int pollInterval)
+{
+  this->channelName = channelName;
+  this->sampleInterval = sampleInterval;
+  this->pollInterval = pollInterval;
+}
+
+bool ShmSource::SetRequestHandler(RotatorRequestHandler callback)
+{
+  requestHandler = callback;
+  return true;
+}
+
+void ShmSource::SetClock(Clock *clock)
+{
+  this->clock = clock;
+  positionQuery.SetClock(clock);
+}
+
+void ShmSource::Start()
+{
+  channel = ShmChannel::Create(channelName);
+  if (channel == nullptr) {
+    fprintf(stderr, "ShmSource: %s unavailable, source disabled\n", channelName.c_str());
+    return;
+  }
+  positionQuery.Initialize(requestHandler, 0, requestTimeout);
+
+  closing = false;
+  commandThread = clock->Spawn([this]() { commandMain(); });
+  if (sampleInterval > 0) {
+    sampleThread = clock->Spawn([this]() { sampleMain(); });
+  }
+}
+
+void ShmSource::WaitForClose()
+{
+  std::unique_lock<std::mutex> lk(stateMutex);
+  clock->Wait(lk, stateEvent, [this] { return closing; });
+}
+
+void ShmSource::Terminate()
+{
+  {
+    std::lock_guard<std::mutex> lk(stateMutex);
+    closing = true;
+  }
+  clock->Notify(stateEvent);
+  if (commandThread.joinable()) {
+    commandThread.join();
+  }
+  if (sampleThread.joinable()) {
+    sampleThread.join();
+  }
+  channel.reset();
+}
+
+void ShmSource::run(const ShmCommand &command)
+{
+  std::vector<RotatorRequest> reqs;
+  RotatorRequest req;
+  req.deadline = clock->Now() + std::chrono::milliseconds(requestTimeout);
+
+  switch (command.type) {
+  case SHM_SET_POSITION:
+    req.cmd = CHANGE_AZI;
+    req.payload.ChangeAzi.aziRequested = command.azi;
+    reqs.push_back(req);
+    req.cmd = CHANGE_ELE;
+    req.payload.ChangeEle.eleRequested = command.ele;
+    reqs.push_back(req);
+    channel->PublishTarget(0, command.azi, clock->UnixTime());
+    channel->PublishTarget(1, command.ele, clock->UnixTime());
+    break;
+  case SHM_STOP:
+    req.cmd = ROTATOR_STOP;
+    reqs.push_back(req);
+    break;
+  case SHM_PARK:
+    req.cmd = ROTATOR_PARK;
+    reqs.push_back(req);
+    break;
+  case SHM_MOVE:
+    req.cmd = ROTATOR_MOVE;
+    req.payload.Move.direction = command.direction;
+    req.payload.Move.speed = (std::max)(1, (std::min)(100, (int)command.speed));
+    reqs.push_back(req);
+    break;
+  default:
+    fprintf(stderr, "ShmSource: unknown command type %u\n", command.type);
+    channel->PublishCommandDone(command.seq, false, clock->UnixTime());
+    return;
+  }
+
+  // the last response of the command publishes its outcome
+  struct Outcome {
+    std::mutex mutex;
+    size_t remaining;
+    bool success = true;
+  };
+  auto outcome = std::make_shared<Outcome>();
+  outcome->remaining = reqs.size();
+  std::shared_ptr<ShmChannel> published = channel;
+  Clock *clock = this->clock;
+  uint64_t seq = command.seq;
+  auto callback = [outcome, published, clock, seq](RotatorResponse resp) {
+    bool success;
+    {
+      std::lock_guard<std::mutex> lk(outcome->mutex);
+      outcome->success &= resp.success;
+      if (--outcome->remaining > 0) {
+        return;
+      }
+      success = outcome->success;
+    }
+    published->PublishCommandDone(seq, success, clock->UnixTime());
+  };
+
+  for (auto &one : reqs) {
+    if (!requestHandler(one, callback)) {
+      RotatorResponse resp;
+      resp.success = false;
+      callback(resp);
+    }
+  }
+}
+
+void ShmSource::commandMain()
+{
+  std::unique_lock<std::mutex> lk(stateMutex);
+  while (!closing) {
+    lk.unlock();
+    while (auto command = channel->Pop()) {
+      run(*command);
+    }
+    lk.lock();
+
+    if (pollInterval > 0) {
+      clock->WaitFor(lk, stateEvent, std::chrono::microseconds(pollInterval), [this] { return closing; });
+    } else {
+      lk.unlock();
+      std::this_thread::yield();
+      lk.lock();
+    }
+  }
+}
+
+void ShmSource::sampleMain()
+{
+  std::unique_lock<std::mutex> lk(stateMutex);
+  while (!closing) {
+    lk.unlock();
+    PositionQuery::Position pos = positionQuery.Query();
+    channel->PublishPosition(pos.valid, pos.azi, pos.ele, clock->UnixTime());
+    lk.lock();
+
+    clock->WaitFor(lk, stateEvent, std::chrono::milliseconds(sampleInterval), [this] { return closing; });
+  }
+}
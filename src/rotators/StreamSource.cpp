@@ -0,0 +1,803 @@
+#include "rotators/StreamSource.hpp"
+#include "trace/TraceLog.hpp"
+#include <cstring>
+#include <future>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <pty.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <termios.h>
+#endif
+
+StreamSource::StreamSource(std::string sourceName, std::string lineTerminators)
+  : sourceName(sourceName), lineTerminators(lineTerminators)
+{
+}
+
+bool StreamSource::ParseTransport(std::string name, Transport &transport)
+{
+  if (name == "tcp") {
+    transport = TRANSPORT_TCP;
+  } else if (name == "pty") {
+    transport = TRANSPORT_PTY;
+  } else if (name == "unix") {
+    transport = TRANSPORT_UNIX;
+  } else if (name == "udp") {
+    transport = TRANSPORT_UDP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void StreamSource::SetTransport(Transport transport, std::string tcpHost, int tcpPort, std::string ptyLink)
+{
+  this->transport = transport;
+  this->tcpHost = tcpHost;
+  this->tcpPort = tcpPort;
+  this->ptyLink = ptyLink;
+}
+
+void StreamSource::SetTraceRecorder(TraceRecorder *trace)
+{
+  this->trace = trace;
+}
+
+void StreamSource::SetClock(Clock *clock)
+{
+  this->clock = clock;
+  positionQuery.SetClock(clock);
+  arbiter.SetClock(clock);
+}
+
+void StreamSource::SetReactor(IoReactor *reactor)
+{
+  this->sharedReactor = reactor;
+}
+
+void StreamSource::SetQuerySharing(int shareWindow)
+{
+  this->queryShareWindow = shareWindow;
+}
+
+void StreamSource::SetArbitration(MoveArbiter::Policy policy, int holdOff, int ownerIdle, std::map<std::string, int> priorities)
+{
+  arbiter.Initialize(policy, holdOff, ownerIdle, priorities);
+}
+
+bool StreamSource::SetRequestHandler(RotatorRequestHandler callback)
+{
+  requestHandler = callback;
+  return true;
+}
+
+bool StreamSource::submit(RotatorRequest req)
+{
+  return requestHandler(req, [this](RotatorResponse resp) {
+    if (!resp.success) {
+      fprintf(stderr, "%s Thread: request failed in sink.\n", sourceName.c_str());
+    }
+  });
+}
+
+bool StreamSource::listenTcp()
+{
+  sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (sock == -1) {
+    SOCKET_PRINT_ERROR("Error creating socket");
+    return false;
+  }
+
+  int reuse = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+  struct sockaddr_in serverAddr;
+  memset(&serverAddr, 0, sizeof(serverAddr));
+  serverAddr.sin_family = AF_INET;
+  serverAddr.sin_port = htons(tcpPort);
+  if (inet_pton(AF_INET, tcpHost.c_str(), &serverAddr.sin_addr) != 1) {
+    serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+  }
+
+  if (bind(sock, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
+    fprintf(stderr, "%s Thread: error binding to port %d\n", sourceName.c_str(), tcpPort);
+    CLOSE_SOCKET(sock);
+    sock = -1;
+    return false;
+  }
+
+  if (listen(sock, 8) < 0) {
+    fprintf(stderr, "%s Thread: error listening to port %d\n", sourceName.c_str(), tcpPort);
+    CLOSE_SOCKET(sock);
+    sock = -1;
+    return false;
+  }
+
+  printf("%s listening on %s:%d\n", sourceName.c_str(), tcpHost.c_str(), tcpPort);
+  return true;
+}
+
+bool StreamSource::listenUnix()
+{
+#ifndef WIN32
+  struct sockaddr_un serverAddr;
+  memset(&serverAddr, 0, sizeof(serverAddr));
+  serverAddr.sun_family = AF_UNIX;
+  if (ptyLink.empty() || ptyLink.size() >= sizeof(serverAddr.sun_path)) {
+    fprintf(stderr, "%s Thread: bad unix socket path '%s'\n", sourceName.c_str(), ptyLink.c_str());
+    return false;
+  }
+  strncpy(serverAddr.sun_path, ptyLink.c_str(), sizeof(serverAddr.sun_path) - 1);
+
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock == -1) {
+    SOCKET_PRINT_ERROR("Error creating socket");
+    return false;
+  }
+
+  // left behind by a previous run that did not get to clean up
+  unlink(ptyLink.c_str());
+  if (bind(sock, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
+    fprintf(stderr, "%s Thread: error binding to %s\n", sourceName.c_str(), ptyLink.c_str());
+    CLOSE_SOCKET(sock);
+    sock = -1;
+    return false;
+  }
+
+  if (listen(sock, 8) < 0) {
+    fprintf(stderr, "%s Thread: error listening on %s\n", sourceName.c_str(), ptyLink.c_str());
+    CLOSE_SOCKET(sock);
+    sock = -1;
+    return false;
+  }
+
+  printf("%s listening on %s\n", sourceName.c_str(), ptyLink.c_str());
+  return true;
+#else
+  fprintf(stderr, "%s Thread: unix transport is not available on Windows\n", sourceName.c_str());
+  return false;
+#endif
+}
+
+bool StreamSource::listenStream()
+{
+  return transport == TRANSPORT_UNIX ? listenUnix() : listenTcp();
+}
+
+std::string StreamSource::endpoint() const
+{
+  if (transport == TRANSPORT_UNIX || transport == TRANSPORT_PTY) {
+    return ptyLink;
+  }
+  return tcpHost + ":" + std::to_string(tcpPort);
+}
+
+// the peer's address for logs and priorities; "unix" for every local client
+static std::string peerName(const sockaddr_in &addr)
+{
+  if (addr.sin_family != AF_INET) {
+    return "unix";
+  }
+  char str[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &addr.sin_addr, str, sizeof(str));
+  return str;
+}
+
+void StreamSource::acceptLoop()
+{
+  if (!listenStream()) {
+    return;
+  }
+
+  while (!threadClosing) {
+    struct sockaddr_in clientAddr;
+    int connSock;
+    unsigned int clientAddrLen = sizeof(clientAddr);
+#ifdef WIN32
+    connSock = accept(sock, (struct sockaddr *)&clientAddr, (int *)&clientAddrLen);
+#else
+    connSock = accept(sock, (struct sockaddr *)&clientAddr, &clientAddrLen);
+#endif
+
+    if (connSock < 0) {
+      if (!threadClosing) {
+        fprintf(stderr, "%s Thread: error accepting\n", sourceName.c_str());
+        CLOSE_SOCKET(sock);
+      }
+      return;
+    }
+
+    std::string peer = peerName(clientAddr);
+    printf("New connection from %s at PORT %d\n", peer.c_str(), ntohs(clientAddr.sin_port));
+
+    ClientSession session;
+    session.fd = connSock;
+    session.isSocket = true;
+    session.clientId = nextClientId++;
+    session.clientPriority = arbiter.PriorityOf(peer);
+
+    std::lock_guard<std::mutex> lk(clientsMutex);
+    clientWorkers.push_back(std::thread([this, session]() {
+      serveConnection(session);
+      printf("Client exited.\n");
+    }));
+  }
+}
+
+void StreamSource::servePty()
+{
+#ifndef WIN32
+  int masterFd, slaveFd;
+  char slaveName[128];
+  if (openpty(&masterFd, &slaveFd, slaveName, nullptr, nullptr) < 0) {
+    SOCKET_PRINT_ERROR("Error opening pty");
+    return;
+  }
+
+  // raw, no echo: the client sees exactly what we write
+  struct termios tio;
+  tcgetattr(slaveFd, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slaveFd, TCSANOW, &tio);
+
+  if (!ptyLink.empty()) {
+    unlink(ptyLink.c_str());
+    if (symlink(slaveName, ptyLink.c_str()) < 0) {
+      perror("Error linking pty");
+    }
+  }
+  printf("%s serving on pty %s%s%s\n", sourceName.c_str(), slaveName,
+         ptyLink.empty() ? "" : " -> ", ptyLink.c_str());
+
+  // slaveFd stays open on our side, so the master does not see EIO
+  // whenever the client closes and reopens the port
+  ClientSession session;
+  session.fd = masterFd;
+  session.isSocket = false;
+  session.clientId = nextClientId++;
+  session.clientPriority = 0;
+  serveConnection(session);
+
+  close(slaveFd);
+  if (!ptyLink.empty()) {
+    unlink(ptyLink.c_str());
+  }
+#else
+  fprintf(stderr, "%s Thread: pty transport is not available on Windows\n", sourceName.c_str());
+#endif
+}
+
+void StreamSource::serveDatagrams()
+{
+  sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock == -1) {
+    SOCKET_PRINT_ERROR("Error creating socket");
+    return;
+  }
+
+  struct sockaddr_in serverAddr;
+  memset(&serverAddr, 0, sizeof(serverAddr));
+  serverAddr.sin_family = AF_INET;
+  serverAddr.sin_port = htons(tcpPort);
+  if (inet_pton(AF_INET, tcpHost.c_str(), &serverAddr.sin_addr) != 1) {
+    serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+  }
+  if (bind(sock, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
+    fprintf(stderr, "%s Thread: error binding to udp port %d\n", sourceName.c_str(), tcpPort);
+    CLOSE_SOCKET(sock);
+    sock = -1;
+    return;
+  }
+  printf("%s listening on udp %s:%d\n", sourceName.c_str(), tcpHost.c_str(), tcpPort);
+
+  struct Peer {
+    ClientSession session;
+    uint64_t lastSeq = 0;
+    Clock::TimePoint lastSeen;
+  };
+  std::map<std::string, Peer> peers;  // by address:port
+  uint64_t dropped = 0;
+
+  // replies sent later (sendReply) must not reach a closed or reused fd
+  struct DatagramSocket {
+    std::mutex mutex;
+    int fd;
+  };
+  auto replySocket = std::make_shared<DatagramSocket>();
+  replySocket->fd = sock;
+
+  auto forget = [this, &peers](std::map<std::string, Peer>::iterator it) {
+    arbiter.Release(it->second.session.clientId);
+    return peers.erase(it);
+  };
+
+  char buf[1500];
+  while (!threadClosing) {
+    fd_set readFds;
+    FD_ZERO(&readFds);
+    FD_SET(sock, &readFds);
+    struct timeval tv = {0, 200 * 1000};
+    int ready = select(sock + 1, &readFds, nullptr, nullptr, &tv);
+
+    Clock::TimePoint now = clock->Now();
+    for (auto it = peers.begin(); it != peers.end();) {
+      bool idle = now - it->second.lastSeen > std::chrono::milliseconds(datagramPeerTimeout);
+      it = idle ? forget(it) : std::next(it);
+    }
+    if (ready <= 0) {
+      continue;
+    }
+
+    struct sockaddr_in fromAddr;
+    unsigned int fromAddrLen = sizeof(fromAddr);
+#ifdef WIN32
+    int ret = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&fromAddr, (int *)&fromAddrLen);
+#else
+    int ret = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&fromAddr, &fromAddrLen);
+#endif
+    if (ret <= 0) {
+      // e.g. an ICMP port unreachable from an earlier reply; the socket is fine
+      continue;
+    }
+
+    std::string datagram(buf, ret);
+    char *seqEnd;
+    unsigned long long seq = strtoull(datagram.c_str(), &seqEnd, 10);
+    if (seqEnd == datagram.c_str()) {
+      fprintf(stderr, "%s Thread: datagram without sequence number dropped\n", sourceName.c_str());
+      continue;
+    }
+
+    std::string peerAddr = peerName(fromAddr);
+    std::string key = peerAddr + ":" + std::to_string(ntohs(fromAddr.sin_port));
+    auto it = peers.find(key);
+    if (it == peers.end()) {
+      printf("New datagram peer %s at PORT %d\n", peerAddr.c_str(), ntohs(fromAddr.sin_port));
+      Peer peer;
+      peer.session.fd = sock;
+      peer.session.isSocket = true;
+      peer.session.isDatagram = true;
+      peer.session.clientId = nextClientId++;
+      peer.session.clientPriority = arbiter.PriorityOf(peerAddr);
+      it = peers.emplace(key, peer).first;
+    } else if (seq <= it->second.lastSeq) {
+      // late or repeated: a newer one was already taken
+      if (++dropped % 100 == 1) {
+        fprintf(stderr, "%s Thread: %llu stale datagrams dropped\n", sourceName.c_str(), (unsigned long long)dropped);
+      }
+      continue;
+    }
+    it->second.lastSeq = seq;
+    it->second.lastSeen = now;
+
+    // a datagram is complete: its last line needs no terminator
+    std::string payload = datagram.substr(seqEnd - datagram.c_str());
+    if (payload.empty() || lineTerminators.find(payload.back()) == std::string::npos) {
+      payload += lineTerminators[0];
+    }
+    LineReader reader(lineTerminators);
+    reader.Append(payload.data(), payload.size());
+
+    ClientSession &session = it->second.session;
+    session.sendReply = [replySocket, seq, fromAddr, fromAddrLen](const std::string &text) {
+      std::string reply = std::to_string(seq) + " " + text;
+      std::lock_guard<std::mutex> lk(replySocket->mutex);
+      if (replySocket->fd >= 0) {
+        sendto(replySocket->fd, reply.c_str(), reply.size(), 0, (const struct sockaddr *)&fromAddr, fromAddrLen);
+      }
+    };
+    std::string reply = processInput(session, reader);
+    if (!reply.empty()) {
+      session.sendReply(reply);
+    }
+    if (session.closing) {
+      forget(it);
+    }
+  }
+
+  for (auto it = peers.begin(); it != peers.end();) {
+    it = forget(it);
+  }
+  std::lock_guard<std::mutex> lk(replySocket->mutex);
+  replySocket->fd = -1;
+  CLOSE_SOCKET(sock);
+  sock = -1;
+}
+
+static int streamRead(int fd, bool isSocket, char *buf, size_t len)
+{
+#ifndef WIN32
+  if (!isSocket) {
+    return read(fd, buf, len);
+  }
+#endif
+  return recv(fd, buf, len, 0);
+}
+
+static int streamWrite(int fd, bool isSocket, const char *buf, size_t len)
+{
+#ifndef WIN32
+  if (!isSocket) {
+    size_t written = 0;
+    while (written < len) {
+      int ret = write(fd, buf + written, len - written);
+      if (ret < 0) {
+        return ret;
+      }
+      written += ret;
+    }
+    return written;
+  }
+#endif
+  return send_fixed(fd, buf, len, 0);
+}
+
+static void streamClose(int fd, bool isSocket)
+{
+#ifndef WIN32
+  if (!isSocket) {
+    close(fd);
+    return;
+  }
+#endif
+  CLOSE_SOCKET(fd);
+}
+
+bool StreamSource::pushWrite(const ClientSession &session, const std::string &text)
+{
+  // on the sampler thread: a client that is busy or not reading misses this
+  // update rather than holding up everyone else's
+  std::unique_lock<std::mutex> lk(*session.writeMutex, std::try_to_lock);
+  if (!lk.owns_lock()) {
+    return false;
+  }
+
+  int ret;
+#ifndef WIN32
+  if (!session.isSocket) {
+    fd_set writeFds;
+    FD_ZERO(&writeFds);
+    FD_SET(session.fd, &writeFds);
+    struct timeval tv = {0, 0};
+    if (select(session.fd + 1, nullptr, &writeFds, nullptr, &tv) <= 0) {
+      return false;
+    }
+    ret = write(session.fd, text.c_str(), text.size());
+  } else {
+    ret = send(session.fd, text.c_str(), text.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+#else
+  ret = send(session.fd, text.c_str(), text.size(), 0);
+#endif
+  if (ret <= 0) {
+    return false;
+  }
+  if ((size_t)ret < text.size()) {
+    // rare with lines this short; finish it, or the stream loses its framing
+    return streamWrite(session.fd, session.isSocket, text.c_str() + ret, text.size() - ret) >= 0;
+  }
+  return true;
+}
+
+void StreamSource::subscribe(ClientSession &session, int interval, double threshold,
+                             std::function<std::string(const PositionQuery::Position &pos)> format)
+{
+  if (interval <= 0) {
+    positionFeed.Unsubscribe(session.clientId);
+    return;
+  }
+
+  ClientSession target = session;
+  positionFeed.Subscribe(session.clientId, interval, threshold, [target, format](const PositionQuery::Position &pos) {
+    pushWrite(target, format(pos));
+  });
+}
+
+std::string StreamSource::processInput(ClientSession &session, LineReader &reader)
+{
+  std::string line;
+  std::string reply;
+  while (reader.Next(line) || (flushPartialLines && reader.TakePartial(line))) {
+    if (trace != nullptr) {
+      trace->Record(TRACE_SOURCE_COMMAND, (uint16_t)session.clientId, line.c_str(), line.size());
+    }
+
+    reply += processLine(session, line);
+    if (session.closing) {
+      break;
+    }
+  }
+  return reply;
+}
+
+void StreamSource::serveConnection(ClientSession session)
+{
+  char buf[256];
+  LineReader reader(lineTerminators);
+
+  // give up move ownership however this connection ends
+  struct ArbiterRelease {
+    MoveArbiter &arbiter;
+    uint64_t clientId;
+    ~ArbiterRelease() { arbiter.Release(clientId); }
+  } arbiterRelease{arbiter, session.clientId};
+
+  while (!threadClosing && !session.closing) {
+    // wake up periodically so Terminate() does not hang on an idle client
+    fd_set readFds;
+    FD_ZERO(&readFds);
+    FD_SET(session.fd, &readFds);
+    struct timeval tv = {0, 200 * 1000};
+    int ready = select(session.fd + 1, &readFds, nullptr, nullptr, &tv);
+    if (ready == 0) {
+      continue;
+    }
+
+    int ret = streamRead(session.fd, session.isSocket, buf, sizeof(buf));
+    if (ready < 0 || ret <= 0) {
+      fprintf(stderr, "%s Thread: connection closed.\n", sourceName.c_str());
+      break;
+    }
+    reader.Append(buf, ret);
+
+    // replies of every command in this read go out in one write
+    std::string reply = processInput(session, reader);
+    if (!reply.empty()) {
+      std::lock_guard<std::mutex> lk(*session.writeMutex);
+      ret = streamWrite(session.fd, session.isSocket, reply.c_str(), reply.size());
+      if (ret < 0) {
+        fprintf(stderr, "%s Thread: failed to send response.\n", sourceName.c_str());
+        break;
+      }
+    }
+  }
+
+  positionFeed.Unsubscribe(session.clientId);
+  streamClose(session.fd, session.isSocket);
+}
+
+void StreamSource::acceptSession(int fd, const sockaddr_in &addr)
+{
+  std::string peer = peerName(addr);
+  printf("New connection from %s at PORT %d\n", peer.c_str(), ntohs(addr.sin_port));
+
+  auto session = std::make_shared<ReactorSession>();
+  session->session.fd = fd;
+  session->session.isSocket = true;
+  session->session.clientId = nextClientId++;
+  session->session.clientPriority = arbiter.PriorityOf(peer);
+  session->reader = LineReader(lineTerminators);
+  {
+    std::lock_guard<std::mutex> lk(sessionsMutex);
+    sessions[fd] = session;
+  }
+
+  // on the reactor thread: only queue the bytes for a worker
+  reactor->Watch(fd, [this, session](const char *data, int len) {
+    std::lock_guard<std::mutex> lk(sessionsMutex);
+    if (len > 0) {
+      session->input.append(data, len);
+    } else {
+      fprintf(stderr, "%s Thread: connection closed.\n", sourceName.c_str());
+      session->closed = true;
+    }
+    if (!session->queued) {
+      session->queued = true;
+      runQueue.push_back(session);
+      sessionsEvent.notify_one();
+    }
+  });
+}
+
+void StreamSource::closeSession(ReactorSession &session)
+{
+  arbiter.Release(session.session.clientId);
+  positionFeed.Unsubscribe(session.session.clientId);
+  CLOSE_SOCKET(session.session.fd);
+  printf("Client exited.\n");
+}
+
+void StreamSource::ioWorkerMain()
+{
+  std::unique_lock<std::mutex> lk(sessionsMutex);
+  while (true) {
+    sessionsEvent.wait(lk, [this] { return threadClosing || !runQueue.empty(); });
+    if (threadClosing) {
+      return;
+    }
+    std::shared_ptr<ReactorSession> session = runQueue.front();
+    runQueue.pop_front();
+
+    while (true) {
+      std::string input;
+      input.swap(session->input);
+      if (input.empty()) {
+        session->queued = false;
+        if (session->closed) {
+          sessions.erase(session->session.fd);
+          closeSession(*session);
+        }
+        break;
+      }
+      if (session->session.closing) {
+        // quit: drop whatever came after it until the reactor lets go
+        continue;
+      }
+
+      lk.unlock();
+      session->reader.Append(input.data(), input.size());
+      std::string reply = processInput(session->session, session->reader);
+      if (!reply.empty()) {
+        std::lock_guard<std::mutex> writeLk(*session->session.writeMutex);
+        if (send_fixed(session->session.fd, reply.c_str(), reply.size(), 0) < 0) {
+          fprintf(stderr, "%s Thread: failed to send response.\n", sourceName.c_str());
+          session->session.closing = true;
+        }
+      }
+      if (session->session.closing) {
+        // the reactor sees the end of the stream and hands the session back
+        shutdown(session->session.fd, SHUT_RDWR);
+      }
+      lk.lock();
+    }
+  }
+}
+
+bool StreamSource::startReactor()
+{
+  if (!listenStream()) {
+    return false;
+  }
+
+  for (int i = 0; i < ioWorkers; i++) {
+    ioWorkerThreads.push_back(std::thread(&StreamSource::ioWorkerMain, this));
+  }
+
+  auto onAccept = [this](int fd, const sockaddr_in &addr) { acceptSession(fd, addr); };
+  if (reactor == sharedReactor) {
+    // Listen() belongs on the reactor thread
+    int fd = sock;
+    reactor->Post([this, fd, onAccept]() {
+      if (!reactor->Listen(fd, onAccept)) {
+        fprintf(stderr, "%s Thread: error watching %s\n", sourceName.c_str(), endpoint().c_str());
+      }
+    });
+  } else if (!reactor->Listen(sock, onAccept)) {
+    fprintf(stderr, "%s Thread: error watching %s\n", sourceName.c_str(), endpoint().c_str());
+    return false;
+  }
+  printf("%s serving with the %s backend%s\n", sourceName.c_str(), IoBackendName(CurrentIoBackend()),
+         reactor == sharedReactor ? " (shared reactor)" : "");
+  return true;
+}
+
+void StreamSource::serveReactor()
+{
+  if (startReactor()) {
+    reactor->Run();
+  }
+}
+
+void StreamSource::leaveSharedReactor()
+{
+  // on the reactor thread, so no handler of this source runs once it is done
+  std::promise<void> done;
+  reactor->Post([this, &done]() {
+    if (sock >= 0) {
+      reactor->Remove(sock);
+    }
+    {
+      std::lock_guard<std::mutex> lk(sessionsMutex);
+      for (auto &session : sessions) {
+        if (!session.second->closed) {
+          reactor->Remove(session.first);
+        }
+      }
+    }
+    done.set_value();
+  });
+  done.get_future().wait();
+}
+
+void StreamSource::threadMain(StreamSource *self)
+{
+  if (self->transport == TRANSPORT_PTY) {
+    self->servePty();
+  } else if (self->transport == TRANSPORT_UDP) {
+    self->serveDatagrams();
+  } else if (self->reactor) {
+    self->serveReactor();
+  } else {
+    self->acceptLoop();
+  }
+}
+
+void StreamSource::Start()
+{
+  positionQuery.Initialize(requestHandler, queryShareWindow, requestTimeout);
+  positionFeed.Initialize(&positionQuery, clock);
+  threadClosing = false;
+  reactor = nullptr;
+  if (transport == TRANSPORT_TCP || transport == TRANSPORT_UNIX) {
+    if (sharedReactor == nullptr) {
+      ownReactor = IoReactor::Create(CurrentIoBackend());
+    }
+    reactor = sharedReactor != nullptr ? sharedReactor : ownReactor.get();
+  }
+  if (reactor != nullptr && reactor == sharedReactor) {
+    // no thread of its own: the shared reactor's thread serves the sockets
+    startReactor();
+  } else {
+    worker = std::thread(StreamSource::threadMain, this);
+  }
+  printf("%s Initialized.\n", sourceName.c_str());
+}
+
+void StreamSource::WaitForClose()
+{
+  if (worker.joinable()) {
+    worker.join();
+  } else if (reactor != nullptr && reactor == sharedReactor) {
+    std::unique_lock<std::mutex> lk(sessionsMutex);
+    closeEvent.wait(lk, [this] { return threadClosing.load(); });
+  }
+}
+
+void StreamSource::Terminate()
+{
+  threadClosing = true;
+  positionFeed.Stop();
+
+  if (ownReactor) {
+    ownReactor->Stop();
+  } else if (reactor != nullptr) {
+    leaveSharedReactor();
+  } else if ((transport == TRANSPORT_TCP || transport == TRANSPORT_UNIX) && sock >= 0) {
+    // unblock accept()
+    shutdown(sock, 2);
+    CLOSE_SOCKET(sock);
+    sock = -1;
+  }
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+
+  if (reactor) {
+    {
+      std::lock_guard<std::mutex> lk(sessionsMutex);
+      sessionsEvent.notify_all();
+      closeEvent.notify_all();
+    }
+    for (auto &ioWorker : ioWorkerThreads) {
+      ioWorker.join();
+    }
+    ioWorkerThreads.clear();
+
+    for (auto &session : sessions) {
+      closeSession(*session.second);
+    }
+    sessions.clear();
+    runQueue.clear();
+    ownReactor.reset();
+    reactor = nullptr;
+    if (sock >= 0) {
+      CLOSE_SOCKET(sock);
+      sock = -1;
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(clientsMutex);
+  for (auto &clientWorker : clientWorkers) {
+    clientWorker.join();
+  }
+  clientWorkers.clear();
+
+#ifndef WIN32
+  if (transport == TRANSPORT_UNIX && !ptyLink.empty()) {
+    unlink(ptyLink.c_str());
+  }
+#endif
+}
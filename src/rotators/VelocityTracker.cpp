@@ -0,0 +1,227 @@
+#include "rotators/VelocityTracker.hpp"
+#include <algorithm>
+#include <cmath>
+
+// below half a Pelco-D position unit: the same target
+static const double sameTarget = 0.005;
+
+const char *VelocityTrackingStateName(VelocityTrackingState state)
+{
+  switch (state) {
+  case VELOCITY_IDLE: return "IDLE";
+  case VELOCITY_SLEWING: return "SLEWING";
+  case VELOCITY_TRACKING: return "TRACKING";
+  case VELOCITY_SETTLING: return "SETTLING";
+  }
+  return "?";
+}
+
+VelocityTracker::VelocityTracker()
+{
+}
+
+VelocityTracker::VelocityTracker(Params params)
+  : params(params)
+{
+}
+
+double VelocityTracker::delta(double from, double to) const
+{
+  double d = to - from;
+  if (params.periodic) {
+    d = std::fmod(d, 360.0);
+    if (d > 180) {
+      d -= 360;
+    } else if (d <= -180) {
+      d += 360;
+    }
+  }
+  return d;
+}
+
+bool VelocityTracker::targetMoving(double now) const
+{
+  return rateValid && now - changeTime <= params.staleTime;
+}
+
+double VelocityTracker::reference(double now) const
+{
+  if (!targetMoving(now)) {
+    return target;
+  }
+  return target + rate * (now - changeTime);
+}
+
+void VelocityTracker::enter(VelocityTrackingState next)
+{
+  if (next == VELOCITY_SLEWING && state != VELOCITY_SLEWING) {
+    stats.slews++;
+  }
+  if (next != VELOCITY_TRACKING) {
+    step = 0;
+  }
+  if (next != state) {
+    integral = 0;
+  }
+  state = next;
+}
+
+double VelocityTracker::lead(double now, double ref, double error) const
+{
+  // where an absolute move should go: ahead of a moving target by the time
+  // the slew takes, if the head can catch up with it at all
+  if (!targetMoving(now) || std::abs(rate) >= params.maxSpeed / 2) {
+    return ref;
+  }
+  return ref + rate * std::abs(error) / (params.maxSpeed - std::abs(rate));
+}
+
+double VelocityTracker::moveTo(double position)
+{
+  position = (std::max)(params.minPosition, (std::min)(params.maxPosition, position));
+  commanded = position;
+  stats.positions++;
+  return position;
+}
+
+void VelocityTracker::OnTarget(double now, double value)
+{
+  if (!targetValid) {
+    targetValid = true;
+    target = value;
+    changeTime = now;
+    return;
+  }
+
+  double d = delta(target, value);
+  if (std::abs(d) < sameTarget) {
+    return;
+  }
+
+  // rate from consecutive changes; the tracking program may repeat a target
+  // (rounding) between them
+  double dt = now - changeTime;
+  if (dt > 0 && dt <= params.staleTime) {
+    rate = rateValid ? (rate + d / dt) / 2 : d / dt;
+    rateValid = true;
+  } else {
+    rate = 0;
+    rateValid = false;
+  }
+  target = value;
+  changeTime = now;
+}
+
+void VelocityTracker::OnPosition(double now, double position)
+{
+  estimate = position;
+  estimateTime = now;
+  sampleTime = now;
+  positionValid = true;
+}
+
+void VelocityTracker::Reset()
+{
+  targetValid = false;
+  positionValid = false;
+  rateValid = false;
+  rate = 0;
+  enter(VELOCITY_IDLE);
+}
+
+std::optional<double> VelocityTracker::OnTick(double now)
+{
+  std::optional<double> move;
+  double dt = now - lastTick;
+  lastTick = now;
+  int previous = step;
+
+  if (positionValid) {
+    // dead reckoning on the commanded speed
+    estimate += step * params.maxSpeed / params.maxStep * (now - estimateTime);
+    estimateTime = now;
+  }
+
+  if (targetValid) {
+    bool moving = targetMoving(now);
+    double ref = reference(now);
+    double error = positionValid ? delta(estimate, ref) : params.slewThreshold + 1;
+    double ahead = lead(now, ref, error);
+
+    switch (state) {
+    case VELOCITY_IDLE:
+      if (std::abs(error) > params.slewThreshold) {
+        enter(VELOCITY_SLEWING);
+        move = moveTo(ahead);
+      } else if (std::abs(error) > params.tolerance) {
+        if (moving) {
+          enter(VELOCITY_TRACKING);
+        } else {
+          enter(VELOCITY_SETTLING);
+          move = moveTo(ref);
+        }
+      }
+      break;
+
+    case VELOCITY_SLEWING:
+    case VELOCITY_SETTLING:
+      if (moving && std::abs(error) <= params.slewThreshold / 2) {
+        enter(VELOCITY_TRACKING);
+      } else if (!moving && std::abs(error) <= params.tolerance) {
+        enter(VELOCITY_IDLE);
+      } else if (moving && std::abs(error) > params.slewThreshold && state == VELOCITY_SETTLING) {
+        enter(VELOCITY_SLEWING);
+        move = moveTo(ahead);
+      } else if (std::abs(delta(commanded, ahead)) >
+                 (moving ? (std::max)(params.slewThreshold, std::abs(delta(estimate, commanded))) : params.tolerance)) {
+        // the target moved on since the move was commanded, further than
+        // the head still has to go (each new move restarts the motor)
+        move = moveTo(ahead);
+      }
+      break;
+
+    case VELOCITY_TRACKING:
+      if (std::abs(error) > params.slewThreshold) {
+        enter(VELOCITY_SLEWING);
+        move = moveTo(ahead);
+      } else if (!moving) {
+        enter(VELOCITY_SETTLING);
+        move = moveTo(ref);
+      }
+      break;
+    }
+
+    if (state == VELOCITY_TRACKING) {
+      double limit = params.maxSpeed;
+      double speed = rate + params.kp * error + params.ki * integral;
+      if (dt > 0 && std::abs(speed) < limit) {
+        // no integration while saturated
+        integral += error * dt;
+        speed = rate + params.kp * error + params.ki * integral;
+      }
+      speed = (std::max)(-limit, (std::min)(limit, speed));
+      // a little hysteresis, against dithering between two steps on every tick
+      double desired = speed / params.maxSpeed * params.maxStep;
+      if (std::abs(desired - step) > 0.75) {
+        step = (int)std::lround(desired);
+      }
+    }
+  }
+
+  if (step != previous) {
+    stats.speedChanges++;
+  }
+  return move;
+}
+
+bool VelocityTracker::NeedsSampling(double now) const
+{
+  switch (state) {
+  case VELOCITY_IDLE:
+    return !positionValid;
+  case VELOCITY_TRACKING:
+    return now - sampleTime >= params.sampleInterval;
+  default:
+    return true;
+  }
+}
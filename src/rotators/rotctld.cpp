@@ -1,239 +1,444 @@
 #include "rotators/rotctld.hpp"
 
-void rotctld::Initialize(std::string tcpHost, int tcpPort, bool gpredictBugWalkaround)
+rotctld::rotctld()
+  : StreamSource("rotctld", "\n")
 {
-  this->tcpHost = tcpHost;
-  this->tcpPort = tcpPort;
-  this->gpredictBugWalkaround = gpredictBugWalkaround;
 }
 
-void rotctld::connStart()
+void rotctld::Initialize(std::string tcpHost, int tcpPort, bool gpredictBugWalkaround)
 {
-  int status;
+  SetTransport(TRANSPORT_TCP, tcpHost, tcpPort, "");
+
+  // In Gpredict v2.2.1, there is incorrect handling for Windows rotator protocol that accidentally
+  // got the trailing '\n' removed; See
+  // https://github.com/csete/gpredict/commit/f0d6afce3fc457963de9ae620af517c76deb82a1
+  //
+  // So whatever one read left over is taken as a full command. This is not reliable, since
+  // there is no guarantee that a full command packet arrives in one recv.
+  this->flushPartialLines = gpredictBugWalkaround;
+}
 
-  sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-  if (sock == -1) {
-    SOCKET_PRINT_ERROR("Error creating socket");
-    return;
+// hamlib error codes (negated in replies)
+static const int RIG_OK = 0;
+static const int RIG_EINVAL = 1;
+static const int RIG_ENIMPL = 4;
+static const int RIG_ETIMEOUT = 5;
+static const int RIG_EIO = 6;
+static const int RIG_ERJCTED = 9;
+// not a hamlib code: the reply goes out later (datagram get_pos)
+static const int REPLY_DEFERRED = 1;
+
+const rotctld::CommandEntry rotctld::commandTable[] = {
+  {'P', "set_pos", 2, &rotctld::cmdSetPos},
+  {'p', "get_pos", 0, &rotctld::cmdGetPos},
+  {'M', "move", 2, &rotctld::cmdMove},
+  {'S', "stop", 0, &rotctld::cmdStop},
+  {'K', "park", 0, &rotctld::cmdPark},
+  {'R', "reset", 1, &rotctld::cmdReset},
+  {'_', "get_info", 0, &rotctld::cmdGetInfo},
+  {'\0', "dump_caps", 0, &rotctld::cmdDumpCaps},
+  {'\0', "dump_state", 0, &rotctld::cmdDumpState},
+  // extension: `\subscribe <ms> [<deg>]`, see cmdSubscribe
+  {'\0', "subscribe", 1, &rotctld::cmdSubscribe, 1},
+  {'q', "quit", 0, &rotctld::cmdQuit},
+  {'Q', "quit", 0, &rotctld::cmdQuit},
+};
+
+int rotctld::requestAndWait(ClientSession &session, RotatorRequest req)
+{
+  if (session.isDatagram) {
+    req.deadline = clock->Now() + std::chrono::milliseconds(requestTimeout);
+    return submit(req) ? RIG_OK : -RIG_EIO;
   }
 
-  struct sockaddr_in serverAddr;
-  serverAddr.sin_family = AF_INET;
-  serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
-  serverAddr.sin_port = htons(tcpPort);
-
-  if (bind(sock, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
-    fprintf(stderr, "rotctld Thread: error binding to port %d\n", tcpPort);
-    CLOSE_SOCKET(sock);
-    sockActive = false;
+  ResponseLatch latch(1, clock, requestTimeout);
+  if (!latch.Submit(requestHandler, req, 0)) {
+    return -RIG_EIO;
   }
-
-  sockActive = true;
+  if (!latch.Wait()) {
+    return -RIG_ETIMEOUT;
+  }
+  return latch.Get(0)->success ? RIG_OK : -RIG_EIO;
 }
 
-void rotctld::connTerminate()
+int rotctld::cmdSetPos(ClientSession &session, const CommandArgs &args, CommandValues &)
 {
-  CLOSE_SOCKET(sock);
-}
+  double azi, ele;
+  try {
+    azi = std::stod(args[0]);
+    ele = std::stod(args[1]);
+  } catch (const std::exception &) {
+    return -RIG_EINVAL;
+  }
 
-void rotctld::threadMain(rotctld *self) {
-  self->connStart();
+  if (!arbiter.AcquireMove(session.clientId, session.clientPriority)) {
+    printf("rotctld Thread: client %llu lost move arbitration, rejected.\n", (unsigned long long)session.clientId);
+    return -RIG_ERJCTED;
+  }
 
-  if (!self->sockActive) {
-    fprintf(stderr, "rotctld Thread: Error binding to target\n");
-    return;
+  if (session.isDatagram) {
+    // acknowledged once taken; the receive loop never waits for the device
+    setTarget(azi, ele);
+    return RIG_OK;
   }
 
-  if (listen(self->sock, 1) < 0) {
-    fprintf(stderr, "rotctld Thread: error listening to port %d\n", self->tcpPort);
-    CLOSE_SOCKET(self->sock);
-    return;
+  // Set azi and ele
+  ResponseLatch latch(2, clock, requestTimeout);
+  {
+    RotatorRequest req;
+    req.cmd = CHANGE_AZI;
+    req.payload.ChangeAzi.aziRequested = azi;
+    latch.Submit(requestHandler, req, 0);
+  }
+  {
+    RotatorRequest req;
+    req.cmd = CHANGE_ELE;
+    req.payload.ChangeEle.eleRequested = ele;
+    latch.Submit(requestHandler, req, 1);
   }
 
-  while (true) {
-    struct sockaddr_in clientAddr;
-    int connSock, n;
-    unsigned int clientAddrLen = sizeof(clientAddr);
-#ifdef WIN32
-    connSock = accept(self->sock, (struct sockaddr *)&clientAddr, (int *)&clientAddrLen);
-#else
-    connSock = accept(self->sock, (struct sockaddr *)&clientAddr, &clientAddrLen);
-#endif
+  if (!latch.Wait()) {
+    fprintf(stderr, "rotctld Thread: position change timed out.\n");
+    return -RIG_ETIMEOUT;
+  }
+  if (!latch.Get(0)->success || !latch.Get(1)->success) {
+    return -RIG_EIO;
+  }
+  return RIG_OK;
+}
 
-    if (connSock < 0) {
-      fprintf(stderr, "rotctld Thread: error accepting\n");
-      CLOSE_SOCKET(self->sock);
+void rotctld::setTarget(double azi, double ele)
+{
+  {
+    std::lock_guard<std::mutex> lk(targetSlot->mutex);
+    if (targetSlot->inFlight) {
+      targetSlot->pending = true;
+      targetSlot->azi = azi;
+      targetSlot->ele = ele;
       return;
     }
+    targetSlot->inFlight = true;
+  }
+  submitTarget(targetSlot, requestHandler, clock, requestTimeout, azi, ele);
+}
 
-    char str[INET_ADDRSTRLEN];
-		printf("New connection from %s at PORT %d\n",
-		       inet_ntop(AF_INET, &clientAddr.sin_addr, str, sizeof(str)),
-		       ntohs(clientAddr.sin_port));
-
-    self->clientWorkers.push_back(
-      std::thread(
-        [](rotctld *self, int connSock, struct sockaddr_in clientAddr) {
-          rotctld::connThreadMain(self, connSock, clientAddr);
-          printf("Client exited.\n");
-        },
-        self, connSock, clientAddr
-      )
-    );
-  }
-  
-}
-
-// TODO: elegant
-int recv_until_newline(int sockfd, char *buf, size_t buflen) {
-  int bytes_read = 0, ret;
-  char byte;
-  while ((ret = recv_fixed(sockfd, &byte, 1, 0)) > 0 && bytes_read < buflen) {
-    if (ret != 1) {
-      return ret;
+void rotctld::submitTarget(std::shared_ptr<TargetSlot> slot, RotatorRequestHandler handler, Clock *clock,
+                           int timeout, double azi, double ele)
+{
+  // once both axes are answered, the newest target that came meanwhile goes next
+  auto remaining = std::make_shared<std::atomic<int>>(2);
+  auto done = [slot, handler, clock, timeout, remaining](RotatorResponse resp) {
+    if (!resp.success) {
+      fprintf(stderr, "rotctld Thread: position target failed in sink.\n");
+    }
+    if (--*remaining > 0) {
+      return;
+    }
+    double nextAzi, nextEle;
+    {
+      std::lock_guard<std::mutex> lk(slot->mutex);
+      if (!slot->pending) {
+        slot->inFlight = false;
+        return;
+      }
+      slot->pending = false;
+      nextAzi = slot->azi;
+      nextEle = slot->ele;
+    }
+    submitTarget(slot, handler, clock, timeout, nextAzi, nextEle);
+  };
+
+  RotatorRequest req;
+  req.deadline = clock->Now() + std::chrono::milliseconds(timeout);
+  req.cmd = CHANGE_AZI;
+  req.payload.ChangeAzi.aziRequested = azi;
+  RotatorRequest eleReq = req;
+  eleReq.cmd = CHANGE_ELE;
+  eleReq.payload.ChangeEle.eleRequested = ele;
+  for (auto &one : {req, eleReq}) {
+    if (!handler(one, done)) {
+      RotatorResponse resp;
+      resp.success = false;
+      done(resp);
     }
+  }
+}
 
-    buf[bytes_read] = byte;
-    printf("Got %c\n", byte);
-    bytes_read++;
+int rotctld::cmdGetPos(ClientSession &, const CommandArgs &, CommandValues &values)
+{
+  // shared with every other client polling at the same time (datagram
+  // clients are answered by processLine through QueryAsync instead)
+  return positionValues(positionQuery.Query(), values);
+}
 
-    if (byte == '\n') {
-      return bytes_read;
-    }
+int rotctld::positionValues(const PositionQuery::Position &pos, CommandValues &values)
+{
+  if (!pos.valid) {
+    return -RIG_EIO;
   }
 
-  // insufficient buf, but its your fault!
-  return -1;
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%lf", pos.azi);
+  values.push_back({"Azimuth", buf});
+  snprintf(buf, sizeof(buf), "%lf", pos.ele);
+  values.push_back({"Elevation", buf});
+  return RIG_OK;
 }
 
-void rotctld::connThreadMain(rotctld *self, int connSock, struct sockaddr_in clientAddr) {
-  char buf[80];
+int rotctld::cmdMove(ClientSession &session, const CommandArgs &args, CommandValues &)
+{
+  RotatorRequest req;
+  req.cmd = ROTATOR_MOVE;
+  try {
+    req.payload.Move.direction = std::stoi(args[0]);
+    req.payload.Move.speed = std::stoi(args[1]);
+  } catch (const std::exception &) {
+    return -RIG_EINVAL;
+  }
 
-  printf("rotctld::connThreadMain initialized.\n");
+  if (!arbiter.AcquireMove(session.clientId, session.clientPriority)) {
+    return -RIG_ERJCTED;
+  }
+  return requestAndWait(session, req);
+}
 
-  while (!self->threadClosing) {
-    int ret;
-    if (self->gpredictBugWalkaround) {
-      // In Gpredict v2.2.1, there is incorrect handling for Windows rotator protocol that accidentally
-      // got the trailing '\n' removed; See
-      // https://github.com/csete/gpredict/commit/f0d6afce3fc457963de9ae620af517c76deb82a1
-      //
-      // However, this is not a reliable way, since there is no guarantee that a full
-      // command packet can be read by one recv call, and parsing this way is potentially buggy
-      ret = recv(connSock, buf, sizeof(buf), 0);
-    } else {
-      ret = recv_until_newline(connSock, buf, sizeof(buf));
-    }
-    
-    if (ret <= 0) {
-      fprintf(stderr, "rotctld Thread: failed to read newline.\n");
-      CLOSE_SOCKET(connSock);
-      return;
-    }
+int rotctld::cmdStop(ClientSession &session, const CommandArgs &, CommandValues &)
+{
+  // stopping is always allowed, whoever holds the rotator
+  RotatorRequest req;
+  req.cmd = ROTATOR_STOP;
+  return requestAndWait(session, req);
+}
 
-    if (buf[0] == 'p') {
-      // printf("rotctld Thread: Command received: %c\n", buf[0]);
-      // Request: Print az and el
-      double azi, ele;
+int rotctld::cmdPark(ClientSession &session, const CommandArgs &, CommandValues &)
+{
+  if (!arbiter.AcquireMove(session.clientId, session.clientPriority)) {
+    return -RIG_ERJCTED;
+  }
 
-      // Get azi
-      {
-        RotatorRequest req;
-        req.cmd = GET_AZI;
+  RotatorRequest req;
+  req.cmd = ROTATOR_PARK;
+  return requestAndWait(session, req);
+}
 
-        RotatorResponse resp = self->requestHandler(req);
-        azi = resp.payload.aziResp.azi;
-      }
+int rotctld::cmdReset(ClientSession &session, const CommandArgs &, CommandValues &)
+{
+  if (!arbiter.AcquireMove(session.clientId, session.clientPriority)) {
+    return -RIG_ERJCTED;
+  }
 
-      // Get ele
-      {
-        RotatorRequest req;
-        req.cmd = GET_ELE;
+  RotatorRequest req;
+  req.cmd = ROTATOR_RESET;
+  return requestAndWait(session, req);
+}
 
-        RotatorResponse resp = self->requestHandler(req);
-        ele = resp.payload.eleResp.ele;
-      }
+int rotctld::cmdGetInfo(ClientSession &, const CommandArgs &, CommandValues &values)
+{
+  values.push_back({"Info", "Rotator-Bridge"});
+  return RIG_OK;
+}
 
-      char respBuf[80];
-      snprintf(respBuf, sizeof(respBuf), "%lf\n%lf\n", azi, ele);
+int rotctld::cmdDumpCaps(ClientSession &, const CommandArgs &, CommandValues &values)
+{
+  char buf[512];
+  snprintf(buf, sizeof(buf),
+    "Model name:\tRotator-Bridge\n"
+    "Mfg name:\tBY6DX\n"
+    "Rot type:\tAz-El\n"
+    "Port type:\tNetwork link\n"
+    "Min Azimuth:\t%.2f\n"
+    "Max Azimuth:\t%.2f\n"
+    "Min Elevation:\t%.2f\n"
+    "Max Elevation:\t%.2f\n"
+    "Can Set Position:\tY\n"
+    "Can Get Position:\tY\n"
+    "Can Stop:\tY\n"
+    "Can Park:\tY\n"
+    "Can Reset:\tY\n"
+    "Can Move:\tY\n"
+    "Can get Info:\tY",
+    minAzi, maxAzi, minEle, maxEle);
+  values.push_back({"", buf});
+  return RIG_OK;
+}
 
-      // printf("rotctld Thread: Command response: azi=%lf, ele=%lf\n", azi, ele);
+int rotctld::cmdDumpState(ClientSession &, const CommandArgs &, CommandValues &values)
+{
+  // rotctld protocol version 1, as read by hamlib's netrotctl backend
+  char buf[64];
+  values.push_back({"", "1"});
+  values.push_back({"", "1"});  // rot model: dummy
+  snprintf(buf, sizeof(buf), "min_az=%f", minAzi);
+  values.push_back({"", buf});
+  snprintf(buf, sizeof(buf), "max_az=%f", maxAzi);
+  values.push_back({"", buf});
+  snprintf(buf, sizeof(buf), "min_el=%f", minEle);
+  values.push_back({"", buf});
+  snprintf(buf, sizeof(buf), "max_el=%f", maxEle);
+  values.push_back({"", buf});
+  values.push_back({"", "south_zero=0"});
+  values.push_back({"", "rot_type=AzEl"});
+  values.push_back({"", "done"});
+  return RIG_OK;
+}
 
-      ret = send_fixed(connSock, respBuf, sizeof(respBuf), 0);
-      if (ret < 0) {
-        fprintf(stderr, "rotctld Thread: failed to send response.\n");
-        CLOSE_SOCKET(connSock);
-        return;
-      }
+int rotctld::cmdSubscribe(ClientSession &session, const CommandArgs &args, CommandValues &)
+{
+  // position pushed as `POS <azi> <ele>` lines every <ms>, or with <deg> only
+  // once it moved further than that; `\subscribe 0` stops. Lines can arrive
+  // between replies, so only clients that ask get them.
+  int interval;
+  double threshold = 0;
+  try {
+    interval = std::stoi(args[0]);
+    if (args.size() > 1) {
+      threshold = std::stod(args[1]);
+    }
+  } catch (const std::exception &) {
+    return -RIG_EINVAL;
+  }
+  if (interval < 0 || threshold < 0) {
+    return -RIG_EINVAL;
+  }
+  if (session.isDatagram) {
+    // no stream to push on
+    return -RIG_ENIMPL;
+  }
 
-    } else if (buf[0] == 'P') {
-      // Request: set az and el
-      double azi, ele;
-      sscanf(buf + 1, "%lf %lf", &azi, &ele);
+  subscribe(session, interval, threshold, [](const PositionQuery::Position &pos) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "POS %lf %lf\n", pos.azi, pos.ele);
+    return std::string(buf);
+  });
+  return RIG_OK;
+}
 
-      // Set azi
-      {
-        RotatorRequest req;
-        req.cmd = CHANGE_AZI;
-        req.payload.ChangeAzi.aziRequested = azi;
+int rotctld::cmdQuit(ClientSession &session, const CommandArgs &, CommandValues &)
+{
+  session.closing = true;
+  return RIG_OK;
+}
 
-        RotatorResponse resp = self->requestHandler(req);
-        // TODO: check return value
+std::string rotctld::processLine(ClientSession &session, const std::string &line)
+{
+  std::vector<std::string> tokens;
+  {
+    size_t pos = 0;
+    while (true) {
+      size_t begin = line.find_first_not_of(" \t\r\n", pos);
+      if (begin == std::string::npos) {
+        break;
+      }
+      size_t end = line.find_first_of(" \t\r\n", begin);
+      if (end == std::string::npos) {
+        end = line.size();
       }
+      tokens.push_back(line.substr(begin, end - begin));
+      pos = end;
+    }
+  }
 
-      // Set ele
-      {
-        RotatorRequest req;
-        req.cmd = CHANGE_ELE;
-        req.payload.ChangeEle.eleRequested = ele;
+  // several commands may share a line, e.g. "P 10 20 p"
+  std::string reply;
+  size_t idx = 0;
+  while (idx < tokens.size() && !session.closing) {
+    std::string name = tokens[idx++];
+
+    // extended response: '+' separates values with newlines, ';' '|' ',' with themselves
+    char sep = 0;
+    if (name[0] == '+' || name[0] == ';' || name[0] == '|' || name[0] == ',') {
+      sep = name[0] == '+' ? '\n' : name[0];
+      name.erase(0, 1);
+      if (name.empty()) {
+        if (idx >= tokens.size()) {
+          break;
+        }
+        name = tokens[idx++];
+      }
+    }
 
-        RotatorResponse resp = self->requestHandler(req);
-        // TODO: check return value
+    const CommandEntry *entry = nullptr;
+    for (const auto &candidate : commandTable) {
+      bool matched = name[0] == '\\'
+        ? name.compare(1, std::string::npos, candidate.longName) == 0
+        : name.size() == 1 && name[0] == candidate.shortName;
+      if (matched) {
+        entry = &candidate;
+        break;
       }
+    }
 
-      std::string respBuf = "RET 0";
-      ret = send_fixed(connSock, respBuf.c_str(), respBuf.size(), 0);
-      if (ret < 0) {
-        fprintf(stderr, "rotctld Thread: failed to send response.\n");
-        CLOSE_SOCKET(connSock);
-        return;
+    int status;
+    CommandArgs args;
+    CommandValues values;
+    if (entry == nullptr) {
+      fprintf(stderr, "rotctld Thread: unknown command '%s'\n", name.c_str());
+      status = -RIG_ENIMPL;
+    } else if (tokens.size() - idx < (size_t)entry->argCount) {
+      status = -RIG_EINVAL;
+      idx = tokens.size();
+    } else {
+      args.assign(tokens.begin() + idx, tokens.begin() + idx + entry->argCount);
+      idx += entry->argCount;
+      for (int i = 0; i < entry->optionalArgs && idx < tokens.size(); i++) {
+        char *end;
+        strtod(tokens[idx].c_str(), &end);
+        if (*end != '\0') {
+          break;
+        }
+        args.push_back(tokens[idx++]);
       }
-    } else if (buf[0] == 'S') {
-      // stop
-      std::string respBuf = "RET 0";
-      ret = send_fixed(connSock, respBuf.c_str(), respBuf.size(), 0);
-      if (ret < 0) {
-        fprintf(stderr, "rotctld Thread: failed to send response.\n");
-        CLOSE_SOCKET(connSock);
-        return;
+      if (session.isDatagram && entry->handler == &rotctld::cmdGetPos) {
+        // the receive loop serves every datagram client: answered in a
+        // datagram of its own once the shared query is
+        auto sendReply = session.sendReply;
+        std::string longName = entry->longName;
+        positionQuery.QueryAsync([sendReply, longName, args, sep](const PositionQuery::Position &pos) {
+          CommandValues posValues;
+          int posStatus = positionValues(pos, posValues);
+          sendReply(formatReply(longName, args, posValues, posStatus, sep));
+        });
+        status = REPLY_DEFERRED;
+      } else {
+        status = (this->*(entry->handler))(session, args, values);
       }
+    }
 
-      CLOSE_SOCKET(connSock);
-      return;
+    if (session.closing) {
+      // quit: no reply
+      break;
+    }
+    if (status == REPLY_DEFERRED) {
+      continue;
     }
+    reply += formatReply(entry != nullptr ? entry->longName : name, args, values, status, sep);
   }
-}
-
-void rotctld::WaitForClose() {
-  worker.join();
-}
 
-void rotctld::Start() {
-  worker = std::thread(rotctld::threadMain, this);
-  threadExited = false;
-  printf("rotctld Initialized.\n");
+  return reply;
 }
 
-void rotctld::Terminate() {
-  threadClosing = true;
-
-  worker.join();
-  threadExited = true;
+std::string rotctld::formatReply(const std::string &name, const CommandArgs &args, const CommandValues &values,
+                                 int status, char sep)
+{
+  std::string reply;
+  if (sep != 0) {
+    reply += name;
+    reply += ":";
+    for (const auto &arg : args) {
+      reply += " " + arg;
+    }
+    reply += sep;
+    for (const auto &value : values) {
+      reply += value.first.empty() ? value.second : value.first + ": " + value.second;
+      reply += sep;
+    }
+    reply += "RPRT " + std::to_string(status) + "\n";
+  } else if (status != RIG_OK || values.empty()) {
+    reply += "RPRT " + std::to_string(status) + "\n";
+  } else {
+    for (const auto &value : values) {
+      reply += value.second + "\n";
+    }
+  }
+  return reply;
 }
-
-bool rotctld::SetRequestHandler(
-  std::function<RotatorResponse(RotatorRequest)> callback
-) {
-  requestHandler = callback;
-  return true;
-}
\ No newline at end of file
@@ -0,0 +1,362 @@
+#include "trace/TraceLog.hpp"
+#include <cstring>
+
+#ifdef RBRIDGE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static const char traceMagic[8] = {'R', 'B', 'T', 'R', 'A', 'C', 'E', '\0'};
+static const uint32_t traceVersion = 1;
+
+static bool isGzipPath(const std::string &path) {
+  return path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0;
+}
+
+static size_t tracePadding(size_t len) {
+  return (8 - (len % 8)) % 8;
+}
+
+std::vector<char> TraceEncodeRequest(const RotatorRequest &req) {
+  // cmd (1 byte) + argument; doubles are stored in host representation.
+  // A preset hint carries two of them, everything else fits in one.
+  size_t arguments = req.cmd == ROTATOR_PRESET_HINT ? 2 : 1;
+  std::vector<char> payload(1 + arguments * sizeof(double), 0);
+  payload[0] = (char)req.cmd;
+
+  switch (req.cmd) {
+  case CHANGE_AZI:
+    memcpy(payload.data() + 1, &req.payload.ChangeAzi.aziRequested, sizeof(double));
+    break;
+  case CHANGE_ELE:
+    memcpy(payload.data() + 1, &req.payload.ChangeEle.eleRequested, sizeof(double));
+    break;
+  case CAMPTZ_PRESET_CALL:
+  case CAMPTZ_PRESET_SET:
+  case CAMPTZ_PRESET_CLEAR:
+    payload[1] = req.payload.CamPTZPreset.presetIdx;
+    break;
+  case ROTATOR_MOVE:
+    payload[1] = (char)req.payload.Move.direction;
+    payload[2] = (char)req.payload.Move.speed;
+    break;
+  case CAMPTZ_SPEED:
+    payload[1] = (char)req.payload.CamPTZSpeed.pan;
+    payload[2] = (char)req.payload.CamPTZSpeed.tilt;
+    break;
+  case ROTATOR_PRESET_HINT:
+    memcpy(payload.data() + 1, &req.payload.PresetHint.azi, sizeof(double));
+    memcpy(payload.data() + 1 + sizeof(double), &req.payload.PresetHint.ele, sizeof(double));
+    break;
+  default:
+    break;
+  }
+
+  return payload;
+}
+
+bool TraceDecodeRequest(const std::vector<char> &payload, RotatorRequest &req) {
+  if (payload.empty()) {
+    return false;
+  }
+  size_t arguments = payload[0] == (char)ROTATOR_PRESET_HINT ? 2 : 1;
+  if (payload.size() != 1 + arguments * sizeof(double)) {
+    return false;
+  }
+
+  req.cmd = (RotatorCmd)payload[0];
+  switch (req.cmd) {
+  case CHANGE_AZI:
+    memcpy(&req.payload.ChangeAzi.aziRequested, payload.data() + 1, sizeof(double));
+    break;
+  case CHANGE_ELE:
+    memcpy(&req.payload.ChangeEle.eleRequested, payload.data() + 1, sizeof(double));
+    break;
+  case CAMPTZ_PRESET_CALL:
+  case CAMPTZ_PRESET_SET:
+  case CAMPTZ_PRESET_CLEAR:
+    req.payload.CamPTZPreset.presetIdx = payload[1];
+    break;
+  case ROTATOR_MOVE:
+    req.payload.Move.direction = (unsigned char)payload[1];
+    req.payload.Move.speed = (unsigned char)payload[2];
+    break;
+  case CAMPTZ_SPEED:
+    req.payload.CamPTZSpeed.pan = (signed char)payload[1];
+    req.payload.CamPTZSpeed.tilt = (signed char)payload[2];
+    break;
+  case ROTATOR_PRESET_HINT:
+    memcpy(&req.payload.PresetHint.azi, payload.data() + 1, sizeof(double));
+    memcpy(&req.payload.PresetHint.ele, payload.data() + 1 + sizeof(double), sizeof(double));
+    break;
+  case GET_AZI:
+  case GET_ELE:
+  case ROTATOR_STOP:
+  case ROTATOR_PARK:
+  case ROTATOR_RESET:
+    break;
+  default:
+    return false;
+  }
+
+  return true;
+}
+
+TraceRecorder::~TraceRecorder() {
+  Close();
+}
+
+bool TraceRecorder::writeRaw(const char *buf, size_t len) {
+#ifdef RBRIDGE_HAVE_ZLIB
+  if (gzFile != nullptr) {
+    return gzwrite((::gzFile)gzFile, buf, (unsigned)len) == (int)len;
+  }
+#endif
+  return fwrite(buf, 1, len, file) == len;
+}
+
+bool TraceRecorder::Open(std::string path) {
+  this->path = path;
+
+  if (isGzipPath(path)) {
+#ifdef RBRIDGE_HAVE_ZLIB
+    gzFile = gzopen(path.c_str(), "wb1");
+#else
+    fprintf(stderr, "TraceRecorder: built without zlib, cannot write %s\n", path.c_str());
+    return false;
+#endif
+  } else {
+    file = fopen(path.c_str(), "wb");
+  }
+
+  if (!IsOpen()) {
+    fprintf(stderr, "TraceRecorder: unable to open %s\n", path.c_str());
+    return false;
+  }
+
+  char header[16] = {0};
+  memcpy(header, traceMagic, sizeof(traceMagic));
+  memcpy(header + 8, &traceVersion, sizeof(traceVersion));
+  writeRaw(header, sizeof(header));
+
+  startTime = std::chrono::steady_clock::now();
+  threadClosing = false;
+  writer = std::thread(TraceRecorder::threadMain, this);
+
+  printf("TraceRecorder: recording to %s\n", path.c_str());
+  return true;
+}
+
+void TraceRecorder::Close() {
+  if (!IsOpen()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(bufferMutex);
+    threadClosing = true;
+  }
+  bufferEvent.notify_all();
+  writer.join();
+
+#ifdef RBRIDGE_HAVE_ZLIB
+  if (gzFile != nullptr) {
+    gzclose((::gzFile)gzFile);
+    gzFile = nullptr;
+  }
+#endif
+  if (file != nullptr) {
+    fclose(file);
+    file = nullptr;
+  }
+
+  if (droppedRecords.load() > 0) {
+    fprintf(stderr, "TraceRecorder: %llu records dropped (writer too slow)\n",
+            (unsigned long long)droppedRecords.load());
+  }
+}
+
+void TraceRecorder::Record(TraceRecordType type, uint16_t channel, const char *data, size_t len) {
+  if (!IsOpen()) {
+    return;
+  }
+
+  TraceRecordHeader header;
+  header.length = (uint32_t)len;
+  header.type = type;
+  header.channel = channel;
+  header.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - startTime
+  ).count();
+
+  size_t padding = tracePadding(len);
+  bool wakeWriter;
+  {
+    std::lock_guard<std::mutex> lk(bufferMutex);
+    if (pending.size() + sizeof(header) + len + padding > maxPending) {
+      droppedRecords++;
+      return;
+    }
+
+    const char *headerBytes = (const char *)&header;
+    pending.insert(pending.end(), headerBytes, headerBytes + sizeof(header));
+    pending.insert(pending.end(), data, data + len);
+    pending.insert(pending.end(), padding, '\0');
+    wakeWriter = pending.size() >= flushThreshold;
+  }
+
+  if (wakeWriter) {
+    bufferEvent.notify_one();
+  }
+}
+
+void TraceRecorder::RecordRequest(const RotatorRequest &req, uint16_t channel) {
+  auto payload = TraceEncodeRequest(req);
+  Record(TRACE_SINK_REQUEST, channel, payload.data(), payload.size());
+}
+
+void TraceRecorder::threadMain(TraceRecorder *self) {
+  std::vector<char> writing;
+  bool closing = false;
+
+  while (!closing) {
+    {
+      std::unique_lock<std::mutex> lk(self->bufferMutex);
+      self->bufferEvent.wait_for(lk, std::chrono::milliseconds(self->flushInterval), [self] {
+        return self->threadClosing || self->pending.size() >= self->flushThreshold;
+      });
+
+      closing = self->threadClosing;
+      writing.swap(self->pending);
+    }
+
+    if (!writing.empty()) {
+      if (!self->writeRaw(writing.data(), writing.size())) {
+        fprintf(stderr, "TraceRecorder Thread: write error on %s\n", self->path.c_str());
+      }
+      writing.clear();
+
+      // keep the file readable up to the last flush if the bridge gets killed
+#ifdef RBRIDGE_HAVE_ZLIB
+      if (self->gzFile != nullptr) {
+        gzflush((::gzFile)self->gzFile, Z_SYNC_FLUSH);
+      }
+#endif
+      if (self->file != nullptr) {
+        fflush(self->file);
+      }
+    }
+  }
+}
+
+TraceReader::~TraceReader() {
+  Close();
+}
+
+bool TraceReader::readRaw(char *buf, size_t len) {
+#ifdef RBRIDGE_HAVE_ZLIB
+  if (gzFile != nullptr) {
+    return gzread((::gzFile)gzFile, buf, (unsigned)len) == (int)len;
+  }
+#endif
+  return fread(buf, 1, len, file) == len;
+}
+
+bool TraceReader::Open(std::string path) {
+  if (isGzipPath(path)) {
+#ifdef RBRIDGE_HAVE_ZLIB
+    gzFile = gzopen(path.c_str(), "rb");
+#else
+    fprintf(stderr, "TraceReader: built without zlib, cannot read %s\n", path.c_str());
+    return false;
+#endif
+  } else {
+    file = fopen(path.c_str(), "rb");
+  }
+
+  if (file == nullptr && gzFile == nullptr) {
+    fprintf(stderr, "TraceReader: unable to open %s\n", path.c_str());
+    return false;
+  }
+
+  char header[16];
+  uint32_t version;
+  if (!readRaw(header, sizeof(header)) || memcmp(header, traceMagic, sizeof(traceMagic)) != 0) {
+    fprintf(stderr, "TraceReader: %s is not a trace file\n", path.c_str());
+    Close();
+    return false;
+  }
+
+  memcpy(&version, header + 8, sizeof(version));
+  if (version != traceVersion) {
+    fprintf(stderr, "TraceReader: unsupported trace version %u\n", version);
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void TraceReader::Close() {
+#ifdef RBRIDGE_HAVE_ZLIB
+  if (gzFile != nullptr) {
+    gzclose((::gzFile)gzFile);
+    gzFile = nullptr;
+  }
+#endif
+  if (file != nullptr) {
+    fclose(file);
+    file = nullptr;
+  }
+}
+
+bool TraceReader::Next(TraceRecord &record) {
+  if (!readRaw((char *)&record.header, sizeof(record.header))) {
+    return false;
+  }
+
+  size_t padding = tracePadding(record.header.length);
+  record.payload.resize(record.header.length + padding);
+  if (!readRaw(record.payload.data(), record.payload.size())) {
+    return false;
+  }
+  record.payload.resize(record.header.length);
+
+  return true;
+}
+
+TraceReplayer::Stats TraceReplayer::Replay(
+  std::string path, RotatorController &sink, bool realtime, int timeout_msec, int channel
+) {
+  Stats stats;
+  TraceReader reader;
+  if (!reader.Open(path)) {
+    return stats;
+  }
+
+  TraceRecord record;
+  auto replayStart = std::chrono::steady_clock::now();
+  while (reader.Next(record)) {
+    if (record.header.type != TRACE_SINK_REQUEST || (channel >= 0 && record.header.channel != channel)) {
+      continue;
+    }
+
+    RotatorRequest req;
+    if (!TraceDecodeRequest(record.payload, req)) {
+      stats.skipped++;
+      continue;
+    }
+
+    if (realtime) {
+      std::this_thread::sleep_until(replayStart + std::chrono::nanoseconds(record.header.timestampNs));
+    }
+
+    auto resp = sink.RequestSync(req, timeout_msec);
+    if (resp.has_value() && resp->success) {
+      stats.replayed++;
+    } else {
+      stats.failed++;
+    }
+  }
+
+  return stats;
+}
@@ -0,0 +1,51 @@
+#include "transport/IoBackend.hpp"
+#include "transport/Uring.hpp"
+#include <atomic>
+#include <cstdio>
+
+static std::atomic<IoBackend> currentBackend{IO_BLOCKING};
+
+bool ParseIoBackend(std::string name, IoBackend &backend)
+{
+  if (name == "blocking") {
+    backend = IO_BLOCKING;
+  } else if (name == "epoll") {
+    backend = IO_EPOLL;
+  } else if (name == "uring" || name == "io_uring") {
+    backend = IO_URING;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *IoBackendName(IoBackend backend)
+{
+  switch (backend) {
+  case IO_BLOCKING: return "blocking";
+  case IO_EPOLL: return "epoll";
+  case IO_URING: return "uring";
+  }
+  return "?";
+}
+
+IoBackend SetIoBackend(IoBackend backend)
+{
+  if (backend == IO_URING && !UringQueue::Available()) {
+    fprintf(stderr, "IoBackend: io_uring not available, falling back to epoll\n");
+    backend = IO_EPOLL;
+  }
+#ifndef __linux__
+  if (backend == IO_EPOLL) {
+    fprintf(stderr, "IoBackend: epoll is Linux only, falling back to blocking\n");
+    backend = IO_BLOCKING;
+  }
+#endif
+  currentBackend = backend;
+  return backend;
+}
+
+IoBackend CurrentIoBackend()
+{
+  return currentBackend;
+}
@@ -0,0 +1,450 @@
+#include "transport/Reactor.hpp"
+#include "transport/Uring.hpp"
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+class EpollReactor : public IoReactor {
+private:
+  struct Entry {
+    bool listener;
+    AcceptHandler onAccept;
+    DataHandler onData;
+  };
+
+  int epollFd = -1;
+  int wakeFd = -1;
+  std::map<int, Entry> entries;
+  bool stopping = false;
+  char buf[4096];
+
+  // Post() / Stop() from other threads
+  std::mutex tasksMutex;
+  std::vector<std::function<void()>> tasks;
+  bool stopRequested = false;
+
+  bool add(int fd, Entry entry) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      perror("EpollReactor: epoll_ctl");
+      return false;
+    }
+    entries[fd] = std::move(entry);
+    return true;
+  }
+
+  void ready(int fd) {
+    auto it = entries.find(fd);
+    if (it == entries.end()) {
+      return;
+    }
+
+    if (it->second.listener) {
+      struct sockaddr_in addr;
+      socklen_t addrLen = sizeof(addr);
+      int connFd = accept(fd, (struct sockaddr *)&addr, &addrLen);
+      if (connFd >= 0) {
+        it->second.onAccept(connFd, addr);
+      }
+      return;
+    }
+
+    int ret = recv(fd, buf, sizeof(buf), 0);
+    if (ret > 0) {
+      it->second.onData(buf, ret);
+      return;
+    }
+    if (ret < 0 && (errno == EINTR || errno == EAGAIN)) {
+      return;
+    }
+    DataHandler handler = std::move(it->second.onData);
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    entries.erase(it);
+    handler(nullptr, ret);
+  }
+
+  void wake() {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+      perror("EpollReactor: wake");
+    }
+  }
+
+  void runTasks() {
+    uint64_t count;
+    if (read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+      perror("EpollReactor: wake");
+    }
+    std::vector<std::function<void()>> batch;
+    {
+      std::lock_guard<std::mutex> lk(tasksMutex);
+      batch.swap(tasks);
+      stopping = stopRequested;
+    }
+    for (auto &task : batch) {
+      task();
+    }
+  }
+
+public:
+  bool Init() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd < 0 || wakeFd < 0) {
+      return false;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) == 0;
+  }
+
+  virtual ~EpollReactor() {
+    if (epollFd >= 0) {
+      close(epollFd);
+    }
+    if (wakeFd >= 0) {
+      close(wakeFd);
+    }
+  }
+
+  virtual bool Listen(int fd, AcceptHandler handler) override {
+    return add(fd, Entry{true, handler, nullptr});
+  }
+
+  virtual bool Watch(int fd, DataHandler handler) override {
+    return add(fd, Entry{false, nullptr, handler});
+  }
+
+  virtual void Remove(int fd) override {
+    if (entries.erase(fd) > 0) {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+  }
+
+  virtual void Post(std::function<void()> task) override {
+    {
+      std::lock_guard<std::mutex> lk(tasksMutex);
+      tasks.push_back(std::move(task));
+    }
+    wake();
+  }
+
+  virtual bool Run() override {
+    struct epoll_event events[64];
+    while (!stopping) {
+      int count = epoll_wait(epollFd, events, 64, -1);
+      if (count < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        perror("EpollReactor: epoll_wait");
+        return false;
+      }
+      for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == wakeFd) {
+          runTasks();
+        } else {
+          ready(events[i].data.fd);
+        }
+      }
+    }
+    return true;
+  }
+
+  virtual void Stop() override {
+    {
+      std::lock_guard<std::mutex> lk(tasksMutex);
+      stopRequested = true;
+    }
+    wake();
+  }
+};
+#endif
+
+#ifdef RBRIDGE_HAVE_IO_URING
+// multishot accept and recv: one submission per socket, re-armed only when
+// the kernel ends it; received data lands in a pool of kernel-provided
+// buffers, handed back with the next submission
+class UringReactor : public IoReactor {
+private:
+  struct Entry {
+    int fd;
+    bool listener;
+    AcceptHandler onAccept;
+    DataHandler onData;
+    bool removed = false;  // cancelled, waiting for its last completion
+  };
+
+  // user_data of the wake poll and of cancellations; entries are pointers
+  static const uint64_t wakeData = 0;
+  static const uint64_t cancelData = 1;
+
+  static const unsigned ringEntries = 256;
+  static const uint16_t bufferGroup = 0;
+  static const unsigned bufferCount = 64;
+  static const unsigned bufferSize = 2048;
+
+  UringQueue ring;
+  int wakeFd = -1;
+  std::map<int, std::unique_ptr<Entry>> entries;
+  std::map<Entry *, std::unique_ptr<Entry>> removed;
+  bool stopping = false;
+
+  // Post() / Stop() from other threads
+  std::mutex tasksMutex;
+  std::vector<std::function<void()>> tasks;
+  bool stopRequested = false;
+
+  io_uring_sqe *getSqe() {
+    io_uring_sqe *sqe = ring.GetSqe();
+    if (sqe == nullptr) {
+      // full: hand the queued ones over first
+      ring.Submit();
+      sqe = ring.GetSqe();
+    }
+    return sqe;
+  }
+
+  bool arm(Entry *entry) {
+    io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr) {
+      return false;
+    }
+    sqe->fd = entry->fd;
+    sqe->user_data = reinterpret_cast<uint64_t>(entry);
+    if (entry->listener) {
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    } else {
+      sqe->opcode = IORING_OP_RECV;
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = bufferGroup;
+    }
+    return true;
+  }
+
+  bool add(std::unique_ptr<Entry> entry) {
+    if (!arm(entry.get())) {
+      return false;
+    }
+    entries[entry->fd] = std::move(entry);
+    return true;
+  }
+
+  bool armWake() {
+    io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr) {
+      return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wakeFd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = wakeData;
+    return true;
+  }
+
+  void runTasks() {
+    uint64_t count;
+    if (read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+      perror("UringReactor: wake");
+    }
+    std::vector<std::function<void()>> batch;
+    {
+      std::lock_guard<std::mutex> lk(tasksMutex);
+      batch.swap(tasks);
+      stopping = stopRequested;
+    }
+    for (auto &task : batch) {
+      task();
+    }
+    if (!stopping) {
+      armWake();
+    }
+  }
+
+  void wake() {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+      perror("UringReactor: wake");
+    }
+  }
+
+  // a cancelled entry: no handlers, only its buffers go back
+  void retire(Entry *entry, int res, unsigned flags) {
+    if (entry->listener && res >= 0) {
+      close(res);
+    }
+    if (flags & IORING_CQE_F_BUFFER) {
+      ring.RecycleBuffer(flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+    if (!(flags & IORING_CQE_F_MORE)) {
+      removed.erase(entry);
+    }
+  }
+
+  void complete(Entry *entry, int res, unsigned flags) {
+    bool more = flags & IORING_CQE_F_MORE;
+
+    if (entry->removed) {
+      retire(entry, res, flags);
+      return;
+    }
+
+    if (entry->listener) {
+      if (res >= 0) {
+        struct sockaddr_in addr;
+        socklen_t addrLen = sizeof(addr);
+        memset(&addr, 0, sizeof(addr));
+        getpeername(res, (struct sockaddr *)&addr, &addrLen);
+        entry->onAccept(res, addr);
+      }
+      if (!more && !stopping && res != -EBADF && res != -ECANCELED) {
+        arm(entry);
+      }
+      return;
+    }
+
+    if (flags & IORING_CQE_F_BUFFER) {
+      unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+      if (res > 0) {
+        entry->onData(ring.Buffer(id), res);
+      }
+      ring.RecycleBuffer(id);
+    }
+    if (more) {
+      return;
+    }
+    if (res > 0 || res == -ENOBUFS) {
+      // ended early (buffers ran out); the socket is still open
+      arm(entry);
+      return;
+    }
+
+    DataHandler handler = std::move(entry->onData);
+    entries.erase(entry->fd);
+    handler(nullptr, res);
+  }
+
+public:
+  bool Init() {
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd < 0 || !ring.Init(ringEntries)) {
+      return false;
+    }
+    if (!ring.ProvideBuffers(bufferGroup, bufferCount, bufferSize)) {
+      return false;
+    }
+    return armWake();
+  }
+
+  virtual ~UringReactor() {
+    if (wakeFd >= 0) {
+      close(wakeFd);
+    }
+  }
+
+  virtual bool Listen(int fd, AcceptHandler handler) override {
+    return add(std::unique_ptr<Entry>(new Entry{fd, true, handler, nullptr}));
+  }
+
+  virtual bool Watch(int fd, DataHandler handler) override {
+    return add(std::unique_ptr<Entry>(new Entry{fd, false, nullptr, handler}));
+  }
+
+  virtual void Remove(int fd) override {
+    auto it = entries.find(fd);
+    if (it == entries.end()) {
+      return;
+    }
+    Entry *entry = it->second.get();
+    io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr) {
+      // cannot cancel: still drop the handlers
+      entry->onAccept = nullptr;
+      entry->onData = nullptr;
+    } else {
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->addr = reinterpret_cast<uint64_t>(entry);
+      sqe->user_data = cancelData;
+    }
+    entry->removed = true;
+    removed[entry] = std::move(it->second);
+    entries.erase(it);
+  }
+
+  virtual void Post(std::function<void()> task) override {
+    {
+      std::lock_guard<std::mutex> lk(tasksMutex);
+      tasks.push_back(std::move(task));
+    }
+    wake();
+  }
+
+  virtual bool Run() override {
+    while (!stopping) {
+      int ret = ring.Submit(1);
+      if (ret < 0) {
+        fprintf(stderr, "UringReactor: io_uring_enter: %s\n", strerror(-ret));
+        return false;
+      }
+      while (io_uring_cqe *cqe = ring.PeekCqe()) {
+        uint64_t userData = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        ring.SeenCqe();
+
+        if (userData == wakeData) {
+          runTasks();
+        } else if (userData != cancelData) {
+          complete(reinterpret_cast<Entry *>(userData), res, flags);
+        }
+      }
+    }
+    return true;
+  }
+
+  virtual void Stop() override {
+    {
+      std::lock_guard<std::mutex> lk(tasksMutex);
+      stopRequested = true;
+    }
+    wake();
+  }
+};
+#endif
+
+std::unique_ptr<IoReactor> IoReactor::Create(IoBackend backend)
+{
+#ifdef RBRIDGE_HAVE_IO_URING
+  if (backend == IO_URING) {
+    auto reactor = std::make_unique<UringReactor>();
+    if (reactor->Init()) {
+      return reactor;
+    }
+    fprintf(stderr, "IoReactor: io_uring setup failed, using epoll\n");
+    backend = IO_EPOLL;
+  }
+#endif
+#ifdef __linux__
+  if (backend == IO_EPOLL || backend == IO_URING) {
+    auto reactor = std::make_unique<EpollReactor>();
+    if (reactor->Init()) {
+      return reactor;
+    }
+    fprintf(stderr, "IoReactor: epoll setup failed\n");
+  }
+#endif
+  return nullptr;
+}
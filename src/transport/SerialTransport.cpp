@@ -0,0 +1,186 @@
+#include "transport/SerialTransport.hpp"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <cerrno>
+#endif
+
+SerialTransport::SerialTransport(std::string device, int baud, int frameSize, double frameGap, int recvTimeout)
+  : device(device), baud(baud), frameSize(frameSize), frameGap(frameGap), recvTimeout(recvTimeout)
+{
+}
+
+double SerialTransport::charTime() const
+{
+  return 10.0 / baud;
+}
+
+std::string SerialTransport::Describe() const
+{
+  return "serial://" + device + "@" + std::to_string(baud);
+}
+
+#ifndef WIN32
+
+static speed_t baudConstant(int baud)
+{
+  switch (baud) {
+  case 1200: return B1200;
+  case 2400: return B2400;
+  case 4800: return B4800;
+  case 9600: return B9600;
+  case 19200: return B19200;
+  case 38400: return B38400;
+  case 57600: return B57600;
+  case 115200: return B115200;
+  default: return 0;
+  }
+}
+
+bool SerialTransport::Open()
+{
+  speed_t speed = baudConstant(baud);
+  if (speed == 0) {
+    fprintf(stderr, "SerialTransport: unsupported baud rate %d\n", baud);
+    return false;
+  }
+
+  fd = open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    perror("Error opening serial port");
+    return false;
+  }
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) < 0) {
+    perror("Error reading serial port attributes");
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  // raw 8N1, no flow control
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  tio.c_iflag &= ~(IXON | IXOFF | IXANY);
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+    perror("Error configuring serial port");
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  tcflush(fd, TCIOFLUSH);
+
+  lineIdleAt = std::chrono::steady_clock::now();
+  return true;
+}
+
+void SerialTransport::Close()
+{
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+// for poll(): what is left of deadline (ms), 0 once it has passed
+static int msUntil(std::chrono::steady_clock::time_point deadline)
+{
+  auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+  return left.count() > 0 ? (int)left.count() : 0;
+}
+
+int SerialTransport::writeAll(const char *buf, size_t buflen)
+{
+  // the whole buffer within recvTimeout, however the UART takes it
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(recvTimeout);
+  size_t written = 0;
+  while (written < buflen) {
+    int ret = write(fd, buf + written, buflen - written);
+    if (ret < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return -1;
+      }
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      if (poll(&pfd, 1, msUntil(deadline)) <= 0) {
+        return -1;
+      }
+      continue;
+    }
+    written += ret;
+  }
+
+  // the UART drains the bytes behind our back; remember when it is done
+  auto now = std::chrono::steady_clock::now();
+  auto start = (std::max)(now, lineIdleAt);
+  lineIdleAt = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(charTime() * buflen)
+  );
+  return (int)written;
+}
+
+int SerialTransport::Send(const char *buf, size_t buflen)
+{
+  if (frameGap <= 0 || frameSize <= 0) {
+    return writeAll(buf, buflen);
+  }
+
+  // paced: one frame at a time, each after the line has been idle for the gap
+  auto gap = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(charTime() * frameGap)
+  );
+  for (size_t offset = 0; offset < buflen; offset += frameSize) {
+    std::this_thread::sleep_until(lineIdleAt + gap);
+    size_t len = (std::min)((size_t)frameSize, buflen - offset);
+    if (writeAll(buf + offset, len) < 0) {
+      return -1;
+    }
+  }
+  return (int)buflen;
+}
+
+int SerialTransport::Recv(char *buf, size_t buflen)
+{
+  // one deadline for the frame: a line trickling in byte by byte does not
+  // extend it
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(recvTimeout);
+  size_t got = 0;
+  while (got < buflen) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, msUntil(deadline));
+    if (ready <= 0) {
+      fprintf(stderr, "SerialTransport: %s reply from device within %d ms\n", got > 0 ? "incomplete" : "no", recvTimeout);
+      return -1;
+    }
+
+    int ret = read(fd, buf + got, buflen - got);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      continue;
+    }
+    if (ret <= 0) {
+      return -1;
+    }
+    got += ret;
+  }
+  return (int)got;
+}
+
+#else
+
+bool SerialTransport::Open()
+{
+  fprintf(stderr, "SerialTransport: serial ports are not supported on Windows yet\n");
+  return false;
+}
+
+void SerialTransport::Close() {}
+int SerialTransport::writeAll(const char *buf, size_t buflen) { return -1; }
+int SerialTransport::Send(const char *buf, size_t buflen) { return -1; }
+int SerialTransport::Recv(char *buf, size_t buflen) { return -1; }
+
+#endif
@@ -0,0 +1,258 @@
+#include "transport/ShmChannel.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// a writer preempted mid-update holds readers off for this many tries
+static const int readAttempts = 10000;
+
+static int64_t nanoseconds(double unixTime)
+{
+  return (int64_t)std::llround(unixTime * 1e9);
+}
+
+static double axisDistance(int axis, double from, double to)
+{
+  double delta = std::fabs(to - from);
+  if (axis == 0) {
+    // azimuth wraps around
+    delta = std::fmod(delta, 360);
+    delta = (std::min)(delta, 360 - delta);
+  }
+  return delta;
+}
+
+#ifndef WIN32
+
+static ShmSegment *mapSegment(int fd)
+{
+  void *addr = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return addr == MAP_FAILED ? nullptr : static_cast<ShmSegment *>(addr);
+}
+
+std::shared_ptr<ShmChannel> ShmChannel::Create(const std::string &name)
+{
+  // one mapping per name in the process, for one writer lock
+  static std::mutex registryMutex;
+  static std::map<std::string, std::weak_ptr<ShmChannel>> registry;
+  std::lock_guard<std::mutex> lk(registryMutex);
+  if (auto existing = registry[name].lock()) {
+    return existing;
+  }
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0660);
+  if (fd < 0) {
+    fprintf(stderr, "ShmChannel: shm_open %s: %s\n", name.c_str(), strerror(errno));
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ShmSegment)) {
+    // left over by a bridge that did not unlink it, or still served
+    ShmSegment *old = mapSegment(fd);
+    if (old != nullptr) {
+      bool live = old->magic == ShmSegment::Magic && old->bridgePid != getpid() && old->bridgePid > 0 &&
+                  kill(old->bridgePid, 0) == 0;
+      int pid = old->bridgePid;
+      munmap(old, sizeof(ShmSegment));
+      if (live) {
+        fprintf(stderr, "ShmChannel: %s is served by bridge pid %d\n", name.c_str(), pid);
+        close(fd);
+        return nullptr;
+      }
+    }
+  }
+  if (ftruncate(fd, sizeof(ShmSegment)) != 0) {
+    fprintf(stderr, "ShmChannel: ftruncate %s: %s\n", name.c_str(), strerror(errno));
+    close(fd);
+    return nullptr;
+  }
+  ShmSegment *segment = mapSegment(fd);
+  close(fd);
+  if (segment == nullptr) {
+    fprintf(stderr, "ShmChannel: mmap %s: %s\n", name.c_str(), strerror(errno));
+    return nullptr;
+  }
+
+  // the header last: consumers attaching meanwhile see no magic yet
+  memset(static_cast<void *>(segment), 0, sizeof(ShmSegment));
+  segment->version = ShmSegment::Version;
+  segment->size = sizeof(ShmSegment);
+  segment->bridgePid = getpid();
+  std::atomic_thread_fence(std::memory_order_release);
+  segment->magic = ShmSegment::Magic;
+
+  auto channel = std::shared_ptr<ShmChannel>(new ShmChannel());
+  channel->name = name;
+  channel->segment = segment;
+  channel->owner = true;
+  registry[name] = channel;
+  printf("ShmChannel: serving %s\n", name.c_str());
+  return channel;
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Attach(const std::string &name)
+{
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ShmSegment)) {
+    close(fd);
+    return nullptr;
+  }
+  ShmSegment *segment = mapSegment(fd);
+  close(fd);
+  if (segment == nullptr) {
+    return nullptr;
+  }
+  if (segment->magic != ShmSegment::Magic || segment->version != ShmSegment::Version ||
+      segment->size != sizeof(ShmSegment)) {
+    munmap(segment, sizeof(ShmSegment));
+    return nullptr;
+  }
+
+  auto channel = std::unique_ptr<ShmChannel>(new ShmChannel());
+  channel->name = name;
+  channel->segment = segment;
+  return channel;
+}
+
+ShmChannel::~ShmChannel()
+{
+  if (segment == nullptr) {
+    return;
+  }
+  if (owner) {
+    segment->bridgePid = 0;
+    shm_unlink(name.c_str());
+  }
+  munmap(segment, sizeof(ShmSegment));
+}
+
+#else
+
+std::shared_ptr<ShmChannel> ShmChannel::Create(const std::string &name)
+{
+  fprintf(stderr, "ShmChannel: shared memory channels need POSIX shared memory\n");
+  return nullptr;
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Attach(const std::string &name)
+{
+  return nullptr;
+}
+
+ShmChannel::~ShmChannel()
+{
+}
+
+#endif
+
+void ShmChannel::publish()
+{
+  // seqlock: odd while the record is rewritten
+  uint64_t seq = segment->telemetrySeq.load(std::memory_order_relaxed);
+  segment->telemetrySeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&segment->telemetry, &shadow, sizeof(shadow));
+  segment->telemetrySeq.store(seq + 2, std::memory_order_release);
+}
+
+void ShmChannel::PublishPosition(bool valid, double azi, double ele, double unixTime)
+{
+  std::lock_guard<std::mutex> lk(writerMutex);
+  if (valid) {
+    shadow.flags |= SHM_POSITION_VALID;
+    shadow.azi = azi;
+    shadow.ele = ele;
+    shadow.positionTime = nanoseconds(unixTime);
+    bool moving = (shadow.flags & SHM_TARGET_VALID) &&
+                  (axisDistance(0, azi, shadow.targetAzi) > settleTolerance ||
+                   axisDistance(1, ele, shadow.targetEle) > settleTolerance);
+    shadow.state = moving ? SHM_MOVING : SHM_IDLE;
+  } else {
+    shadow.state = SHM_FAULT;
+  }
+  shadow.updateTime = nanoseconds(unixTime);
+  publish();
+}
+
+void ShmChannel::PublishTarget(int axis, double value, double unixTime)
+{
+  std::lock_guard<std::mutex> lk(writerMutex);
+  if (!(shadow.flags & SHM_TARGET_VALID)) {
+    // the other axis stays where the head is
+    shadow.targetAzi = shadow.azi;
+    shadow.targetEle = shadow.ele;
+  }
+  shadow.flags |= SHM_TARGET_VALID;
+  (axis == 0 ? shadow.targetAzi : shadow.targetEle) = value;
+  shadow.targetTime = nanoseconds(unixTime);
+  shadow.updateTime = shadow.targetTime;
+  if (shadow.state != SHM_FAULT && (shadow.flags & SHM_POSITION_VALID) &&
+      axisDistance(axis, axis == 0 ? shadow.azi : shadow.ele, value) > settleTolerance) {
+    shadow.state = SHM_MOVING;
+  }
+  publish();
+}
+
+void ShmChannel::PublishCommandDone(uint64_t seq, bool success, double unixTime)
+{
+  std::lock_guard<std::mutex> lk(writerMutex);
+  shadow.commandDone = seq;
+  shadow.commandResult = success ? 0 : -1;
+  if (!success) {
+    shadow.state = SHM_FAULT;
+  }
+  shadow.updateTime = nanoseconds(unixTime);
+  publish();
+}
+
+std::optional<ShmCommand> ShmChannel::Pop()
+{
+  uint64_t tail = segment->ringTail.load(std::memory_order_relaxed);
+  if (tail == segment->ringHead.load(std::memory_order_acquire)) {
+    return {};
+  }
+  ShmCommand command = segment->ring[tail % ShmSegment::RingSize];
+  segment->ringTail.store(tail + 1, std::memory_order_release);
+  return command;
+}
+
+bool ShmChannel::Read(ShmTelemetry &telemetry) const
+{
+  for (int i = 0; i < readAttempts; i++) {
+    uint64_t before = segment->telemetrySeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    memcpy(&telemetry, &segment->telemetry, sizeof(telemetry));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (segment->telemetrySeq.load(std::memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t ShmChannel::Push(ShmCommand command)
+{
+  uint64_t head = segment->ringHead.load(std::memory_order_relaxed);
+  if (head - segment->ringTail.load(std::memory_order_acquire) >= ShmSegment::RingSize) {
+    return 0;
+  }
+  command.seq = head + 1;
+  segment->ring[head % ShmSegment::RingSize] = command;
+  segment->ringHead.store(head + 1, std::memory_order_release);
+  return command.seq;
+}
@@ -0,0 +1,246 @@
+#include "transport/SimPTZ.hpp"
+#include <cmath>
+
+SimPTZ::SimPTZ(Params params, std::string name)
+  : params(params), name(name)
+{
+  pan.pos = pan.target = params.initialPan;
+  tilt.pos = tilt.target = params.initialTilt;
+}
+
+bool SimPTZ::Open()
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  lastUpdate = clock->Now();
+  printf("SimPTZ: %s ready (pan %.1f deg/s, tilt %.1f deg/s, restart %.2f s)\n",
+         name.c_str(), params.panSpeed, params.tiltSpeed, params.restartDelay);
+  return true;
+}
+
+void SimPTZ::Close()
+{
+}
+
+void SimPTZ::SetClock(Clock *clock)
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  this->clock = clock;
+  lastUpdate = clock->Now();
+}
+
+std::string SimPTZ::Describe() const
+{
+  return "sim://" + name;
+}
+
+void SimPTZ::advanceAxis(Axis &axis, double dt, Clock::TimePoint now, bool wrap)
+{
+  if (axis.velocity != 0) {
+    axis.pos += axis.velocity * dt;
+  } else if (axis.moving) {
+    // part of dt may still be in the motor restart
+    double active = dt;
+    if (now < axis.startAt) {
+      return;
+    }
+    active = (std::min)(dt, std::chrono::duration<double>(now - axis.startAt).count());
+
+    double delta = axis.target - axis.pos;
+    if (wrap) {
+      // continuous pan takes the short way
+      delta = std::fmod(delta + 540.0, 360.0) - 180.0;
+    }
+    double step = axis.speedLimit * active;
+    if (std::abs(delta) <= step) {
+      axis.pos += delta;
+      axis.moving = false;
+    } else {
+      axis.pos += delta > 0 ? step : -step;
+    }
+  }
+
+  if (wrap) {
+    axis.pos = std::fmod(axis.pos + 360.0, 360.0);
+  }
+}
+
+void SimPTZ::advance(Clock::TimePoint now)
+{
+  double dt = std::chrono::duration<double>(now - lastUpdate).count();
+  if (dt <= 0) {
+    return;
+  }
+  lastUpdate = now;
+
+  advanceAxis(pan, dt, now, params.panContinuous);
+  advanceAxis(tilt, dt, now, false);
+
+  // end stops
+  if (!params.panContinuous) {
+    pan.pos = (std::max)(0.0, (std::min)(359.99, pan.pos));
+  }
+  tilt.pos = (std::max)(params.tiltMin, (std::min)(180.0, tilt.pos));
+}
+
+void SimPTZ::startMove(Axis &axis, double target, double speed, Clock::TimePoint now)
+{
+  // the 3025 stops its motor on every absolute command
+  axis.velocity = 0;
+  axis.target = target;
+  axis.moving = true;
+  axis.speedLimit = speed;
+  axis.startAt = now + std::chrono::duration_cast<Clock::Duration>(
+    std::chrono::duration<double>(params.restartDelay)
+  );
+  motorRestarts++;
+}
+
+void SimPTZ::queueReply(unsigned char cmd2, double value)
+{
+  int raw = (int)std::lround(value * 100);
+  unsigned char reply[7] = {0xFF, 0x00, 0x00, cmd2, (unsigned char)(raw / 256), (unsigned char)(raw % 256), 0};
+  reply[6] = (unsigned char)(reply[1] + reply[2] + reply[3] + reply[4] + reply[5]);
+  txQueue.insert(txQueue.end(), reply, reply + sizeof(reply));
+}
+
+void SimPTZ::handleFrame(const unsigned char *frame)
+{
+  auto now = lastUpdate;
+  unsigned char cmd1 = frame[2], cmd2 = frame[3], data1 = frame[4], data2 = frame[5];
+  framesReceived++;
+
+  if (cmd1 != 0) {
+    return;
+  }
+
+  switch (cmd2) {
+  case 0x4B:
+    startMove(pan, (data1 * 256 + data2) / 100.0, params.panSpeed, now);
+    return;
+  case 0x4D: {
+    double value = (data1 * 256 + data2) / 100.0;
+    startMove(tilt, value > 270 ? value - 360 : value, params.tiltSpeed, now);
+    return;
+  }
+  case 0x51:
+    queriesReceived++;
+    queueReply(0x59, pan.pos);
+    return;
+  case 0x53:
+    queriesReceived++;
+    queueReply(0x5B, tilt.pos < 0 ? tilt.pos + 360 : tilt.pos);
+    return;
+  case 0x03:
+    presets[data2] = std::make_pair(pan.pos, tilt.pos);
+    return;
+  case 0x05:
+    presets.erase(data2);
+    return;
+  case 0x07: {
+    auto it = presets.find(data2);
+    if (it != presets.end()) {
+      startMove(pan, it->second.first, params.presetSpeed, now);
+      startMove(tilt, it->second.second, params.presetSpeed, now);
+    }
+    return;
+  }
+  case 0x0F:
+    // remote reset
+    pan.moving = tilt.moving = false;
+    pan.velocity = tilt.velocity = 0;
+    return;
+  default:
+    break;
+  }
+
+  if ((cmd2 & 0x01) == 0 && (cmd2 & ~0x1E) == 0) {
+    // pan/tilt speed command; all zero is stop
+    pan.moving = tilt.moving = false;
+    pan.velocity = 0;
+    tilt.velocity = 0;
+    if (cmd2 & 0x02) {
+      pan.velocity = params.panSpeed * data1 / 0x3F;
+    } else if (cmd2 & 0x04) {
+      pan.velocity = -params.panSpeed * data1 / 0x3F;
+    }
+    // tilt device value counts down from the horizon towards the zenith
+    if (cmd2 & 0x08) {
+      tilt.velocity = -params.tiltSpeed * data2 / 0x3F;
+    } else if (cmd2 & 0x10) {
+      tilt.velocity = params.tiltSpeed * data2 / 0x3F;
+    }
+  }
+}
+
+int SimPTZ::Send(const char *buf, size_t buflen)
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  advance(clock->Now());
+
+  rxPartial.append(buf, buflen);
+  while (true) {
+    // resynchronise on the 0xFF sync byte
+    size_t sync = rxPartial.find('\xFF');
+    if (sync == std::string::npos) {
+      rxPartial.clear();
+      break;
+    }
+    rxPartial.erase(0, sync);
+    if (rxPartial.size() < 7) {
+      break;
+    }
+
+    const unsigned char *frame = (const unsigned char *)rxPartial.data();
+    unsigned char checksum = (unsigned char)(frame[1] + frame[2] + frame[3] + frame[4] + frame[5]);
+    if (checksum == frame[6]) {
+      handleFrame(frame);
+    } else {
+      fprintf(stderr, "SimPTZ: %s dropped frame with bad checksum\n", name.c_str());
+    }
+    rxPartial.erase(0, 7);
+  }
+
+  return (int)buflen;
+}
+
+int SimPTZ::Recv(char *buf, size_t buflen)
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  if (txQueue.size() < buflen) {
+    // a real device would leave us waiting forever
+    fprintf(stderr, "SimPTZ: %s has no reply pending\n", name.c_str());
+    return -1;
+  }
+
+  for (size_t i = 0; i < buflen; i++) {
+    buf[i] = txQueue.front();
+    txQueue.pop_front();
+  }
+  return (int)buflen;
+}
+
+void SimPTZ::GetPosition(double &panPos, double &tiltPos)
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  advance(clock->Now());
+  panPos = pan.pos;
+  tiltPos = tilt.pos;
+}
+
+uint64_t SimPTZ::FramesReceived() const
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  return framesReceived;
+}
+
+uint64_t SimPTZ::MotorRestarts() const
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  return motorRestarts;
+}
+
+uint64_t SimPTZ::QueriesReceived() const
+{
+  std::lock_guard<std::mutex> lk(stateMutex);
+  return queriesReceived;
+}
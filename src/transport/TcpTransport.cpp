@@ -0,0 +1,294 @@
+#include "transport/TcpTransport.hpp"
+#include "transport/IoBackend.hpp"
+#include <cerrno>
+#include <cstring>
+
+TcpTransport::TcpTransport(std::string tcpHost, int tcpPort)
+  : tcpHost(tcpHost), tcpPort(tcpPort)
+{
+}
+
+bool TcpTransport::Open()
+{
+  int status;
+
+  sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (sock == -1) {
+    SOCKET_PRINT_ERROR("Error creating socket");
+    return false;
+  }
+
+  struct sockaddr_in hostAddr;
+  hostAddr.sin_family = AF_INET;
+  struct hostent *h = gethostbyname(tcpHost.c_str());
+  if (h == nullptr) {
+    fprintf(stderr, "Error during gethostbyname()\n");
+    CLOSE_SOCKET(sock);
+    return false;
+  }
+
+  memcpy((char *)&hostAddr.sin_addr.s_addr, h->h_addr_list[0], h->h_length);
+  hostAddr.sin_port = htons(tcpPort);
+
+  status = connect(sock, (struct sockaddr *)&hostAddr, sizeof(hostAddr));
+  if (status == -1) {
+    SOCKET_PRINT_ERROR("Error connecting to target");
+    CLOSE_SOCKET(sock);
+    return false;
+  }
+
+  SetIoTimeout(ioTimeout);
+
+  if (CurrentIoBackend() == IO_URING) {
+    std::lock_guard<std::mutex> lk(ringMutex);
+    ring = std::make_unique<UringQueue>();
+    if (!ring->Init(8) || ring->RegisterFiles(&sock, 1) < 0) {
+      fprintf(stderr, "TcpTransport: io_uring setup failed, using blocking I/O\n");
+      ring.reset();
+    }
+  }
+
+  return true;
+}
+
+void TcpTransport::Close()
+{
+  {
+    std::lock_guard<std::mutex> lk(ringMutex);
+    ring.reset();
+  }
+  std::lock_guard<std::mutex> lk(sockMutex);
+  if (sock >= 0) {
+    CLOSE_SOCKET(sock);
+    sock = -1;
+  }
+}
+
+void TcpTransport::SetIoTimeout(int timeout)
+{
+  ioTimeout = timeout;
+  if (sock < 0) {
+    return;
+  }
+
+  // blocking path: no call waits longer than this; recvWithin() keeps the
+  // whole frame within it
+#ifdef WIN32
+  DWORD tv = timeout;
+#else
+  struct timeval tv = {timeout / 1000, (timeout % 1000) * 1000};
+#endif
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof(tv));
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char *)&tv, sizeof(tv));
+}
+
+int TcpTransport::recvWithin(char *buf, size_t buflen)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ioTimeout);
+  size_t got = 0;
+  while (got < buflen) {
+    int ret = recv(sock, buf + got, buflen - got, 0);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      fprintf(stderr, "TcpTransport: no reply from %s within %d ms\n", Describe().c_str(), ioTimeout);
+      return -1;
+    }
+    if (ret <= 0) {
+      return -1;
+    }
+    got += ret;
+    if (got < buflen && std::chrono::steady_clock::now() >= deadline) {
+      // a trickle does not extend it
+      fprintf(stderr, "TcpTransport: incomplete reply from %s within %d ms\n", Describe().c_str(), ioTimeout);
+      return -1;
+    }
+  }
+  return (int)got;
+}
+
+#ifdef RBRIDGE_HAVE_IO_URING
+int TcpTransport::uringTransfer(const char *tx, size_t txlen, char *rx, size_t rxlen)
+{
+  enum { TAG_SEND = 1, TAG_RECV = 2, TAG_TIMEOUT = 3 };
+  size_t sent = 0, received = 0;
+  struct __kernel_timespec timeout = {ioTimeout / 1000, (long long)(ioTimeout % 1000) * 1000000};
+  bool timedOut = false;
+
+  // cancels the operation before it if it does not complete in time: a
+  // receive from a device that does not answer, or a send to a peer that
+  // stopped reading; further links run after it
+  auto linkTimeout = [&](bool more) {
+    io_uring_sqe *sqe = ring->GetSqe();
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->flags = more ? IOSQE_IO_LINK : 0;
+    sqe->addr = reinterpret_cast<uint64_t>(&timeout);
+    sqe->len = 1;
+    sqe->user_data = TAG_TIMEOUT;
+  };
+
+  while (sent < txlen || received < rxlen) {
+    unsigned queued = 0;
+    if (sent < txlen) {
+      io_uring_sqe *sqe = ring->GetSqe();
+      sqe->opcode = IORING_OP_SEND;
+      sqe->fd = 0;  // registered index
+      sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+      sqe->addr = reinterpret_cast<uint64_t>(tx + sent);
+      sqe->len = txlen - sent;
+      sqe->msg_flags = MSG_NOSIGNAL;
+      sqe->user_data = TAG_SEND;
+      linkTimeout(received < rxlen);
+      queued += 2;
+    }
+    if (received < rxlen) {
+      io_uring_sqe *sqe = ring->GetSqe();
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = 0;
+      sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+      sqe->addr = reinterpret_cast<uint64_t>(rx + received);
+      sqe->len = rxlen - received;
+      sqe->msg_flags = MSG_WAITALL;
+      sqe->user_data = TAG_RECV;
+      linkTimeout(false);
+      queued += 2;
+    }
+    if (ring->Submit(queued) < 0) {
+      return -1;
+    }
+
+    bool error = false;
+    for (unsigned done = 0; done < queued;) {
+      io_uring_cqe *cqe = ring->PeekCqe();
+      if (cqe == nullptr) {
+        if (ring->Submit(1) < 0) {
+          return -1;
+        }
+        continue;
+      }
+      int res = cqe->res;
+      uint64_t tag = cqe->user_data;
+      ring->SeenCqe();
+      done++;
+
+      if (tag == TAG_TIMEOUT) {
+        timedOut = timedOut || res == -ETIME;
+        continue;
+      }
+      if (res == -ECANCELED) {
+        // a short send broke the link (the recv goes again next round), or
+        // the timeout fired
+        continue;
+      }
+      if (res < 0 || (tag == TAG_RECV && res == 0)) {
+        error = true;
+      } else if (tag == TAG_SEND) {
+        sent += res;
+      } else {
+        received += res;
+      }
+    }
+    if (timedOut) {
+      fprintf(stderr, "TcpTransport: %s %s within %d ms\n", sent < txlen ? "send stalled to" : "no reply from",
+              Describe().c_str(), ioTimeout);
+      return -1;
+    }
+    if (error) {
+      return -1;
+    }
+  }
+  return (int)(rxlen > 0 ? received : sent);
+}
+#else
+int TcpTransport::uringTransfer(const char *, size_t, char *, size_t)
+{
+  return -1;
+}
+#endif
+
+int TcpTransport::Send(const char *buf, size_t buflen)
+{
+  if (ring) {
+    std::lock_guard<std::mutex> lk(ringMutex);
+    return uringTransfer(buf, buflen, nullptr, 0);
+  }
+  return send_fixed(sock, buf, buflen, 0);
+}
+
+int TcpTransport::Recv(char *buf, size_t buflen)
+{
+  if (ring) {
+    std::lock_guard<std::mutex> lk(ringMutex);
+    return uringTransfer(nullptr, 0, buf, buflen);
+  }
+  return recvWithin(buf, buflen);
+}
+
+int TcpTransport::Transact(const char *tx, size_t txlen, char *rx, size_t rxlen)
+{
+  if (ring) {
+    std::lock_guard<std::mutex> lk(ringMutex);
+    return uringTransfer(tx, txlen, rx, rxlen);
+  }
+  if (txlen > 0 && send_fixed(sock, tx, txlen, 0) == -1) {
+    return -1;
+  }
+  return recvWithin(rx, rxlen);
+}
+
+int TcpTransport::RecvSome(char *buf, size_t buflen)
+{
+  // waits for the peer as long as it takes; the I/O timeout is for frames
+  while (true) {
+    int ret = recv(sock, buf, buflen, 0);
+    if (ret >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      return ret;
+    }
+  }
+}
+
+int TcpTransport::RecvSomeUntil(char *buf, size_t buflen, std::chrono::steady_clock::time_point deadline)
+{
+  while (true) {
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0) {
+      return -1;
+    }
+    fd_set readFds;
+    FD_ZERO(&readFds);
+    FD_SET(sock, &readFds);
+    struct timeval tv = {(long)(left.count() / 1000000), (long)(left.count() % 1000000)};
+    int ready = select(sock + 1, &readFds, nullptr, nullptr, &tv);
+    if (ready < 0 && errno != EINTR) {
+      return -1;
+    }
+    if (ready <= 0) {
+      continue;
+    }
+    int ret = recv(sock, buf, buflen, 0);
+    if (ret >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      return ret;
+    }
+  }
+}
+
+void TcpTransport::Shutdown()
+{
+  std::lock_guard<std::mutex> lk(sockMutex);
+  if (sock >= 0) {
+    shutdown(sock, 2);
+  }
+}
+
+void TcpTransport::Abort()
+{
+  // the blocked recv sees the end of the stream
+  Shutdown();
+}
+
+std::string TcpTransport::Describe() const
+{
+  return "tcp://" + tcpHost + ":" + std::to_string(tcpPort);
+}
@@ -0,0 +1,264 @@
+#include "transport/Uring.hpp"
+
+#ifdef RBRIDGE_HAVE_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int uringSetup(unsigned entries, io_uring_params *params)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+  return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int uringRegister(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+// failed buffer hand-backs, consumed in PeekCqe()
+static const uint64_t provideTag = ~0ULL;
+
+template<typename T>
+static T *at(void *base, unsigned offset)
+{
+  return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+
+UringQueue::~UringQueue()
+{
+  free(bufBase);
+  if (sqeMap != nullptr) {
+    munmap(sqeMap, sqeMapSize);
+  }
+  if (cqMap != nullptr && cqMap != sqMap) {
+    munmap(cqMap, cqMapSize);
+  }
+  if (sqMap != nullptr) {
+    munmap(sqMap, sqMapSize);
+  }
+  if (ringFd >= 0) {
+    close(ringFd);
+  }
+}
+
+bool UringQueue::Available()
+{
+  static const bool available = [] {
+    UringQueue probe;
+    return probe.Init(2);
+  }();
+  return available;
+}
+
+bool UringQueue::Init(unsigned entries)
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ringFd = uringSetup(entries, &params);
+  if (ringFd < 0) {
+    return false;
+  }
+
+  sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    sqMapSize = cqMapSize = (std::max)(sqMapSize, cqMapSize);
+  }
+
+  sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  if (sqMap == MAP_FAILED) {
+    sqMap = nullptr;
+    return false;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cqMap = sqMap;
+  } else {
+    cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqMap == MAP_FAILED) {
+      cqMap = nullptr;
+      return false;
+    }
+  }
+  sqeMapSize = params.sq_entries * sizeof(io_uring_sqe);
+  sqeMap = mmap(nullptr, sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+  if (sqeMap == MAP_FAILED) {
+    sqeMap = nullptr;
+    return false;
+  }
+
+  sqHead = at<unsigned>(sqMap, params.sq_off.head);
+  sqTail = at<unsigned>(sqMap, params.sq_off.tail);
+  sqMask = at<unsigned>(sqMap, params.sq_off.ring_mask);
+  sqArray = at<unsigned>(sqMap, params.sq_off.array);
+  cqHead = at<unsigned>(cqMap, params.cq_off.head);
+  cqTail = at<unsigned>(cqMap, params.cq_off.tail);
+  cqMask = at<unsigned>(cqMap, params.cq_off.ring_mask);
+  sqes = static_cast<io_uring_sqe *>(sqeMap);
+  cqes = at<io_uring_cqe>(cqMap, params.cq_off.cqes);
+
+  // identity index array: entry i lives in sqes[i]
+  for (unsigned i = 0; i <= *sqMask; i++) {
+    sqArray[i] = i;
+  }
+  sqLocalTail = *sqTail;
+  return true;
+}
+
+io_uring_sqe *UringQueue::GetSqe()
+{
+  unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+  if (sqLocalTail - head > *sqMask) {
+    return nullptr;
+  }
+  io_uring_sqe *sqe = &sqes[sqLocalTail & *sqMask];
+  memset(sqe, 0, sizeof(*sqe));
+  sqLocalTail++;
+  toSubmit++;
+  return sqe;
+}
+
+int UringQueue::Submit(unsigned waitFor)
+{
+  __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+  unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+  // may return before waitFor completions are in (a signal after submitting)
+  while (true) {
+    enters++;
+    int ret = uringEnter(ringFd, toSubmit, waitFor, flags);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret < 0) {
+      return -errno;
+    }
+    toSubmit -= (std::min)((unsigned)ret, toSubmit);
+    return ret;
+  }
+}
+
+io_uring_cqe *UringQueue::PeekCqe()
+{
+  while (true) {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+      return nullptr;
+    }
+    io_uring_cqe *cqe = &cqes[head & *cqMask];
+    if (cqe->user_data != provideTag) {
+      return cqe;
+    }
+    SeenCqe();
+  }
+}
+
+void UringQueue::SeenCqe()
+{
+  __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
+
+int UringQueue::RegisterFiles(const int *fds, unsigned count)
+{
+  int ret = uringRegister(ringFd, IORING_REGISTER_FILES, fds, count);
+  return ret < 0 ? -errno : ret;
+}
+
+bool UringQueue::queueProvide(unsigned first, unsigned count)
+{
+  io_uring_sqe *sqe = GetSqe();
+  if (sqe == nullptr) {
+    Submit();
+    sqe = GetSqe();
+  }
+  if (sqe == nullptr) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = count;
+  sqe->addr = reinterpret_cast<uint64_t>(Buffer(first));
+  sqe->len = bufSize;
+  sqe->off = first;
+  sqe->buf_group = bufGroup;
+  // no completion unless it fails, so it never ends a wait
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = provideTag;
+  return true;
+}
+
+bool UringQueue::ProvideBuffers(uint16_t group, unsigned count, unsigned size)
+{
+  if (posix_memalign(reinterpret_cast<void **>(&bufBase), 64, (size_t)count * size) != 0) {
+    bufBase = nullptr;
+    return false;
+  }
+  bufGroup = group;
+  bufCount = count;
+  bufSize = size;
+  return queueProvide(0, count);
+}
+
+void UringQueue::RecycleBuffer(unsigned id)
+{
+  queueProvide(id, 1);
+}
+
+#else
+
+UringQueue::~UringQueue()
+{
+}
+
+bool UringQueue::Available()
+{
+  return false;
+}
+
+bool UringQueue::Init(unsigned entries)
+{
+  return false;
+}
+
+io_uring_sqe *UringQueue::GetSqe()
+{
+  return nullptr;
+}
+
+int UringQueue::Submit(unsigned waitFor)
+{
+  return -1;
+}
+
+io_uring_cqe *UringQueue::PeekCqe()
+{
+  return nullptr;
+}
+
+void UringQueue::SeenCqe()
+{
+}
+
+int UringQueue::RegisterFiles(const int *fds, unsigned count)
+{
+  return -1;
+}
+
+bool UringQueue::ProvideBuffers(uint16_t group, unsigned count, unsigned size)
+{
+  return false;
+}
+
+void UringQueue::RecycleBuffer(unsigned id)
+{
+}
+
+#endif
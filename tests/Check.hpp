@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// Minimal assertions for the ctest executables: a failed check is reported
+// with its location and the test keeps going; main() returns CheckResult().
+
+inline int &checkFailures()
+{
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(cond)                                                        \
+  do {                                                                     \
+    if (!(cond)) {                                                         \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      checkFailures()++;                                                   \
+    }                                                                      \
+  } while (0)
+
+#define CHECK_NEAR(a, b, eps)                                              \
+  do {                                                                     \
+    double checkA = (a), checkB = (b);                                     \
+    if (!(std::abs(checkA - checkB) <= (eps))) {                           \
+      fprintf(stderr, "%s:%d: CHECK_NEAR(%s, %s) failed: %f vs %f\n",      \
+              __FILE__, __LINE__, #a, #b, checkA, checkB);                 \
+      checkFailures()++;                                                   \
+    }                                                                      \
+  } while (0)
+
+#define RUN_TEST(test)                                                     \
+  do {                                                                     \
+    int before = checkFailures();                                          \
+    test();                                                                \
+    printf("%s %s\n", checkFailures() == before ? "ok  " : "FAIL", #test); \
+  } while (0)
+
+inline int CheckResult()
+{
+  if (checkFailures() > 0) {
+    fprintf(stderr, "%d checks failed\n", checkFailures());
+    return 1;
+  }
+  return 0;
+}
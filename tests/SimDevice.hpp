@@ -0,0 +1,60 @@
+#pragma once
+
+#include "transport/SimPTZ.hpp"
+#include <poll.h>
+#include <cstring>
+
+// A SimPTZ behind a byte stream, the way the 3025 sits behind its serial
+// converter: serves the test's end of a TCP connection or a pty. Pelco-D
+// frames go into the model; position queries are answered on the stream.
+class SimDevice {
+public:
+  SimPTZ sim;
+  std::mutex framesMutex;
+  std::vector<std::chrono::steady_clock::time_point> frameTimes;  // last byte of each frame in
+
+  explicit SimDevice(SimPTZ::Params params = SimPTZ::Params()) : sim(params) {}
+
+  // until the peer closes, an error, or stop
+  void Serve(int fd, const std::atomic<bool> &stop) {
+    std::string pending;
+    char buf[256];
+    while (!stop) {
+      struct pollfd pfd = {fd, POLLIN, 0};
+      int ready = poll(&pfd, 1, 50);
+      if (ready == 0) {
+        continue;
+      }
+      int ret = ready < 0 ? -1 : read(fd, buf, sizeof(buf));
+      if (ret <= 0) {
+        return;
+      }
+      pending.append(buf, ret);
+
+      while (pending.size() >= 7) {
+        if ((unsigned char)pending[0] != 0xFF) {
+          pending.erase(0, 1);
+          continue;
+        }
+        {
+          std::lock_guard<std::mutex> lk(framesMutex);
+          frameTimes.push_back(std::chrono::steady_clock::now());
+        }
+        sim.Send(pending.data(), 7);
+        unsigned char cmd2 = pending[3];
+        pending.erase(0, 7);
+        if (cmd2 == 0x51 || cmd2 == 0x53) {
+          char reply[7];
+          if (sim.Recv(reply, sizeof(reply)) != sizeof(reply) || write(fd, reply, sizeof(reply)) != sizeof(reply)) {
+            return;
+          }
+        }
+      }
+    }
+  }
+
+  size_t Frames() {
+    std::lock_guard<std::mutex> lk(framesMutex);
+    return frameTimes.size();
+  }
+};
@@ -0,0 +1,234 @@
+// AxisTracker transitions in simulated time: a VirtualClock advanced by hand
+// and a head that moves toward its last command at a fixed speed.
+
+#include "Check.hpp"
+#include "rotators/AxisTracker.hpp"
+#include "Clock.hpp"
+
+struct Head {
+  double position = 0;
+  double command = 0;
+  double speed = 20;  // (deg/s) 0: stuck
+
+  void Step(double dt) {
+    double d = command - position;
+    double step = speed * dt;
+    position = std::abs(d) <= step ? command : position + (d > 0 ? step : -step);
+  }
+};
+
+// the owner's loop: sample every 100 ms, (re)send whatever the timers ask for
+struct Rig {
+  VirtualClock clock;
+  AxisTracker tracker;
+  Head head;
+
+  explicit Rig(AxisTracker::Params params = AxisTracker::Params()) : tracker(params) {}
+
+  double Now() { return clock.Seconds(); }
+
+  void Target(double target, AxisTracker::Action expected) {
+    AxisTracker::Action action = tracker.OnTarget(Now(), target);
+    CHECK(action == expected);
+    if (action == AxisTracker::SEND) {
+      head.command = target;
+    }
+  }
+
+  void Run(double seconds) {
+    for (int i = 0; i < (int)std::lround(seconds * 10); i++) {
+      clock.Advance(std::chrono::milliseconds(100));
+      head.Step(0.1);
+      if (tracker.NeedsSampling()) {
+        tracker.OnPosition(Now(), head.position);
+      }
+      if (auto resend = tracker.OnTick(Now())) {
+        head.command = *resend;
+      }
+    }
+  }
+};
+
+static void testSettle()
+{
+  Rig rig;
+  rig.Target(2, AxisTracker::SEND);  // unknown position: a slew
+  CHECK(rig.tracker.State() == AXIS_SLEWING);
+  rig.Run(0.5);
+  CHECK(rig.tracker.State() == AXIS_SETTLED);
+
+  // a small step follows without a slew, and a repeat is not resent
+  rig.Target(4, AxisTracker::SEND);
+  CHECK(rig.tracker.State() == AXIS_TRACKING);
+  rig.Target(4, AxisTracker::SUPPRESS);
+  rig.Run(0.5);
+  CHECK(rig.tracker.State() == AXIS_SETTLED);
+  CHECK_NEAR(rig.head.position, 4, 1e-9);
+
+  // idle (and no longer sampled) after settleTime without targets
+  rig.Run(1.5);
+  CHECK(rig.tracker.State() == AXIS_SETTLED);
+  rig.Run(1);
+  CHECK(rig.tracker.State() == AXIS_IDLE);
+  CHECK(!rig.tracker.NeedsSampling());
+  CHECK(rig.tracker.GetStats().sent == 2);
+  CHECK(rig.tracker.GetStats().suppressed == 1);
+}
+
+static void testSlew()
+{
+  Rig rig;
+  rig.Target(0, AxisTracker::SEND);
+  rig.Run(3);
+  CHECK(rig.tracker.State() == AXIS_IDLE);
+
+  // 40 deg at 20 deg/s; retargets within slewThreshold wait for arrival
+  rig.Target(40, AxisTracker::SEND);
+  CHECK(rig.tracker.State() == AXIS_SLEWING);
+  rig.Run(1);
+  rig.Target(42, AxisTracker::SUPPRESS);
+  rig.Target(43, AxisTracker::SUPPRESS);
+  CHECK_NEAR(rig.head.command, 40, 1e-9);
+
+  // on arrival the last held target goes out, as a tracking step
+  rig.Run(0.9);
+  CHECK_NEAR(rig.head.command, 40, 1e-9);
+  rig.Run(0.1);
+  CHECK_NEAR(rig.head.command, 43, 1e-9);
+  CHECK(rig.tracker.State() == AXIS_TRACKING);
+  rig.Run(0.5);
+  CHECK(rig.tracker.State() == AXIS_SETTLED);
+  CHECK_NEAR(rig.head.position, 43, 1e-9);
+
+  // another slew replaces the one underway at once
+  rig.Target(100, AxisTracker::SEND);
+  rig.Run(1);
+  rig.Target(10, AxisTracker::SEND);
+  CHECK(rig.tracker.State() == AXIS_SLEWING);
+  CHECK_NEAR(rig.head.command, 10, 1e-9);
+}
+
+static void testPeriodic()
+{
+  AxisTracker::Params params;
+  params.periodic = true;
+  Rig rig(params);
+  rig.Target(1, AxisTracker::SEND);
+  rig.Run(0.5);
+
+  // 1 -> 359 is a 2 deg step across north, not a slew
+  rig.Target(359, AxisTracker::SEND);
+  CHECK(rig.tracker.State() == AXIS_TRACKING);
+}
+
+static void testHold()
+{
+  AxisTracker::Params params;
+  params.holdThreshold = 1;
+  params.maxHold = 2;
+  Rig rig(params);
+  rig.Target(10, AxisTracker::SEND);
+  rig.Run(1);
+  CHECK(rig.tracker.State() == AXIS_SETTLED);
+
+  // steps below holdThreshold are held, the latest one kept
+  rig.Target(10.3, AxisTracker::SUPPRESS);
+  rig.Run(0.5);
+  rig.Target(10.6, AxisTracker::SUPPRESS);
+  CHECK_NEAR(rig.head.command, 10, 1e-9);
+  CHECK(rig.tracker.State() == AXIS_SETTLED);
+
+  // one that adds up past the threshold goes out and drops the held one
+  rig.Target(11.5, AxisTracker::SEND);
+  CHECK_NEAR(rig.head.command, 11.5, 1e-9);
+  rig.Run(3);
+  CHECK_NEAR(rig.head.command, 11.5, 1e-9);
+  CHECK(rig.tracker.GetStats().sent == 2);
+}
+
+static void testMaxHold()
+{
+  AxisTracker::Params params;
+  params.holdThreshold = 1;
+  params.maxHold = 2;
+  Rig rig(params);
+  rig.Target(10, AxisTracker::SEND);
+  rig.Run(1);
+
+  // a held step goes out once it has waited maxHold
+  rig.Target(10.5, AxisTracker::SUPPRESS);
+  rig.Run(1.9);
+  CHECK_NEAR(rig.head.command, 10, 1e-9);
+  rig.Run(0.2);
+  CHECK_NEAR(rig.head.command, 10.5, 1e-9);
+
+  // during a long slew too, without waiting for arrival
+  rig.head.speed = 5;
+  rig.Target(100, AxisTracker::SEND);
+  rig.Run(1);
+  rig.Target(102, AxisTracker::SUPPRESS);
+  rig.Run(1.9);
+  CHECK_NEAR(rig.head.command, 100, 1e-9);
+  rig.Run(0.2);
+  CHECK_NEAR(rig.head.command, 102, 1e-9);
+  CHECK(rig.tracker.State() == AXIS_SLEWING);
+}
+
+static void testStall()
+{
+  AxisTracker::Params params;
+  params.maxReplays = 2;
+  Rig rig(params);
+  rig.Target(0, AxisTracker::SEND);
+  rig.Run(3);
+
+  // the head stops short: replayed after stallTime, up to maxReplays
+  rig.head.speed = 0;
+  rig.Target(30, AxisTracker::SEND);
+  rig.Run(1.4);
+  CHECK(rig.tracker.GetStats().replayed == 0);
+  rig.Run(0.4);
+  CHECK(rig.tracker.GetStats().replayed == 1);
+  CHECK(rig.tracker.State() == AXIS_SLEWING);
+  rig.Run(5);
+  CHECK(rig.tracker.GetStats().replayed == 2);
+  CHECK(rig.tracker.State() == AXIS_FAULT);
+  CHECK(rig.tracker.GetStats().faults == 1);
+
+  // retried after faultRetry; the head lost what it got while stuck, and
+  // moves again on the retry
+  rig.head.speed = 20;
+  rig.head.command = rig.head.position;
+  rig.Run(2.9);
+  CHECK(rig.tracker.GetStats().replayed == 2);
+  rig.Run(0.2);
+  CHECK(rig.tracker.GetStats().replayed == 3);
+  CHECK(rig.tracker.State() == AXIS_SLEWING);
+  rig.Run(2);
+  CHECK(rig.tracker.State() == AXIS_SETTLED);
+  CHECK_NEAR(rig.head.position, 30, 1e-9);
+}
+
+static void testCommandFailed()
+{
+  Rig rig;
+  rig.Target(10, AxisTracker::SEND);
+  rig.tracker.OnCommandFailed(rig.Now());
+  CHECK(rig.tracker.State() == AXIS_FAULT);
+
+  // a new target leaves the fault at once, even a repeated one
+  rig.Target(10, AxisTracker::SEND);
+  CHECK(rig.tracker.State() == AXIS_SLEWING);
+}
+
+int main()
+{
+  RUN_TEST(testSettle);
+  RUN_TEST(testSlew);
+  RUN_TEST(testPeriodic);
+  RUN_TEST(testHold);
+  RUN_TEST(testMaxHold);
+  RUN_TEST(testStall);
+  RUN_TEST(testCommandFailed);
+  return CheckResult();
+}
@@ -0,0 +1,128 @@
+// CamPTZ over TCP to a converter that drops the link: the process survives
+// the writes to a closed socket (no SIGPIPE), the requests fail, the link is
+// reopened, and once the converter serves again the circuit closes.
+
+#include "Check.hpp"
+#include "SimDevice.hpp"
+#include "pipeline/Pipeline.hpp"
+
+// accepts on 127.0.0.1, then closes at once (dropping) or serves a SimDevice
+class FakeConverter {
+private:
+  int sock = -1;
+  std::thread thread;
+  std::atomic<bool> closing{false};
+
+  void threadMain() {
+    while (!closing) {
+      struct pollfd pfd = {sock, POLLIN, 0};
+      if (poll(&pfd, 1, 50) <= 0) {
+        continue;
+      }
+      int conn = accept(sock, nullptr, nullptr);
+      if (conn < 0) {
+        continue;
+      }
+      connections++;
+      if (!dropping) {
+        device.Serve(conn, closing);
+      }
+      CLOSE_SOCKET(conn);
+    }
+  }
+
+public:
+  SimDevice device;
+  std::atomic<bool> dropping{true};
+  std::atomic<int> connections{0};
+  int port = 0;
+
+  bool Start() {
+    sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 8) < 0 ||
+        getsockname(sock, (struct sockaddr *)&addr, &addrLen) < 0) {
+      return false;
+    }
+    port = ntohs(addr.sin_port);
+    thread = std::thread(&FakeConverter::threadMain, this);
+    return true;
+  }
+
+  ~FakeConverter() {
+    closing = true;
+    if (thread.joinable()) {
+      thread.join();
+    }
+    CLOSE_SOCKET(sock);
+  }
+};
+
+static std::optional<RotatorResponse> request(Pipeline &pipeline, RotatorCmd cmd, double value = 0)
+{
+  RotatorRequest req;
+  req.cmd = cmd;
+  if (cmd == CHANGE_AZI) {
+    req.payload.ChangeAzi.aziRequested = value;
+  }
+  return pipeline.RequestSync(req, 3000);
+}
+
+static void testLinkDrop()
+{
+  FakeConverter converter;
+  CHECK(converter.Start());
+
+  Pipeline pipeline;
+  CHECK(pipeline.AddConfigLine(
+    "sink camptz host=127.0.0.1 port=" + std::to_string(converter.port) +
+    " smart-sink=0 keepalive=0 presets=0 preset-reset=0 io-timeout=300 breaker-open=0.2 breaker-max-open=0.4"
+  ));
+  pipeline.Start();
+
+  // every write goes to a socket the converter already closed
+  int failed = 0;
+  for (int i = 0; i < 6; i++) {
+    auto resp = request(pipeline, i % 2 == 0 ? CHANGE_AZI : GET_AZI, 10 + i);
+    CHECK(resp.has_value());
+    if (resp.has_value() && !resp->success) {
+      failed++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  CHECK(failed > 0);
+  CHECK(converter.connections >= 2);
+
+  // the converter comes back: a probe closes the circuit, requests go through
+  converter.dropping = false;
+  bool recovered = false;
+  for (int i = 0; i < 30 && !recovered; i++) {
+    auto resp = request(pipeline, GET_AZI);
+    recovered = resp.has_value() && resp->success;
+    if (!recovered) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+  CHECK(recovered);
+
+  auto resp = request(pipeline, CHANGE_AZI, 5);
+  CHECK(resp.has_value() && resp->success);
+  std::this_thread::sleep_for(std::chrono::milliseconds(800));
+  resp = request(pipeline, GET_AZI);
+  CHECK(resp.has_value() && resp->success);
+  if (resp.has_value()) {
+    CHECK_NEAR(resp->payload.aziResp.azi, 5, 0.05);
+  }
+
+  pipeline.Terminate();
+}
+
+int main()
+{
+  RUN_TEST(testLinkDrop);
+  return CheckResult();
+}
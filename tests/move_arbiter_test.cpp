@@ -0,0 +1,75 @@
+// MoveArbiter policies with the default hold-off, in virtual time.
+
+#include "Check.hpp"
+#include "rotators/MoveArbiter.hpp"
+
+static void testOwner()
+{
+  VirtualClock clock;
+  MoveArbiter arbiter;
+  arbiter.SetClock(&clock);
+  arbiter.Initialize(MoveArbiter::ARBITRATION_OWNER, 2000, 0, {});
+
+  // held through any quiet period, until the owner disconnects
+  CHECK(arbiter.AcquireMove(1, 0));
+  CHECK(!arbiter.AcquireMove(2, 0));
+  clock.Advance(std::chrono::seconds(60));
+  CHECK(!arbiter.AcquireMove(2, 10));
+  CHECK(arbiter.AcquireMove(1, 0));
+  arbiter.Release(1);
+  CHECK(arbiter.AcquireMove(2, 0));
+  CHECK(!arbiter.AcquireMove(1, 0));
+}
+
+static void testOwnerIdle()
+{
+  VirtualClock clock;
+  MoveArbiter arbiter;
+  arbiter.SetClock(&clock);
+  arbiter.Initialize(MoveArbiter::ARBITRATION_OWNER, 2000, 5000, {});
+
+  CHECK(arbiter.AcquireMove(1, 0));
+  clock.Advance(std::chrono::seconds(3));
+  CHECK(!arbiter.AcquireMove(2, 0));
+  CHECK(arbiter.AcquireMove(1, 0));
+  clock.Advance(std::chrono::seconds(5));
+  CHECK(arbiter.AcquireMove(2, 0));
+  CHECK(!arbiter.AcquireMove(1, 0));
+}
+
+static void testLww()
+{
+  VirtualClock clock;
+  MoveArbiter arbiter;
+  arbiter.SetClock(&clock);
+  arbiter.Initialize(MoveArbiter::ARBITRATION_LWW, 2000, 0, {});
+
+  CHECK(arbiter.AcquireMove(1, 0));
+  clock.Advance(std::chrono::milliseconds(1500));
+  CHECK(!arbiter.AcquireMove(2, 0));
+  clock.Advance(std::chrono::milliseconds(500));
+  CHECK(arbiter.AcquireMove(2, 0));
+}
+
+static void testPriority()
+{
+  VirtualClock clock;
+  MoveArbiter arbiter;
+  arbiter.SetClock(&clock);
+  arbiter.Initialize(MoveArbiter::ARBITRATION_PRIORITY, 2000, 0, {});
+
+  CHECK(arbiter.AcquireMove(1, 5));
+  CHECK(!arbiter.AcquireMove(2, 5));
+  CHECK(arbiter.AcquireMove(3, 10));
+  clock.Advance(std::chrono::seconds(2));
+  CHECK(arbiter.AcquireMove(2, 5));
+}
+
+int main()
+{
+  RUN_TEST(testOwner);
+  RUN_TEST(testOwnerIdle);
+  RUN_TEST(testLww);
+  RUN_TEST(testPriority);
+  return CheckResult();
+}
@@ -0,0 +1,282 @@
+// GS-232 and EasyComm round trips over the pty transport: the test opens the
+// slave through the source's symlink like a tracking program would, and a
+// fake pipeline answers position queries (or fails them, as a device that
+// does not answer) and records everything else. Per-client state is checked
+// with two clients on the unix socket transport.
+
+#include "Check.hpp"
+#include "rotators/EasyComm.hpp"
+#include "rotators/GS232.hpp"
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+struct FakePipeline {
+  double azi = 123.4;
+  double ele = 45;
+  std::atomic<bool> deviceDown{false};  // position queries fail
+  std::mutex mutex;
+  std::condition_variable event;
+  std::vector<RotatorRequest> requests;  // everything but position queries
+
+  RotatorRequestHandler Handler() {
+    return [this](RotatorRequest req, RotatorCallback callback) {
+      RotatorResponse resp;
+      resp.success = true;
+      if ((req.cmd == GET_AZI || req.cmd == GET_ELE) && deviceDown) {
+        resp.success = false;
+      } else if (req.cmd == GET_AZI) {
+        resp.payload.aziResp.azi = azi;
+      } else if (req.cmd == GET_ELE) {
+        resp.payload.eleResp.ele = ele;
+      } else {
+        std::lock_guard<std::mutex> lk(mutex);
+        requests.push_back(req);
+        event.notify_all();
+      }
+      callback(resp);
+      return true;
+    };
+  }
+
+  // the first count requests, once they all arrived
+  std::vector<RotatorRequest> Wait(size_t count) {
+    std::unique_lock<std::mutex> lk(mutex);
+    event.wait_for(lk, std::chrono::seconds(2), [&] { return requests.size() >= count; });
+    std::vector<RotatorRequest> taken = requests;
+    requests.clear();
+    return taken;
+  }
+};
+
+// the client end: the pty slave opened through the link, or a connection to
+// the unix socket
+class LineClient {
+private:
+  int fd = -1;
+
+public:
+  bool Open(const std::string &link) {
+    for (int i = 0; i < 100 && access(link.c_str(), F_OK) != 0; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    fd = open(link.c_str(), O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+      return false;
+    }
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+    return true;
+  }
+
+  bool Connect(const std::string &path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    for (int i = 0; i < 100; i++) {
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        return true;
+      }
+      close(fd);
+      fd = -1;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  ~LineClient() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  void Write(const std::string &text) {
+    CHECK(write(fd, text.data(), text.size()) == (ssize_t)text.size());
+  }
+
+  // up to and including terminator; empty on timeout
+  std::string ReadUntil(char terminator) {
+    std::string reply;
+    char c;
+    while (true) {
+      struct pollfd pfd = {fd, POLLIN, 0};
+      if (poll(&pfd, 1, 2000) <= 0 || read(fd, &c, 1) != 1) {
+        return "";
+      }
+      reply += c;
+      if (c == terminator) {
+        return reply;
+      }
+    }
+  }
+
+  std::string Query(const std::string &line, char terminator) {
+    Write(line);
+    return ReadUntil(terminator);
+  }
+};
+
+static std::string linkPath(const char *name)
+{
+  return std::string("/tmp/rbridge-test-") + name + "-" + std::to_string(getpid());
+}
+
+static void testGS232B()
+{
+  FakePipeline pipeline;
+  GS232 source;
+  std::string link = linkPath("gs232b");
+  source.Initialize(StreamSource::TRANSPORT_PTY, "", 0, link, true);
+  source.SetRequestHandler(pipeline.Handler());
+  source.Start();
+
+  LineClient client;
+  CHECK(client.Open(link));
+  CHECK(client.Query("C2\r", '\r') == "AZ=123  EL=045\r");
+  CHECK(client.Query("C\r", '\r') == "AZ=123\r");
+  CHECK(client.Query("B\r", '\r') == "EL=045\r");
+
+  client.Write("W090 030\r");
+  auto requests = pipeline.Wait(2);
+  CHECK(requests.size() == 2);
+  if (requests.size() == 2) {
+    CHECK(requests[0].cmd == CHANGE_AZI);
+    CHECK_NEAR(requests[0].payload.ChangeAzi.aziRequested, 90, 1e-9);
+    CHECK(requests[1].cmd == CHANGE_ELE);
+    CHECK_NEAR(requests[1].payload.ChangeEle.eleRequested, 30, 1e-9);
+  }
+
+  // speed applies to the moves that follow; lower case is accepted
+  client.Write("x2\rR\rS\r");
+  requests = pipeline.Wait(2);
+  CHECK(requests.size() == 2);
+  if (requests.size() == 2) {
+    CHECK(requests[0].cmd == ROTATOR_MOVE);
+    CHECK(requests[0].payload.Move.direction == MOVE_CW);
+    CHECK(requests[0].payload.Move.speed == 50);
+    CHECK(requests[1].cmd == ROTATOR_STOP);
+  }
+
+  // the device does not answer: an error, not a made-up position
+  pipeline.deviceDown = true;
+  CHECK(client.Query("C2\r", '\r') == "?>\r");
+  pipeline.deviceDown = false;
+  CHECK(client.Query("C2\r", '\r') == "AZ=123  EL=045\r");
+
+  source.Terminate();
+  source.WaitForClose();
+}
+
+static void testGS232SpeedPerClient()
+{
+  FakePipeline pipeline;
+  GS232 source;
+  std::string path = linkPath("gs232-unix");
+  source.Initialize(StreamSource::TRANSPORT_UNIX, "", 0, path, true);
+  source.SetRequestHandler(pipeline.Handler());
+  source.Start();
+
+  // one client's X1 does not slow down another's moves
+  LineClient slow, fast;
+  CHECK(slow.Connect(path));
+  CHECK(fast.Connect(path));
+  slow.Write("X1\rR\r");
+  auto requests = pipeline.Wait(1);
+  fast.Write("L\r");
+  for (auto &req : pipeline.Wait(1)) {
+    requests.push_back(req);
+  }
+  CHECK(requests.size() == 2);
+  if (requests.size() == 2) {
+    CHECK(requests[0].payload.Move.direction == MOVE_CW);
+    CHECK(requests[0].payload.Move.speed == 25);
+    CHECK(requests[1].payload.Move.direction == MOVE_CCW);
+    CHECK(requests[1].payload.Move.speed == 100);
+  }
+
+  source.Terminate();
+  source.WaitForClose();
+}
+
+static void testGS232A()
+{
+  FakePipeline pipeline;
+  pipeline.azi = 359.7;  // rounds to north
+  GS232 source;
+  std::string link = linkPath("gs232a");
+  source.Initialize(StreamSource::TRANSPORT_PTY, "", 0, link, false);
+  source.SetRequestHandler(pipeline.Handler());
+  source.Start();
+
+  LineClient client;
+  CHECK(client.Open(link));
+  CHECK(client.Query("C2\r", '\r') == "+0000+0045\r");
+
+  client.Write("M180\r");
+  auto requests = pipeline.Wait(1);
+  CHECK(requests.size() == 1);
+  if (requests.size() == 1) {
+    CHECK(requests[0].cmd == CHANGE_AZI);
+    CHECK_NEAR(requests[0].payload.ChangeAzi.aziRequested, 180, 1e-9);
+  }
+
+  source.Terminate();
+  source.WaitForClose();
+}
+
+static void testEasyComm()
+{
+  FakePipeline pipeline;
+  EasyComm source;
+  std::string link = linkPath("easycomm");
+  source.Initialize(StreamSource::TRANSPORT_PTY, "", 0, link);
+  source.SetRequestHandler(pipeline.Handler());
+  source.Start();
+
+  LineClient client;
+  CHECK(client.Open(link));
+  CHECK(client.Query("AZ EL\n", '\n') == "AZ123.4 EL45.0\n");
+  CHECK(client.Query("VE\n", '\n') == "VERotator-Bridge\n");
+
+  // a target and a query on one line: the query answers, the target goes out
+  CHECK(client.Query("AZ210.5 EL12 AZ\n", '\n') == "AZ123.4\n");
+  auto requests = pipeline.Wait(2);
+  CHECK(requests.size() == 2);
+  if (requests.size() == 2) {
+    CHECK(requests[0].cmd == CHANGE_AZI);
+    CHECK_NEAR(requests[0].payload.ChangeAzi.aziRequested, 210.5, 1e-9);
+    CHECK(requests[1].cmd == CHANGE_ELE);
+    CHECK_NEAR(requests[1].payload.ChangeEle.eleRequested, 12, 1e-9);
+  }
+
+  client.Write("ML MU\nSA SE\n");
+  requests = pipeline.Wait(2);
+  CHECK(requests.size() == 2);
+  if (requests.size() == 2) {
+    CHECK(requests[0].cmd == ROTATOR_MOVE);
+    CHECK(requests[0].payload.Move.direction == (MOVE_CCW | MOVE_UP));
+    CHECK(requests[1].cmd == ROTATOR_STOP);
+  }
+
+  // no AZ / EL reply while the device does not answer
+  pipeline.deviceDown = true;
+  CHECK(client.Query("AZ EL VE\n", '\n') == "VERotator-Bridge\n");
+
+  source.Terminate();
+  source.WaitForClose();
+}
+
+int main()
+{
+  RUN_TEST(testGS232B);
+  RUN_TEST(testGS232SpeedPerClient);
+  RUN_TEST(testGS232A);
+  RUN_TEST(testEasyComm);
+  return CheckResult();
+}
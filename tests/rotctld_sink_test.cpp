@@ -0,0 +1,323 @@
+// RotctldSink against a local rotctld stand-in: replies matched to pipelined
+// commands in order, `p` joining, suppression of repeated targets, and the
+// `\subscribe` handshake with a pushing daemon and its fallback to polling,
+// and a daemon that accepts the connection but never answers.
+
+#include "Check.hpp"
+#include "rotators/LineReader.hpp"
+#include "rotators/RotctldSink.hpp"
+#include <cstring>
+#include <future>
+#include <poll.h>
+
+// Speaks enough of the rotctld protocol for the sink. Replies can be held
+// back to keep commands pipelined; as a bridge it accepts `\subscribe`.
+class StandIn {
+private:
+  int sock = -1;
+  std::thread thread;
+  std::atomic<bool> closing{false};
+  std::mutex mutex;
+  std::vector<std::string> received;
+  double azi = 30, ele = 40;
+  int pushInterval = 0;  // (ms) once subscribed
+
+  std::string reply(const std::string &line) {
+    double a, e;
+    std::lock_guard<std::mutex> lk(mutex);
+    received.push_back(line);
+    if (line == "p") {
+      return std::to_string(azi) + "\n" + std::to_string(ele) + "\n";
+    } else if (sscanf(line.c_str(), "P %lf %lf", &a, &e) == 2) {
+      if (a < 0 || a > 360 || e < 0 || e > 90) {
+        return "RPRT -1\n";
+      }
+      azi = a;
+      ele = e;
+      return "RPRT 0\n";
+    } else if (line.rfind("\\subscribe ", 0) == 0) {
+      if (!bridge) {
+        return "RPRT -4\n";
+      }
+      pushInterval = atoi(line.c_str() + 11);
+      return "RPRT 0\n";
+    }
+    return "RPRT 0\n";
+  }
+
+  void serve(int conn) {
+    LineReader lines("\n");
+    std::string line, out;
+    char buf[256];
+    auto lastPush = std::chrono::steady_clock::now();
+    while (!closing) {
+      struct pollfd pfd = {conn, POLLIN, 0};
+      int ready = poll(&pfd, 1, 10);
+      if (ready > 0) {
+        int ret = recv(conn, buf, sizeof(buf), 0);
+        if (ret <= 0) {
+          return;
+        }
+        lines.Append(buf, ret);
+        while (lines.Next(line)) {
+          out += reply(line);
+        }
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (pushInterval > 0 && now - lastPush >= std::chrono::milliseconds(pushInterval)) {
+          out += "POS " + std::to_string(azi) + " " + std::to_string(ele) + "\n";
+          lastPush = now;
+        }
+      }
+      if (!hold && !out.empty()) {
+        if (send(conn, out.data(), out.size(), MSG_NOSIGNAL) < 0) {
+          return;
+        }
+        out.clear();
+      }
+    }
+  }
+
+  void threadMain() {
+    while (!closing) {
+      struct pollfd pfd = {sock, POLLIN, 0};
+      if (poll(&pfd, 1, 50) <= 0) {
+        continue;
+      }
+      int conn = accept(sock, nullptr, nullptr);
+      if (conn >= 0) {
+        serve(conn);
+        CLOSE_SOCKET(conn);
+      }
+    }
+  }
+
+public:
+  bool bridge = false;
+  std::atomic<bool> hold{false};
+  int port = 0;
+
+  bool Start() {
+    sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 4) < 0 ||
+        getsockname(sock, (struct sockaddr *)&addr, &addrLen) < 0) {
+      return false;
+    }
+    port = ntohs(addr.sin_port);
+    thread = std::thread(&StandIn::threadMain, this);
+    return true;
+  }
+
+  ~StandIn() {
+    closing = true;
+    if (thread.joinable()) {
+      thread.join();
+    }
+    CLOSE_SOCKET(sock);
+  }
+
+  std::vector<std::string> Received() {
+    std::lock_guard<std::mutex> lk(mutex);
+    return received;
+  }
+
+  size_t Count(const std::string &line) {
+    std::lock_guard<std::mutex> lk(mutex);
+    return std::count(received.begin(), received.end(), line);
+  }
+};
+
+static std::future<RotatorResponse> request(RotctldSink &sink, RotatorCmd cmd, double value = 0)
+{
+  RotatorRequest req;
+  req.cmd = cmd;
+  if (cmd == CHANGE_AZI) {
+    req.payload.ChangeAzi.aziRequested = value;
+  } else if (cmd == CHANGE_ELE) {
+    req.payload.ChangeEle.eleRequested = value;
+  }
+  auto done = std::make_shared<std::promise<RotatorResponse>>();
+  CHECK(sink.Request(req, [done](RotatorResponse resp) { done->set_value(resp); }));
+  return done->get_future();
+}
+
+static std::optional<RotatorResponse> await(std::future<RotatorResponse> &future)
+{
+  if (future.wait_for(std::chrono::seconds(2)) != std::future_status::ready) {
+    return std::nullopt;
+  }
+  return future.get();
+}
+
+// lets the worker put what was requested so far on the wire
+static void settle()
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+static void testPipelined()
+{
+  StandIn daemon;
+  CHECK(daemon.Start());
+  RotctldSink sink;
+  sink.Initialize("127.0.0.1", daemon.port, 1000);
+  sink.SetSubscription(0);
+  sink.Start();
+
+  auto first = request(sink, GET_AZI);
+  auto resp = await(first);
+  CHECK(resp.has_value() && resp->success);
+  CHECK(resp.has_value() && std::abs(resp->payload.aziResp.azi - 30) < 1e-6);
+
+  // held replies: commands keep going out; polls join the `p` on the wire
+  daemon.hold = true;
+  auto azi = request(sink, GET_AZI);
+  settle();
+  auto ele = request(sink, GET_ELE);
+  settle();
+  auto badMove = request(sink, CHANGE_AZI, 400);
+  settle();
+  auto stop = request(sink, ROTATOR_STOP);
+  settle();
+  auto move = request(sink, CHANGE_AZI, 100);
+  settle();
+  auto ele2 = request(sink, CHANGE_ELE, 20);
+  auto aziAgain = request(sink, GET_AZI);
+  settle();
+  CHECK(azi.wait_for(std::chrono::seconds(0)) == std::future_status::timeout);
+  CHECK(daemon.Count("p") == 3);
+  daemon.hold = false;
+
+  // the initial `p`, the first poll, then the held ones in order
+  std::vector<std::string> expected = {
+    "p", "p", "p", "P 400.00 40.00", "S", "P 100.00 40.00", "P 100.00 20.00"
+  };
+  CHECK(daemon.Received() == expected);
+
+  resp = await(azi);
+  CHECK(resp.has_value() && resp->success && std::abs(resp->payload.aziResp.azi - 30) < 1e-6);
+  resp = await(ele);
+  CHECK(resp.has_value() && resp->success && std::abs(resp->payload.eleResp.ele - 40) < 1e-6);
+  resp = await(aziAgain);
+  CHECK(resp.has_value() && resp->success && std::abs(resp->payload.aziResp.azi - 30) < 1e-6);
+  resp = await(badMove);
+  CHECK(resp.has_value() && !resp->success);
+  resp = await(stop);
+  CHECK(resp.has_value() && resp->success);
+  resp = await(move);
+  CHECK(resp.has_value() && resp->success);
+  resp = await(ele2);
+  CHECK(resp.has_value() && resp->success);
+
+  // the same target again within the window is not sent
+  auto repeat = request(sink, CHANGE_ELE, 20);
+  resp = await(repeat);
+  CHECK(resp.has_value() && resp->success);
+  auto polled = request(sink, GET_ELE);
+  resp = await(polled);
+  CHECK(resp.has_value() && resp->success && std::abs(resp->payload.eleResp.ele - 20) < 1e-6);
+  CHECK(daemon.Count("P 100.00 20.00") == 1);
+
+  sink.Terminate();
+}
+
+static void testSubscribeFallback()
+{
+  // a hamlib rotctld rejects `\subscribe`: every poll is a `p`
+  StandIn daemon;
+  CHECK(daemon.Start());
+  RotctldSink sink;
+  sink.Initialize("127.0.0.1", daemon.port, 1000);
+  sink.SetSubscription(100);
+  sink.Start();
+
+  for (int i = 0; i < 3; i++) {
+    auto azi = request(sink, GET_AZI);
+    auto resp = await(azi);
+    CHECK(resp.has_value() && resp->success && std::abs(resp->payload.aziResp.azi - 30) < 1e-6);
+    settle();
+  }
+  CHECK(daemon.Count("\\subscribe 100") == 1);
+  CHECK(daemon.Count("p") == 4);
+
+  sink.Terminate();
+}
+
+static void testSubscribed()
+{
+  // another bridge pushes: polls are answered from the last push
+  StandIn daemon;
+  daemon.bridge = true;
+  CHECK(daemon.Start());
+  RotctldSink sink;
+  sink.Initialize("127.0.0.1", daemon.port, 1000);
+  sink.SetSubscription(100);
+  sink.Start();
+
+  auto first = request(sink, GET_AZI);
+  CHECK(await(first).has_value());
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  size_t polls = daemon.Count("p");
+
+  auto move = request(sink, CHANGE_AZI, 200);
+  auto resp = await(move);
+  CHECK(resp.has_value() && resp->success);
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  for (int i = 0; i < 3; i++) {
+    auto azi = request(sink, GET_AZI);
+    resp = await(azi);
+    CHECK(resp.has_value() && resp->success && std::abs(resp->payload.aziResp.azi - 200) < 1e-6);
+  }
+  CHECK(daemon.Count("p") == polls);
+
+  sink.Terminate();
+}
+
+static void testSilentDaemon()
+{
+  // accepts the connection and never answers: the first query times out,
+  // the request fails and the sink still shuts down
+  StandIn daemon;
+  daemon.hold = true;
+  CHECK(daemon.Start());
+  RotctldSink sink;
+  sink.Initialize("127.0.0.1", daemon.port, 1000);
+  sink.SetSubscription(0);
+  sink.SetIoTimeout(300);
+  sink.Start();
+
+  auto start = std::chrono::steady_clock::now();
+  auto azi = request(sink, GET_AZI);
+  auto resp = await(azi);
+  CHECK(resp.has_value() && !resp->success);
+  CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(300));
+
+  // answering again: the next attempt after the reconnect interval connects
+  daemon.hold = false;
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  azi = request(sink, GET_AZI);
+  resp = await(azi);
+  CHECK(resp.has_value() && resp->success && std::abs(resp->payload.aziResp.azi - 30) < 1e-6);
+
+  daemon.hold = true;
+  start = std::chrono::steady_clock::now();
+  sink.Terminate();
+  CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+}
+
+int main()
+{
+  RUN_TEST(testPipelined);
+  RUN_TEST(testSubscribeFallback);
+  RUN_TEST(testSubscribed);
+  RUN_TEST(testSilentDaemon);
+  return CheckResult();
+}
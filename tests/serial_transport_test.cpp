@@ -0,0 +1,173 @@
+// SerialTransport on a pty pair, the simulator serving the master end:
+// Pelco-D round trips, the reply timeout (also for a reply that trickles in),
+// and inter-frame pacing.
+
+#include "Check.hpp"
+#include "SimDevice.hpp"
+#include "transport/SerialTransport.hpp"
+#include <pty.h>
+#include <termios.h>
+
+// the simulator behind the master end of a fresh pty
+class SimLine {
+private:
+  int masterFd = -1;
+  int slaveFd = -1;
+  std::thread thread;
+  std::atomic<bool> closing{false};
+
+public:
+  SimDevice device;
+  std::string slaveName;
+
+  bool Start() {
+    char name[128];
+    if (openpty(&masterFd, &slaveFd, name, nullptr, nullptr) < 0) {
+      return false;
+    }
+    struct termios tio;
+    tcgetattr(masterFd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(masterFd, TCSANOW, &tio);
+    slaveName = name;
+    thread = std::thread([this]() { device.Serve(masterFd, closing); });
+    return true;
+  }
+
+  ~SimLine() {
+    closing = true;
+    if (thread.joinable()) {
+      thread.join();
+    }
+    close(slaveFd);
+    close(masterFd);
+  }
+};
+
+static std::string pelco(unsigned char cmd2, int data = 0)
+{
+  unsigned char frame[7] = {0xFF, 0x01, 0x00, cmd2, (unsigned char)(data >> 8), (unsigned char)data, 0};
+  frame[6] = (unsigned char)(frame[1] + frame[2] + frame[3] + frame[4] + frame[5]);
+  return std::string((char *)frame, sizeof(frame));
+}
+
+static void testRoundTrip()
+{
+  SimLine line;
+  CHECK(line.Start());
+  SerialTransport serial(line.slaveName, 9600, 7, 0, 500);
+  CHECK(serial.Open());
+
+  std::string query = pelco(0x51);
+  char reply[7];
+  CHECK(serial.Send(query.data(), query.size()) == 7);
+  CHECK(serial.Recv(reply, sizeof(reply)) == 7);
+  CHECK((unsigned char)reply[3] == 0x59);
+  CHECK((unsigned char)reply[4] == 0 && (unsigned char)reply[5] == 0);
+
+  // 2 deg at 20 deg/s after the 0.3 s restart delay
+  std::string move = pelco(0x4B, 200);
+  CHECK(serial.Send(move.data(), move.size()) == 7);
+  std::this_thread::sleep_for(std::chrono::milliseconds(700));
+  CHECK(serial.Send(query.data(), query.size()) == 7);
+  CHECK(serial.Recv(reply, sizeof(reply)) == 7);
+  CHECK((unsigned char)reply[3] == 0x59);
+  CHECK((unsigned char)reply[4] * 256 + (unsigned char)reply[5] == 200);
+
+  // position commands are not answered: nothing to read
+  auto start = std::chrono::steady_clock::now();
+  CHECK(serial.Send(move.data(), move.size()) == 7);
+  CHECK(serial.Recv(reply, sizeof(reply)) == -1);
+  CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(500));
+
+  serial.Close();
+}
+
+static void testTrickle()
+{
+  // a byte every 100 ms: the frame is not complete within the timeout, and
+  // the bytes coming in do not extend it
+  int masterFd, slaveFd;
+  char name[128];
+  CHECK(openpty(&masterFd, &slaveFd, name, nullptr, nullptr) == 0);
+  SerialTransport serial(name, 9600, 7, 0, 300);
+  CHECK(serial.Open());
+
+  std::atomic<bool> closing{false};
+  std::thread trickle([&]() {
+    std::string reply = pelco(0x59, 200);
+    for (size_t i = 0; i < reply.size() && !closing; i++) {
+      CHECK(write(masterFd, &reply[i], 1) == 1);
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  });
+
+  char reply[7];
+  auto start = std::chrono::steady_clock::now();
+  CHECK(serial.Recv(reply, sizeof(reply)) == -1);
+  auto took = std::chrono::steady_clock::now() - start;
+  CHECK(took >= std::chrono::milliseconds(300));
+  CHECK(took < std::chrono::milliseconds(450));
+
+  closing = true;
+  trickle.join();
+  serial.Close();
+  close(slaveFd);
+  close(masterFd);
+}
+
+// intervals between frame arrivals at the simulator (s)
+static std::vector<double> sendFrames(int baud, double frameGap, int frames)
+{
+  SimLine line;
+  CHECK(line.Start());
+  SerialTransport serial(line.slaveName, baud, 7, frameGap, 500);
+  CHECK(serial.Open());
+
+  std::string coalesced;
+  for (int i = 0; i < frames; i++) {
+    coalesced += pelco(0x4B, 100 * i);
+  }
+  CHECK(serial.Send(coalesced.data(), coalesced.size()) == (int)coalesced.size());
+  for (int i = 0; i < 100 && line.device.Frames() < (size_t)frames; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  serial.Close();
+
+  std::lock_guard<std::mutex> lk(line.device.framesMutex);
+  std::vector<double> intervals;
+  for (size_t i = 1; i < line.device.frameTimes.size(); i++) {
+    intervals.push_back(std::chrono::duration<double>(line.device.frameTimes[i] - line.device.frameTimes[i - 1]).count());
+  }
+  CHECK(line.device.frameTimes.size() == (size_t)frames);
+  return intervals;
+}
+
+static void testFramePacing()
+{
+  // 2400 baud: 4.17 ms per character, a frame every 7 + 10 characters
+  std::vector<double> intervals = sendFrames(2400, 10, 5);
+  double expected = 17 * 10.0 / 2400;
+  for (double interval : intervals) {
+    CHECK(interval >= expected - 0.005);
+    CHECK(interval <= expected + 0.05);
+  }
+}
+
+static void testNoPacing()
+{
+  // no gap: the coalesced buffer goes out in one write
+  std::vector<double> intervals = sendFrames(2400, 0, 5);
+  for (double interval : intervals) {
+    CHECK(interval < 0.02);
+  }
+}
+
+int main()
+{
+  RUN_TEST(testRoundTrip);
+  RUN_TEST(testTrickle);
+  RUN_TEST(testFramePacing);
+  RUN_TEST(testNoPacing);
+  return CheckResult();
+}
@@ -0,0 +1,119 @@
+// Sink requests through the trace encoding and through a trace file.
+
+#include "Check.hpp"
+#include "trace/TraceLog.hpp"
+#include <unistd.h>
+
+static std::vector<RotatorRequest> sample()
+{
+  std::vector<RotatorRequest> requests;
+  RotatorRequest req;
+  req.cmd = CHANGE_AZI;
+  req.payload.ChangeAzi.aziRequested = 123.456;
+  requests.push_back(req);
+  req.cmd = CHANGE_ELE;
+  req.payload.ChangeEle.eleRequested = 12.5;
+  requests.push_back(req);
+  req.cmd = CAMPTZ_PRESET_CALL;
+  req.payload.CamPTZPreset.presetIdx = 21;
+  requests.push_back(req);
+  req.cmd = ROTATOR_MOVE;
+  req.payload.Move.direction = MOVE_CW | MOVE_UP;
+  req.payload.Move.speed = 75;
+  requests.push_back(req);
+  req.cmd = CAMPTZ_SPEED;
+  req.payload.CamPTZSpeed.pan = -0x20;
+  req.payload.CamPTZSpeed.tilt = 0x3F;
+  requests.push_back(req);
+  req.cmd = ROTATOR_PRESET_HINT;
+  req.payload.PresetHint.azi = 271.25;
+  req.payload.PresetHint.ele = 33.75;
+  requests.push_back(req);
+  req.cmd = ROTATOR_STOP;
+  requests.push_back(req);
+  return requests;
+}
+
+static void checkSame(const RotatorRequest &a, const RotatorRequest &b)
+{
+  CHECK(a.cmd == b.cmd);
+  switch (a.cmd) {
+  case CHANGE_AZI:
+    CHECK(a.payload.ChangeAzi.aziRequested == b.payload.ChangeAzi.aziRequested);
+    break;
+  case CHANGE_ELE:
+    CHECK(a.payload.ChangeEle.eleRequested == b.payload.ChangeEle.eleRequested);
+    break;
+  case CAMPTZ_PRESET_CALL:
+    CHECK(a.payload.CamPTZPreset.presetIdx == b.payload.CamPTZPreset.presetIdx);
+    break;
+  case ROTATOR_MOVE:
+    CHECK(a.payload.Move.direction == b.payload.Move.direction);
+    CHECK(a.payload.Move.speed == b.payload.Move.speed);
+    break;
+  case CAMPTZ_SPEED:
+    CHECK(a.payload.CamPTZSpeed.pan == b.payload.CamPTZSpeed.pan);
+    CHECK(a.payload.CamPTZSpeed.tilt == b.payload.CamPTZSpeed.tilt);
+    break;
+  case ROTATOR_PRESET_HINT:
+    CHECK(a.payload.PresetHint.azi == b.payload.PresetHint.azi);
+    CHECK(a.payload.PresetHint.ele == b.payload.PresetHint.ele);
+    break;
+  default:
+    break;
+  }
+}
+
+static void testEncoding()
+{
+  for (const auto &req : sample()) {
+    RotatorRequest decoded;
+    CHECK(TraceDecodeRequest(TraceEncodeRequest(req), decoded));
+    checkSame(req, decoded);
+  }
+
+  // a hint cut short is not taken for anything
+  RotatorRequest hint = sample()[5];
+  std::vector<char> payload = TraceEncodeRequest(hint);
+  payload.resize(1 + sizeof(double));
+  RotatorRequest decoded;
+  CHECK(!TraceDecodeRequest(payload, decoded));
+}
+
+static void testFile()
+{
+  std::string path = "/tmp/rbridge-test-trace-" + std::to_string(getpid());
+  std::vector<RotatorRequest> requests = sample();
+  {
+    TraceRecorder recorder;
+    CHECK(recorder.Open(path));
+    for (const auto &req : requests) {
+      recorder.RecordRequest(req, 1);
+    }
+    recorder.Close();
+  }
+
+  TraceReader reader;
+  CHECK(reader.Open(path));
+  TraceRecord record;
+  size_t read = 0;
+  while (reader.Next(record)) {
+    RotatorRequest decoded;
+    CHECK(record.header.type == TRACE_SINK_REQUEST);
+    CHECK(TraceDecodeRequest(record.payload, decoded));
+    if (read < requests.size()) {
+      checkSame(requests[read], decoded);
+    }
+    read++;
+  }
+  CHECK(read == requests.size());
+  reader.Close();
+  unlink(path.c_str());
+}
+
+int main()
+{
+  RUN_TEST(testEncoding);
+  RUN_TEST(testFile);
+  return CheckResult();
+}
@@ -0,0 +1,213 @@
+// Fits a calibration grid for `stage calibration` from pointing observations.
+//
+// Observation file, one line per observation ('#' starts a comment):
+//   <unix-time> sun|moon <device-azi> <device-ele>
+//   <unix-time> <true-azi> <true-ele> <device-azi> <device-ele>
+// where device-* is what the head reported while centred on the target (e.g.
+// peaked on the sun's noise with a radio, or boresighted with a camera). The
+// sun and moon positions are computed for the station with low-precision
+// ephemerides (sun ~0.01 deg, moon ~0.3 deg) and refraction.
+//
+// Each grid node gets the Gaussian-weighted mean of the nearby residuals,
+// pulled towards the global mean where observations are sparse.
+//
+//   calib_fit --lat=52.1 --lon=5.1 --observations=obs.txt --output=grid.txt
+
+#include "popl.hpp"
+#include "pipeline/Calibration.hpp"
+#include "pipeline/Stages.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static const double degToRad = M_PI / 180.0;
+
+struct Observation {
+  double trueAzi, trueEle;
+  double deviceAzi, deviceEle;
+};
+
+static double sinDeg(double x) { return std::sin(x * degToRad); }
+static double cosDeg(double x) { return std::cos(x * degToRad); }
+
+// equatorial (deg) -> horizontal for the station, geocentric
+static void equatorialToHorizontal(double ra, double dec, double daysJ2000, double lat, double lon,
+                                   double &azi, double &ele)
+{
+  double gmst = 280.46061837 + 360.98564736629 * daysJ2000;
+  double ha = gmst + lon - ra;
+  ele = std::asin(sinDeg(lat) * sinDeg(dec) + cosDeg(lat) * cosDeg(dec) * cosDeg(ha)) / degToRad;
+  azi = wrapAzimuth(std::atan2(-cosDeg(dec) * sinDeg(ha),
+                               sinDeg(dec) * cosDeg(lat) - cosDeg(dec) * sinDeg(lat) * cosDeg(ha)) / degToRad);
+}
+
+static void eclipticToEquatorial(double lambda, double beta, double daysJ2000, double &ra, double &dec)
+{
+  double eps = 23.439 - 0.0000004 * daysJ2000;
+  ra = std::atan2(sinDeg(lambda) * cosDeg(eps) - std::tan(beta * degToRad) * sinDeg(eps), cosDeg(lambda)) / degToRad;
+  dec = std::asin(sinDeg(beta) * cosDeg(eps) + cosDeg(beta) * sinDeg(eps) * sinDeg(lambda)) / degToRad;
+}
+
+// Bennett, for standard conditions
+static double refraction(double ele)
+{
+  if (ele < -1) {
+    return 0;
+  }
+  return 1.0 / std::tan((ele + 7.31 / (ele + 4.4)) * degToRad) / 60.0;
+}
+
+static void sunPosition(double unixTime, double lat, double lon, double &azi, double &ele)
+{
+  double n = unixTime / 86400.0 - 10957.5;  // days since J2000.0
+  double l = 280.460 + 0.9856474 * n;
+  double g = 357.528 + 0.9856003 * n;
+  double lambda = l + 1.915 * sinDeg(g) + 0.020 * sinDeg(2 * g);
+  double ra, dec;
+  eclipticToEquatorial(lambda, 0, n, ra, dec);
+  equatorialToHorizontal(ra, dec, n, lat, lon, azi, ele);
+  ele += refraction(ele);
+}
+
+static void moonPosition(double unixTime, double lat, double lon, double &azi, double &ele)
+{
+  double n = unixTime / 86400.0 - 10957.5;
+  double t = n / 36525.0;
+  double lambda = 218.32 + 481267.881 * t
+                + 6.29 * sinDeg(135.0 + 477198.87 * t) - 1.27 * sinDeg(259.3 - 413335.36 * t)
+                + 0.66 * sinDeg(235.7 + 890534.22 * t) + 0.21 * sinDeg(269.9 + 954397.74 * t)
+                - 0.19 * sinDeg(357.5 + 35999.05 * t) - 0.11 * sinDeg(186.5 + 966404.03 * t);
+  double beta = 5.13 * sinDeg(93.3 + 483202.02 * t) + 0.28 * sinDeg(228.2 + 960400.89 * t)
+              - 0.28 * sinDeg(318.3 + 6003.15 * t) - 0.17 * sinDeg(217.6 - 407332.21 * t);
+  double parallax = 0.9508 + 0.0518 * cosDeg(134.9 + 477198.85 * t) + 0.0095 * cosDeg(259.2 - 413335.38 * t)
+                  + 0.0078 * cosDeg(235.7 + 890534.23 * t) + 0.0028 * cosDeg(269.9 + 954397.70 * t);
+  double ra, dec;
+  eclipticToEquatorial(lambda, beta, n, ra, dec);
+  equatorialToHorizontal(ra, dec, n, lat, lon, azi, ele);
+  ele -= parallax * cosDeg(ele);  // topocentric
+  ele += refraction(ele);
+}
+
+static bool readObservations(std::string path, double lat, double lon, std::vector<Observation> &observations)
+{
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "calib_fit: cannot open %s\n", path.c_str());
+    return false;
+  }
+
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(file, line)) {
+    lineNo++;
+    auto comment = line.find('#');
+    if (comment != std::string::npos) {
+      line = line.substr(0, comment);
+    }
+    std::istringstream fields(line);
+    double time;
+    std::string target;
+    if (!(fields >> time >> target)) {
+      continue;
+    }
+
+    Observation obs;
+    bool ok;
+    if (target == "sun" || target == "moon") {
+      ok = (bool)(fields >> obs.deviceAzi >> obs.deviceEle);
+      if (target == "sun") {
+        sunPosition(time, lat, lon, obs.trueAzi, obs.trueEle);
+      } else {
+        moonPosition(time, lat, lon, obs.trueAzi, obs.trueEle);
+      }
+    } else {
+      std::istringstream trueAzi(target);
+      ok = (bool)(trueAzi >> obs.trueAzi) && (bool)(fields >> obs.trueEle >> obs.deviceAzi >> obs.deviceEle);
+    }
+
+    if (!ok) {
+      fprintf(stderr, "calib_fit: %s:%d: malformed observation\n", path.c_str(), lineNo);
+      return false;
+    }
+    if (obs.trueEle < 0) {
+      fprintf(stderr, "calib_fit: %s:%d: %s below the horizon (%.2f), skipped\n",
+              path.c_str(), lineNo, target.c_str(), obs.trueEle);
+      continue;
+    }
+    observations.push_back(obs);
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  popl::OptionParser op("Allowed options");
+  auto helpOption = op.add<popl::Switch>("h", "help", "produce help message");
+  auto lat = op.add<popl::Implicit<double>>("", "lat", "Station latitude (deg, north positive)", 0.0);
+  auto lon = op.add<popl::Implicit<double>>("", "lon", "Station longitude (deg, east positive)", 0.0);
+  auto observationsPath = op.add<popl::Value<std::string>>("", "observations", "Observation file");
+  auto outputPath = op.add<popl::Value<std::string>>("", "output", "Grid file to write", "grid.txt");
+  auto aziStep = op.add<popl::Implicit<double>>("", "azi-step", "Grid node spacing in azimuth (deg)", 30.0);
+  auto eleStep = op.add<popl::Implicit<double>>("", "ele-step", "Grid node spacing in elevation (deg)", 15.0);
+  auto priorWeight = op.add<popl::Implicit<double>>("", "prior-weight", "Weight of the global mean at every node", 0.1);
+  op.parse(argc, argv);
+
+  if (helpOption->is_set() || !observationsPath->is_set()) {
+    std::cout << op << "\n";
+    return helpOption->is_set() ? 0 : 1;
+  }
+
+  std::vector<Observation> observations;
+  if (!readObservations(observationsPath->value(), lat->value(), lon->value(), observations)) {
+    return 1;
+  }
+  if (observations.empty()) {
+    fprintf(stderr, "calib_fit: no usable observations\n");
+    return 1;
+  }
+
+  double meanAzi = 0, meanEle = 0;
+  for (const auto &obs : observations) {
+    meanAzi += azimuthDelta(obs.trueAzi, obs.deviceAzi);
+    meanEle += obs.deviceEle - obs.trueEle;
+  }
+  meanAzi /= observations.size();
+  meanEle /= observations.size();
+
+  std::vector<CalibrationGrid::Node> nodes;
+  double sumSquares = 0;
+  for (double ele = 0; ele <= 90 + 1e-9; ele += eleStep->value()) {
+    for (double azi = 0; azi < 360 - 1e-9; azi += aziStep->value()) {
+      double weight = priorWeight->value();
+      double sumAzi = weight * meanAzi, sumEle = weight * meanEle;
+      for (const auto &obs : observations) {
+        double da = azimuthDelta(azi, obs.trueAzi) / aziStep->value();
+        double de = (obs.trueEle - ele) / eleStep->value();
+        double w = std::exp(-0.5 * (da * da + de * de));
+        weight += w;
+        sumAzi += w * azimuthDelta(obs.trueAzi, obs.deviceAzi);
+        sumEle += w * (obs.deviceEle - obs.trueEle);
+      }
+      nodes.push_back(CalibrationGrid::Node{azi, ele, sumAzi / weight, sumEle / weight});
+    }
+  }
+
+  // residuals left after applying the fitted grid
+  CalibrationGrid grid;
+  grid.Build(nodes, CalibrationGrid::INTERP_BILINEAR, 0.5);
+  for (const auto &obs : observations) {
+    double deviceAzi, deviceEle;
+    grid.Forward(obs.trueAzi, obs.trueEle, deviceAzi, deviceEle);
+    double ra = azimuthDelta(deviceAzi, obs.deviceAzi) * cosDeg(obs.trueEle), re = obs.deviceEle - deviceEle;
+    sumSquares += ra * ra + re * re;
+  }
+
+  printf("calib_fit: %zu observations, mean offset azi %.3f ele %.3f, residual rms %.3f deg\n",
+         observations.size(), meanAzi, meanEle, std::sqrt(sumSquares / observations.size()));
+
+  if (!CalibrationGrid::Save(outputPath->value(), nodes)) {
+    return 1;
+  }
+  printf("calib_fit: %zu nodes written to %s\n", nodes.size(), outputPath->value().c_str());
+  return 0;
+}